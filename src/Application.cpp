@@ -20,6 +20,7 @@
 #include "Application.hpp"
 
 #include "Scene.hpp"
+#include "Options.hpp"
 #include "MainWindow.hpp"
 
 #include <Magick++.h>
@@ -49,6 +50,23 @@ bool Application::OnInit()
 }
 
 
+void Application::OnInitCmdLine( wxCmdLineParser & parser )
+{
+	wxApp::OnInitCmdLine( parser );
+
+	AddOptions( parser );
+}
+
+
+bool Application::OnCmdLineParsed( wxCmdLineParser & parser )
+{
+	if( ! wxApp::OnCmdLineParsed( parser ) )
+		return false;
+
+	return ParseOptions( parser );
+}
+
+
 int Application::OnExit()
 {
 	// Destroy the global scene singleton when the application goes down. This
@@ -51,6 +51,11 @@ private:
 	// the main window.
 	virtual bool				OnInit();
 
+	// Called by wxWidgets during OnInit to set up and then handle the
+	// command line options (see Options.hpp).
+	virtual void				OnInitCmdLine( wxCmdLineParser & parser );
+	virtual bool				OnCmdLineParsed( wxCmdLineParser & parser );
+
 	// Called when the app quits. Destroys the global scene singleton. The
 	// scene destructor cleans up all the assets that were used.
 	virtual int					OnExit();
@@ -73,13 +73,9 @@ protected:
 	{}
 
 public:
-	~Asset()
-	{
-		// Remove assets from the cache automatically when they are deallocated
-		// (if they are in the cache).
-		if( is_linked() )
-			GetScene().GetAssetSet< AssetType >().erase( GetScene().GetAssetSet< AssetType >().iterator_to( * static_cast< AssetType * >( this ) ) );
-	}
+	// Removes the asset from the cache (if it is in the cache). Defined in
+	// Scene.hpp, as it needs the scene.
+	~Asset();
 };
 
 
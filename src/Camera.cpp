@@ -19,10 +19,22 @@
 
 #include "Camera.hpp"
 
+#include "Mesh.hpp"
 #include "Scene.hpp"
+#include "Options.hpp"
+#include "ThreadPool.hpp"
+#include "MeshInstance.hpp"
 #include "ShaderProgram.hpp"
 
 
+namespace
+{
+	// Instances are culled and queued on the scene's workers in chunks of
+	// this many, which must be a multiple of four (see FrustumCulling::Cull).
+	const size_t InstancesPerTask = 4096;
+}
+
+
 Camera::Camera()
 	// Initialise stuff to zero.
 	: m_Yaw		( 0.0f )
@@ -112,6 +124,17 @@ void Camera::Look( const float yaw, const float pitch )
 }
 
 
+void Camera::Place( const Vector3f & position, const float yaw, const float pitch )
+{
+	m_Position = position;
+	m_Yaw = 0.0f;
+	m_Pitch = 0.0f;
+
+	// Look takes care of clamping and reconstructing the view matrix.
+	Look( yaw, pitch );
+}
+
+
 void Camera::ConstructViewMatrix()
 {
 	// Standard stuff for constructing a translation-rotation matrix.
@@ -131,7 +154,7 @@ void Camera::ConstructViewMatrix()
 }
 
 
-void Camera::Render()
+void Camera::Render( OcclusionCulling * pOcclusionCulling )
 {
 	// Clear the colour and depth buffers before we start drawing. Because we
 	// are doing deferred rendering, this also clears all planes of the
@@ -147,24 +170,234 @@ void Camera::Render()
 	glMatrixMode( GL_MODELVIEW );
 	glLoadMatrixf( m_ViewMatrix.data() );
 
-	// Render objects in the scene.
-	GetScene().m_RootNode.Render( m_ViewMatrix );
+	// Only the world transforms of nodes that have moved are recomputed. The
+	// model view transforms are kept for the shadow passes, which always come
+	// after this pass in a frame.
+	ThreadPool & threadPool = GetScene().GetThreadPool();
+	TransformHierarchy & transforms = GetScene().m_Transforms;
+	transforms.Update( threadPool );
+	transforms.ComputeModelViews( m_ViewMatrix, m_ModelViews, threadPool );
+
+	// Instances outside the view frustum are skipped, unless
+	// Options::m_FrustumCulling is turned off. The rest are sorted to keep
+	// state changes down and to draw front to back (see RenderQueue).
+	const TransformHierarchy::InstanceBounds & bounds = transforms.GetInstanceBounds();
+	const Matrix4f viewProjection = m_ProjectionMatrix.matrix() * m_ViewMatrix.matrix();
+	const FrustumCulling culling( viewProjection );
+	const FrustumCulling * const pCulling = GetOptions().m_FrustumCulling ? & culling : nullptr;
+
+	if( ! GetOptions().m_OcclusionCulling )
+		pOcclusionCulling = nullptr;
+
+	// With occlusion culling, only the instances that were visible last frame
+	// are drawn to start with, as they are likely to still be visible.
+	m_IsInstanceVisible.resize( transforms.GetNumInstances() );
+	m_WasInstanceVisible.resize( transforms.GetNumInstances(), 0 );
+
+	CullingStats stats;
+
+	QueueInstances( [ & ] ( const size_t firstInstance, const size_t endInstance, CullingStats & chunkStats )
+	{
+		CullFrustum( pCulling, bounds, firstInstance, endInstance, & m_IsInstanceVisible[ firstInstance ], chunkStats.m_Frustum );
+
+		for( size_t instanceIndex = firstInstance; instanceIndex < endInstance; ++instanceIndex )
+			m_IsInstanceQueued[ instanceIndex ] = m_IsInstanceVisible[ instanceIndex ] && ( pOcclusionCulling == nullptr || m_WasInstanceVisible[ instanceIndex ] );
+	}, nullptr, m_IsInstanceQueued, stats, m_RenderQueue );
+
+	m_FrustumCullingStats = stats.m_Frustum;
+
+	m_DrawBatch.Clear();
+	m_RenderQueue.Submit( m_ModelViews, m_DrawBatch );
+	m_DrawBatch.Submit( false );
+
+	m_SecondPassQueue.Clear();
+	m_OcclusionCullingStats = OcclusionCulling::Stats();
+
+	if( pOcclusionCulling == nullptr )
+		return;
+
+	// Then every instance in the frustum is tested against the depth of
+	// those, and the ones that are visible but weren't drawn yet are drawn
+	// in a second pass. The ones that are visible are drawn first next
+	// frame. The pyramid is kept for the shadow passes too.
+	pOcclusionCulling->Build( viewProjection );
+
+	QueueInstances( [ & ] ( const size_t firstInstance, const size_t endInstance, CullingStats & chunkStats )
+	{
+		copy( m_IsInstanceVisible.begin() + firstInstance, m_IsInstanceVisible.begin() + endInstance, m_WasInstanceVisible.begin() + firstInstance );
+		pOcclusionCulling->Cull( bounds, firstInstance, endInstance, & m_WasInstanceVisible[ firstInstance ], chunkStats.m_Occlusion );
+
+		for( size_t instanceIndex = firstInstance; instanceIndex < endInstance; ++instanceIndex )
+			m_IsInstanceQueued[ instanceIndex ] = m_WasInstanceVisible[ instanceIndex ] && ! m_IsInstanceQueued[ instanceIndex ];
+	}, nullptr, m_IsInstanceQueued, stats, m_SecondPassQueue );
+
+	m_OcclusionCullingStats = stats.m_Occlusion;
+
+	m_DrawBatch.Clear();
+	m_SecondPassQueue.Submit( m_ModelViews, m_DrawBatch );
+	m_DrawBatch.Submit( false );
 }
 
 
 // TODO: Merge this with the regular Render method above.
-void Camera::RenderShadowVolumes()
+void Camera::RenderShadowVolumes( const ShadowPass pass, const Vector3f & lightPosition, const OcclusionCulling * pOcclusionCulling )
 {
-	// Clear the shadow buffer.
-	glClear( GL_COLOR_BUFFER_BIT );
-
-	// Set OpenGL matrices.
+	// Set OpenGL matrices. The shadow buffer is cleared by the viewport, as
+	// each pass draws into it.
 	glMatrixMode( GL_PROJECTION );
 	glLoadMatrixf( m_ProjectionMatrix.data() );
 
 	glMatrixMode( GL_MODELVIEW );
 	glLoadMatrixf( m_ViewMatrix.data() );
 
-	// Render shadow volumes cast by objects in the scene.
-	GetScene().m_RootNode.RenderShadowVolumes( m_ViewMatrix );
+	// Render shadow volumes cast by objects in the scene. Casters whose
+	// shadows can't reach the view, or are hidden behind the scene, are
+	// skipped altogether, and the clusters of the rest are culled one by one
+	// (see ShadowCulling). The instances of each mesh are drawn together
+	// (see RenderQueue).
+	ShadowCulling culling( m_ViewMatrix * lightPosition, m_ProjectionMatrix.matrix() );
+	const FrustumCulling casterCulling( m_ProjectionMatrix.matrix() * m_ViewMatrix.matrix(), lightPosition, ShadowCulling::LightRadius );
+
+	ShadowCulling * const pCulling = GetOptions().m_ShadowCulling ? & culling : nullptr;
+	const FrustumCulling * const pCasterCulling = GetOptions().m_ShadowCulling ? & casterCulling : nullptr;
+
+	// The pyramid is only up to date if Render built it this frame.
+	if( ! GetOptions().m_OcclusionCulling )
+		pOcclusionCulling = nullptr;
+
+	const TransformHierarchy & transforms = GetScene().m_Transforms;
+	const TransformHierarchy::InstanceBounds & bounds = transforms.GetInstanceBounds();
+	assert( m_ModelViews.size() == transforms.GetNumNodes() );
+
+	// Casters with cached volumes are left out of the queue, and drawn from
+	// the cache afterwards. Their LODs are picked as MeshInstance does.
+	const bool useCache = ( pass == ShadowPass_Triangles && GetOptions().m_ShadowVolumeCache );
+	const float lodScale = useCache ? GetLodScale() : 0.0f;
+
+	if( useCache )
+		m_ShadowVolumeCache.BeginFrame( lightPosition );
+
+	CullingStats casterStats;
+
+	QueueInstances( [ & ] ( const size_t firstInstance, const size_t endInstance, CullingStats & chunkStats )
+	{
+		CullFrustum( pCasterCulling, bounds, firstInstance, endInstance, & m_IsCasterVisible[ firstInstance ], chunkStats.m_Frustum );
+
+		if( pOcclusionCulling != nullptr )
+			pOcclusionCulling->CullShadows( bounds, firstInstance, endInstance, lightPosition, ShadowCulling::LightRadius, & m_IsCasterVisible[ firstInstance ], chunkStats.m_Occlusion );
+
+		if( ! useCache )
+			return;
+
+		for( size_t instanceIndex = firstInstance; instanceIndex < endInstance; ++instanceIndex )
+		{
+			if( ! m_IsCasterVisible[ instanceIndex ] )
+				continue;
+
+			const size_t nodeIndex = transforms.GetInstanceNode( instanceIndex );
+			const Mesh & mesh = transforms.GetInstance( instanceIndex ).GetMesh();
+
+			if( ! mesh.UsesShadowPass( ShadowPass_Triangles ) )
+				continue;
+
+			const size_t lodIndex = mesh.SelectLod( Affine3f( m_ModelViews[ nodeIndex ] ), lodScale, GetOptions().m_ShadowLodPixelError );
+
+			if( m_ShadowVolumeCache.Use( instanceIndex, lodIndex, transforms.GetWorldTransform( nodeIndex ) ) )
+				m_IsCasterVisible[ instanceIndex ] = 0;
+		}
+	}, & pass, m_IsCasterVisible, casterStats, m_ShadowQueue );
+
+	m_DrawBatch.Clear();
+	m_ShadowQueue.SubmitShadowVolumes( pass, m_ModelViews, m_DrawBatch, pCulling );
+	m_DrawBatch.Submit( pass != ShadowPass_Triangles );
+
+	if( useCache )
+		m_ShadowVolumeCache.Render();
+
+	// Every pass has the same casters, so they are only counted once.
+	if( pass == ShadowPass_Triangles )
+	{
+		m_ShadowCullingStats = ShadowCulling::Stats();
+		m_CasterCullingStats = casterStats.m_Frustum;
+		m_CasterOcclusionStats = casterStats.m_Occlusion;
+	}
+
+	m_ShadowCullingStats.m_NumClusters += culling.GetStats().m_NumClusters;
+	m_ShadowCullingStats.m_NumCulled += culling.GetStats().m_NumCulled;
+}
+
+
+void Camera::QueueInstances( const InstanceFilter & filter, const ShadowPass * pPass, vector< uint8_t > & isQueued, CullingStats & stats, RenderQueue & queue )
+{
+	const TransformHierarchy & transforms = GetScene().m_Transforms;
+	const size_t numInstances = transforms.GetNumInstances();
+	const size_t numChunks = ( numInstances + InstancesPerTask - 1 ) / InstancesPerTask;
+
+	// Reads the GL, so it has to be done here rather than on the workers.
+	const float lodScale = GetLodScale();
+
+	isQueued.resize( numInstances );
+	m_ChunkStats.assign( numChunks, CullingStats() );
+
+	if( m_DrawLists.size() < numChunks )
+		m_DrawLists.resize( numChunks );
+
+	GetScene().GetThreadPool().ParallelFor( numInstances, InstancesPerTask, [ & ] ( const size_t firstInstance, const size_t endInstance )
+	{
+		const size_t chunkIndex = firstInstance / InstancesPerTask;
+		RenderQueue::DrawList & list = m_DrawLists[ chunkIndex ];
+
+		filter( firstInstance, endInstance, m_ChunkStats[ chunkIndex ] );
+
+		list.clear();
+
+		for( size_t instanceIndex = firstInstance; instanceIndex < endInstance; ++instanceIndex )
+		{
+			if( ! isQueued[ instanceIndex ] )
+				continue;
+
+			const size_t nodeIndex = transforms.GetInstanceNode( instanceIndex );
+			const Affine3f modelView( m_ModelViews[ nodeIndex ] );
+			MeshInstance & instance = transforms.GetInstance( instanceIndex );
+
+			if( pPass != nullptr )
+				instance.RenderShadowVolumes( modelView, lodScale, nodeIndex, * pPass, list );
+			else instance.Render( modelView, lodScale, nodeIndex, list );
+		}
+	} );
+
+	stats = CullingStats();
+	queue.Clear();
+
+	for( size_t chunkIndex = 0; chunkIndex < numChunks; ++chunkIndex )
+	{
+		stats += m_ChunkStats[ chunkIndex ];
+		queue.Merge( m_DrawLists[ chunkIndex ] );
+	}
+}
+
+
+void Camera::CullFrustum( const FrustumCulling * pCulling, const TransformHierarchy::InstanceBounds & bounds, const size_t firstInstance, const size_t endInstance, uint8_t * pIsVisible, FrustumCulling::Stats & stats )
+{
+	if( pCulling != nullptr )
+		pCulling->Cull( bounds, firstInstance, endInstance, pIsVisible, stats );
+	else
+	{
+		fill( pIsVisible, pIsVisible + ( endInstance - firstInstance ), 1 );
+		stats.m_NumVisible += endInstance - firstInstance;
+	}
+}
+
+
+float Camera::GetLodScale() const
+{
+	if( ! GetOptions().m_UseLods )
+		return 0.0f;
+
+	// The vertical scale of the projection is the reciprocal of
+	// tan(vertFov / 2), which maps to half the height of the viewport.
+	GLint dimensions[4];
+	glGetIntegerv( GL_VIEWPORT, dimensions );
+
+	return m_ProjectionMatrix( 1, 1 ) * 0.5f * dimensions[3];
 }
@@ -25,6 +25,16 @@
 #pragma once
 
 
+#include "DrawBatch.hpp"
+#include "RenderQueue.hpp"
+#include "ShadowPass.hpp"
+#include "FrustumCulling.hpp"
+#include "OcclusionCulling.hpp"
+#include "ShadowCulling.hpp"
+#include "ShadowVolumeCache.hpp"
+#include "TransformHierarchy.hpp"
+
+
 ///////////////////////////////////////////////////////////////////////////////
 // Camera class
 ///////////////////////////////////////////////////////////////////////////////
@@ -48,13 +58,53 @@ public:
 														  const float vertFov,
 														  const float zNear );
 
-	// Render the scene from this camera's point of view.
-	void				Render();
+	// Render the scene from this camera's point of view. Mesh instances
+	// outside the view are culled (see FrustumCulling) unless
+	// Options::m_FrustumCulling is turned off. The rest are sorted by state
+	// and depth before they are drawn, with the instances of each mesh drawn
+	// together (see RenderQueue), and pooled meshes are drawn together after
+	// the others (see DrawBatch). This also updates the scene's world
+	// transforms (see TransformHierarchy) and works out the model view
+	// transforms that the shadow passes use, so it has to be called first
+	// each frame. Everything up to drawing is split between the scene's
+	// workers.
+	//
+	// Unless pOcclusionCulling is nullptr or Options::m_OcclusionCulling is
+	// turned off, instances that were hidden last frame are held back and
+	// only drawn in a second pass if they turn out to be visible now (see
+	// OcclusionCulling), which builds the pyramid that the shadow passes
+	// cull against.
+	void				Render( OcclusionCulling * pOcclusionCulling );
 
-	// Render shadow volumes from this camera's point of view.
+	// Render shadow volumes from this camera's point of view. The light
+	// position is in world space, and is used to cull shadow casters (see
+	// FrustumCulling) and their clusters (see ShadowCulling) unless
+	// Options::m_ShadowCulling is turned off. Casters whose shadows are
+	// hidden are culled too (see OcclusionCulling), unless pOcclusionCulling
+	// is nullptr or Options::m_OcclusionCulling is turned off. It has to be
+	// the one that was passed to Render this frame. The per-triangle volumes
+	// of casters that aren't moving are drawn from the shadow volume cache
+	// unless Options::m_ShadowVolumeCache is turned off.
 	// TODO: I don't like having a second render function for this that is so
 	//		similar to the first.
-	void				RenderShadowVolumes();
+	void				RenderShadowVolumes( const ShadowPass pass, const Vector3f & lightPosition, const OcclusionCulling * pOcclusionCulling );
+
+	// The draws of the last call to Render, in the first and second passes.
+	const RenderQueue &	GetRenderQueue() const								{ return m_RenderQueue; }
+	const RenderQueue &	GetSecondPassQueue() const							{ return m_SecondPassQueue; }
+
+	// Culling statistics for the last call to Render. Only the instances
+	// inside the frustum are tested for occlusion.
+	const FrustumCulling::Stats &	GetFrustumCullingStats() const		{ return m_FrustumCullingStats; }
+	const OcclusionCulling::Stats &	GetOcclusionCullingStats() const	{ return m_OcclusionCullingStats; }
+
+	// Culling statistics for every shadow pass since the last per-triangle
+	// pass, which is always the first pass of a frame. Casters are only
+	// counted in that pass.
+	const FrustumCulling::Stats &	GetCasterCullingStats() const		{ return m_CasterCullingStats; }
+	const OcclusionCulling::Stats &	GetCasterOcclusionStats() const		{ return m_CasterOcclusionStats; }
+	const ShadowCulling::Stats &	GetShadowCullingStats() const		{ return m_ShadowCullingStats; }
+	const ShadowVolumeCache::Stats &	GetShadowVolumeCacheStats() const	{ return m_ShadowVolumeCache.GetStats(); }
 
 	// Moves the camera by the specified delta. For example, you could use this
 	// to move the camera when the user presses the arrow keys or WASD.
@@ -67,6 +117,15 @@ public:
 	// can't turn upside down.
 	void				Look( const float yaw, const float pitch );
 
+	// Moves the camera to an absolute position and orientation. Yaw and pitch
+	// are in radians and pitch is clamped in the same way as Look.
+	void				Place( const Vector3f & position, const float yaw, const float pitch );
+
+	// Returns the number of pixels that a unit length covers at a distance of
+	// one unit in front of the camera, for choosing LODs (see
+	// Mesh::SelectLod). Zero if LODs are turned off.
+	float				GetLodScale() const;
+
 	const Affine3f &	ViewMatrix() const									{ return m_ViewMatrix; }
 	const Affine3f &	ProjectionMatrix() const							{ return m_ProjectionMatrix; }
 
@@ -80,6 +139,31 @@ private:
 	// the Move and Look functions above).
 	void				ConstructViewMatrix();
 
+	// What was culled in a chunk of instances, or in all of them.
+	struct CullingStats
+	{
+		CullingStats &			operator += ( const CullingStats & other )	{ m_Frustum += other.m_Frustum; m_Occlusion += other.m_Occlusion; return * this; }
+
+		FrustumCulling::Stats	m_Frustum;
+		OcclusionCulling::Stats	m_Occlusion;
+	};
+
+	// Decides which instances from firstInstance up to endInstance are
+	// queued, by setting their entries in the queue's array, and counts what
+	// it culls in stats.
+	typedef std::function< void ( const size_t firstInstance, const size_t endInstance, CullingStats & stats ) >	InstanceFilter;
+
+	// Queues the instances that the filter picks to be drawn in the G-buffer
+	// pass, or in a shadow pass if pPass isn't nullptr. The instances are
+	// split into chunks that are filtered on the scene's workers, each into a
+	// draw list of its own, and the lists are merged into the queue in order,
+	// so that it's the same however the work was shared out.
+	void				QueueInstances( const InstanceFilter & filter, const ShadowPass * pPass, vector< uint8_t > & isQueued, CullingStats & stats, RenderQueue & queue );
+
+	// Culls a chunk of instances against the frustum, or keeps them all if
+	// pCulling is nullptr.
+	static void			CullFrustum( const FrustumCulling * pCulling, const TransformHierarchy::InstanceBounds & bounds, const size_t firstInstance, const size_t endInstance, uint8_t * pIsVisible, FrustumCulling::Stats & stats );
+
 	// Encapsulates code that is common to both of the perspective projection
 	// functions above.
 	void				SetPerspectiveProjectionCommon( const float horizFov,
@@ -92,4 +176,39 @@ private:
 	Vector3f			m_Position;
 	float				m_Yaw;
 	float				m_Pitch;
+
+	// Reused each time the scene is rendered, so that their buffers are too.
+	DrawBatch			m_DrawBatch;
+	RenderQueue			m_RenderQueue;
+	RenderQueue			m_SecondPassQueue;
+	RenderQueue			m_ShadowQueue;
+
+	// The draw list and culling statistics of each chunk of instances (see
+	// QueueInstances).
+	vector< RenderQueue::DrawList >	m_DrawLists;
+	vector< CullingStats >			m_ChunkStats;
+
+	// The model view transform of each node in the scene's
+	// TransformHierarchy, worked out by Render.
+	TransformHierarchy::MatrixArray	m_ModelViews;
+
+	// Whether each of the scene's mesh instances passed frustum culling,
+	// whether it passed occlusion culling too in the last frame that it was
+	// tested, whether it's queued in the current pass, and whether it might
+	// cast a visible shadow.
+	vector< uint8_t >	m_IsInstanceVisible;
+	vector< uint8_t >	m_WasInstanceVisible;
+	vector< uint8_t >	m_IsInstanceQueued;
+	vector< uint8_t >	m_IsCasterVisible;
+
+	FrustumCulling::Stats	m_FrustumCullingStats;
+	FrustumCulling::Stats	m_CasterCullingStats;
+
+	OcclusionCulling::Stats	m_OcclusionCullingStats;
+	OcclusionCulling::Stats	m_CasterOcclusionStats;
+
+	ShadowCulling::Stats	m_ShadowCullingStats;
+
+	// The per-triangle shadow volumes of static casters.
+	ShadowVolumeCache	m_ShadowVolumeCache;
 };
@@ -0,0 +1,40 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+#version 150 compatibility
+
+
+// The depth buffer or the level of the pyramid above this one (see
+// OcclusionCulling).
+uniform sampler2DRect sourceTexture;
+uniform ivec2 sourceSize;
+
+
+void main()
+{
+	// Each texel covers two by two texels of the source, and keeps the
+	// furthest of them. Reads past the last row or column of an odd sized
+	// source are clamped to it.
+	ivec2 source = ivec2( gl_FragCoord.xy ) * 2;
+	ivec2 next = min( source + ivec2( 1 ), sourceSize - ivec2( 1 ) );
+
+	float depth = texelFetch( sourceTexture, source ).r;
+	depth = max( depth, texelFetch( sourceTexture, ivec2( next.x, source.y ) ).r );
+	depth = max( depth, texelFetch( sourceTexture, ivec2( source.x, next.y ) ).r );
+	depth = max( depth, texelFetch( sourceTexture, next ).r );
+
+	gl_FragColor.r = depth;
+}
@@ -0,0 +1,159 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Precomp.hpp"
+#include "Common.hpp"
+
+#include "DrawBatch.hpp"
+
+#include "Scene.hpp"
+#include "Material.hpp"
+#include "GeometryPool.hpp"
+#include "ShaderProgram.hpp"
+
+
+DrawBatch::DrawBatch()
+	: m_NumUploaded			( 0 )
+	, m_CommandBufferId		( 0 )
+	, m_TransformBufferId	( 0 )
+	, m_TransformTextureId	( 0 )
+{}
+
+
+DrawBatch::~DrawBatch()
+{
+	glDeleteBuffers( 1, & m_CommandBufferId );
+	glDeleteBuffers( 1, & m_TransformBufferId );
+	glDeleteTextures( 1, & m_TransformTextureId );
+}
+
+
+void DrawBatch::Clear()
+{
+	m_Commands.clear();
+	m_Materials.clear();
+	m_Transforms.clear();
+	m_NumUploaded = 0;
+}
+
+
+size_t DrawBatch::AddInstance( const Affine3f & modelView, const Vector3f & positionScale, const Vector3f & positionOffset )
+{
+	const size_t instanceIndex = GetNumInstances();
+
+	// Column major, like the GL.
+	const Matrix4f matrix = modelView.matrix();
+	m_Transforms.insert( m_Transforms.end(), matrix.data(), matrix.data() + 16 );
+
+	m_Transforms.insert( m_Transforms.end(), positionScale.data(), positionScale.data() + 3 );
+	m_Transforms.push_back( 0.0f );
+
+	m_Transforms.insert( m_Transforms.end(), positionOffset.data(), positionOffset.data() + 3 );
+	m_Transforms.push_back( 0.0f );
+
+	return instanceIndex;
+}
+
+
+void DrawBatch::UploadInstances()
+{
+	if( m_TransformBufferId == 0 )
+	{
+		// Binding the name is what creates the buffer, which has to exist
+		// before it can be attached to the texture.
+		glGenBuffers( 1, & m_TransformBufferId );
+		glBindBuffer( GL_TEXTURE_BUFFER, m_TransformBufferId );
+		glBindBuffer( GL_TEXTURE_BUFFER, 0 );
+
+		// The texture keeps referring to the buffer when its data is
+		// respecified, so it only needs attaching once.
+		glGenTextures( 1, & m_TransformTextureId );
+		glBindTexture( GL_TEXTURE_BUFFER, m_TransformTextureId );
+		glTexBuffer( GL_TEXTURE_BUFFER, GL_RGBA32F, m_TransformBufferId );
+		glBindTexture( GL_TEXTURE_BUFFER, 0 );
+	}
+
+	// Orphan the buffer each time, as the GL may still be reading the last
+	// frame's instances.
+	if( m_NumUploaded != GetNumInstances() )
+	{
+		glBindBuffer( GL_TEXTURE_BUFFER, m_TransformBufferId );
+		glBufferData( GL_TEXTURE_BUFFER, m_Transforms.size() * sizeof( float ), m_Transforms.data(), GL_STREAM_DRAW );
+		glBindBuffer( GL_TEXTURE_BUFFER, 0 );
+
+		m_NumUploaded = GetNumInstances();
+	}
+
+	glActiveTexture( GL_TEXTURE0 + DrawTransformsTextureUnit );
+	glBindTexture( GL_TEXTURE_BUFFER, m_TransformTextureId );
+	glActiveTexture( GL_TEXTURE0 );
+}
+
+
+void DrawBatch::Add( Material * pMaterial, const DrawCommand & command )
+{
+	assert( command.m_BaseInstance + command.m_NumInstances <= GetNumInstances() );
+
+	m_Commands.push_back( command );
+	m_Materials.push_back( pMaterial );
+}
+
+
+void DrawBatch::Submit( const bool withAdjacency )
+{
+	if( m_Commands.empty() )
+		return;
+
+	if( m_CommandBufferId == 0 )
+		glGenBuffers( 1, & m_CommandBufferId );
+
+	const size_t numDraws = m_Commands.size();
+
+	UploadInstances();
+
+	// Orphaned like the transforms.
+	glBindBuffer( GL_DRAW_INDIRECT_BUFFER, m_CommandBufferId );
+	glBufferData( GL_DRAW_INDIRECT_BUFFER, numDraws * sizeof( DrawCommand ), m_Commands.data(), GL_STREAM_DRAW );
+
+	GeometryPool & pool = GetScene().m_GeometryPool;
+	pool.ReserveDraws( GetNumInstances() );
+	pool.BindVertexArray( withAdjacency );
+
+	const GLenum mode = withAdjacency ? GL_TRIANGLES_ADJACENCY : GL_TRIANGLES;
+	size_t firstDraw = 0;
+
+	while( firstDraw < numDraws )
+	{
+		Material * const pMaterial = m_Materials[ firstDraw ];
+		size_t endDraw = firstDraw + 1;
+
+		while( endDraw < numDraws && m_Materials[ endDraw ] == pMaterial )
+			++endDraw;
+
+		if( pMaterial != nullptr )
+			pMaterial->RenderSetup();
+
+		// The index of each instance comes from the draw index attribute.
+		ShaderProgram::GetCurrent()->SetFirstInstance( -1 );
+
+		glMultiDrawElementsIndirect( mode, GL_UNSIGNED_INT, reinterpret_cast< const GLvoid * >( firstDraw * sizeof( DrawCommand ) ), static_cast< GLsizei >( endDraw - firstDraw ), sizeof( DrawCommand ) );
+
+		firstDraw = endDraw;
+	}
+
+	glBindBuffer( GL_DRAW_INDIRECT_BUFFER, 0 );
+	glBindVertexArray( 0 );
+}
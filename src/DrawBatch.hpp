@@ -0,0 +1,111 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// A DrawBatch collects the draws of pooled meshes (see GeometryPool) during a
+// traversal of the scene and submits them all at once. Draws are instanced:
+// the model view matrix and position transform of each instance are written
+// to a texture buffer that the vertex shaders read, indexed by the draw
+// index attribute, which the base instance of each command offsets, so
+// nothing needs changing between draws. Meshes with their own buffers are
+// drawn instanced from the same texture buffer, counting from the first of
+// their instances with gl_InstanceID (see Mesh::Render). Draws are submitted
+// in the order they were added, with one glMultiDrawElementsIndirect for each
+// run of draws that share a material; the G-buffer pass adds them sorted by
+// material (see RenderQueue), and the shadow passes, which don't use
+// materials, take a single call each.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+
+class Material;
+
+
+// The layout glMultiDrawElementsIndirect reads its draws from.
+struct DrawCommand
+{
+	GLuint							m_NumIndices;
+	GLuint							m_NumInstances;
+	GLuint							m_FirstIndex;
+	GLint							m_BaseVertex;
+	GLuint							m_BaseInstance;		// The first instance (see DrawBatch::AddInstance).
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// DrawBatch class
+///////////////////////////////////////////////////////////////////////////////
+class DrawBatch
+{
+public:
+	// The vertex attribute that the index of the instance is fed through
+	// (see ShaderProgram), and the texture unit the instance transforms are
+	// bound to.
+	static const GLuint				DrawIndexAttribute = 7;
+	static const GLuint				DrawTransformsTextureUnit = 4;
+
+	// Texels of the instance transforms buffer per instance: the four columns
+	// of the model view matrix, then the position scale and offset.
+	static const size_t				TexelsPerDraw = 6;
+
+									DrawBatch();
+									~DrawBatch();
+
+	void							Clear();
+
+	// Adds the transforms of an instance, returning the index the vertex
+	// shaders find them at. The instances of a draw have to be added one
+	// after another.
+	size_t							AddInstance( const Affine3f & modelView, const Vector3f & positionScale, const Vector3f & positionOffset );
+
+	// Uploads the instances if any have been added since they were last
+	// uploaded, and binds them for the vertex shaders. Meshes with their own
+	// buffers need this done before they are drawn; Submit does it for the
+	// pooled draws.
+	void							UploadInstances();
+
+	// Adds a draw from the geometry pool, of the command's instances from its
+	// base instance on. Each run of draws with the same material is drawn in
+	// one call, with the material set up first. The shadow passes pass
+	// nullptr and draw with whichever program is current.
+	void							Add( Material * pMaterial, const DrawCommand & command );
+
+	// Draws everything that has been added since the batch was cleared, as
+	// triangles or as triangles with adjacency.
+	void							Submit( const bool withAdjacency );
+
+	size_t							GetNumDraws() const					{ return m_Commands.size(); }
+	size_t							GetNumInstances() const				{ return m_Transforms.size() / ( 4 * TexelsPerDraw ); }
+
+private:
+	// Revoked.
+									DrawBatch( const DrawBatch & copy );
+	DrawBatch &						operator = ( const DrawBatch & copy );
+
+	// The commands that are uploaded, and the material of each.
+	vector< DrawCommand >			m_Commands;
+	vector< Material * >			m_Materials;
+
+	// TexelsPerDraw * 4 floats per instance, in the order the instances were
+	// added, and how many of them have been uploaded.
+	vector< float >					m_Transforms;
+	size_t							m_NumUploaded;
+
+	// The buffers the commands and transforms are uploaded to, which are
+	// reused from one submission to the next.
+	GLuint							m_CommandBufferId;
+	GLuint							m_TransformBufferId;
+	GLuint							m_TransformTextureId;
+};
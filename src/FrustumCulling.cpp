@@ -0,0 +1,224 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Precomp.hpp"
+#include "Common.hpp"
+
+#include "FrustumCulling.hpp"
+
+
+FrustumCulling::FrustumCulling( const Matrix4f & viewProjection )
+	: m_NumPlanes( 0 )
+{
+	SetFrustumPlanes( viewProjection );
+}
+
+
+FrustumCulling::FrustumCulling( const Matrix4f & viewProjection, const Vector3f & lightPosition, const float lightRadius )
+	: m_NumPlanes( 0 )
+{
+	const Vector4f light( lightPosition.x(), lightPosition.y(), lightPosition.z(), 1.0f );
+	const Matrix4f inverseViewProjection = viewProjection.inverse();
+
+	// Each plane is the set of clip space points with one coordinate at -w
+	// or +w, ie the faces of the normalised device cube: -x, +x, -y, +y, -z
+	// and +z in that order. They are worked out again here, rather than
+	// taken from SetFrustumPlanes, to know which is which.
+	Vector4f planes[6];
+	bool isPlaneUsed[6];
+	bool facesLight[6];
+
+	for( int planeIndex = 0; planeIndex < 6; ++planeIndex )
+	{
+		const int axis = planeIndex / 2;
+		const float sign = ( planeIndex % 2 == 0 ) ? 1.0f : -1.0f;
+
+		planes[ planeIndex ] = viewProjection.row( 3 ).transpose() + sign * viewProjection.row( axis ).transpose();
+		isPlaneUsed[ planeIndex ] = planes[ planeIndex ].head< 3 >().squaredNorm() > 1e-12f * planes[ planeIndex ].squaredNorm();
+
+		if( isPlaneUsed[ planeIndex ] )
+			planes[ planeIndex ] /= planes[ planeIndex ].head< 3 >().norm();
+
+		facesLight[ planeIndex ] = planes[ planeIndex ].dot( light ) >= 0.0f;
+	}
+
+	// A point that is definitely inside the frustum, for orienting planes.
+	const Vector4f inside = inverseViewProjection * Vector4f( 0.0f, 0.0f, 0.0f, 1.0f );
+
+	for( int planeIndex = 0; planeIndex < 6; ++planeIndex )
+	{
+		if( isPlaneUsed[ planeIndex ] && facesLight[ planeIndex ] )
+			m_Planes[ m_NumPlanes++ ] = planes[ planeIndex ];
+	}
+
+	// Each edge of the cube is where two faces on different axes meet, and
+	// runs along the third axis. The far ends of the side edges of an
+	// infinite frustum come out with a w of zero, ie as directions, which
+	// the plane through them handles just the same.
+	for( int firstPlane = 0; firstPlane < 6; ++firstPlane )
+	{
+		for( int secondPlane = firstPlane + 1; secondPlane < 6; ++secondPlane )
+		{
+			const int firstAxis = firstPlane / 2;
+			const int secondAxis = secondPlane / 2;
+
+			if( firstAxis == secondAxis || ! isPlaneUsed[ firstPlane ] || ! isPlaneUsed[ secondPlane ] || facesLight[ firstPlane ] == facesLight[ secondPlane ] )
+				continue;
+
+			const int edgeAxis = 3 - firstAxis - secondAxis;
+			Vector4f ends[2];
+
+			for( int endIndex = 0; endIndex < 2; ++endIndex )
+			{
+				Vector4f corner( 0.0f, 0.0f, 0.0f, 1.0f );
+				corner[ firstAxis ] = ( firstPlane % 2 == 0 ) ? -1.0f : 1.0f;
+				corner[ secondAxis ] = ( secondPlane % 2 == 0 ) ? -1.0f : 1.0f;
+				corner[ edgeAxis ] = ( endIndex == 0 ) ? -1.0f : 1.0f;
+				ends[ endIndex ] = inverseViewProjection * corner;
+			}
+
+			// The plane through three homogeneous points is orthogonal to
+			// all of them, so each coefficient is a signed 3x3 minor.
+			Matrix< float, 3, 4 > points;
+			points.row( 0 ) = light.transpose();
+			points.row( 1 ) = ends[0].transpose();
+			points.row( 2 ) = ends[1].transpose();
+
+			Vector4f plane;
+
+			for( int coefficient = 0; coefficient < 4; ++coefficient )
+			{
+				Matrix3f minor;
+				int minorColumn = 0;
+
+				for( int column = 0; column < 4; ++column )
+				{
+					if( column != coefficient )
+						minor.col( minorColumn++ ) = points.col( column );
+				}
+
+				plane[ coefficient ] = ( ( coefficient % 2 == 0 ) ? 1.0f : -1.0f ) * minor.determinant();
+			}
+
+			// Skip the plane if the light is on the edge's line.
+			const float normalLength = plane.head< 3 >().norm();
+
+			if( normalLength <= 1e-6f * plane.norm() )
+				continue;
+
+			plane /= normalLength;
+
+			if( plane.dot( inside ) * inside.w() < 0.0f )
+				plane = -plane;
+
+			m_Planes[ m_NumPlanes++ ] = plane;
+		}
+	}
+
+	// Every plane has the light on its inner side, so moving them all out by
+	// the light's radius keeps the whole light sphere in.
+	for( int planeIndex = 0; planeIndex < m_NumPlanes; ++planeIndex )
+		m_Planes[ planeIndex ].w() += lightRadius;
+}
+
+
+void FrustumCulling::SetFrustumPlanes( const Matrix4f & viewProjection )
+{
+	// Gribb and Hartmann's method, as in ShadowCulling. An infinite far plane
+	// comes out with no normal and is skipped. The planes don't need to be
+	// normalised as only the sign of the distance is used.
+	const Vector4f rowW = viewProjection.row( 3 );
+
+	const Vector4f planes[6] =
+	{
+		rowW + viewProjection.row( 0 ).transpose(),
+		rowW - viewProjection.row( 0 ).transpose(),
+		rowW + viewProjection.row( 1 ).transpose(),
+		rowW - viewProjection.row( 1 ).transpose(),
+		rowW + viewProjection.row( 2 ).transpose(),
+		rowW - viewProjection.row( 2 ).transpose()
+	};
+
+	for( int planeIndex = 0; planeIndex < 6; ++planeIndex )
+	{
+		if( planes[ planeIndex ].head< 3 >().squaredNorm() > 1e-12f * planes[ planeIndex ].squaredNorm() )
+			m_Planes[ m_NumPlanes++ ] = planes[ planeIndex ];
+	}
+}
+
+
+void FrustumCulling::Cull( const TransformHierarchy::InstanceBounds & bounds, const size_t firstInstance, const size_t endInstance, uint8_t * pIsVisible, Stats & stats ) const
+{
+	assert( firstInstance % 4 == 0 );
+
+	const __m128 zero = _mm_setzero_ps();
+
+	for( size_t groupInstance = firstInstance; groupInstance < endInstance; groupInstance += 4 )
+	{
+		const __m128 centreX = _mm_load_ps( & bounds.m_Centres[0][ groupInstance ] );
+		const __m128 centreY = _mm_load_ps( & bounds.m_Centres[1][ groupInstance ] );
+		const __m128 centreZ = _mm_load_ps( & bounds.m_Centres[2][ groupInstance ] );
+		const __m128 extentX = _mm_load_ps( & bounds.m_Extents[0][ groupInstance ] );
+		const __m128 extentY = _mm_load_ps( & bounds.m_Extents[1][ groupInstance ] );
+		const __m128 extentZ = _mm_load_ps( & bounds.m_Extents[2][ groupInstance ] );
+
+		// A box is outside a plane if its centre is further behind it than
+		// the box reaches along the plane's normal.
+		__m128 isOutside = zero;
+
+		for( int planeIndex = 0; planeIndex < m_NumPlanes; ++planeIndex )
+		{
+			const Vector4f & plane = m_Planes[ planeIndex ];
+
+			__m128 distance = _mm_add_ps( _mm_mul_ps( centreX, _mm_set1_ps( plane.x() ) ), _mm_set1_ps( plane.w() ) );
+			distance = _mm_add_ps( distance, _mm_mul_ps( centreY, _mm_set1_ps( plane.y() ) ) );
+			distance = _mm_add_ps( distance, _mm_mul_ps( centreZ, _mm_set1_ps( plane.z() ) ) );
+
+			__m128 reach = _mm_mul_ps( extentX, _mm_set1_ps( abs( plane.x() ) ) );
+			reach = _mm_add_ps( reach, _mm_mul_ps( extentY, _mm_set1_ps( abs( plane.y() ) ) ) );
+			reach = _mm_add_ps( reach, _mm_mul_ps( extentZ, _mm_set1_ps( abs( plane.z() ) ) ) );
+
+			isOutside = _mm_or_ps( isOutside, _mm_cmplt_ps( _mm_add_ps( distance, reach ), zero ) );
+		}
+
+		const int outsideMask = _mm_movemask_ps( isOutside );
+		const size_t numLanes = min< size_t >( 4, endInstance - groupInstance );
+
+		for( size_t lane = 0; lane < numLanes; ++lane )
+		{
+			const bool isLaneVisible = ( ( outsideMask >> lane ) & 1 ) == 0;
+			pIsVisible[ groupInstance - firstInstance + lane ] = isLaneVisible ? 1 : 0;
+
+			if( isLaneVisible )
+				++stats.m_NumVisible;
+			else ++stats.m_NumCulled;
+		}
+	}
+}
+
+
+bool FrustumCulling::IsBoxVisible( const Vector3f & centre, const Vector3f & extent ) const
+{
+	for( int planeIndex = 0; planeIndex < m_NumPlanes; ++planeIndex )
+	{
+		const Vector4f & plane = m_Planes[ planeIndex ];
+
+		if( plane.head< 3 >().dot( centre ) + plane.w() + plane.head< 3 >().cwiseAbs().dot( extent ) < 0.0f )
+			return false;
+	}
+
+	return true;
+}
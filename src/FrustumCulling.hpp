@@ -0,0 +1,88 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Culls mesh instances whose world space bounding boxes (see
+// TransformHierarchy) are outside the view frustum, before the scene is drawn.
+// The boxes are tested four at a time with SSE, against each plane of the
+// frustum in turn. The test is conservative: a box that straddles a corner of
+// the frustum may be kept even though it is outside.
+//
+// Shadow casters are culled the same way, against the convex hull of the
+// frustum and the light rather than the frustum itself: a caster's shadow is
+// swept away from the light, so it can only reach the frustum if the caster
+// is between the light and some part of the frustum. The hull is bounded by
+// the frustum planes that face the light, and by planes through the light
+// and each frustum edge between a plane that faces it and one that doesn't.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+
+#include "TransformHierarchy.hpp"
+
+
+///////////////////////////////////////////////////////////////////////////////
+// FrustumCulling class
+///////////////////////////////////////////////////////////////////////////////
+class FrustumCulling
+{
+public:
+	// How many instances were drawn and how many were culled.
+	struct Stats
+	{
+							Stats()									: m_NumVisible( 0 ), m_NumCulled( 0 ) {}
+
+		Stats &				operator += ( const Stats & other )		{ m_NumVisible += other.m_NumVisible; m_NumCulled += other.m_NumCulled; return * this; }
+
+		size_t				m_NumVisible;
+		size_t				m_NumCulled;
+	};
+
+	// The frustum is taken from the projection * view matrix, which may be
+	// infinite.
+							FrustumCulling( const Matrix4f & viewProjection );
+
+	// Culls shadow casters instead. The light position is in world space,
+	// and the light is treated as a sphere of the given radius (see
+	// ShadowCulling::LightRadius).
+							FrustumCulling( const Matrix4f & viewProjection, const Vector3f & lightPosition, const float lightRadius );
+
+	// Culls the boxes from firstInstance up to endInstance, which must start
+	// on a multiple of four. Each box's entry in pIsVisible, counting from
+	// the first box, is set to 1 if the box is at least partly inside the
+	// frustum and 0 if not, and the boxes are added to stats. Culling doesn't
+	// change anything in here, so ranges of boxes can be culled on several
+	// threads at once.
+	void					Cull( const TransformHierarchy::InstanceBounds & bounds, const size_t firstInstance, const size_t endInstance, uint8_t * pIsVisible, Stats & stats ) const;
+
+	// Tests a single box, given by its centre and half extents, in the same
+	// way.
+	bool					IsBoxVisible( const Vector3f & centre, const Vector3f & extent ) const;
+
+	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+	// Six frustum planes, plus one through the light for each of the
+	// frustum's twelve edges at most.
+	static const int		MaxPlanes = 18;
+
+	// Extracts the frustum planes from viewProjection, leaving out the far
+	// plane if the projection is infinite.
+	void					SetFrustumPlanes( const Matrix4f & viewProjection );
+
+	// In world space, facing into the volume being culled against.
+	Vector4f				m_Planes[ MaxPlanes ];
+	int						m_NumPlanes;
+};
@@ -17,19 +17,53 @@
 #version 150 compatibility
 
 
+// Meshes are drawn instanced, with each instance's model view matrix, and
+// the scale and offset that map its quantised positions back to model space
+// (see Mesh.hpp), in a texture buffer (see DrawBatch.hpp). Meshes in the
+// geometry pool take the index of the instance from the draw index attribute,
+// which honours the base instance of their commands. Meshes with buffers of
+// their own count from firstInstance with gl_InstanceID instead.
+uniform samplerBuffer drawTransforms;
+uniform int firstInstance;		// -1 for pooled meshes.
+
+in uint drawIndex;
+
+
 out vec3 normal;
 out vec4 viewPos;
 
+
 //out vec3 colour;
 
 
+// Returns the model view matrix and position transform of the current
+// instance.
+mat4 GetDrawTransform( out vec3 scale, out vec3 offset )
+{
+	int instance = ( firstInstance < 0 ) ? int( drawIndex ) : firstInstance + gl_InstanceID;
+	int texel = instance * 6;
+	scale = texelFetch( drawTransforms, texel + 4 ).xyz;
+	offset = texelFetch( drawTransforms, texel + 5 ).xyz;
+	return mat4( texelFetch( drawTransforms, texel ), texelFetch( drawTransforms, texel + 1 ), texelFetch( drawTransforms, texel + 2 ), texelFetch( drawTransforms, texel + 3 ) );
+}
+
+
 void main()
 {
-	viewPos = gl_ModelViewMatrix * gl_Vertex;
+	vec3 scale, offset;
+	mat4 modelView = GetDrawTransform( scale, offset );
+	vec4 modelPos = vec4( gl_Vertex.xyz * scale + offset, 1.0 );
+
+	viewPos = modelView * modelPos;
 	gl_Position = gl_ProjectionMatrix * viewPos;
 
 	gl_TexCoord[0] = gl_MultiTexCoord0;
-	normal = 0.5 + 0.5 * gl_NormalMatrix * gl_Normal;
+
+	// The normal matrix is the inverse transpose of the model view, so that
+	// normals stay at right angles to surfaces under non-uniform scaling, and
+	// the result is normalised so that any scaling can't push it out of the
+	// range the G-buffer can store.
+	normal = 0.5 + 0.5 * normalize( transpose( inverse( mat3( modelView ) ) ) * gl_Normal );
 
 	//colour = gl_Color.rgb;
 }
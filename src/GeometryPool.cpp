@@ -0,0 +1,334 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Precomp.hpp"
+#include "Common.hpp"
+
+#include "GeometryPool.hpp"
+
+#include "Mesh.hpp"
+#include "DrawBatch.hpp"
+
+
+// Arenas start out this many elements big, and at least double each time
+// they grow, so a scene only causes a few copies however many meshes it has.
+static const size_t MinArenaCapacity = 64 * 1024;
+
+
+GeometryPool::Arena::Arena( const size_t elementSize )
+	: m_ElementSize	( elementSize )
+	, m_Capacity	( 0 )
+	, m_BufferId	( 0 )
+{}
+
+
+GeometryPool::Arena::~Arena()
+{
+	glDeleteBuffers( 1, & m_BufferId );
+}
+
+
+bool GeometryPool::Arena::Allocate( const void * pElements, const size_t numElements, size_t & firstElement )
+{
+	firstElement = 0;
+
+	if( numElements == 0 )
+		return false;
+
+	auto range = m_FreeRanges.begin();
+
+	while( range != m_FreeRanges.end() && range->second < numElements )
+		++range;
+
+	const bool grow = ( range == m_FreeRanges.end() );
+
+	if( grow )
+	{
+		// The new space is merged with any free range at the end, so the
+		// allocation goes in the last free range.
+		Grow( max( 2 * m_Capacity, m_Capacity + numElements ) );
+		range = prev( m_FreeRanges.end() );
+		assert( range->second >= numElements );
+	}
+
+	firstElement = range->first;
+
+	if( range->second > numElements )
+		m_FreeRanges[ firstElement + numElements ] = range->second - numElements;
+
+	m_FreeRanges.erase( range );
+
+	// The copy write target is used so that the element array binding of
+	// whichever vertex array is bound isn't disturbed.
+	glBindBuffer( GL_COPY_WRITE_BUFFER, m_BufferId );
+	glBufferSubData( GL_COPY_WRITE_BUFFER, firstElement * m_ElementSize, numElements * m_ElementSize, pElements );
+	glBindBuffer( GL_COPY_WRITE_BUFFER, 0 );
+
+	return grow;
+}
+
+
+void GeometryPool::Arena::Free( const size_t firstElement, const size_t numElements )
+{
+	if( numElements == 0 )
+		return;
+
+	assert( firstElement + numElements <= m_Capacity );
+
+	auto range = m_FreeRanges.insert( make_pair( firstElement, numElements ) ).first;
+	assert( range->second == numElements );
+
+	// Merge with the following range, then the preceding one.
+	const auto next = std::next( range );
+
+	if( next != m_FreeRanges.end() && range->first + range->second == next->first )
+	{
+		range->second += next->second;
+		m_FreeRanges.erase( next );
+	}
+
+	if( range != m_FreeRanges.begin() )
+	{
+		const auto previous = prev( range );
+
+		if( previous->first + previous->second == range->first )
+		{
+			previous->second += range->second;
+			m_FreeRanges.erase( range );
+		}
+	}
+}
+
+
+size_t GeometryPool::Arena::GetFreeBytes() const
+{
+	size_t numFree = 0;
+
+	foreach( const auto & range, m_FreeRanges )
+		numFree += range.second;
+
+	return numFree * m_ElementSize;
+}
+
+
+void GeometryPool::Arena::Grow( const size_t minCapacity )
+{
+	const size_t capacity = max( minCapacity, MinArenaCapacity );
+
+	GLuint bufferId = 0;
+	glGenBuffers( 1, & bufferId );
+	glBindBuffer( GL_COPY_WRITE_BUFFER, bufferId );
+	glBufferData( GL_COPY_WRITE_BUFFER, capacity * m_ElementSize, nullptr, GL_STATIC_DRAW );
+
+	// Copy the old contents across on the GL, so the ranges that have been
+	// handed out keep their data.
+	if( m_BufferId != 0 )
+	{
+		glBindBuffer( GL_COPY_READ_BUFFER, m_BufferId );
+		glCopyBufferSubData( GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, m_Capacity * m_ElementSize );
+		glBindBuffer( GL_COPY_READ_BUFFER, 0 );
+		glDeleteBuffers( 1, & m_BufferId );
+	}
+
+	glBindBuffer( GL_COPY_WRITE_BUFFER, 0 );
+
+	const size_t oldCapacity = m_Capacity;
+	m_BufferId = bufferId;
+	m_Capacity = capacity;
+
+	Free( oldCapacity, capacity - oldCapacity );
+}
+
+
+GeometryPool::GeometryPool()
+	: m_Vertices			( sizeof( PackedVertex ) )
+	, m_Indices				( sizeof( uint32_t ) )
+	, m_AdjacencyIndices	( sizeof( uint32_t ) )
+	, m_VertexArrayId		( 0 )
+	, m_AdjacencyArrayId	( 0 )
+	, m_DrawIndexBufferId	( 0 )
+	, m_NumDrawIndices		( 0 )
+{
+	if( ! IsSupported() )
+		clog << "Indirect multi-draws aren't supported, so meshes will have buffers of their own" << endl;
+}
+
+
+GeometryPool::~GeometryPool()
+{
+	glDeleteBuffers( 1, & m_DrawIndexBufferId );
+	glDeleteVertexArrays( 1, & m_VertexArrayId );
+	glDeleteVertexArrays( 1, & m_AdjacencyArrayId );
+}
+
+
+bool GeometryPool::IsSupported()
+{
+	// The base instance of an indirect command is ignored without
+	// ARB_base_instance, and every draw would get the first draw's transform.
+	return GLEW_VERSION_4_3 || ( GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance );
+}
+
+
+size_t GeometryPool::AllocateVertices( const void * pVertices, const size_t numVertices )
+{
+	size_t firstVertex;
+
+	if( m_Vertices.Allocate( pVertices, numVertices, firstVertex ) )
+		SetupVertexArrays();
+
+	return firstVertex;
+}
+
+
+size_t GeometryPool::AllocateIndices( const uint32_t * pIndices, const size_t numIndices )
+{
+	size_t firstIndex;
+
+	if( m_Indices.Allocate( pIndices, numIndices, firstIndex ) )
+		SetupVertexArrays();
+
+	return firstIndex;
+}
+
+
+size_t GeometryPool::AllocateAdjacencyIndices( const uint32_t * pIndices, const size_t numIndices )
+{
+	size_t firstIndex;
+
+	if( m_AdjacencyIndices.Allocate( pIndices, numIndices, firstIndex ) )
+		SetupVertexArrays();
+
+	return firstIndex;
+}
+
+
+void GeometryPool::FreeVertices( const size_t firstVertex, const size_t numVertices )
+{
+	m_Vertices.Free( firstVertex, numVertices );
+}
+
+
+void GeometryPool::FreeIndices( const size_t firstIndex, const size_t numIndices )
+{
+	m_Indices.Free( firstIndex, numIndices );
+}
+
+
+void GeometryPool::FreeAdjacencyIndices( const size_t firstIndex, const size_t numIndices )
+{
+	m_AdjacencyIndices.Free( firstIndex, numIndices );
+}
+
+
+void GeometryPool::ReserveDraws( const size_t numDraws )
+{
+	if( numDraws <= m_NumDrawIndices )
+		return;
+
+	m_NumDrawIndices = max( numDraws, 2 * m_NumDrawIndices );
+
+	vector< uint32_t > drawIndices( m_NumDrawIndices );
+
+	for( size_t drawIndex = 0; drawIndex < m_NumDrawIndices; ++drawIndex )
+		drawIndices[ drawIndex ] = static_cast< uint32_t >( drawIndex );
+
+	// Respecifying the buffer's data keeps the vertex arrays pointing at it,
+	// so they only need setting up when it is first created.
+	const bool isNew = ( m_DrawIndexBufferId == 0 );
+
+	if( isNew )
+		glGenBuffers( 1, & m_DrawIndexBufferId );
+
+	glBindBuffer( GL_ARRAY_BUFFER, m_DrawIndexBufferId );
+	glBufferData( GL_ARRAY_BUFFER, m_NumDrawIndices * sizeof( uint32_t ), drawIndices.data(), GL_STATIC_DRAW );
+	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+
+	if( isNew )
+		SetupVertexArrays();
+}
+
+
+void GeometryPool::BindVertexArray( const bool withAdjacency )
+{
+	if( m_VertexArrayId == 0 )
+		SetupVertexArrays();
+
+	glBindVertexArray( withAdjacency ? m_AdjacencyArrayId : m_VertexArrayId );
+}
+
+
+MemoryUsage GeometryPool::GetMemoryUsage() const
+{
+	const size_t gpuBytes = m_Vertices.GetFreeBytes() + m_Indices.GetFreeBytes() + m_AdjacencyIndices.GetFreeBytes() + m_NumDrawIndices * sizeof( uint32_t );
+	return MemoryUsage( sizeof( * this ), gpuBytes );
+}
+
+
+void GeometryPool::SetupVertexArrays()
+{
+	if( m_VertexArrayId == 0 )
+	{
+		glGenVertexArrays( 1, & m_VertexArrayId );
+		glGenVertexArrays( 1, & m_AdjacencyArrayId );
+	}
+
+	// Same layout as Mesh::UploadPackedVertices, except that texture
+	// coordinates are always there (untextured meshes have zeros).
+	const GLsizei stride = sizeof( PackedVertex );
+
+	glBindVertexArray( m_VertexArrayId );
+	glBindBuffer( GL_ARRAY_BUFFER, m_Vertices.GetBufferId() );
+
+	glEnableClientState( GL_VERTEX_ARRAY );
+	glVertexPointer( 3, GL_SHORT, stride, reinterpret_cast< const GLvoid * >( offsetof( PackedVertex, m_Position ) ) );
+
+	glEnableClientState( GL_NORMAL_ARRAY );
+	glNormalPointer( GL_INT_2_10_10_10_REV, stride, reinterpret_cast< const GLvoid * >( offsetof( PackedVertex, m_Normal ) ) );
+
+	glEnableClientState( GL_TEXTURE_COORD_ARRAY );
+	glTexCoordPointer( 2, GL_HALF_FLOAT, stride, reinterpret_cast< const GLvoid * >( offsetof( PackedVertex, m_TexCoord ) ) );
+
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, m_Indices.GetBufferId() );
+
+	// The shadow shaders only need positions.
+	glBindVertexArray( m_AdjacencyArrayId );
+	glBindBuffer( GL_ARRAY_BUFFER, m_Vertices.GetBufferId() );
+
+	glEnableClientState( GL_VERTEX_ARRAY );
+	glVertexPointer( 3, GL_SHORT, stride, reinterpret_cast< const GLvoid * >( offsetof( PackedVertex, m_Position ) ) );
+
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, m_AdjacencyIndices.GetBufferId() );
+
+	// Both arrays step through the draw indices once per instance.
+	if( m_DrawIndexBufferId != 0 )
+	{
+		const GLuint vertexArrayIds[] = { m_VertexArrayId, m_AdjacencyArrayId };
+
+		foreach( const GLuint vertexArrayId, vertexArrayIds )
+		{
+			glBindVertexArray( vertexArrayId );
+			glBindBuffer( GL_ARRAY_BUFFER, m_DrawIndexBufferId );
+
+			glEnableVertexAttribArray( DrawBatch::DrawIndexAttribute );
+			glVertexAttribIPointer( DrawBatch::DrawIndexAttribute, 1, GL_UNSIGNED_INT, 0, 0 );
+			glVertexAttribDivisor( DrawBatch::DrawIndexAttribute, 1 );
+		}
+	}
+
+	glBindVertexArray( 0 );
+	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+}
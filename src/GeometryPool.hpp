@@ -0,0 +1,124 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// The scene's geometry pool holds the vertices and indices of every mesh in a
+// few large GL buffers, rather than each mesh having buffers of its own (see
+// Options::m_SceneBuffers). With everything in the same buffers, one vertex
+// array can draw any mesh, so a whole pass can be submitted as a handful of
+// glMultiDrawElementsIndirect calls (see DrawBatch) instead of a bind and a
+// draw per mesh.
+//
+// Meshes are allocated a range of each buffer when they are uploaded and give
+// it back when they are destroyed. The buffers grow as needed by copying to a
+// bigger buffer on the GL, so ranges stay valid when that happens. Only
+// meshes in the compact vertex layout (see Mesh.hpp) are pooled, with 32-bit
+// indices relative to the mesh's first vertex.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+
+#include "MemoryUsage.hpp"
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GeometryPool class
+///////////////////////////////////////////////////////////////////////////////
+class GeometryPool
+{
+public:
+								GeometryPool();
+								~GeometryPool();
+
+	// Whether the GL can draw from the pool, ie has indirect multi-draws that
+	// honour the base instance of each command. Meshes aren't pooled if not.
+	static bool					IsSupported();
+
+	// Copies elements into the pool, returning the first element of the range
+	// they were put in. Allocating nothing returns zero and needs no freeing.
+	size_t						AllocateVertices( const void * pVertices, const size_t numVertices );
+	size_t						AllocateIndices( const uint32_t * pIndices, const size_t numIndices );
+	size_t						AllocateAdjacencyIndices( const uint32_t * pIndices, const size_t numIndices );
+
+	void						FreeVertices( const size_t firstVertex, const size_t numVertices );
+	void						FreeIndices( const size_t firstIndex, const size_t numIndices );
+	void						FreeAdjacencyIndices( const size_t firstIndex, const size_t numIndices );
+
+	// Makes sure that the draw index stream covers at least numDraws
+	// instances. Each instance's index is fed to the vertex shaders as the
+	// instanced attribute DrawBatch::DrawIndexAttribute, which the base
+	// instance of its command offsets.
+	void						ReserveDraws( const size_t numDraws );
+
+	// Binds the vertex array for drawing triangles out of the pool, or for
+	// drawing triangles with adjacency (positions only).
+	void						BindVertexArray( const bool withAdjacency );
+
+	// Memory used by the pool itself. Pooled meshes count the ranges they
+	// have been allocated (see Mesh::GetMemoryUsage), so this only counts
+	// the space that is free and the draw indices.
+	MemoryUsage					GetMemoryUsage() const;
+
+private:
+	// One GL buffer that ranges of fixed size elements are allocated from,
+	// first fit. Freed ranges are merged with their neighbours.
+	class Arena
+	{
+	public:
+								Arena( const size_t elementSize );
+								~Arena();
+
+		// Returns true if the buffer had to grow, which replaces it with a
+		// new buffer object.
+		bool					Allocate( const void * pElements, const size_t numElements, size_t & firstElement );
+		void					Free( const size_t firstElement, const size_t numElements );
+
+		GLuint					GetBufferId() const					{ return m_BufferId; }
+		size_t					GetFreeBytes() const;
+
+	private:
+		// Revoked.
+								Arena( const Arena & copy );
+		Arena &					operator = ( const Arena & copy );
+
+		void					Grow( const size_t minCapacity );
+
+		const size_t			m_ElementSize;
+		size_t					m_Capacity;
+		GLuint					m_BufferId;
+
+		// Number of elements in each free range, keyed by its first element.
+		map< size_t, size_t >	m_FreeRanges;
+	};
+
+	// Revoked.
+								GeometryPool( const GeometryPool & copy );
+	GeometryPool &				operator = ( const GeometryPool & copy );
+
+	// Points the vertex arrays at the current buffers. Needed whenever an
+	// arena grows.
+	void						SetupVertexArrays();
+
+	Arena						m_Vertices;
+	Arena						m_Indices;
+	Arena						m_AdjacencyIndices;
+
+	GLuint						m_VertexArrayId;
+	GLuint						m_AdjacencyArrayId;
+
+	// 0, 1, 2... one per instance.
+	GLuint						m_DrawIndexBufferId;
+	size_t						m_NumDrawIndices;
+};
@@ -20,6 +20,7 @@
 #include "GlCanvas.hpp"
 
 #include "Scene.hpp"
+#include "SceneNode.hpp"
 #include "Application.hpp"
 
 
@@ -28,6 +29,7 @@ BEGIN_EVENT_TABLE( GlCanvas, wxGLCanvas )
 	EVT_LEFT_UP( GlCanvas::OnMouseUp )
     EVT_KEY_DOWN( GlCanvas::OnKeyDown )
 	EVT_LEFT_DOWN( GlCanvas::OnMouseDown )
+	EVT_RIGHT_DOWN( GlCanvas::OnRightDown )
 	EVT_KILL_FOCUS( GlCanvas::OnLoseFocus )
 	EVT_TIMER( wxID_ANY, GlCanvas::OnTimer )
 END_EVENT_TABLE()
@@ -46,6 +48,8 @@ GlCanvas::GlCanvas( wxWindow * pParent )
     : wxGLCanvas	( pParent, wxID_ANY, m_gGlAttributes, wxDefaultPosition, wxDefaultSize, wxFULL_REPAINT_ON_RESIZE )
 	, m_UpdateTimer	( this )
 	, m_NumKeysDown	( 0 )
+	, m_SelectedNode	( 0 )
+	, m_SelectedRevision( numeric_limits< size_t >::max() )
 {
 	Bind( wxEVT_PAINT, & GlCanvas::OnFirstPaint, this );
 }
@@ -54,12 +58,32 @@ GlCanvas::GlCanvas( wxWindow * pParent )
 void GlCanvas::OnLoseFocus( wxFocusEvent & event )
 {
 	m_NumKeysDown = 0;
-	m_UpdateTimer.Stop();
 	m_KeyDownBits.reset();
+	StopUpdatingIfIdle();
 	Unbind( wxEVT_MOTION, & GlCanvas::OnMouseLook, this );
 }
 
 
+void GlCanvas::StartUpdating()
+{
+	if( ! m_UpdateTimer.IsRunning() )
+	{
+		m_UpdateTimer.Start( 16 );
+		m_UpdateWatch.Start();
+	}
+}
+
+
+void GlCanvas::StopUpdatingIfIdle()
+{
+	if( m_NumKeysDown == 0 && ! GetScene().IsLoading() )
+	{
+		m_UpdateTimer.Stop();
+		m_UpdateWatch.Pause();
+	}
+}
+
+
 void GlCanvas::RenderImmediate()
 {
 	wxClientDC deviceContext( this );
@@ -118,16 +142,17 @@ void GlCanvas::OnKeyDown( wxKeyEvent & event )
 	case MoveKey_Right:
 	case MoveKey_Up:
 	case MoveKey_Down:
+	case NodeKey_Forwards:
+	case NodeKey_Backwards:
+	case NodeKey_Left:
+	case NodeKey_Right:
+	case NodeKey_Up:
+	case NodeKey_Down:
 		if( ! m_KeyDownBits[ event.GetKeyCode() ] )
 		{
 			++m_NumKeysDown;
 			m_KeyDownBits.set( event.GetKeyCode() );
-
-			if( ! m_UpdateTimer.IsRunning() )
-			{
-				m_UpdateTimer.Start( 16 );
-				m_UpdateWatch.Start();
-			}
+			StartUpdating();
 		}
 		break;
 
@@ -151,6 +176,12 @@ void GlCanvas::OnKeyUp( wxKeyEvent & event )
 	case MoveKey_Right:
 	case MoveKey_Up:
 	case MoveKey_Down:
+	case NodeKey_Forwards:
+	case NodeKey_Backwards:
+	case NodeKey_Left:
+	case NodeKey_Right:
+	case NodeKey_Up:
+	case NodeKey_Down:
 		if( m_KeyDownBits[ event.GetKeyCode() ] )
 		{
 			m_KeyDownBits.reset( event.GetKeyCode() );
@@ -158,12 +189,7 @@ void GlCanvas::OnKeyUp( wxKeyEvent & event )
 			if( m_NumKeysDown > 0 )
 			{
 				--m_NumKeysDown;
-
-				if( m_NumKeysDown == 0 )
-				{
-					m_UpdateTimer.Stop();
-					m_UpdateWatch.Pause();
-				}
+				StopUpdatingIfIdle();
 			}
 		}
 		break;
@@ -179,6 +205,45 @@ void GlCanvas::OnMouseDown( wxMouseEvent & event )
 }
 
 
+void GlCanvas::OnRightDown( wxMouseEvent & event )
+{
+	const Camera & camera = m_pViewport->m_Camera;
+	const wxSize clientSize = GetClientSize();
+
+	// The ray through the pixel in view space, where the camera looks down
+	// +z, taken back into world space.
+	const Vector3f viewDirection( ( 2.0f * event.GetX() / clientSize.x - 1.0f ) / camera.ProjectionMatrix()( 0, 0 ),
+								  ( 1.0f - 2.0f * event.GetY() / clientSize.y ) / camera.ProjectionMatrix()( 1, 1 ),
+								  1.0f );
+	const Affine3f cameraToWorld = camera.ViewMatrix().inverse( Isometry );
+
+	Scene & scene = GetScene();
+	vector< InstanceBvh::RayHit > hits;
+	scene.QueryRay( cameraToWorld.translation(), cameraToWorld.linear() * viewDirection, numeric_limits< float >::max(), hits );
+
+	if( hits.empty() )
+	{
+		m_SelectedRevision = numeric_limits< size_t >::max();
+		return;
+	}
+
+	m_SelectedNode = scene.m_Transforms.GetInstanceNode( hits.front().m_InstanceIndex );
+	m_SelectedRevision = scene.m_Transforms.GetLayoutRevision();
+	clog << "Selected node " << scene.m_Transforms.GetNode( m_SelectedNode ).m_Name << endl;
+}
+
+
+SceneNode * GlCanvas::GetSelectedNode() const
+{
+	const TransformHierarchy & transforms = GetScene().m_Transforms;
+
+	if( m_SelectedRevision != transforms.GetLayoutRevision() )
+		return nullptr;
+
+	return & transforms.GetNode( m_SelectedNode );
+}
+
+
 void GlCanvas::OnMouseUp( wxMouseEvent & event )
 {
 	Unbind( wxEVT_MOTION, & GlCanvas::OnMouseLook, this );
@@ -225,5 +290,42 @@ void GlCanvas::OnTimer( wxTimerEvent & event )
 
 	m_pViewport->m_Camera.Move( 10.0f * frameLength * translation );
 
+	// The selected node moves the same way as the camera, at the same speed.
+	if( SceneNode * const pNode = GetSelectedNode() )
+	{
+		Vector3f nodeTranslation = Vector3f::Zero();
+
+		if( m_KeyDownBits[ NodeKey_Left ] )
+			nodeTranslation.x() -= 1.0f;
+
+		if( m_KeyDownBits[ NodeKey_Right ] )
+			nodeTranslation.x() += 1.0f;
+
+		if( m_KeyDownBits[ NodeKey_Forwards ] )
+			nodeTranslation.z() += 1.0f;
+
+		if( m_KeyDownBits[ NodeKey_Backwards ] )
+			nodeTranslation.z() -= 1.0f;
+
+		nodeTranslation = m_pViewport->m_Camera.ViewMatrix().linear().transpose() * nodeTranslation;
+
+		if( m_KeyDownBits[ NodeKey_Up ] )
+			nodeTranslation.y() += 1.0f;
+
+		if( m_KeyDownBits[ NodeKey_Down ] )
+			nodeTranslation.y() -= 1.0f;
+
+		if( ! nodeTranslation.isZero() )
+			pNode->Move( 10.0f * frameLength * nodeTranslation );
+	}
+
+	// Scene loading uploads to the GL, so make sure it's our context.
+	if( GetScene().IsLoading() )
+	{
+		wxGetApp().SetTargetGlCanvas( * this );
+		GetScene().UpdateLoading( m_gLoadingBudget );
+	}
+
 	RenderImmediate();
+	StopUpdatingIfIdle();
 }
@@ -15,7 +15,9 @@
 //
 // A GlCanvas is a window in wxWidgets that can be drawn to using OpenGL. This
 // class extends the base wxWidgets class with some app specific features for
-// moving the camera with the WASD keys and doing mouse-look.
+// moving the camera with the WASD keys and doing mouse-look. Right-clicking
+// selects the scene node under the cursor, which the arrow keys, page up and
+// page down then move around.
 //
 // TODO: De-couple movement code from this class.
 // TODO: Always use the 60Hz timer whenever we want to redraw? Eg currently,
@@ -31,6 +33,9 @@
 #include "Viewport.hpp"
 
 
+class SceneNode;
+
+
 ///////////////////////////////////////////////////////////////////////////////
 // GlCanvas class
 ///////////////////////////////////////////////////////////////////////////////
@@ -46,6 +51,11 @@ public:
 	//		if so.
 	void						RenderImmediate();
 
+	// Starts the 60Hz timer if it isn't already running. The timer keeps
+	// running while there are movement keys held down or scenes being loaded,
+	// so call this after starting to load a scene.
+	void						StartUpdating();
+
 	// Eigen needs this so that vectors/matrices are aligned properly in
 	// classes that are new'd.
 	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -63,6 +73,17 @@ private:
 		MoveKey_Down		= WXK_SHIFT
 	};
 
+	// Keys that move the selected node relative to the camera.
+	enum
+	{
+		NodeKey_Forwards	= WXK_UP,
+		NodeKey_Backwards	= WXK_DOWN,
+		NodeKey_Left		= WXK_LEFT,
+		NodeKey_Right		= WXK_RIGHT,
+		NodeKey_Up			= WXK_PAGEUP,
+		NodeKey_Down		= WXK_PAGEDOWN
+	};
+
 	// Called when the window is resized. Need to resize the geometry buffer
 	// when this happens as it needs to have the same resolution as the window.
 	void						OnSize( wxSizeEvent & event );
@@ -82,7 +103,9 @@ private:
 	// doesn't matter if it drops below 60. If the user is not moving the
 	// camera then the scene is static and we don't use the timer or re-draw
 	// the scene (ie the app is idle and uses no CPU time; you should be able
-	// to see this in eg Windows Task Manager).
+	// to see this in eg Windows Task Manager). The exception is while a scene
+	// is loading: part of each frame is then spent uploading the scene to the
+	// GL so that it appears progressively while the camera stays responsive.
 	// TODO: It can be nice to see the unrestricted maximum frame-rate. This is
 	//		sometimes used as a vague measure of performance. If nothing else,
 	//		if the app can update substantially quicker than 60Hz then you can
@@ -115,6 +138,11 @@ private:
 	void						OnMouseUp( wxMouseEvent & event );
 	void						OnMouseDown( wxMouseEvent & event );
 
+	// Called when the user clicks the right mouse button in the window.
+	// Selects the node of the nearest mesh instance whose bounds are under
+	// the cursor, or nothing if there isn't one.
+	void						OnRightDown( wxMouseEvent & event );
+
 	// Called whenever the user moves the mouse and mouse-look is enabled.
 	// Updates the rotation of the camera depending on how the mouse was moved.
 	void						OnMouseLook( wxMouseEvent & event );
@@ -127,6 +155,13 @@ private:
 	//		event, use RenderImmediate instead.
 	void						Render();
 
+	// Stops the 60Hz timer if there is nothing left for it to do.
+	void						StopUpdatingIfIdle();
+
+	// Returns the selected node, or nullptr if nothing is selected or the
+	// scene has changed since it was.
+	SceneNode *					GetSelectedNode() const;
+
 	// These next 2 lines use Boost funkiness to get the highest value movement
 	// key as a compile time constant, which can then be used as the size for
 	// an array. The array is used to track what movement keys are currently
@@ -135,7 +170,8 @@ private:
 	// it.
 	// TODO: Clever, but complicated, plus allowing users to reconfigure the
 	//		controls will require a different solution.
-	typedef mpl::vector_c< int, MoveKey_Forwards, MoveKey_Backwards, MoveKey_Left, MoveKey_Right, MoveKey_Up, MoveKey_Down > KeyCodes;
+	typedef mpl::vector_c< int, MoveKey_Forwards, MoveKey_Backwards, MoveKey_Left, MoveKey_Right, MoveKey_Up, MoveKey_Down,
+							   NodeKey_Forwards, NodeKey_Backwards, NodeKey_Left, NodeKey_Right, NodeKey_Up, NodeKey_Down > KeyCodes;
 
 	static const int MaxKeyCode = mpl::deref< mpl::max_element< KeyCodes >::type >::type::value;
 
@@ -145,6 +181,8 @@ private:
 	bitset< MaxKeyCode + 1 >	m_KeyDownBits;		// Records what movement keys are currently held down.
 	wxPoint						m_LastMousePos;		// Records the position of the mouse the last time we updated the camera. We use this to work out mow much it has moved.
 	int							m_NumKeysDown;		// The number of movement keys that are currently held down. When this is zero we may not need to update the camera/redraw.
+	size_t						m_SelectedNode;		// The scene's TransformHierarchy index of the node that the arrow keys move.
+	size_t						m_SelectedRevision;	// The hierarchy's layout revision when the node was selected, as the index is only good until it's rebuilt.
 
 	// This array specifies the OpenGL related attributes used when creating a
 	// GL canvas (eg bits-per-pixel, depth bits, stencil bits, etc.). They are
@@ -152,5 +190,8 @@ private:
 	// constant.
 	static const int			m_gGlAttributes[];
 
+	// How long to spend each frame adding scenes that are being loaded.
+	static const long			m_gLoadingBudget = 5;
+
 	DECLARE_EVENT_TABLE()
 };
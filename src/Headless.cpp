@@ -0,0 +1,342 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Entry point for the headless renderer, a command line tool that renders a
+// scene into image files without opening a window and reports how long each
+// frame took. Run with --help for the options.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Precomp.hpp"
+#include "Common.hpp"
+
+#include "Scene.hpp"
+#include "Options.hpp"
+#include "SceneNode.hpp"
+#include "Viewport.hpp"
+#include "HeadlessRenderer.hpp"
+
+#include <wx/init.h>
+#include <Magick++.h>
+
+
+// Parses a vector given as "x,y,z".
+static bool ParseVector( const wxString & text, Vector3f & vector )
+{
+	return sscanf( text.ToStdString().c_str(), "%f,%f,%f", & vector.x(), & vector.y(), & vector.z() ) == 3;
+}
+
+
+// Parses an angle given in degrees and converts it to radians.
+static bool ParseAngle( const wxString & text, float & angle )
+{
+	double degrees;
+
+	if( ! text.ToCDouble( & degrees ) )
+		return false;
+
+	angle = static_cast< float >( degrees ) * pi< float >() / 180.0f;
+	return true;
+}
+
+
+// Counts the mesh instances of a node and its descendents.
+static size_t CountInstances( const SceneNode & node )
+{
+	size_t numInstances = node.m_MeshInstances.size();
+
+	foreach( const SceneNode & child, node.m_ChildNodes )
+		numInstances += CountInstances( child );
+
+	return numInstances;
+}
+
+
+int main( int argc, char ** argv )
+{
+	// We don't use any of the GUI, but wxWidgets still needs initialising for
+	// the command line parser, logging and stop watches.
+	wxInitializer initializer( argc, argv );
+
+	if( ! initializer.IsOk() )
+	{
+		cerr << "Error initialising wxWidgets" << endl;
+		return 1;
+	}
+
+	wxCmdLineParser parser( argc, argv );
+	parser.AddSwitch( "h", "help", "Show this help", wxCMD_LINE_OPTION_HELP );
+	parser.AddOption( "o", "output", "Image file to write the final frame to (default frame.png)" );
+	parser.AddOption( "W", "width", "Width of the image in pixels (default 1280)", wxCMD_LINE_VAL_NUMBER );
+	parser.AddOption( "H", "height", "Height of the image in pixels (default 720)", wxCMD_LINE_VAL_NUMBER );
+	parser.AddOption( "c", "camera", "Camera position as x,y,z" );
+	parser.AddOption( "y", "yaw", "Camera yaw in degrees" );
+	parser.AddOption( "t", "pitch", "Camera pitch in degrees" );
+	parser.AddOption( "l", "light", "Light position as x,y,z" );
+	parser.AddOption( "f", "frames", "Number of frames to render and time (default 1)", wxCMD_LINE_VAL_NUMBER );
+	parser.AddOption( "n", "move-node", "Name of a scene node to move halfway through the frames" );
+	parser.AddOption( "x", "move-offset", "How far to move the node, in world space, as x,y,z (default 0,1,0)" );
+	parser.AddOption( "s", "timings", "CSV file to write the time taken by each frame to" );
+	parser.AddSwitch( "m", "memory", "Log the memory used by the scene once it has loaded" );
+	parser.AddSwitch( "X", "check-shadow-cache", "Render the final frame again without the shadow volume cache and count the pixels that differ" );
+	parser.AddSwitch( "b", "vertex-benchmark", "Compare frame times with float and compact vertices, then render as usual" );
+	parser.AddOption( "v", "bvh-benchmark", "Time building, refitting and querying a BVH over this many random boxes, then render as usual", wxCMD_LINE_VAL_NUMBER );
+	AddOptions( parser );
+	parser.AddParam( "scene file" );
+
+	// Parse returns -1 if help was shown.
+	const int parseResult = parser.Parse();
+
+	if( parseResult != 0 )
+		return ( parseResult < 0 ) ? 0 : 1;
+
+	wxString outputFileName = "frame.png";
+	wxString timingsFileName;
+	long width = 1280;
+	long height = 720;
+	long numFrames = 1;
+	Vector3f cameraPosition( Vector3f::Zero() );
+	Vector3f lightPosition( 0.0f, 0.0f, -100.0f );
+	Vector3f moveOffset( 0.0f, 1.0f, 0.0f );
+	wxString moveNodeName;
+	float yaw = 0.0f;
+	float pitch = 0.0f;
+	wxString value;
+
+	parser.Found( "output", & outputFileName );
+	parser.Found( "timings", & timingsFileName );
+	parser.Found( "width", & width );
+	parser.Found( "height", & height );
+	parser.Found( "frames", & numFrames );
+	parser.Found( "move-node", & moveNodeName );
+
+	if( width <= 0 || height <= 0 || numFrames <= 0 )
+	{
+		cerr << "Width, height and number of frames must be positive" << endl;
+		return 1;
+	}
+
+	if( ( parser.Found( "camera", & value ) && ! ParseVector( value, cameraPosition ) ) ||
+		( parser.Found( "light", & value ) && ! ParseVector( value, lightPosition ) ) ||
+		( parser.Found( "move-offset", & value ) && ! ParseVector( value, moveOffset ) ) )
+	{
+		cerr << "Positions and offsets must be given as x,y,z" << endl;
+		return 1;
+	}
+
+	// The node is moved between frames that both update the transforms
+	// partially, so there has to be one before it.
+	if( ! moveNodeName.IsEmpty() && numFrames < 2 )
+	{
+		cerr << "Moving a node needs at least two frames" << endl;
+		return 1;
+	}
+
+	if( ( parser.Found( "yaw", & value ) && ! ParseAngle( value, yaw ) ) ||
+		( parser.Found( "pitch", & value ) && ! ParseAngle( value, pitch ) ) )
+	{
+		cerr << "Angles must be given in degrees" << endl;
+		return 1;
+	}
+
+	if( ! ParseOptions( parser ) )
+		return 1;
+
+	const string sceneFileName = parser.GetParam( 0 ).ToStdString();
+
+	Magick::InitializeMagick( argv[0] );
+
+	try
+	{
+		HeadlessRenderer renderer( width, height );
+
+		// The benchmark renders from the same place as the frames below.
+		renderer.GetViewport().m_Camera.Place( cameraPosition, yaw, pitch );
+		renderer.GetViewport().m_LightPosition = lightPosition;
+
+		if( parser.Found( "vertex-benchmark" ) )
+			renderer.BenchmarkVertexFormats( sceneFileName, numFrames );
+
+		long numBenchmarkInstances;
+
+		if( parser.Found( "bvh-benchmark", & numBenchmarkInstances ) )
+			InstanceBvh::Benchmark( GetScene().GetThreadPool(), max( numBenchmarkInstances, 1l ) );
+
+		const long loadTime = renderer.LoadScene( sceneFileName );
+		cout << "Loaded " << sceneFileName << " in " << loadTime << "ms" << endl;
+
+		if( parser.Found( "memory" ) )
+			GetScene().DumpMemoryUsage();
+
+		// The node is found by its name in the hierarchy, which is in place
+		// once the scene has loaded.
+		TransformHierarchy & transforms = GetScene().m_Transforms;
+		SceneNode * pMovedNode = nullptr;
+
+		for( size_t nodeIndex = 0; pMovedNode == nullptr && ! moveNodeName.IsEmpty() && nodeIndex < transforms.GetNumNodes(); ++nodeIndex )
+		{
+			if( transforms.GetNode( nodeIndex ).m_Name == moveNodeName.ToStdString() )
+				pMovedNode = & transforms.GetNode( nodeIndex );
+		}
+
+		if( ! moveNodeName.IsEmpty() && pMovedNode == nullptr )
+			throw runtime_error( "No node named " + moveNodeName.ToStdString() );
+
+		const long moveFrame = numFrames / 2;
+		vector< int64_t > frameTimes;
+
+		for( long frameIndex = 0; frameIndex < numFrames; ++frameIndex )
+		{
+			if( pMovedNode != nullptr && frameIndex == moveFrame )
+				pMovedNode->Move( moveOffset );
+
+			frameTimes.push_back( renderer.RenderFrame() );
+
+			// The frame only updated the moved node and its descendents, which
+			// should leave the same transforms as updating everything.
+			if( pMovedNode != nullptr && frameIndex == moveFrame )
+			{
+				const size_t numMismatches = transforms.CountMismatches( GetScene().GetThreadPool() );
+
+				cout << "Moved " << pMovedNode->m_Name << " before frame " << moveFrame << ", updating " << transforms.GetNumUpdated() << " of " << transforms.GetNumNodes() << " world transforms" << endl;
+
+				if( numMismatches > 0 )
+				{
+					cerr << "The partial transform update differs from a full rebuild in " << numMismatches << " transforms and bounds" << endl;
+					return 1;
+				}
+
+				cout << "The partial transform update matches a full rebuild" << endl;
+			}
+
+			// The moved casters lose their volumes in the frame they move in,
+			// and are captured again in the next, while the other casters stay
+			// cached. Everything should be cached before the move for the
+			// counts to show only the moved ones.
+			if( pMovedNode != nullptr && frameIndex >= moveFrame && frameIndex <= moveFrame + 1 && GetOptions().m_ShadowVolumeCache )
+			{
+				const ShadowVolumeCache::Stats & cacheStats = renderer.GetViewport().m_Camera.GetShadowVolumeCacheStats();
+
+				cout << "Shadow volume cache in frame " << frameIndex << ": " << cacheStats.m_NumDiscarded << " casters discarded and " << cacheStats.m_NumCaptured << " captured, with " << CountInstances( * pMovedNode ) << " instances moved" << endl;
+			}
+		}
+
+		renderer.SaveImage( outputFileName.ToStdString() );
+		cout << "Wrote " << outputFileName.ToStdString() << endl;
+
+		// The first frame includes one-off costs such as compiling shaders
+		// on first use, so it is reported separately.
+		int64_t minTime = numeric_limits< int64_t >::max();
+		int64_t maxTime = 0;
+		int64_t totalTime = 0;
+
+		for( size_t frameIndex = frameTimes.size() > 1 ? 1 : 0; frameIndex < frameTimes.size(); ++frameIndex )
+		{
+			minTime = min( minTime, frameTimes[ frameIndex ] );
+			maxTime = max( maxTime, frameTimes[ frameIndex ] );
+			totalTime += frameTimes[ frameIndex ];
+		}
+
+		const size_t numTimedFrames = frameTimes.size() > 1 ? frameTimes.size() - 1 : 1;
+
+		cout << fixed << setprecision( 2 );
+		cout << "First frame: " << frameTimes.front() / 1000.0 << "ms" << endl;
+		cout << "Frame times over " << numTimedFrames << " frames: min " << minTime / 1000.0 << "ms, avg " << totalTime / 1000.0 / numTimedFrames << "ms, max " << maxTime / 1000.0 << "ms" << endl;
+
+		const FrustumCulling::Stats & frustumStats = renderer.GetViewport().m_Camera.GetFrustumCullingStats();
+		const size_t numInstances = frustumStats.m_NumVisible + frustumStats.m_NumCulled;
+
+		if( numInstances > 0 )
+			cout << "Instances culled per frame: " << frustumStats.m_NumCulled << " of " << numInstances << " (" << 100.0 * frustumStats.m_NumCulled / numInstances << "%)" << endl;
+
+		const OcclusionCulling::Stats & occlusionStats = renderer.GetViewport().m_Camera.GetOcclusionCullingStats();
+		const RenderQueue & secondPassQueue = renderer.GetViewport().m_Camera.GetSecondPassQueue();
+
+		if( occlusionStats.m_NumTested > 0 )
+			cout << "Instances occluded per frame: " << occlusionStats.m_NumOccluded << " of " << occlusionStats.m_NumTested << " (" << 100.0 * occlusionStats.m_NumOccluded / occlusionStats.m_NumTested << "%), with " << secondPassQueue.GetNumInstances() << " drawn in the second pass" << endl;
+
+		const RenderQueue & renderQueue = renderer.GetViewport().m_Camera.GetRenderQueue();
+		cout << "G-buffer draws per frame: " << renderQueue.GetNumDraws() + secondPassQueue.GetNumDraws() << " for " << renderQueue.GetNumInstances() + secondPassQueue.GetNumInstances() << " instances, with " << renderQueue.GetNumStateChanges() + secondPassQueue.GetNumStateChanges() << " program and texture changes" << endl;
+
+		const FrustumCulling::Stats & casterStats = renderer.GetViewport().m_Camera.GetCasterCullingStats();
+		const size_t numCasters = casterStats.m_NumVisible + casterStats.m_NumCulled;
+
+		if( numCasters > 0 )
+			cout << "Shadow casters culled per frame: " << casterStats.m_NumCulled << " of " << numCasters << " (" << 100.0 * casterStats.m_NumCulled / numCasters << "%)" << endl;
+
+		const OcclusionCulling::Stats & casterOcclusionStats = renderer.GetViewport().m_Camera.GetCasterOcclusionStats();
+
+		if( casterOcclusionStats.m_NumTested > 0 )
+			cout << "Shadow casters occluded per frame: " << casterOcclusionStats.m_NumOccluded << " of " << casterOcclusionStats.m_NumTested << " (" << 100.0 * casterOcclusionStats.m_NumOccluded / casterOcclusionStats.m_NumTested << "%)" << endl;
+
+		const ShadowCulling::Stats & cullingStats = renderer.GetViewport().m_Camera.GetShadowCullingStats();
+
+		if( cullingStats.m_NumClusters > 0 )
+			cout << "Shadow clusters culled per frame: " << cullingStats.m_NumCulled << " of " << cullingStats.m_NumClusters << " (" << 100.0 * cullingStats.m_NumCulled / cullingStats.m_NumClusters << "%)" << endl;
+
+		const ShadowVolumeCache::Stats & cacheStats = renderer.GetViewport().m_Camera.GetShadowVolumeCacheStats();
+
+		if( cacheStats.m_NumCached > 0 )
+			cout << "Shadow volumes drawn from the cache per frame: " << cacheStats.m_NumDrawn << ", with " << cacheStats.m_NumCaptured << " captured; " << cacheStats.m_NumCached << " cached in " << cacheStats.m_NumBytes / ( 1024.0 * 1024.0 ) << "MB" << endl;
+
+		const LightClusters & lightClusters = renderer.GetViewport().GetLightClusters();
+
+		if( lightClusters.GetNumLights() > 0 )
+			cout << "Scene lights in view per frame: " << lightClusters.GetNumLights() << " of " << GetScene().m_Lights.size() << ", averaging " << static_cast< double >( lightClusters.GetNumLightIndices() ) / lightClusters.GetNumClusters() << " per cluster" << endl;
+
+		// The cache only saves work, so drawing the final frame again without
+		// it should give the same image.
+		if( parser.Found( "check-shadow-cache" ) && GetOptions().m_ShadowVolumeCache )
+		{
+			vector< uint8_t > cachedPixels;
+			vector< uint8_t > pixels;
+			renderer.ReadPixels( cachedPixels );
+
+			GetOptions().m_ShadowVolumeCache = false;
+			renderer.RenderFrame();
+			renderer.ReadPixels( pixels );
+			GetOptions().m_ShadowVolumeCache = true;
+
+			size_t numDifferent = 0;
+
+			for( size_t byteIndex = 0; byteIndex < pixels.size(); byteIndex += 4 )
+			{
+				if( ! equal( pixels.begin() + byteIndex, pixels.begin() + byteIndex + 4, cachedPixels.begin() + byteIndex ) )
+					++numDifferent;
+			}
+
+			cout << "Pixels that differ without the shadow volume cache: " << numDifferent << " of " << pixels.size() / 4 << endl;
+		}
+
+		if( ! timingsFileName.IsEmpty() )
+		{
+			ofstream timingsFile( timingsFileName.ToStdString() );
+
+			if( ! timingsFile )
+				throw runtime_error( "Error writing frame timings to " + timingsFileName.ToStdString() );
+
+			timingsFile << "frame,microseconds" << endl;
+
+			for( size_t frameIndex = 0; frameIndex < frameTimes.size(); ++frameIndex )
+				timingsFile << frameIndex << "," << frameTimes[ frameIndex ] << endl;
+		}
+	}
+	catch( const std::exception & exception )
+	{
+		cerr << "Error: " << exception.what() << endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,177 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Precomp.hpp"
+#include "Common.hpp"
+
+#include "HeadlessRenderer.hpp"
+
+#include "Mesh.hpp"
+#include "Scene.hpp"
+#include "Options.hpp"
+#include "Viewport.hpp"
+
+#include <Magick++.h>
+
+
+HeadlessRenderer::HeadlessRenderer( const GLint width, const GLint height )
+	: m_Width	( width )
+	, m_Height	( height )
+{
+	// Core entry points aren't necessarily exported by offscreen drivers in the
+	// way that glew expects, so have it look everything up.
+	glewExperimental = GL_TRUE;
+	const GLenum glewResult = glewInit();
+
+	// A GLX build of glew can't find a GLX display when the context comes
+	// from EGL, but it has already looked up the GL entry points by then.
+#if defined( GLEW_ERROR_NO_GLX_DISPLAY )
+	if( glewResult != GLEW_OK && glewResult != GLEW_ERROR_NO_GLX_DISPLAY )
+#else
+	if( glewResult != GLEW_OK )
+#endif
+		throw runtime_error( "Error initialising glew" );
+
+	clog << "Rendering with " << OffscreenContext::GetRenderer() << endl;
+
+	Scene::CreateSingleton();
+
+	glGenFramebuffers( 1, & m_FramebufferId );
+	glGenRenderbuffers( 1, & m_ColourRenderBufferId );
+
+	glBindRenderbuffer( GL_RENDERBUFFER, m_ColourRenderBufferId );
+	glRenderbufferStorage( GL_RENDERBUFFER, GL_RGBA8, width, height );
+	glBindRenderbuffer( GL_RENDERBUFFER, 0 );
+
+	glBindFramebuffer( GL_FRAMEBUFFER, m_FramebufferId );
+	glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_ColourRenderBufferId );
+
+	const GLenum status = glCheckFramebufferStatus( GL_FRAMEBUFFER );
+	glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+
+	if( status != GL_FRAMEBUFFER_COMPLETE )
+		throw runtime_error( "Error creating the headless framebuffer" );
+
+	m_pViewport.reset( new Viewport( width, height ) );
+	m_pViewport->m_TargetFramebufferId = m_FramebufferId;
+}
+
+
+HeadlessRenderer::~HeadlessRenderer()
+{
+	// Everything that uses the GL has to go before the context does.
+	m_pViewport.reset();
+
+	glDeleteRenderbuffers( 1, & m_ColourRenderBufferId );
+	glDeleteFramebuffers( 1, & m_FramebufferId );
+
+	Scene::DestroySingleton();
+}
+
+
+long HeadlessRenderer::LoadScene( const string & fileName )
+{
+	wxStopWatch loadWatch;
+
+	GetScene().LoadFromFile( fileName );
+	GetScene().FinishLoading();
+
+	return loadWatch.Time();
+}
+
+
+int64_t HeadlessRenderer::RenderFrame()
+{
+	wxStopWatch frameWatch;
+
+	m_pViewport->Render();
+
+	return frameWatch.TimeInMicro().GetValue();
+}
+
+
+void HeadlessRenderer::BenchmarkVertexFormats( const string & fileName, const long numFrames )
+{
+	const bool wasCompact = GetOptions().m_CompactVertices;
+	const char * const formatNames[] = { "Float streams", "Compact" };
+	const int numFormats = sizeof( formatNames ) / sizeof( formatNames[0] );
+
+	clog << "Vertex format benchmark for " << fileName << " (" << numFrames << " frames each)" << endl;
+
+	for( int formatIndex = 0; formatIndex < numFormats; ++formatIndex )
+	{
+		GetOptions().m_CompactVertices = ( formatIndex == 1 );
+
+		LoadScene( fileName );
+		SceneFile & file = GetScene().m_Files.back();
+
+		size_t vertexBytes = 0;
+		size_t indexBytes = 0;
+
+		foreach( const Mesh * pMesh, file.m_Meshes )
+		{
+			vertexBytes += pMesh->GetVertexBytes();
+			indexBytes += pMesh->GetIndexBytes();
+		}
+
+		// The first frame pays for things like shader compilation, so it
+		// isn't timed.
+		RenderFrame();
+
+		int64_t totalTime = 0;
+
+		for( long frameIndex = 0; frameIndex < numFrames; ++frameIndex )
+			totalTime += RenderFrame();
+
+		// Every mesh is drawn in the geometry pass and again in the shadow
+		// pass. This ignores the post-transform cache, so it's an upper bound
+		// on what is actually fetched.
+		const double frameTime = static_cast< double >( totalTime ) / numFrames / 1000.0;
+		const size_t fetchedBytes = 2 * ( vertexBytes + indexBytes );
+
+		clog << "  " << formatNames[ formatIndex ] << ": " << MemoryUsage::FormatBytes( vertexBytes ) << " vertices, " << MemoryUsage::FormatBytes( indexBytes ) << " indices, "
+			 << MemoryUsage::FormatBytes( fetchedBytes ) << " fetched per frame, " << fixed << setprecision( 2 ) << frameTime << "ms per frame ("
+			 << fetchedBytes / ( frameTime / 1000.0 ) / ( 1024.0 * 1024.0 * 1024.0 ) << "GB/s)" << endl;
+
+		GetScene().Unload( file );
+	}
+
+	GetOptions().m_CompactVertices = wasCompact;
+}
+
+
+void HeadlessRenderer::SaveImage( const string & fileName ) const
+{
+	vector< uint8_t > pixels;
+	ReadPixels( pixels );
+
+	// The GL's origin is the bottom left, whereas images start at the top.
+	Magick::Image image( m_Width, m_Height, "RGBA", Magick::CharPixel, pixels.data() );
+	image.flip();
+	image.write( fileName );
+}
+
+
+void HeadlessRenderer::ReadPixels( vector< uint8_t > & pixels ) const
+{
+	pixels.resize( m_Width * m_Height * 4 );
+
+	glBindFramebuffer( GL_READ_FRAMEBUFFER, m_FramebufferId );
+	glReadBuffer( GL_COLOR_ATTACHMENT0 );
+	glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+	glReadPixels( 0, 0, m_Width, m_Height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data() );
+	glBindFramebuffer( GL_READ_FRAMEBUFFER, 0 );
+}
@@ -0,0 +1,83 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Renders a scene without a window, into a framebuffer object, so that frames
+// can be written to image files and timed from the command line. Owns the GL
+// context and the scene singleton for as long as it exists, so there must be
+// only one of these and it can't be mixed with the windowed application.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+
+#include "OffscreenContext.hpp"
+
+
+class Viewport;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// HeadlessRenderer class
+///////////////////////////////////////////////////////////////////////////////
+class HeadlessRenderer
+{
+public:
+	// Creates the GL context, the scene and a viewport of the given size in
+	// pixels.
+							HeadlessRenderer( const GLint width, const GLint height );
+							~HeadlessRenderer();
+
+	// Loads a scene and waits until it is completely loaded, textures and all.
+	// Returns the time taken in milliseconds.
+	long					LoadScene( const string & fileName );
+
+	// Renders a single frame and returns how long it took in microseconds.
+	// Viewport::Render waits for the GL to finish, so this is the time to get
+	// the frame completely rendered rather than just the time to submit it.
+	int64_t					RenderFrame();
+
+	// Loads a scene once with float vertex streams and once with compact
+	// vertices (see Mesh.hpp), rendering numFrames frames each time, and logs
+	// the size of the vertex data fetched per frame and the average frame
+	// time for each. The scene is unloaded again afterwards.
+	void					BenchmarkVertexFormats( const string & fileName, const long numFrames );
+
+	// Writes the most recently rendered frame to an image file. The format is
+	// taken from the extension.
+	void					SaveImage( const string & fileName ) const;
+
+	// Reads the most recently rendered frame back as RGBA, bottom row first.
+	void					ReadPixels( vector< uint8_t > & pixels ) const;
+
+	Viewport &				GetViewport()							{ return * m_pViewport; }
+
+private:
+	// Revoked.
+							HeadlessRenderer( const HeadlessRenderer & copy );
+	HeadlessRenderer &		operator = ( const HeadlessRenderer & copy );
+
+	// Must be declared first so it is created before, and destroyed after,
+	// everything that uses the GL.
+	OffscreenContext		m_Context;
+
+	const GLint				m_Width;
+	const GLint				m_Height;
+
+	// The framebuffer that the viewport's final image is rendered into.
+	GLuint					m_FramebufferId;
+	GLuint					m_ColourRenderBufferId;
+
+	unique_ptr< Viewport >	m_pViewport;
+};
@@ -0,0 +1,607 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Precomp.hpp"
+#include "Common.hpp"
+
+#include "InstanceBvh.hpp"
+
+#include "Camera.hpp"
+#include "ThreadPool.hpp"
+#include "FrustumCulling.hpp"
+
+
+namespace
+{
+	// Leaves are always made at this size or below, and at up to
+	// MaxLeafInstances if the surface area heuristic says splitting isn't
+	// worth it.
+	const uint32_t MinLeafInstances = 4;
+	const uint32_t MaxLeafInstances = 16;
+
+	// Candidate split planes per axis.
+	const int NumBins = 16;
+
+	// Cost of visiting a node, relative to testing an instance's box.
+	const float TraversalCost = 1.0f;
+
+	// Nodes with at least this many instances are handed out to other
+	// threads while building.
+	const uint32_t ParallelGrain = 4096;
+
+
+	float GetSurfaceArea( const AlignedBox3f & box )
+	{
+		if( box.isEmpty() )
+			return 0.0f;
+
+		const Vector3f sizes = box.sizes();
+		return 2.0f * ( sizes.x() * sizes.y() + sizes.y() * sizes.z() + sizes.z() * sizes.x() );
+	}
+
+
+	// Returns true if the ray enters the box within maxDistance, and how far
+	// along it does. Rays parallel to a slab produce NaNs, which min and max
+	// ignore as they are the second argument.
+	bool IntersectRay( const Vector3f & boxMin, const Vector3f & boxMax, const Vector3f & origin, const Vector3f & inverseDirection, const float maxDistance, float & entry )
+	{
+		float nearDistance = 0.0f;
+		float farDistance = maxDistance;
+
+		for( int axis = 0; axis < 3; ++axis )
+		{
+			float distance0 = ( boxMin[ axis ] - origin[ axis ] ) * inverseDirection[ axis ];
+			float distance1 = ( boxMax[ axis ] - origin[ axis ] ) * inverseDirection[ axis ];
+
+			if( distance0 > distance1 )
+				swap( distance0, distance1 );
+
+			nearDistance = max( nearDistance, distance0 );
+			farDistance = min( farDistance, distance1 );
+		}
+
+		entry = nearDistance;
+		return nearDistance <= farDistance;
+	}
+
+
+	float GetSquaredDistance( const Vector3f & point, const Vector3f & boxCentre, const Vector3f & boxExtent )
+	{
+		return ( ( point - boxCentre ).cwiseAbs() - boxExtent ).cwiseMax( 0.0f ).squaredNorm();
+	}
+
+
+	bool IsNearer( const InstanceBvh::RayHit & first, const InstanceBvh::RayHit & second )
+	{
+		return first.m_Distance < second.m_Distance;
+	}
+}
+
+
+// Shared by the threads building a tree. Helpers that start after the build
+// has finished find no jobs and return straight away, so only the context has
+// to outlive the build, not the tree.
+struct InstanceBvh::BuildContext
+{
+	const TransformHierarchy::InstanceBounds *	m_pBounds;
+	Node *										m_pNodes;
+	uint32_t *									m_pInstanceIndices;
+	std::atomic< uint32_t >						m_NumNodes;
+
+	std::mutex									m_Mutex;
+	std::condition_variable						m_Changed;
+	deque< BuildJob >							m_Jobs;
+	size_t										m_NumRunning;
+};
+
+
+InstanceBvh::InstanceBvh()
+{}
+
+
+void InstanceBvh::Build( const TransformHierarchy::InstanceBounds & bounds, const size_t numInstances, ThreadPool & threadPool )
+{
+	m_Nodes.clear();
+	m_InstanceIndices.resize( numInstances );
+
+	for( size_t instanceIndex = 0; instanceIndex < numInstances; ++instanceIndex )
+		m_InstanceIndices[ instanceIndex ] = static_cast< uint32_t >( instanceIndex );
+
+	if( numInstances == 0 )
+		return;
+
+	// A binary tree with at least one instance per leaf can't have more
+	// nodes than this.
+	m_Nodes.resize( 2 * numInstances - 1 );
+
+	const std::shared_ptr< BuildContext > pContext = std::make_shared< BuildContext >();
+	pContext->m_pBounds = & bounds;
+	pContext->m_pNodes = m_Nodes.data();
+	pContext->m_pInstanceIndices = m_InstanceIndices.data();
+	pContext->m_NumNodes = 1;
+	pContext->m_NumRunning = 0;
+
+	BuildJob rootJob;
+	rootJob.m_NodeIndex = 0;
+	rootJob.m_FirstInstance = 0;
+	rootJob.m_NumInstances = static_cast< uint32_t >( numInstances );
+	pContext->m_Jobs.push_back( rootJob );
+
+	// Small trees are quicker to build than to wake the workers for.
+	if( numInstances >= 2 * ParallelGrain )
+	{
+		for( size_t threadIndex = 0; threadIndex < threadPool.GetNumThreads(); ++threadIndex )
+			threadPool.Submit( [ pContext ] () { RunBuildJobs( pContext ); } );
+	}
+
+	RunBuildJobs( pContext );
+
+	m_Nodes.resize( pContext->m_NumNodes );
+}
+
+
+void InstanceBvh::RunBuildJobs( const std::shared_ptr< BuildContext > & pContext )
+{
+	BuildContext & context = * pContext;
+	std::unique_lock< std::mutex > lock( context.m_Mutex );
+
+	for( ;; )
+	{
+		if( ! context.m_Jobs.empty() )
+		{
+			const BuildJob job = context.m_Jobs.front();
+			context.m_Jobs.pop_front();
+			++context.m_NumRunning;
+
+			lock.unlock();
+			BuildNode( context, job );
+			lock.lock();
+
+			if( --context.m_NumRunning == 0 && context.m_Jobs.empty() )
+				context.m_Changed.notify_all();
+		}
+		else if( context.m_NumRunning == 0 )
+			return;
+		else context.m_Changed.wait( lock );
+	}
+}
+
+
+void InstanceBvh::BuildNode( BuildContext & context, const BuildJob & job )
+{
+	const TransformHierarchy::InstanceBounds & bounds = * context.m_pBounds;
+	vector< BuildJob > jobs( 1, job );
+
+	while( ! jobs.empty() )
+	{
+		const BuildJob current = jobs.back();
+		jobs.pop_back();
+
+		uint32_t * const pIndices = context.m_pInstanceIndices + current.m_FirstInstance;
+		Node & node = context.m_pNodes[ current.m_NodeIndex ];
+
+		// The node is bounded by the boxes, but split by their centres.
+		AlignedBox3f nodeBox;
+		AlignedBox3f centreBox;
+
+		for( uint32_t index = 0; index < current.m_NumInstances; ++index )
+		{
+			const uint32_t instanceIndex = pIndices[ index ];
+			const Vector3f centre( bounds.m_Centres[0][ instanceIndex ], bounds.m_Centres[1][ instanceIndex ], bounds.m_Centres[2][ instanceIndex ] );
+			const Vector3f extent( bounds.m_Extents[0][ instanceIndex ], bounds.m_Extents[1][ instanceIndex ], bounds.m_Extents[2][ instanceIndex ] );
+
+			nodeBox.extend( centre - extent );
+			nodeBox.extend( centre + extent );
+			centreBox.extend( centre );
+		}
+
+		copy( nodeBox.min().data(), nodeBox.min().data() + 3, node.m_Min );
+		copy( nodeBox.max().data(), nodeBox.max().data() + 3, node.m_Max );
+
+		node.m_First = current.m_FirstInstance;
+		node.m_NumInstances = current.m_NumInstances;
+
+		if( current.m_NumInstances <= MinLeafInstances )
+			continue;
+
+		// Bin the centres along every axis at once, then sweep each axis's
+		// bins from both ends to find the cheapest split.
+		const Vector3f centreMin = centreBox.min();
+		const Vector3f centreRange = centreBox.sizes();
+		const Vector3f binScale = ( centreRange.array() > 0.0f ).select( NumBins * centreRange.cwiseInverse(), Vector3f::Zero() );
+
+		AlignedBox3f binBoxes[3][ NumBins ];
+		uint32_t binCounts[3][ NumBins ] = {};
+
+		for( uint32_t index = 0; index < current.m_NumInstances; ++index )
+		{
+			const uint32_t instanceIndex = pIndices[ index ];
+			const Vector3f centre( bounds.m_Centres[0][ instanceIndex ], bounds.m_Centres[1][ instanceIndex ], bounds.m_Centres[2][ instanceIndex ] );
+			const Vector3f extent( bounds.m_Extents[0][ instanceIndex ], bounds.m_Extents[1][ instanceIndex ], bounds.m_Extents[2][ instanceIndex ] );
+			const AlignedBox3f box( centre - extent, centre + extent );
+
+			for( int axis = 0; axis < 3; ++axis )
+			{
+				const int bin = min( static_cast< int >( ( centre[ axis ] - centreMin[ axis ] ) * binScale[ axis ] ), NumBins - 1 );
+				binBoxes[ axis ][ bin ].extend( box );
+				++binCounts[ axis ][ bin ];
+			}
+		}
+
+		int bestAxis = -1;
+		int bestSplit = 0;
+		float bestCost = numeric_limits< float >::max();
+
+		for( int axis = 0; axis < 3; ++axis )
+		{
+			if( centreRange[ axis ] <= 0.0f )
+				continue;
+
+			// Cost of putting bins up to and including each one on the left.
+			float leftCosts[ NumBins - 1 ];
+			AlignedBox3f leftBox;
+			uint32_t leftCount = 0;
+
+			for( int bin = 0; bin < NumBins - 1; ++bin )
+			{
+				leftBox.extend( binBoxes[ axis ][ bin ] );
+				leftCount += binCounts[ axis ][ bin ];
+				leftCosts[ bin ] = leftCount * GetSurfaceArea( leftBox );
+			}
+
+			AlignedBox3f rightBox;
+			uint32_t rightCount = 0;
+
+			for( int bin = NumBins - 1; bin > 0; --bin )
+			{
+				rightBox.extend( binBoxes[ axis ][ bin ] );
+				rightCount += binCounts[ axis ][ bin ];
+
+				const float cost = leftCosts[ bin - 1 ] + rightCount * GetSurfaceArea( rightBox );
+
+				if( cost < bestCost && rightCount > 0 && rightCount < current.m_NumInstances )
+				{
+					bestAxis = axis;
+					bestSplit = bin;
+					bestCost = cost;
+				}
+			}
+		}
+
+		const float nodeArea = GetSurfaceArea( nodeBox );
+
+		if( current.m_NumInstances <= MaxLeafInstances && current.m_NumInstances * nodeArea <= TraversalCost * nodeArea + bestCost )
+			continue;
+
+		// Instances whose centres all coincide can't be binned, so they are
+		// split in half instead.
+		uint32_t numLeft = current.m_NumInstances / 2;
+
+		if( bestAxis >= 0 )
+		{
+			const TransformHierarchy::FloatArray & centres = bounds.m_Centres[ bestAxis ];
+			const float axisMin = centreMin[ bestAxis ];
+			const float axisScale = binScale[ bestAxis ];
+
+			numLeft = static_cast< uint32_t >( partition( pIndices, pIndices + current.m_NumInstances, [ & ] ( const uint32_t instanceIndex )
+			{
+				return min( static_cast< int >( ( centres[ instanceIndex ] - axisMin ) * axisScale ), NumBins - 1 ) < bestSplit;
+			} ) - pIndices );
+		}
+
+		const uint32_t firstChild = context.m_NumNodes.fetch_add( 2 );
+		node.m_First = firstChild;
+		node.m_NumInstances = 0;
+
+		BuildJob children[2];
+		children[0].m_NodeIndex = firstChild;
+		children[0].m_FirstInstance = current.m_FirstInstance;
+		children[0].m_NumInstances = numLeft;
+		children[1].m_NodeIndex = firstChild + 1;
+		children[1].m_FirstInstance = current.m_FirstInstance + numLeft;
+		children[1].m_NumInstances = current.m_NumInstances - numLeft;
+
+		for( int childIndex = 0; childIndex < 2; ++childIndex )
+		{
+			if( children[ childIndex ].m_NumInstances >= ParallelGrain )
+			{
+				{
+					std::lock_guard< std::mutex > lock( context.m_Mutex );
+					context.m_Jobs.push_back( children[ childIndex ] );
+				}
+
+				context.m_Changed.notify_one();
+			}
+			else jobs.push_back( children[ childIndex ] );
+		}
+	}
+}
+
+
+void InstanceBvh::Refit( const TransformHierarchy::InstanceBounds & bounds )
+{
+	// Children always come after their parents, so working backwards reaches
+	// every child before its parent.
+	for( auto pNode = m_Nodes.rbegin(); pNode != m_Nodes.rend(); ++pNode )
+		RefitNode( bounds, * pNode );
+}
+
+
+void InstanceBvh::RefitNode( const TransformHierarchy::InstanceBounds & bounds, Node & node ) const
+{
+	AlignedBox3f box;
+
+	if( node.m_NumInstances == 0 )
+	{
+		for( uint32_t childIndex = node.m_First; childIndex < node.m_First + 2; ++childIndex )
+		{
+			const Node & child = m_Nodes[ childIndex ];
+			box.extend( AlignedBox3f( Vector3f( child.m_Min[0], child.m_Min[1], child.m_Min[2] ), Vector3f( child.m_Max[0], child.m_Max[1], child.m_Max[2] ) ) );
+		}
+	}
+	else
+	{
+		for( uint32_t index = node.m_First; index < node.m_First + node.m_NumInstances; ++index )
+		{
+			const uint32_t instanceIndex = m_InstanceIndices[ index ];
+			const Vector3f centre( bounds.m_Centres[0][ instanceIndex ], bounds.m_Centres[1][ instanceIndex ], bounds.m_Centres[2][ instanceIndex ] );
+			const Vector3f extent( bounds.m_Extents[0][ instanceIndex ], bounds.m_Extents[1][ instanceIndex ], bounds.m_Extents[2][ instanceIndex ] );
+
+			box.extend( centre - extent );
+			box.extend( centre + extent );
+		}
+	}
+
+	copy( box.min().data(), box.min().data() + 3, node.m_Min );
+	copy( box.max().data(), box.max().data() + 3, node.m_Max );
+}
+
+
+void InstanceBvh::QueryFrustum( const TransformHierarchy::InstanceBounds & bounds, const FrustumCulling & frustum, vector< uint32_t > & instances ) const
+{
+	if( m_Nodes.empty() )
+		return;
+
+	vector< uint32_t > nodeStack( 1, 0 );
+
+	while( ! nodeStack.empty() )
+	{
+		const Node & node = m_Nodes[ nodeStack.back() ];
+		nodeStack.pop_back();
+
+		const Vector3f nodeMin( node.m_Min[0], node.m_Min[1], node.m_Min[2] );
+		const Vector3f nodeMax( node.m_Max[0], node.m_Max[1], node.m_Max[2] );
+
+		if( ! frustum.IsBoxVisible( 0.5f * ( nodeMin + nodeMax ), 0.5f * ( nodeMax - nodeMin ) ) )
+			continue;
+
+		if( node.m_NumInstances == 0 )
+		{
+			nodeStack.push_back( node.m_First );
+			nodeStack.push_back( node.m_First + 1 );
+			continue;
+		}
+
+		for( uint32_t index = node.m_First; index < node.m_First + node.m_NumInstances; ++index )
+		{
+			const uint32_t instanceIndex = m_InstanceIndices[ index ];
+			const Vector3f centre( bounds.m_Centres[0][ instanceIndex ], bounds.m_Centres[1][ instanceIndex ], bounds.m_Centres[2][ instanceIndex ] );
+			const Vector3f extent( bounds.m_Extents[0][ instanceIndex ], bounds.m_Extents[1][ instanceIndex ], bounds.m_Extents[2][ instanceIndex ] );
+
+			if( frustum.IsBoxVisible( centre, extent ) )
+				instances.push_back( instanceIndex );
+		}
+	}
+}
+
+
+void InstanceBvh::QuerySphere( const TransformHierarchy::InstanceBounds & bounds, const Vector3f & centre, const float radius, vector< uint32_t > & instances ) const
+{
+	if( m_Nodes.empty() )
+		return;
+
+	const float squaredRadius = radius * radius;
+	vector< uint32_t > nodeStack( 1, 0 );
+
+	while( ! nodeStack.empty() )
+	{
+		const Node & node = m_Nodes[ nodeStack.back() ];
+		nodeStack.pop_back();
+
+		const Vector3f nodeMin( node.m_Min[0], node.m_Min[1], node.m_Min[2] );
+		const Vector3f nodeMax( node.m_Max[0], node.m_Max[1], node.m_Max[2] );
+
+		if( GetSquaredDistance( centre, 0.5f * ( nodeMin + nodeMax ), 0.5f * ( nodeMax - nodeMin ) ) > squaredRadius )
+			continue;
+
+		if( node.m_NumInstances == 0 )
+		{
+			nodeStack.push_back( node.m_First );
+			nodeStack.push_back( node.m_First + 1 );
+			continue;
+		}
+
+		for( uint32_t index = node.m_First; index < node.m_First + node.m_NumInstances; ++index )
+		{
+			const uint32_t instanceIndex = m_InstanceIndices[ index ];
+			const Vector3f boxCentre( bounds.m_Centres[0][ instanceIndex ], bounds.m_Centres[1][ instanceIndex ], bounds.m_Centres[2][ instanceIndex ] );
+			const Vector3f boxExtent( bounds.m_Extents[0][ instanceIndex ], bounds.m_Extents[1][ instanceIndex ], bounds.m_Extents[2][ instanceIndex ] );
+
+			if( GetSquaredDistance( centre, boxCentre, boxExtent ) <= squaredRadius )
+				instances.push_back( instanceIndex );
+		}
+	}
+}
+
+
+void InstanceBvh::QueryRay( const TransformHierarchy::InstanceBounds & bounds, const Vector3f & origin, const Vector3f & direction, const float maxDistance, vector< RayHit > & hits ) const
+{
+	if( m_Nodes.empty() )
+		return;
+
+	const Vector3f inverseDirection = direction.cwiseInverse();
+	const size_t firstHit = hits.size();
+	vector< uint32_t > nodeStack( 1, 0 );
+	float entry;
+
+	while( ! nodeStack.empty() )
+	{
+		const Node & node = m_Nodes[ nodeStack.back() ];
+		nodeStack.pop_back();
+
+		if( ! IntersectRay( Vector3f( node.m_Min[0], node.m_Min[1], node.m_Min[2] ), Vector3f( node.m_Max[0], node.m_Max[1], node.m_Max[2] ), origin, inverseDirection, maxDistance, entry ) )
+			continue;
+
+		if( node.m_NumInstances == 0 )
+		{
+			nodeStack.push_back( node.m_First );
+			nodeStack.push_back( node.m_First + 1 );
+			continue;
+		}
+
+		for( uint32_t index = node.m_First; index < node.m_First + node.m_NumInstances; ++index )
+		{
+			const uint32_t instanceIndex = m_InstanceIndices[ index ];
+			const Vector3f centre( bounds.m_Centres[0][ instanceIndex ], bounds.m_Centres[1][ instanceIndex ], bounds.m_Centres[2][ instanceIndex ] );
+			const Vector3f extent( bounds.m_Extents[0][ instanceIndex ], bounds.m_Extents[1][ instanceIndex ], bounds.m_Extents[2][ instanceIndex ] );
+
+			if( IntersectRay( centre - extent, centre + extent, origin, inverseDirection, maxDistance, entry ) )
+			{
+				RayHit hit;
+				hit.m_InstanceIndex = instanceIndex;
+				hit.m_Distance = entry;
+				hits.push_back( hit );
+			}
+		}
+	}
+
+	sort( hits.begin() + firstHit, hits.end(), & IsNearer );
+}
+
+
+size_t InstanceBvh::GetMemoryUsage() const
+{
+	return m_Nodes.capacity() * sizeof( Node ) + m_InstanceIndices.capacity() * sizeof( uint32_t );
+}
+
+
+void InstanceBvh::Benchmark( ThreadPool & threadPool, const size_t numInstances )
+{
+	// Boxes of all sizes scattered through a cube, then nudged about to time
+	// refitting. Each step is run several times and the best time is reported
+	// to reduce noise.
+	const int numRuns = 3;
+	const float sceneSize = 1000.0f;
+
+	std::mt19937 random( 1 );
+	std::uniform_real_distribution< float > positions( -sceneSize, sceneSize );
+	std::uniform_real_distribution< float > extents( 0.1f, 10.0f );
+	std::uniform_real_distribution< float > nudges( -1.0f, 1.0f );
+	std::uniform_real_distribution< float > angles( -pi< float >(), pi< float >() );
+
+	TransformHierarchy::InstanceBounds bounds;
+	const size_t paddedSize = ( numInstances + 3 ) & ~3;
+
+	for( int axis = 0; axis < 3; ++axis )
+	{
+		bounds.m_Centres[ axis ].resize( paddedSize );
+		bounds.m_Extents[ axis ].resize( paddedSize );
+
+		for( size_t instanceIndex = 0; instanceIndex < numInstances; ++instanceIndex )
+		{
+			bounds.m_Centres[ axis ][ instanceIndex ] = positions( random );
+			bounds.m_Extents[ axis ][ instanceIndex ] = extents( random );
+		}
+	}
+
+	InstanceBvh bvh;
+	int64_t buildTime = numeric_limits< int64_t >::max();
+	int64_t refitTime = numeric_limits< int64_t >::max();
+
+	for( int runIndex = 0; runIndex < numRuns; ++runIndex )
+	{
+		wxStopWatch buildWatch;
+		bvh.Build( bounds, numInstances, threadPool );
+		buildTime = min< int64_t >( buildTime, buildWatch.TimeInMicro().GetValue() );
+	}
+
+	for( int runIndex = 0; runIndex < numRuns; ++runIndex )
+	{
+		for( int axis = 0; axis < 3; ++axis )
+		{
+			for( size_t instanceIndex = 0; instanceIndex < numInstances; ++instanceIndex )
+				bounds.m_Centres[ axis ][ instanceIndex ] += nudges( random );
+		}
+
+		wxStopWatch refitWatch;
+		bvh.Refit( bounds );
+		refitTime = min< int64_t >( refitTime, refitWatch.TimeInMicro().GetValue() );
+	}
+
+	// Queries of about the size that lights and picking would use, and views
+	// from random places, all against the refitted tree.
+	const int numQueries = 1000;
+	vector< uint32_t > instances;
+	vector< RayHit > hits;
+	size_t numFrustumResults = 0;
+	size_t numSphereResults = 0;
+	size_t numRayResults = 0;
+
+	Camera camera;
+	wxStopWatch frustumWatch;
+
+	for( int queryIndex = 0; queryIndex < numQueries; ++queryIndex )
+	{
+		camera.Place( Vector3f( positions( random ), positions( random ), positions( random ) ), angles( random ), 0.0f );
+
+		instances.clear();
+		bvh.QueryFrustum( bounds, FrustumCulling( camera.ProjectionMatrix().matrix() * camera.ViewMatrix().matrix() ), instances );
+		numFrustumResults += instances.size();
+	}
+
+	const int64_t frustumTime = frustumWatch.TimeInMicro().GetValue();
+	wxStopWatch sphereWatch;
+
+	for( int queryIndex = 0; queryIndex < numQueries; ++queryIndex )
+	{
+		instances.clear();
+		bvh.QuerySphere( bounds, Vector3f( positions( random ), positions( random ), positions( random ) ), 50.0f, instances );
+		numSphereResults += instances.size();
+	}
+
+	const int64_t sphereTime = sphereWatch.TimeInMicro().GetValue();
+	wxStopWatch rayWatch;
+
+	for( int queryIndex = 0; queryIndex < numQueries; ++queryIndex )
+	{
+		const Vector3f origin( positions( random ), positions( random ), positions( random ) );
+		const Vector3f target( positions( random ), positions( random ), positions( random ) );
+
+		hits.clear();
+		bvh.QueryRay( bounds, origin, target - origin, 1.0f, hits );
+		numRayResults += hits.size();
+	}
+
+	const int64_t rayTime = rayWatch.TimeInMicro().GetValue();
+
+	clog << "BVH benchmark over " << numInstances << " random boxes (" << threadPool.GetNumThreads() + 1 << " threads)" << endl;
+	clog << fixed << setprecision( 2 );
+	clog << "  Build:   " << buildTime / 1000.0 << "ms, " << bvh.GetNumNodes() << " nodes" << endl;
+	clog << "  Refit:   " << refitTime / 1000.0 << "ms" << endl;
+	clog << "  Frustum: " << numQueries * 1e6 / max< int64_t >( frustumTime, 1 ) << " queries/s, " << numFrustumResults / numQueries << " instances each" << endl;
+	clog << "  Sphere:  " << numQueries * 1e6 / max< int64_t >( sphereTime, 1 ) << " queries/s, " << numSphereResults / numQueries << " instances each" << endl;
+	clog << "  Ray:     " << numQueries * 1e6 / max< int64_t >( rayTime, 1 ) << " queries/s, " << numRayResults / numQueries << " instances each" << endl;
+}
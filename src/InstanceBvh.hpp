@@ -0,0 +1,118 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// A bounding volume hierarchy over the world space bounds of the scene's mesh
+// instances (see TransformHierarchy), for finding the instances in a frustum,
+// a sphere or along a ray without testing every one of them.
+//
+// The tree is built top down, splitting each node where the surface area
+// heuristic says is cheapest, with the candidate splits binned along each
+// axis. Large nodes are handed out to the scene's worker threads as they are
+// split; the calling thread works on them too, so the build still finishes if
+// the workers are busy loading. When instances move, Refit updates the node
+// bounds without changing the tree, which is much cheaper than rebuilding it
+// but makes the tree less efficient the further things move.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+
+#include "TransformHierarchy.hpp"
+
+
+class ThreadPool;
+class FrustumCulling;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// InstanceBvh class
+///////////////////////////////////////////////////////////////////////////////
+class InstanceBvh
+{
+public:
+	// An instance whose bounds a ray hit, and how far along the ray it was
+	// entered.
+	struct RayHit
+	{
+		uint32_t					m_InstanceIndex;
+		float						m_Distance;
+	};
+
+									InstanceBvh();
+
+	// Builds the tree over the first numInstances boxes.
+	void							Build( const TransformHierarchy::InstanceBounds & bounds, const size_t numInstances, ThreadPool & threadPool );
+
+	// Updates the node bounds from the boxes, which must be the same boxes
+	// that the tree was built from, moved.
+	void							Refit( const TransformHierarchy::InstanceBounds & bounds );
+
+	// Each query appends the indices of the instances whose boxes overlap the
+	// volume. The boxes must be the ones the tree was last built or refitted
+	// with. They are tested themselves, not just the nodes, but a box that
+	// overlaps the frustum may still be outside it (see FrustumCulling).
+	void							QueryFrustum( const TransformHierarchy::InstanceBounds & bounds, const FrustumCulling & frustum, vector< uint32_t > & instances ) const;
+	void							QuerySphere( const TransformHierarchy::InstanceBounds & bounds, const Vector3f & centre, const float radius, vector< uint32_t > & instances ) const;
+
+	// Appends the instances whose boxes the ray enters within maxDistance,
+	// nearest first. The direction doesn't need to be normalised; distances
+	// are in multiples of it.
+	void							QueryRay( const TransformHierarchy::InstanceBounds & bounds, const Vector3f & origin, const Vector3f & direction, const float maxDistance, vector< RayHit > & hits ) const;
+
+	size_t							GetNumNodes() const			{ return m_Nodes.size(); }
+	size_t							GetMemoryUsage() const;
+
+	// Times building, refitting and querying a tree over numInstances random
+	// boxes and logs the results.
+	static void						Benchmark( ThreadPool & threadPool, const size_t numInstances );
+
+private:
+	// Inner nodes have no instances of their own, and their children are
+	// next to each other, after them. Leaves hold a range of
+	// m_InstanceIndices.
+	struct Node
+	{
+		float						m_Min[3];
+		uint32_t					m_First;			// First child, or first instance index of a leaf.
+		float						m_Max[3];
+		uint32_t					m_NumInstances;		// Zero for inner nodes.
+	};
+
+	// Nodes that still have to be split.
+	struct BuildJob
+	{
+		uint32_t					m_NodeIndex;
+		uint32_t					m_FirstInstance;
+		uint32_t					m_NumInstances;
+	};
+
+	struct BuildContext;
+
+	// Revoked.
+									InstanceBvh( const InstanceBvh & copy );
+	InstanceBvh &					operator = ( const InstanceBvh & copy );
+
+	// Runs jobs from the context until there are none left and none running.
+	static void						RunBuildJobs( const std::shared_ptr< BuildContext > & pContext );
+
+	// Splits a node and its descendents, queueing those big enough to be
+	// worth handing to another thread.
+	static void						BuildNode( BuildContext & context, const BuildJob & job );
+
+	void							RefitNode( const TransformHierarchy::InstanceBounds & bounds, Node & node ) const;
+
+	vector< Node >					m_Nodes;
+	vector< uint32_t >				m_InstanceIndices;
+};
@@ -12,8 +12,6 @@
 // WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
 // OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
 // CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
-//
-// TODO: Not used yet, flesh this out.
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "Precomp.hpp"
@@ -21,7 +19,55 @@
 
 #include "Light.hpp"
 
+#include "Scene.hpp"
+#include "SceneNode.hpp"
+#include "ShadowCulling.hpp"
+
+
+namespace
+{
+	// A light's range is where its brightest channel falls to this
+	// intensity, which is too faint to show up in an 8 bit framebuffer.
+	const float MinIntensity = 1.0f / 256.0f;
+
+	// The range of lights that don't fall off with distance, which would
+	// otherwise reach forever.
+	const float MaxRange = 100000.0f;
+}
+
 
-Light::Light( const aiLight & assimpLight )
+Light::Light( const aiLight & assimpLight, const SceneNode * pNode )
+	: m_Name		( assimpLight.mName.C_Str() )
+	, m_Type		( assimpLight.mType )
+	, m_pNode		( pNode )
+	, m_Position	( assimpLight.mPosition.x, assimpLight.mPosition.y, assimpLight.mPosition.z )
+	, m_Colour		( assimpLight.mColorDiffuse.r, assimpLight.mColorDiffuse.g, assimpLight.mColorDiffuse.b )
+	, m_Attenuation	( assimpLight.mAttenuationConstant, assimpLight.mAttenuationLinear, assimpLight.mAttenuationQuadratic )
+	, m_Range		( MaxRange )
+	, m_Radius		( ShadowCulling::LightRadius )
 {
+	// Solve c + l * d + q * d^2 = brightness / MinIntensity for d.
+	const float brightness = m_Colour.maxCoeff();
+	const float c = m_Attenuation.x() - brightness / MinIntensity;
+	const float l = m_Attenuation.y();
+	const float q = m_Attenuation.z();
+
+	if( brightness <= 0.0f )
+		m_Range = 0.0f;
+	else if( q > 0.0f )
+		m_Range = ( sqrt( l * l - 4.0f * q * c ) - l ) / ( 2.0f * q );
+	else if( l > 0.0f )
+		m_Range = -c / l;
+
+	m_Range = min( max( m_Range, 0.0f ), MaxRange );
+}
+
+
+Vector3f Light::GetWorldPosition() const
+{
+	if( m_pNode == nullptr )
+		return m_Position;
+
+	const Matrix4f & world = GetScene().m_Transforms.GetWorldTransform( m_pNode->GetHierarchyIndex() );
+	return world.topLeftCorner< 3, 3 >() * m_Position + world.topRightCorner< 3, 1 >();
 }
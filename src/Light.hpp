@@ -13,15 +13,23 @@
 // OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
 // CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 //
-// Represents a light in the scene.
+// A point light imported with a scene. Assimp gives each light's position
+// relative to the node with the same name, so a light follows that node
+// around. Besides its colour and attenuation, each light has a range beyond
+// which it is too faint to matter, which is what LightClusters culls it by,
+// and a radius: the size of the light source itself, which Assimp doesn't
+// import, so every light is given the one the shadows assume (see
+// ShadowCulling::LightRadius).
 //
-// TODO: Not used yet, flesh this out.
+// Spot lights are lit as if they were point lights. Directional lights, and
+// any others that Assimp couldn't work out the type of, are kept but don't
+// light anything (see IsPointLight).
 ///////////////////////////////////////////////////////////////////////////////
 
 #pragma once
 
 
-class Scene;
+class SceneNode;
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -30,5 +38,38 @@ class Scene;
 class Light
 {
 public:
-	Light( const aiLight & assimpLight );
+	// pNode is the node the light is placed relative to, or nullptr if the
+	// light is placed in world space.
+								Light( const aiLight & assimpLight, const SceneNode * pNode );
+
+	bool						IsPointLight() const			{ return m_Type == aiLightSource_POINT || m_Type == aiLightSource_SPOT; }
+
+	// The position of the light in world space, from the world transforms of
+	// the scene's TransformHierarchy as they were last updated.
+	Vector3f					GetWorldPosition() const;
+
+	const string &				GetName() const					{ return m_Name; }
+	const Vector3f &			GetColour() const				{ return m_Colour; }
+
+	// Constant, linear and quadratic attenuation, in that order: the light's
+	// intensity at distance d is 1 / ( x + y * d + z * d^2 ).
+	const Vector3f &			GetAttenuation() const			{ return m_Attenuation; }
+	float						GetRange() const				{ return m_Range; }
+	float						GetRadius() const				{ return m_Radius; }
+
+	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+	// Revoked.
+								Light( const Light & copy );
+	Light &						operator = ( const Light & copy );
+
+	string						m_Name;
+	aiLightSourceType			m_Type;
+	const SceneNode *			m_pNode;
+	Vector3f					m_Position;
+	Vector3f					m_Colour;
+	Vector3f					m_Attenuation;
+	float						m_Range;
+	float						m_Radius;
 };
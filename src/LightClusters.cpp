@@ -0,0 +1,247 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Precomp.hpp"
+#include "Common.hpp"
+
+#include "LightClusters.hpp"
+
+#include "Light.hpp"
+#include "Scene.hpp"
+#include "Camera.hpp"
+
+
+LightClusters::LightClusters()
+	: m_NumTilesX				( 1 )
+	, m_NumTilesY				( 1 )
+	, m_Near					( 1.0f )
+	, m_SliceScale				( 0.0f )
+	, m_NumLightIndices			( 0 )
+	, m_ClustersBufferId		( 0 )
+	, m_ClustersTextureId		( 0 )
+	, m_LightIndicesBufferId	( 0 )
+	, m_LightIndicesTextureId	( 0 )
+	, m_LightsBufferId			( 0 )
+	, m_LightsTextureId			( 0 )
+{}
+
+
+LightClusters::~LightClusters()
+{
+	glDeleteTextures( 1, & m_ClustersTextureId );
+	glDeleteBuffers( 1, & m_ClustersBufferId );
+	glDeleteTextures( 1, & m_LightIndicesTextureId );
+	glDeleteBuffers( 1, & m_LightIndicesBufferId );
+	glDeleteTextures( 1, & m_LightsTextureId );
+	glDeleteBuffers( 1, & m_LightsBufferId );
+}
+
+
+void LightClusters::Build( const Camera & camera, const GLint width, const GLint height )
+{
+	const Affine3f & view = camera.ViewMatrix();
+	const Matrix4f & projection = camera.ProjectionMatrix().matrix();
+
+	m_NumTilesX = max( ( width + TileSize - 1 ) / TileSize, 1 );
+	m_NumTilesY = max( ( height + TileSize - 1 ) / TileSize, 1 );
+
+	// View space depth is positive in front of the camera, and the projection
+	// puts the near plane where ( 2, 2 ) * z + ( 2, 3 ) = -z.
+	m_Near = -projection( 2, 3 ) / ( 1.0f + projection( 2, 2 ) );
+
+	m_Lights.clear();
+	m_Ranges.clear();
+
+	float far = 2.0f * m_Near;
+
+	// Gather the lights in front of the near plane.
+	foreach( const Light & light, GetScene().m_Lights )
+	{
+		if( ! light.IsPointLight() || light.GetRange() <= 0.0f )
+			continue;
+
+		const Vector3f centre = view * light.GetWorldPosition();
+		const float range = light.GetRange();
+
+		if( centre.z() + range <= m_Near )
+			continue;
+
+		ClusterRange clusters;
+		clusters.m_MinX = 0;
+		clusters.m_MaxX = m_NumTilesX - 1;
+		clusters.m_MinY = 0;
+		clusters.m_MaxY = m_NumTilesY - 1;
+
+		// Lights that reach the near plane may cover any of the screen, but the
+		// rest are bounded by the projection of their boxes.
+		if( centre.z() - range > m_Near )
+		{
+			Vector2f minPixel = Vector2f::Constant( numeric_limits< float >::max() );
+			Vector2f maxPixel = -minPixel;
+
+			for( int corner = 0; corner < 8; ++corner )
+			{
+				const Vector4f point( centre.x() + ( corner & 1 ? range : -range ),
+									  centre.y() + ( corner & 2 ? range : -range ),
+									  centre.z() + ( corner & 4 ? range : -range ),
+									  1.0f );
+				const Vector4f clip = projection * point;
+				const Vector2f pixel( ( clip.x() / clip.w() * 0.5f + 0.5f ) * width,
+									  ( clip.y() / clip.w() * 0.5f + 0.5f ) * height );
+
+				minPixel = minPixel.cwiseMin( pixel );
+				maxPixel = maxPixel.cwiseMax( pixel );
+			}
+
+			if( maxPixel.x() < 0.0f || maxPixel.y() < 0.0f || minPixel.x() >= width || minPixel.y() >= height )
+				continue;
+
+			clusters.m_MinX = max( static_cast< int >( minPixel.x() ) / TileSize, 0 );
+			clusters.m_MaxX = min( static_cast< int >( maxPixel.x() ) / TileSize, m_NumTilesX - 1 );
+			clusters.m_MinY = max( static_cast< int >( minPixel.y() ) / TileSize, 0 );
+			clusters.m_MaxY = min( static_cast< int >( maxPixel.y() ) / TileSize, m_NumTilesY - 1 );
+		}
+
+		// The slices aren't known until the furthest light is, so keep the
+		// depths in the meantime.
+		clusters.m_MinSlice = 0;
+		clusters.m_MaxSlice = 0;
+		m_Ranges.push_back( clusters );
+
+		far = max( far, centre.z() + range );
+
+		const Vector3f & colour = light.GetColour();
+		const Vector3f & attenuation = light.GetAttenuation();
+		const float texels[ 4 * TexelsPerLight ] =
+		{
+			centre.x(), centre.y(), centre.z(), range,
+			colour.x(), colour.y(), colour.z(), light.GetRadius(),
+			attenuation.x(), attenuation.y(), attenuation.z(), 0.0f
+		};
+
+		m_Lights.insert( m_Lights.end(), texels, texels + 4 * TexelsPerLight );
+	}
+
+	m_SliceScale = NumSlices / log( far / m_Near );
+
+	const size_t numLights = GetNumLights();
+	const size_t numClusters = m_NumTilesX * m_NumTilesY * NumSlices;
+
+	// Count the lights in each cluster, then give each cluster its offset
+	// and fill them in.
+	m_Clusters.assign( 2 * numClusters, 0 );
+
+	for( size_t lightIndex = 0; lightIndex < numLights; ++lightIndex )
+	{
+		ClusterRange & clusters = m_Ranges[ lightIndex ];
+		const float depth = m_Lights[ 4 * TexelsPerLight * lightIndex + 2 ];
+		const float range = m_Lights[ 4 * TexelsPerLight * lightIndex + 3 ];
+
+		clusters.m_MinSlice = GetSlice( depth - range );
+		clusters.m_MaxSlice = GetSlice( depth + range );
+
+		for( int slice = clusters.m_MinSlice; slice <= clusters.m_MaxSlice; ++slice )
+			for( int y = clusters.m_MinY; y <= clusters.m_MaxY; ++y )
+				for( int x = clusters.m_MinX; x <= clusters.m_MaxX; ++x )
+					++m_Clusters[ 2 * ( ( slice * m_NumTilesY + y ) * m_NumTilesX + x ) + 1 ];
+	}
+
+	uint32_t offset = 0;
+
+	for( size_t clusterIndex = 0; clusterIndex < numClusters; ++clusterIndex )
+	{
+		m_Clusters[ 2 * clusterIndex ] = offset;
+		offset += m_Clusters[ 2 * clusterIndex + 1 ];
+		m_Clusters[ 2 * clusterIndex + 1 ] = 0;
+	}
+
+	m_NumLightIndices = offset;
+	m_LightIndices.resize( m_NumLightIndices );
+
+	for( size_t lightIndex = 0; lightIndex < numLights; ++lightIndex )
+	{
+		const ClusterRange & clusters = m_Ranges[ lightIndex ];
+
+		for( int slice = clusters.m_MinSlice; slice <= clusters.m_MaxSlice; ++slice )
+			for( int y = clusters.m_MinY; y <= clusters.m_MaxY; ++y )
+				for( int x = clusters.m_MinX; x <= clusters.m_MaxX; ++x )
+				{
+					uint32_t * const pCluster = & m_Clusters[ 2 * ( ( slice * m_NumTilesY + y ) * m_NumTilesX + x ) ];
+					m_LightIndices[ pCluster[0] + pCluster[1]++ ] = static_cast< uint32_t >( lightIndex );
+				}
+	}
+
+	Upload( m_ClustersBufferId, m_ClustersTextureId, GL_RG32UI, m_Clusters.data(), m_Clusters.size() * sizeof( uint32_t ) );
+	Upload( m_LightIndicesBufferId, m_LightIndicesTextureId, GL_R32UI, m_LightIndices.data(), m_LightIndices.size() * sizeof( uint32_t ) );
+	Upload( m_LightsBufferId, m_LightsTextureId, GL_RGBA32F, m_Lights.data(), m_Lights.size() * sizeof( float ) );
+}
+
+
+void LightClusters::Bind( const GLuint programId )
+{
+	glActiveTexture( GL_TEXTURE0 + ClustersTextureUnit );
+	glBindTexture( GL_TEXTURE_BUFFER, m_ClustersTextureId );
+	glActiveTexture( GL_TEXTURE0 + LightIndicesTextureUnit );
+	glBindTexture( GL_TEXTURE_BUFFER, m_LightIndicesTextureId );
+	glActiveTexture( GL_TEXTURE0 + LightsTextureUnit );
+	glBindTexture( GL_TEXTURE_BUFFER, m_LightsTextureId );
+	glActiveTexture( GL_TEXTURE0 );
+
+	glUniform3i( glGetUniformLocation( programId, "clusterCounts" ), m_NumTilesX, m_NumTilesY, NumSlices );
+	glUniform1i( glGetUniformLocation( programId, "clusterTileSize" ), TileSize );
+	glUniform2f( glGetUniformLocation( programId, "clusterDepthScale" ), m_Near, m_SliceScale );
+}
+
+
+int LightClusters::GetSlice( const float depth ) const
+{
+	if( depth <= m_Near )
+		return 0;
+
+	return min( static_cast< int >( log( depth / m_Near ) * m_SliceScale ), NumSlices - 1 );
+}
+
+
+void LightClusters::Upload( GLuint & bufferId, GLuint & textureId, const GLenum format, const void * pData, const size_t size )
+{
+	// Buffer textures can't be empty, so nothing is uploaded as a texel of
+	// zeros, which the shader never reads.
+	static const uint32_t zeros[4] = { 0, 0, 0, 0 };
+
+	if( size == 0 )
+		return Upload( bufferId, textureId, format, zeros, sizeof( zeros ) );
+
+	if( bufferId == 0 )
+	{
+		glGenBuffers( 1, & bufferId );
+		glGenTextures( 1, & textureId );
+
+		glBindBuffer( GL_TEXTURE_BUFFER, bufferId );
+		glBufferData( GL_TEXTURE_BUFFER, size, pData, GL_STREAM_DRAW );
+
+		glBindTexture( GL_TEXTURE_BUFFER, textureId );
+		glTexBuffer( GL_TEXTURE_BUFFER, format, bufferId );
+		glBindTexture( GL_TEXTURE_BUFFER, 0 );
+	}
+	else
+	{
+		// Orphaned each frame, as the GL may still be reading the last one's.
+		glBindBuffer( GL_TEXTURE_BUFFER, bufferId );
+		glBufferData( GL_TEXTURE_BUFFER, size, pData, GL_STREAM_DRAW );
+	}
+
+	glBindBuffer( GL_TEXTURE_BUFFER, 0 );
+}
@@ -0,0 +1,123 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Culls the scene's point lights (see Light) into clusters for the lighting
+// pass, so that each pixel is only lit by the lights that can reach it rather
+// than by all of them. The view frustum is split into tiles of TileSize
+// pixels on the screen, and each tile into NumSlices slices of depth, which
+// get exponentially deeper from the near plane out to the furthest that any
+// light reaches, so that clusters are roughly as deep as they are wide.
+//
+// The clusters are rebuilt on the CPU each frame. Each light is added to
+// every cluster that its range's bounding box overlaps on the screen and in
+// depth, which is conservative but cheap. The clusters, the lists of lights
+// in them and the lights themselves are uploaded to buffer textures, which
+// Lighting.FragmentShader.glsl looks them up in by the pixel's position.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+
+class Camera;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// LightClusters class
+///////////////////////////////////////////////////////////////////////////////
+class LightClusters
+{
+public:
+	// The texture units that the clusters, their light indices and the lights
+	// are bound to.
+	static const GLuint			ClustersTextureUnit = 5;
+	static const GLuint			LightIndicesTextureUnit = 6;
+	static const GLuint			LightsTextureUnit = 7;
+
+	static const int			TileSize = 64;
+	static const int			NumSlices = 16;
+
+	// Texels of the lights buffer per light: its view space position and
+	// range, its colour and radius, and its attenuation.
+	static const size_t			TexelsPerLight = 3;
+
+								LightClusters();
+								~LightClusters();
+
+	// Culls the scene's lights into clusters for the camera's view of a
+	// viewport of the given size, and uploads them. The scene's world
+	// transforms have to have been updated (see Camera::Render).
+	void						Build( const Camera & camera, const GLint width, const GLint height );
+
+	// Binds the clusters to their texture units and sets up the rest of the
+	// uniforms that the lighting shader finds them with. The lighting program
+	// has to be current.
+	void						Bind( const GLuint programId );
+
+	// The number of lights in view, and the number of times they were added
+	// to a cluster, in the last Build.
+	size_t						GetNumLights() const			{ return m_Lights.size() / ( 4 * TexelsPerLight ); }
+	size_t						GetNumLightIndices() const		{ return m_NumLightIndices; }
+
+	// The number of clusters, including empty ones.
+	size_t						GetNumClusters() const			{ return m_Clusters.size() / 2; }
+
+private:
+	// Revoked.
+								LightClusters( const LightClusters & copy );
+	LightClusters &				operator = ( const LightClusters & copy );
+
+	// The clusters a light overlaps, as inclusive ranges of tiles and slices.
+	struct ClusterRange
+	{
+		int						m_MinX;
+		int						m_MaxX;
+		int						m_MinY;
+		int						m_MaxY;
+		int						m_MinSlice;
+		int						m_MaxSlice;
+	};
+
+	// The slice that a view space depth is in, clamped to the slices there
+	// are.
+	int							GetSlice( const float depth ) const;
+
+	// Uploads data to a buffer, creating it and its texture on first use.
+	static void					Upload( GLuint & bufferId, GLuint & textureId, const GLenum format, const void * pData, const size_t size );
+
+	int							m_NumTilesX;
+	int							m_NumTilesY;
+
+	// The depth of the near plane, and the number of slices per unit of the
+	// log of depth over it.
+	float						m_Near;
+	float						m_SliceScale;
+
+	// For each cluster, the offset of its first light index and its number
+	// of lights, by slice, then row of tiles from the bottom, then column.
+	vector< uint32_t >			m_Clusters;
+	vector< uint32_t >			m_LightIndices;
+	size_t						m_NumLightIndices;
+
+	// TexelsPerLight * 4 floats per light in view.
+	vector< float >				m_Lights;
+	vector< ClusterRange >		m_Ranges;
+
+	GLuint						m_ClustersBufferId;
+	GLuint						m_ClustersTextureId;
+	GLuint						m_LightIndicesBufferId;
+	GLuint						m_LightIndicesTextureId;
+	GLuint						m_LightsBufferId;
+	GLuint						m_LightsTextureId;
+};
@@ -29,6 +29,63 @@ uniform sampler2DRect normalTexture;
 //		the other way around.
 uniform sampler2DRect shadowTexture;
 
+// How far the shadowed light reaches, or zero if it reaches everywhere. Its
+// shadows aren't drawn beyond that (see Viewport::GetLightBounds), so it has
+// to have faded out by then.
+uniform float lightRange;
+
+// The scene's point lights, culled into clusters (see LightClusters). Each
+// cluster has the offset and count of its lights in lightIndices, and each
+// light is three texels of lights: its view space position and range, its
+// colour and radius, and its attenuation. The clusters are counted in tiles
+// of clusterTileSize pixels across, up and in depth slices, which start at
+// the near plane (clusterDepthScale.x), with clusterDepthScale.y slices per
+// unit of the log of depth over it.
+uniform usamplerBuffer lightClusters;
+uniform usamplerBuffer lightIndices;
+uniform samplerBuffer lights;
+uniform ivec3 clusterCounts;
+uniform int clusterTileSize;
+uniform vec2 clusterDepthScale;
+
+
+// Diffuse lighting from the lights in the fragment's cluster. These don't
+// cast shadows.
+vec3 ClusterLighting( vec3 position, vec3 normal )
+{
+	ivec2 tile = min( ivec2( gl_FragCoord.xy ) / clusterTileSize, clusterCounts.xy - 1 );
+	float depth = max( position.z, clusterDepthScale.x );
+	int slice = min( int( log( depth / clusterDepthScale.x ) * clusterDepthScale.y ), clusterCounts.z - 1 );
+	uvec2 cluster = texelFetch( lightClusters, ( slice * clusterCounts.y + tile.y ) * clusterCounts.x + tile.x ).xy;
+
+	vec3 lighting = vec3( 0.0 );
+
+	for( uint i = 0u; i < cluster.y; ++i )
+	{
+		int lightIndex = 3 * int( texelFetch( lightIndices, int( cluster.x + i ) ).r );
+		vec4 positionAndRange = texelFetch( lights, lightIndex );
+		vec4 colourAndRadius = texelFetch( lights, lightIndex + 1 );
+		vec3 attenuation = texelFetch( lights, lightIndex + 2 ).xyz;
+
+		vec3 toLight = positionAndRange.xyz - position;
+		float distance = length( toLight );
+
+		if( distance >= positionAndRange.w )
+			continue;
+
+		// Distances inside the light source itself are clamped to its radius,
+		// so that surfaces right next to it don't blow out, and the light is
+		// faded out towards its range so that the cut off doesn't show.
+		float d = max( distance, colourAndRadius.w );
+		float fade = 1.0 - distance * distance / ( positionAndRange.w * positionAndRange.w );
+		float intensity = fade * fade / max( attenuation.x + attenuation.y * d + attenuation.z * d * d, 1e-6 );
+
+		lighting += colourAndRadius.rgb * intensity * max( dot( toLight / distance, normal ), 0.0 );
+	}
+
+	return lighting;
+}
+
 
 void main()
 {
@@ -51,6 +108,13 @@ void main()
 	float ambientScalar = 0.1;
 	float diffuseScalar = max( dot( directionToLight, normal ), 0.0 );
 
+	if( lightRange > 0.0 )
+	{
+		float distance = length( gl_LightSource[0].position.xyz - position ) / lightRange;
+		float fade = max( 1.0 - distance * distance, 0.0 );
+		diffuseScalar *= fade * fade;
+	}
+
 	gl_FragColor.rgb = diffuseColour;
-	gl_FragColor.rgb *= ambientScalar + ( 1.0 - ambientScalar ) * shadow * diffuseScalar;
+	gl_FragColor.rgb *= ambientScalar + ( 1.0 - ambientScalar ) * shadow * diffuseScalar + ClusterLighting( position, normal );
 }
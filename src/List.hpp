@@ -23,8 +23,8 @@ class List
 public:
 	class Item;
 
-	typedef typename conditional< std::is_void< ItemTypeParam >::value, Item, ItemTypeParam >::type ItemType;
-	typedef typename conditional< std::is_void< ListTypeParam >::value, List, ListTypeParam >::type ListType;
+	typedef typename std::conditional< std::is_void< ItemTypeParam >::value, Item, ItemTypeParam >::type ItemType;
+	typedef typename std::conditional< std::is_void< ListTypeParam >::value, List, ListTypeParam >::type ListType;
 
 	class Item
 	{
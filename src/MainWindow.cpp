@@ -20,6 +20,7 @@
 #include "MainWindow.hpp"
 
 #include "Scene.hpp"
+#include "Options.hpp"
 #include "GlCanvas.hpp"
 
 
@@ -40,30 +41,63 @@ MainWindow::LogStreambuf::~LogStreambuf()
 MainWindow::LogStreambuf::int_type MainWindow::LogStreambuf::overflow( int_type intChar )
 {
 	const wchar_t characters[2] = { intChar, '\0' };
-	m_LogWindow.AppendText( characters[0] );
-	OutputDebugString( characters );
+	Write( characters );
 	return 0;
 }
 
 
 streamsize MainWindow::LogStreambuf::xsputn( const char * pString, streamsize numChars )
 {
-	const wxString message( pString, numChars );
-	m_LogWindow.AppendText( message );
-	OutputDebugString( message.c_str() );
+	Write( wxString( pString, numChars ) );
 	return numChars;
 }
 
 
+void MainWindow::LogStreambuf::Write( const wxString & message )
+{
+	// Scenes are loaded on worker threads, which log too. Controls can only
+	// be touched from the main thread, so messages from other threads are
+	// added to the log window later on by the main thread.
+	std::lock_guard< std::mutex > lock( m_Mutex );
+
+	if( wxIsMainThread() )
+		m_LogWindow.AppendText( message );
+	else
+	{
+		wxTextCtrl * const pLogWindow = & m_LogWindow;
+		m_LogWindow.CallAfter( [ pLogWindow, message ]() { pLogWindow->AppendText( message ); } );
+	}
+
+	OutputDebugString( message.c_str() );
+}
+
+
 BEGIN_EVENT_TABLE( MainWindow, wxFrame )
 	EVT_MENU( wxID_OPEN, MainWindow::OnOpen )
 	EVT_MENU( wxID_CLOSE, MainWindow::OnClose )
 	EVT_MENU( EventId_ReloadShaders, MainWindow::OnReloadShaders )
+	EVT_MENU( EventId_BenchmarkLoad, MainWindow::OnBenchmarkLoad )
+	EVT_MENU_RANGE( EventId_ImportProfile, EventId_ImportProfileLast, MainWindow::OnImportProfile )
+	EVT_MENU_RANGE( EventId_TriangleOrder, EventId_TriangleOrderLast, MainWindow::OnTriangleOrder )
+	EVT_MENU( EventId_Unload, MainWindow::OnUnload )
+	EVT_MENU( EventId_DumpMemoryUsage, MainWindow::OnDumpMemoryUsage )
+	EVT_MENU( EventId_KeepCpuGeometry, MainWindow::OnKeepCpuGeometry )
+	EVT_MENU( EventId_CompactVertices, MainWindow::OnCompactVertices )
+	EVT_MENU( EventId_SceneBuffers, MainWindow::OnSceneBuffers )
+	EVT_MENU( EventId_UseLods, MainWindow::OnUseLods )
+	EVT_MENU( EventId_SilhouetteShadows, MainWindow::OnSilhouetteShadows )
+	EVT_MENU( EventId_ShadowCulling, MainWindow::OnShadowCulling )
+	EVT_MENU( EventId_FrustumCulling, MainWindow::OnFrustumCulling )
+	EVT_MENU( EventId_Instancing, MainWindow::OnInstancing )
+	EVT_MENU( EventId_OcclusionCulling, MainWindow::OnOcclusionCulling )
+	EVT_MENU( EventId_ShadowVolumeCache, MainWindow::OnShadowVolumeCache )
+	EVT_TIMER( EventId_PropertiesTimer, MainWindow::OnPropertiesTimer )
 END_EVENT_TABLE()
 
 
 MainWindow::MainWindow()
 	: wxFrame( NULL, wxID_ANY, "Soft Shadows", wxDefaultPosition, wxSize( 800, 600 ) )
+	, m_PropertiesTimer( this, EventId_PropertiesTimer )
 {
 	// Make a menubar
 	wxMenuBar * const pMenuBar = new wxMenuBar;
@@ -79,6 +113,45 @@ MainWindow::MainWindow()
 	{
 		wxMenu * const pSceneMenu = new wxMenu;
 		pSceneMenu->Append( EventId_ReloadShaders, wxT( "&Reload Shaders" ) );
+		pSceneMenu->Append( EventId_BenchmarkLoad, wxT( "&Benchmark Load..." ) );
+		pSceneMenu->Append( EventId_Unload, wxT( "&Unload..." ) );
+		pSceneMenu->Append( EventId_DumpMemoryUsage, wxT( "&Dump Memory Usage" ) );
+		pSceneMenu->AppendCheckItem( EventId_KeepCpuGeometry, wxT( "&Keep CPU Geometry" ) );
+		pSceneMenu->Check( EventId_KeepCpuGeometry, GetOptions().m_KeepCpuGeometry );
+		pSceneMenu->AppendCheckItem( EventId_CompactVertices, wxT( "&Compact Vertices" ) );
+		pSceneMenu->Check( EventId_CompactVertices, GetOptions().m_CompactVertices );
+		pSceneMenu->AppendCheckItem( EventId_SceneBuffers, wxT( "Scene &Buffers" ) );
+		pSceneMenu->Check( EventId_SceneBuffers, GetOptions().m_SceneBuffers );
+		pSceneMenu->AppendCheckItem( EventId_UseLods, wxT( "Use &LODs" ) );
+		pSceneMenu->Check( EventId_UseLods, GetOptions().m_UseLods );
+		pSceneMenu->AppendCheckItem( EventId_SilhouetteShadows, wxT( "&Silhouette Shadows" ) );
+		pSceneMenu->Check( EventId_SilhouetteShadows, GetOptions().m_SilhouetteShadows );
+		pSceneMenu->AppendCheckItem( EventId_ShadowCulling, wxT( "Shadow C&ulling" ) );
+		pSceneMenu->Check( EventId_ShadowCulling, GetOptions().m_ShadowCulling );
+		pSceneMenu->AppendCheckItem( EventId_FrustumCulling, wxT( "&Frustum Culling" ) );
+		pSceneMenu->Check( EventId_FrustumCulling, GetOptions().m_FrustumCulling );
+		pSceneMenu->AppendCheckItem( EventId_Instancing, wxT( "I&nstancing" ) );
+		pSceneMenu->Check( EventId_Instancing, GetOptions().m_Instancing );
+		pSceneMenu->AppendCheckItem( EventId_OcclusionCulling, wxT( "&Occlusion Culling" ) );
+		pSceneMenu->Check( EventId_OcclusionCulling, GetOptions().m_OcclusionCulling );
+		pSceneMenu->AppendCheckItem( EventId_ShadowVolumeCache, wxT( "Shadow &Volume Cache" ) );
+		pSceneMenu->Check( EventId_ShadowVolumeCache, GetOptions().m_ShadowVolumeCache );
+
+		wxMenu * const pImportProfileMenu = new wxMenu;
+
+		for( int profileIndex = 0; profileIndex < SceneImporter::NumProfiles; ++profileIndex )
+			pImportProfileMenu->AppendRadioItem( EventId_ImportProfile + profileIndex, SceneImporter::GetProfileLabel( static_cast< SceneImporter::Profile >( profileIndex ) ) );
+
+		pImportProfileMenu->Check( EventId_ImportProfile + GetOptions().m_ImportProfile, true );
+		pSceneMenu->AppendSubMenu( pImportProfileMenu, wxT( "&Import Profile" ) );
+
+		wxMenu * const pTriangleOrderMenu = new wxMenu;
+
+		for( int modeIndex = 0; modeIndex < TriangleOrder::NumModes; ++modeIndex )
+			pTriangleOrderMenu->AppendRadioItem( EventId_TriangleOrder + modeIndex, TriangleOrder::GetModeLabel( static_cast< TriangleOrder::Mode >( modeIndex ) ) );
+
+		pTriangleOrderMenu->Check( EventId_TriangleOrder + GetOptions().m_TriangleOrder, true );
+		pSceneMenu->AppendSubMenu( pTriangleOrderMenu, wxT( "&Triangle Order" ) );
 		pMenuBar->Append( pSceneMenu, wxT( "&Scene" ) );
 	}
 
@@ -91,8 +164,8 @@ MainWindow::MainWindow()
 		objectsPropertiesSplitter.SetSashGravity( 0.5 );
 		{
 			wxNotebook & objectsNotebook = * new wxNotebook( & objectsPropertiesSplitter, wxID_ANY );
-			wxPropertyGrid & propertyGrid = * new wxPropertyGrid( & objectsPropertiesSplitter );
-			objectsPropertiesSplitter.SplitHorizontally( & objectsNotebook, & propertyGrid, GetClientSize().y / 2 );
+			m_pPropertyGrid = new wxPropertyGrid( & objectsPropertiesSplitter );
+			objectsPropertiesSplitter.SplitHorizontally( & objectsNotebook, m_pPropertyGrid, GetClientSize().y / 2 );
 		}
 
 		wxSplitterWindow & canvasLogSplitter = * new wxSplitterWindow( & mainSplitter, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxSP_LIVE_UPDATE );
@@ -119,7 +192,12 @@ void MainWindow::OnOpen( wxCommandEvent & event )
 	if( ! fileName.IsEmpty() )
 	{
 		GetScene().LoadFromFile( fileName.ToStdString() );
-		m_pGlCanvas->Refresh();
+		m_pGlCanvas->StartUpdating();
+
+		// The scene is added progressively, so keep the memory usage up to
+		// date until it's done.
+		UpdateMemoryProperties();
+		m_PropertiesTimer.Start( 1000 );
 	}
 }
 
@@ -135,3 +213,177 @@ void MainWindow::OnReloadShaders( wxCommandEvent & event )
 	GetScene().ReloadShaders();
 	m_pGlCanvas->Refresh();
 }
+
+
+void MainWindow::OnBenchmarkLoad( wxCommandEvent & event )
+{
+	const wxString fileName = wxFileSelector( "Benchmark Scene Load", wxEmptyString, wxEmptyString, wxEmptyString, "*.*", wxFD_OPEN | wxFD_FILE_MUST_EXIST );
+
+	if( ! fileName.IsEmpty() )
+		GetScene().BenchmarkLoad( fileName.ToStdString() );
+}
+
+
+void MainWindow::OnImportProfile( wxCommandEvent & event )
+{
+	// Only affects scenes loaded from now on.
+	GetOptions().m_ImportProfile = static_cast< SceneImporter::Profile >( event.GetId() - EventId_ImportProfile );
+}
+
+
+void MainWindow::OnTriangleOrder( wxCommandEvent & event )
+{
+	// Only affects scenes loaded from now on.
+	GetOptions().m_TriangleOrder = static_cast< TriangleOrder::Mode >( event.GetId() - EventId_TriangleOrder );
+}
+
+
+void MainWindow::OnUnload( wxCommandEvent & event )
+{
+	wxArrayString fileNames;
+
+	foreach( const SceneFile & file, GetScene().m_Files )
+		fileNames.Add( file.m_FileName );
+
+	if( fileNames.IsEmpty() )
+		return;
+
+	const int fileIndex = wxGetSingleChoiceIndex( "Scene file to unload", "Unload Scene", fileNames, this );
+
+	if( fileIndex >= 0 )
+	{
+		auto pFile = GetScene().m_Files.begin();
+		std::advance( pFile, fileIndex );
+
+		GetScene().Unload( * pFile );
+		UpdateMemoryProperties();
+		m_pGlCanvas->Refresh();
+	}
+}
+
+
+void MainWindow::OnDumpMemoryUsage( wxCommandEvent & event )
+{
+	GetScene().DumpMemoryUsage();
+	UpdateMemoryProperties();
+}
+
+
+void MainWindow::OnKeepCpuGeometry( wxCommandEvent & event )
+{
+	GetOptions().m_KeepCpuGeometry = event.IsChecked();
+
+	// Meshes that are already loaded can only lose their copies; turning the
+	// option back on only affects meshes loaded from now on.
+	if( ! GetOptions().m_KeepCpuGeometry )
+	{
+		GetScene().DropCpuGeometry();
+		UpdateMemoryProperties();
+	}
+}
+
+
+void MainWindow::OnCompactVertices( wxCommandEvent & event )
+{
+	// Only affects meshes loaded from now on.
+	GetOptions().m_CompactVertices = event.IsChecked();
+}
+
+
+void MainWindow::OnSceneBuffers( wxCommandEvent & event )
+{
+	// Only affects meshes loaded from now on.
+	GetOptions().m_SceneBuffers = event.IsChecked();
+}
+
+
+void MainWindow::OnUseLods( wxCommandEvent & event )
+{
+	GetOptions().m_UseLods = event.IsChecked();
+	m_pGlCanvas->Refresh();
+}
+
+
+void MainWindow::OnSilhouetteShadows( wxCommandEvent & event )
+{
+	GetOptions().m_SilhouetteShadows = event.IsChecked();
+	m_pGlCanvas->Refresh();
+}
+
+
+void MainWindow::OnShadowCulling( wxCommandEvent & event )
+{
+	GetOptions().m_ShadowCulling = event.IsChecked();
+	m_pGlCanvas->Refresh();
+}
+
+
+void MainWindow::OnFrustumCulling( wxCommandEvent & event )
+{
+	GetOptions().m_FrustumCulling = event.IsChecked();
+	m_pGlCanvas->Refresh();
+}
+
+
+void MainWindow::OnInstancing( wxCommandEvent & event )
+{
+	GetOptions().m_Instancing = event.IsChecked();
+	m_pGlCanvas->Refresh();
+}
+
+
+void MainWindow::OnOcclusionCulling( wxCommandEvent & event )
+{
+	GetOptions().m_OcclusionCulling = event.IsChecked();
+	m_pGlCanvas->Refresh();
+}
+
+
+void MainWindow::OnShadowVolumeCache( wxCommandEvent & event )
+{
+	GetOptions().m_ShadowVolumeCache = event.IsChecked();
+	m_pGlCanvas->Refresh();
+}
+
+
+void MainWindow::OnPropertiesTimer( wxTimerEvent & event )
+{
+	UpdateMemoryProperties();
+
+	if( ! GetScene().IsLoading() )
+		m_PropertiesTimer.Stop();
+}
+
+
+void MainWindow::UpdateMemoryProperties()
+{
+	m_pPropertyGrid->Freeze();
+	m_pPropertyGrid->Clear();
+
+	m_pPropertyGrid->Append( new wxPropertyCategory( "Memory Usage" ) );
+
+	MemoryUsage total;
+
+	for( int categoryIndex = 0; categoryIndex < Scene::NumMemoryCategories; ++categoryIndex )
+	{
+		const Scene::MemoryCategory category = static_cast< Scene::MemoryCategory >( categoryIndex );
+		const MemoryUsage usage = GetScene().GetMemoryUsage( category );
+
+		m_pPropertyGrid->SetPropertyReadOnly( m_pPropertyGrid->Append( new wxStringProperty( Scene::GetMemoryCategoryName( category ), wxPG_LABEL, usage.ToString() ) ) );
+		total += usage;
+	}
+
+	m_pPropertyGrid->SetPropertyReadOnly( m_pPropertyGrid->Append( new wxStringProperty( "Total", wxPG_LABEL, total.ToString() ) ) );
+
+	// Files can have the same name, so their properties are named by index.
+	m_pPropertyGrid->Append( new wxPropertyCategory( "Files" ) );
+	int fileIndex = 0;
+
+	foreach( const SceneFile & file, GetScene().m_Files )
+	{
+		const string label = filesystem::path( file.m_FileName ).filename().string();
+		m_pPropertyGrid->SetPropertyReadOnly( m_pPropertyGrid->Append( new wxStringProperty( label, wxString::Format( "File%d", fileIndex++ ), file.GetMemoryUsage().ToString() ) ) );
+	}
+
+	m_pPropertyGrid->Thaw();
+}
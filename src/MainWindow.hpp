@@ -17,6 +17,10 @@
 #pragma once
 
 
+#include "SceneImporter.hpp"
+#include "TriangleOrder.hpp"
+
+
 class GlCanvas;
 
 
@@ -28,7 +32,25 @@ public:
 private:
 	enum EventId
 	{
-		EventId_ReloadShaders
+		EventId_ReloadShaders,
+		EventId_BenchmarkLoad,
+		EventId_Unload,
+		EventId_DumpMemoryUsage,
+		EventId_KeepCpuGeometry,
+		EventId_CompactVertices,
+		EventId_SceneBuffers,
+		EventId_UseLods,
+		EventId_SilhouetteShadows,
+		EventId_ShadowCulling,
+		EventId_FrustumCulling,
+		EventId_Instancing,
+		EventId_OcclusionCulling,
+		EventId_ShadowVolumeCache,
+		EventId_PropertiesTimer,
+		EventId_ImportProfile,
+		EventId_ImportProfileLast = EventId_ImportProfile + SceneImporter::NumProfiles - 1,
+		EventId_TriangleOrder,
+		EventId_TriangleOrderLast = EventId_TriangleOrder + TriangleOrder::NumModes - 1
 	};
 
 	class LogStreambuf : public streambuf
@@ -41,15 +63,41 @@ private:
 		virtual int_type			overflow( int_type intChar );
 		virtual streamsize			xsputn( const char * pString, streamsize numChars );
 
+		void						Write( const wxString & message );
+
 		wxTextCtrl &				m_LogWindow;
 		streambuf &					m_OldStreambuf;
+		std::mutex					m_Mutex;
 	};
 
 	void							OnOpen( wxCommandEvent & event );
 	void							OnClose( wxCommandEvent & event );
 	void							OnReloadShaders( wxCommandEvent & event );
+	void							OnBenchmarkLoad( wxCommandEvent & event );
+	void							OnImportProfile( wxCommandEvent & event );
+	void							OnTriangleOrder( wxCommandEvent & event );
+	void							OnUnload( wxCommandEvent & event );
+	void							OnDumpMemoryUsage( wxCommandEvent & event );
+	void							OnKeepCpuGeometry( wxCommandEvent & event );
+	void							OnCompactVertices( wxCommandEvent & event );
+	void							OnSceneBuffers( wxCommandEvent & event );
+	void							OnUseLods( wxCommandEvent & event );
+	void							OnSilhouetteShadows( wxCommandEvent & event );
+	void							OnShadowCulling( wxCommandEvent & event );
+	void							OnFrustumCulling( wxCommandEvent & event );
+	void							OnInstancing( wxCommandEvent & event );
+	void							OnOcclusionCulling( wxCommandEvent & event );
+	void							OnShadowVolumeCache( wxCommandEvent & event );
+	void							OnPropertiesTimer( wxTimerEvent & event );
+
+	// Fills the property grid with the memory used by each type of object and
+	// each loaded file. Called periodically while scenes are loading, and
+	// whenever the scene changes.
+	void							UpdateMemoryProperties();
 
 	GlCanvas *						m_pGlCanvas;
+	wxPropertyGrid *				m_pPropertyGrid;
+	wxTimer							m_PropertiesTimer;
 	unique_ptr< LogStreambuf >		m_pLogStreambuf;
 
 	DECLARE_EVENT_TABLE()
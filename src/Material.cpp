@@ -25,15 +25,11 @@
 #include "ShaderProgram.hpp"
 
 
-Material::Material( const aiMaterial & assimpMaterial, const filesystem::path & scenePath )
+Material::Material( const string & diffuseTexturePath, const filesystem::path & scenePath )
 {
-	aiString diffuseTexturePath;
-
-	if( assimpMaterial.GetTexture( aiTextureType_DIFFUSE, 0, & diffuseTexturePath ) == aiReturn_SUCCESS )
+	if( ! diffuseTexturePath.empty() )
 	{
-		filesystem::path texturePath( scenePath );
-		texturePath += diffuseTexturePath.C_Str();
-		m_pDiffuseTexture = GetScene().GetAsset< Texture >( texturePath.string() );
+		m_pDiffuseTexture = GetScene().GetAsset< Texture >( GetTexturePath( diffuseTexturePath, scenePath ) );
 
 		m_pShaderProgram = GetScene().m_pGeometryShaderProgram;
 	}
@@ -51,6 +47,20 @@ void Material::RegisterMesh( Mesh & mesh )
 }
 
 
+bool Material::Matches( const string & diffuseTexturePath ) const
+{
+	return m_pDiffuseTexture ? ( m_pDiffuseTexture->m_FileName == diffuseTexturePath ) : diffuseTexturePath.empty();
+}
+
+
+string Material::GetTexturePath( const string & texturePath, const filesystem::path & scenePath )
+{
+	filesystem::path path( scenePath );
+	path += texturePath;
+	return path.string();
+}
+
+
 void Material::RenderSetup()
 {
 	assert( m_pShaderProgram );
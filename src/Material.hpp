@@ -28,11 +28,21 @@ class ShaderProgram;
 class Material : private List< Mesh, Material >
 {
 public:
-										Material( const aiMaterial & assimpMaterial, const filesystem::path & scenePath );
+										Material( const string & diffuseTexturePath, const filesystem::path & scenePath );
 										~Material();
 
 	void								RegisterMesh( Mesh & mesh );
 
+	// Whether this material uses the given texture, which is a full path
+	// (see GetTexturePath), or no texture if it is empty. Materials are
+	// shared by the hash of their texture path, and this makes sure a match
+	// isn't a collision.
+	bool								Matches( const string & diffuseTexturePath ) const;
+
+	// Returns the file name of a texture referenced by a scene. Texture paths
+	// in scene files are relative to the scene.
+	static string						GetTexturePath( const string & texturePath, const filesystem::path & scenePath );
+
 	void								RenderSetup();
 
 	std::shared_ptr< ShaderProgram >	m_pShaderProgram;
@@ -0,0 +1,46 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Precomp.hpp"
+#include "Common.hpp"
+
+#include "MemoryUsage.hpp"
+
+
+string MemoryUsage::ToString() const
+{
+	return FormatBytes( m_CpuBytes ) + " CPU, " + FormatBytes( m_GpuBytes ) + " GPU";
+}
+
+
+string MemoryUsage::FormatBytes( const size_t numBytes )
+{
+	const char * const units[] = { "B", "KB", "MB", "GB" };
+	const size_t numUnits = sizeof( units ) / sizeof( units[0] );
+
+	double size = static_cast< double >( numBytes );
+	size_t unitIndex = 0;
+
+	while( size >= 1024.0 && unitIndex + 1 < numUnits )
+	{
+		size /= 1024.0;
+		++unitIndex;
+	}
+
+	ostringstream stream;
+	stream << fixed << setprecision( unitIndex == 0 ? 0 : 1 ) << size << units[ unitIndex ];
+	return stream.str();
+}
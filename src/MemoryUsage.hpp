@@ -0,0 +1,43 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Bookkeeping for how much memory things in the scene are using, so that it
+// can be shown in the UI. GL memory can't be queried portably, so GPU sizes
+// are estimates based on what we asked the GL to store; the driver is free to
+// pad, align or keep its own copies.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+
+///////////////////////////////////////////////////////////////////////////////
+// MemoryUsage struct
+///////////////////////////////////////////////////////////////////////////////
+struct MemoryUsage
+{
+					MemoryUsage()											: m_CpuBytes( 0 ), m_GpuBytes( 0 ) {}
+					MemoryUsage( const size_t cpuBytes, const size_t gpuBytes )	: m_CpuBytes( cpuBytes ), m_GpuBytes( gpuBytes ) {}
+
+	MemoryUsage &	operator += ( const MemoryUsage & other )				{ m_CpuBytes += other.m_CpuBytes; m_GpuBytes += other.m_GpuBytes; return * this; }
+
+	// Returns eg "1.5MB CPU, 12.0MB GPU".
+	string			ToString() const;
+
+	// Returns a size in the most readable units, eg "1.5MB".
+	static string	FormatBytes( const size_t numBytes );
+
+	size_t			m_CpuBytes;
+	size_t			m_GpuBytes;
+};
@@ -20,36 +20,261 @@
 #include "Mesh.hpp"
 
 #include "Scene.hpp"
+#include "Options.hpp"
 #include "Material.hpp"
+#include "DrawBatch.hpp"
 #include "MeshInstance.hpp"
+#include "ShadowCulling.hpp"
+#include "GeometryPool.hpp"
+#include "MeshAdjacency.hpp"
+#include "ShaderProgram.hpp"
+
+
+Mesh::Mesh( const MeshStreams & streams, Material & material )
+	: m_NumVertices		( streams.m_NumVertices )
+	, m_NumTris			( streams.m_NumTris )
+	, m_Name			( streams.m_pName )
+	, m_VertexArrayId	( 0 )
+	, m_VertexBufferId	( 0 )
+	, m_ColourBufferId	( 0 )
+	, m_TexCoordBufferId( 0 )
+	, m_NormalBufferId	( 0 )
+	, m_IndexBufferId	( 0 )
+	, m_AdjacencyArrayId( 0 )
+	, m_AdjacencyBufferId( 0 )
+	, m_HasAdjacency	( false )
+	, m_IsPooled		( false )
+	, m_PoolFirstVertex	( 0 )
+	, m_PoolFirstIndex	( 0 )
+	, m_PoolFirstAdjacencyIndex( 0 )
+	, m_GpuBytes		( 0 )
+	, m_VertexBytes		( 0 )
+	, m_IndexBytes		( 0 )
+	, m_IndexType		( GL_UNSIGNED_INT )
+	, m_IsTextured		( false )
+	, m_PositionScale	( Vector3f::Ones() )
+	, m_PositionOffset	( Vector3f::Zero() )
+	, m_Lods			( streams.m_pLods, streams.m_pLods + streams.m_NumLods )
+	, m_Clusters		( streams.m_pClusters, streams.m_pClusters + streams.m_NumClusters )
+	, m_Bounds			( GetBounds( streams ) )
+	, m_BoundsCentre	( Vector3f::Zero() )
+	, m_BoundsRadius	( 0.0f )
+{
+	assert( ! m_Lods.empty() && m_Lods.front().m_NumTris == m_NumTris );
 
+	material.RegisterMesh( * this );
 
-Mesh::Mesh( const aiMesh & assimpMesh, const size_t baseMaterialIndex )
-	: m_VertexBuffer( assimpMesh.mVertices, assimpMesh.mVertices + assimpMesh.mNumVertices )
-	//, m_VertexNormals( assimpMesh.mNormals, assimpMesh.mNormals + assimpMesh.mNumVertices )
-	//, m_ColourBuffers( assimpMesh.GetNumColorChannels() )
-	//, m_UvBuffers( assimpMesh.mNumUVComponents )
-	, m_TriIndexBuffer( assimpMesh.mNumFaces )
-	, m_Name( assimpMesh.mName.C_Str() )
-	, m_ColourBufferId( 0 )
-	, m_TexCoordBufferId( 0 )
-	, m_NormalBufferId( 0 )
+	// Each LOD's clusters follow on from the last LOD's.
+	size_t clusterIndex = 0;
+
+	foreach( const MeshLod & lod, m_Lods )
+	{
+		m_LodFirstClusters.push_back( clusterIndex );
+
+		while( clusterIndex < m_Clusters.size() && m_Clusters[ clusterIndex ].m_FirstTri < lod.m_FirstTri + lod.m_NumTris )
+			++clusterIndex;
+	}
+
+	m_LodFirstClusters.push_back( clusterIndex );
+
+	// The sphere is centred on the bounding box, which is good enough for
+	// choosing LODs.
+	if( streams.m_NumVertices > 0 )
+	{
+		m_BoundsCentre = m_Bounds.center();
+
+		for( size_t vertexIndex = 0; vertexIndex < streams.m_NumVertices; ++vertexIndex )
+		{
+			const Vector3f position( streams.m_pVertices[ vertexIndex ].x, streams.m_pVertices[ vertexIndex ].y, streams.m_pVertices[ vertexIndex ].z );
+			m_BoundsRadius = max( m_BoundsRadius, ( position - m_BoundsCentre ).norm() );
+		}
+	}
+}
+
+
+AlignedBox3f Mesh::GetBounds( const MeshStreams & streams )
+{
+	AlignedBox3f bounds;
+
+	for( size_t vertexIndex = 0; vertexIndex < streams.m_NumVertices; ++vertexIndex )
+		bounds.extend( Vector3f( streams.m_pVertices[ vertexIndex ].x, streams.m_pVertices[ vertexIndex ].y, streams.m_pVertices[ vertexIndex ].z ) );
+
+	return bounds;
+}
+
+
+bool Mesh::Matches( const MeshStreams & streams, const Material & material ) const
 {
-	GetScene().m_Materials[ baseMaterialIndex + assimpMesh.mMaterialIndex ].RegisterMesh( * this );
+	if( GetList() != & material ||
+		streams.m_NumVertices != m_NumVertices ||
+		streams.m_NumTris != m_NumTris ||
+		streams.m_NumLods != m_Lods.size() ||
+		streams.m_NumClusters != m_Clusters.size() )
+		return false;
+
+	// The LODs and clusters are plain old data, straight from the cache.
+	if( memcmp( streams.m_pLods, m_Lods.data(), m_Lods.size() * sizeof( MeshLod ) ) != 0 ||
+		( ! m_Clusters.empty() && memcmp( streams.m_pClusters, m_Clusters.data(), m_Clusters.size() * sizeof( MeshCluster ) ) != 0 ) )
+		return false;
+
+	const AlignedBox3f bounds = GetBounds( streams );
+	return bounds.isEmpty() ? m_Bounds.isEmpty() : ( bounds.min() == m_Bounds.min() && bounds.max() == m_Bounds.max() );
+}
+
 
-	for( unsigned faceIndex = 0; faceIndex < assimpMesh.mNumFaces; ++faceIndex )
+// Converts a float to a half float, rounding to nearest. Values too big for a
+// half become infinity and values too small become zero.
+static uint16_t FloatToHalf( const float value )
+{
+	uint32_t bits;
+	memcpy( & bits, & value, sizeof( bits ) );
+
+	const uint32_t sign = ( bits >> 16 ) & 0x8000;
+	const uint32_t floatExponent = ( bits >> 23 ) & 0xff;
+	const int32_t exponent = static_cast< int32_t >( floatExponent ) - 127 + 15;
+	uint32_t mantissa = bits & 0x7fffff;
+
+	// Infinity and NaN.
+	if( floatExponent == 0xff )
+		return static_cast< uint16_t >( sign | 0x7c00 | ( mantissa != 0 ? 0x200 : 0 ) );
+
+	if( exponent >= 31 )
+		return static_cast< uint16_t >( sign | 0x7c00 );
+
+	// Too small for a normalised half, so make a denormal (or zero).
+	if( exponent <= 0 )
 	{
-		const unsigned int * const pIndices = assimpMesh.mFaces[ faceIndex ].mIndices;
-		copy( pIndices, pIndices + 3, m_TriIndexBuffer[ faceIndex ].data() );
+		if( exponent < -10 )
+			return static_cast< uint16_t >( sign );
+
+		mantissa |= 0x800000;
+		const uint32_t shift = 14 - exponent;
+		const uint32_t half = ( mantissa >> shift ) + ( ( mantissa >> ( shift - 1 ) ) & 1 );
+		return static_cast< uint16_t >( sign | half );
 	}
 
-	glGenVertexArrays( 1, & m_VertexArrayId );
-	glBindVertexArray( m_VertexArrayId );
+	// Rounding up can carry into the exponent, which is what we want.
+	const uint32_t half = ( sign | ( exponent << 10 ) | ( mantissa >> 13 ) ) + ( ( mantissa >> 12 ) & 1 );
+	return static_cast< uint16_t >( half );
+}
+
+
+// Packs a unit vector into signed normalised 10_10_10_2 (ie
+// GL_INT_2_10_10_10_REV), x in the lowest bits.
+static uint32_t PackNormal( const aiVector3D & normal )
+{
+	uint32_t packed = 0;
+
+	for( int axis = 0; axis < 3; ++axis )
+	{
+		const float component = max( -1.0f, min( normal[ axis ], 1.0f ) );
+		const int32_t quantised = static_cast< int32_t >( floor( component * 511.0f + 0.5f ) );
+		packed |= ( static_cast< uint32_t >( quantised ) & 0x3ff ) << ( 10 * axis );
+	}
+
+	return packed;
+}
+
+
+void Mesh::PackVertices( const MeshStreams & streams, vector< PackedVertex > & vertices, Vector3f & positionScale, Vector3f & positionOffset )
+{
+	Vector3f boundsMin = Vector3f::Constant( numeric_limits< float >::max() );
+	Vector3f boundsMax = Vector3f::Constant( -numeric_limits< float >::max() );
+
+	for( size_t vertexIndex = 0; vertexIndex < streams.m_NumVertices; ++vertexIndex )
+	{
+		const Vector3f position( streams.m_pVertices[ vertexIndex ].x, streams.m_pVertices[ vertexIndex ].y, streams.m_pVertices[ vertexIndex ].z );
+		boundsMin = boundsMin.cwiseMin( position );
+		boundsMax = boundsMax.cwiseMax( position );
+	}
+
+	// Positions are stored relative to the centre of the bounds so that the
+	// full signed range is used. Flat meshes have zero extent on some axis,
+	// which mustn't cause a divide by zero.
+	positionOffset = 0.5f * ( boundsMin + boundsMax );
+	positionScale = ( 0.5f * ( boundsMax - boundsMin ) / 32767.0f ).cwiseMax( Vector3f::Constant( numeric_limits< float >::min() ) );
+
+	vertices.resize( streams.m_NumVertices );
+
+	for( size_t vertexIndex = 0; vertexIndex < streams.m_NumVertices; ++vertexIndex )
+	{
+		PackedVertex & vertex = vertices[ vertexIndex ];
+
+		for( int axis = 0; axis < 3; ++axis )
+		{
+			const float quantised = floor( ( streams.m_pVertices[ vertexIndex ][ axis ] - positionOffset[ axis ] ) / positionScale[ axis ] + 0.5f );
+			vertex.m_Position[ axis ] = static_cast< int16_t >( max( -32767.0f, min( quantised, 32767.0f ) ) );
+		}
+
+		vertex.m_Padding = 0;
+		vertex.m_Normal = PackNormal( streams.m_pNormals[ vertexIndex ] );
+
+		if( streams.m_pTexCoords != nullptr )
+		{
+			vertex.m_TexCoord[0] = FloatToHalf( streams.m_pTexCoords[ vertexIndex ].x );
+			vertex.m_TexCoord[1] = FloatToHalf( streams.m_pTexCoords[ vertexIndex ].y );
+		}
+		else
+		{
+			vertex.m_TexCoord[0] = 0;
+			vertex.m_TexCoord[1] = 0;
+		}
+	}
+}
+
+
+void Mesh::Upload( const MeshStreams & streams )
+{
+	assert( ! IsUploaded() );
+	assert( streams.m_NumTris == m_NumTris );
+	assert( streams.m_pNormals != nullptr );
+
+	m_IsTextured = ( streams.m_pTexCoords != nullptr );
+
+	const bool isPacked = GetOptions().m_CompactVertices;
+
+	if( isPacked && GetOptions().m_SceneBuffers && GeometryPool::IsSupported() )
+		UploadToPool( streams );
+	else
+	{
+		glGenVertexArrays( 1, & m_VertexArrayId );
+		glBindVertexArray( m_VertexArrayId );
+
+		if( isPacked )
+			UploadPackedVertices( streams );
+		else
+			UploadFloatVertices( streams );
+
+		if( streams.m_pAdjacencyIndices != nullptr )
+			UploadAdjacency( streams, isPacked );
+
+		glBindVertexArray( 0 );
+	}
+
+	const size_t numIndices = GetNumIndices();
+	m_GpuBytes = m_VertexBytes + numIndices * GetIndexSize();
+
+	if( HasAdjacency() )
+		m_GpuBytes += 2 * numIndices * GetIndexSize();
+
+	if( GetOptions().m_KeepCpuGeometry )
+	{
+		m_Vertices.assign( streams.m_pVertices, streams.m_pVertices + streams.m_NumVertices );
+		m_TriIndices.assign( streams.m_pTriIndices, streams.m_pTriIndices + 3 * m_NumTris );
+	}
+}
+
+
+void Mesh::UploadFloatVertices( const MeshStreams & streams )
+{
+	// The streams are already in the layout the GL wants, so they can be
+	// uploaded directly without any conversion.
+	const size_t streamSize = streams.m_NumVertices * sizeof( aiVector3D );
 
 	glGenBuffers( 1, & m_VertexBufferId );
 	glBindBuffer( GL_ARRAY_BUFFER, m_VertexBufferId );
 
-	glBufferData( GL_ARRAY_BUFFER, m_VertexBuffer.size() * sizeof( m_VertexBuffer.front() ), m_VertexBuffer.data(), GL_STATIC_DRAW );
+	glBufferData( GL_ARRAY_BUFFER, streamSize, streams.m_pVertices, GL_STATIC_DRAW );
 
 	//glEnableVertexAttribArray( 0 );
 	//glVertexAttribPointer( 0, 3, GL_FLOAT, GL_FALSE, 0, 0 );
@@ -57,12 +282,12 @@ Mesh::Mesh( const aiMesh & assimpMesh, const size_t baseMaterialIndex )
 	glEnableClientState( GL_VERTEX_ARRAY );
 	glVertexPointer( 3, GL_FLOAT, 0, 0 );
 
-	if( assimpMesh.HasTextureCoords( 0 ) )
+	if( m_IsTextured )
 	{
 		glGenBuffers( 1, & m_TexCoordBufferId );
 		glBindBuffer( GL_ARRAY_BUFFER, m_TexCoordBufferId );
 
-		glBufferData( GL_ARRAY_BUFFER, m_VertexBuffer.size() * sizeof( * assimpMesh.mTextureCoords[ 0 ] ), assimpMesh.mTextureCoords[ 0 ], GL_STATIC_DRAW );
+		glBufferData( GL_ARRAY_BUFFER, streamSize, streams.m_pTexCoords, GL_STATIC_DRAW );
 
 		//glEnableVertexAttribArray( 1 );
 		//glVertexAttribPointer( 1, 3, GL_FLOAT, GL_FALSE, 0, 0 );
@@ -71,12 +296,10 @@ Mesh::Mesh( const aiMesh & assimpMesh, const size_t baseMaterialIndex )
 		glTexCoordPointer( 3, GL_FLOAT, 0, 0 );
 	}
 
-	assert( assimpMesh.HasNormals() );
-
 	glGenBuffers( 1, & m_NormalBufferId );
 	glBindBuffer( GL_ARRAY_BUFFER, m_NormalBufferId );
 
-	glBufferData( GL_ARRAY_BUFFER, m_VertexBuffer.size() * sizeof( * assimpMesh.mNormals ), assimpMesh.mNormals, GL_STATIC_DRAW );
+	glBufferData( GL_ARRAY_BUFFER, streamSize, streams.m_pNormals, GL_STATIC_DRAW );
 
 	glEnableClientState( GL_NORMAL_ARRAY );
 	glNormalPointer( GL_FLOAT, 0, 0 );
@@ -84,14 +307,187 @@ Mesh::Mesh( const aiMesh & assimpMesh, const size_t baseMaterialIndex )
 	glGenBuffers( 1, & m_IndexBufferId );
 	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, m_IndexBufferId );
 
-	glBufferData( GL_ELEMENT_ARRAY_BUFFER, m_TriIndexBuffer.size() * sizeof( m_TriIndexBuffer.front() ), m_TriIndexBuffer.data(), GL_STATIC_DRAW );
+	const size_t numIndices = 3 * ( m_Lods.back().m_FirstTri + m_Lods.back().m_NumTris );
+	glBufferData( GL_ELEMENT_ARRAY_BUFFER, numIndices * sizeof( uint32_t ), streams.m_pTriIndices, GL_STATIC_DRAW );
+
+	m_IndexBytes = 3 * m_NumTris * sizeof( uint32_t );
+
+	m_VertexBytes = ( m_IsTextured ? 3 : 2 ) * streamSize;
+	m_IndexType = GL_UNSIGNED_INT;
+	m_PositionScale = Vector3f::Ones();
+	m_PositionOffset = Vector3f::Zero();
+}
+
+
+void Mesh::UploadPackedVertices( const MeshStreams & streams )
+{
+	vector< PackedVertex > vertices;
+	PackVertices( streams, vertices, m_PositionScale, m_PositionOffset );
+
+	glGenBuffers( 1, & m_VertexBufferId );
+	glBindBuffer( GL_ARRAY_BUFFER, m_VertexBufferId );
+
+	m_VertexBytes = vertices.size() * sizeof( PackedVertex );
+	glBufferData( GL_ARRAY_BUFFER, m_VertexBytes, vertices.data(), GL_STATIC_DRAW );
+
+	// Everything is interleaved in the one buffer. The positions aren't
+	// normalised; the vertex shaders scale them back to model space.
+	const GLsizei stride = sizeof( PackedVertex );
+
+	glEnableClientState( GL_VERTEX_ARRAY );
+	glVertexPointer( 3, GL_SHORT, stride, reinterpret_cast< const GLvoid * >( offsetof( PackedVertex, m_Position ) ) );
+
+	glEnableClientState( GL_NORMAL_ARRAY );
+	glNormalPointer( GL_INT_2_10_10_10_REV, stride, reinterpret_cast< const GLvoid * >( offsetof( PackedVertex, m_Normal ) ) );
+
+	if( m_IsTextured )
+	{
+		glEnableClientState( GL_TEXTURE_COORD_ARRAY );
+		glTexCoordPointer( 2, GL_HALF_FLOAT, stride, reinterpret_cast< const GLvoid * >( offsetof( PackedVertex, m_TexCoord ) ) );
+	}
+
+	glGenBuffers( 1, & m_IndexBufferId );
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, m_IndexBufferId );
+
+	// Use 16-bit indices whenever they can address all of the vertices.
+	const size_t numIndices = 3 * ( m_Lods.back().m_FirstTri + m_Lods.back().m_NumTris );
+
+	if( streams.m_NumVertices <= 0x10000 )
+	{
+		const vector< uint16_t > indices( streams.m_pTriIndices, streams.m_pTriIndices + numIndices );
+
+		m_IndexType = GL_UNSIGNED_SHORT;
+		m_IndexBytes = 3 * m_NumTris * sizeof( uint16_t );
+		glBufferData( GL_ELEMENT_ARRAY_BUFFER, numIndices * sizeof( uint16_t ), indices.data(), GL_STATIC_DRAW );
+	}
+	else
+	{
+		m_IndexType = GL_UNSIGNED_INT;
+		m_IndexBytes = 3 * m_NumTris * sizeof( uint32_t );
+		glBufferData( GL_ELEMENT_ARRAY_BUFFER, numIndices * sizeof( uint32_t ), streams.m_pTriIndices, GL_STATIC_DRAW );
+	}
+}
+
+
+void Mesh::UploadAdjacency( const MeshStreams & streams, const bool isPacked )
+{
+	// The shadow shaders only need positions, so this vertex array shares the
+	// position stream with the main one.
+	glGenVertexArrays( 1, & m_AdjacencyArrayId );
+	glBindVertexArray( m_AdjacencyArrayId );
+
+	glBindBuffer( GL_ARRAY_BUFFER, m_VertexBufferId );
+	glEnableClientState( GL_VERTEX_ARRAY );
+
+	if( isPacked )
+		glVertexPointer( 3, GL_SHORT, sizeof( PackedVertex ), reinterpret_cast< const GLvoid * >( offsetof( PackedVertex, m_Position ) ) );
+	else
+		glVertexPointer( 3, GL_FLOAT, 0, 0 );
+
+	glGenBuffers( 1, & m_AdjacencyBufferId );
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, m_AdjacencyBufferId );
+
+	// Same index size as the main index buffer.
+	const size_t numIndices = 2 * GetNumIndices();
 
-	glBindVertexArray( 0 );
+	if( m_IndexType == GL_UNSIGNED_SHORT )
+	{
+		const vector< uint16_t > indices( streams.m_pAdjacencyIndices, streams.m_pAdjacencyIndices + numIndices );
+		glBufferData( GL_ELEMENT_ARRAY_BUFFER, numIndices * sizeof( uint16_t ), indices.data(), GL_STATIC_DRAW );
+	}
+	else
+		glBufferData( GL_ELEMENT_ARRAY_BUFFER, numIndices * sizeof( uint32_t ), streams.m_pAdjacencyIndices, GL_STATIC_DRAW );
+
+	m_HasAdjacency = true;
+}
+
+
+void Mesh::UploadToPool( const MeshStreams & streams )
+{
+	vector< PackedVertex > vertices;
+	PackVertices( streams, vertices, m_PositionScale, m_PositionOffset );
+
+	// Indices are relative to the mesh's first vertex (see GetPoolCommand),
+	// so they go in as they are. The pool only has 32-bit indices, as one
+	// index buffer serves every mesh.
+	GeometryPool & pool = GetScene().m_GeometryPool;
+	const size_t numIndices = GetNumIndices();
+
+	m_PoolFirstVertex = pool.AllocateVertices( vertices.data(), vertices.size() );
+	m_PoolFirstIndex = pool.AllocateIndices( streams.m_pTriIndices, numIndices );
+
+	if( streams.m_pAdjacencyIndices != nullptr )
+	{
+		m_PoolFirstAdjacencyIndex = pool.AllocateAdjacencyIndices( streams.m_pAdjacencyIndices, 2 * numIndices );
+		m_HasAdjacency = true;
+	}
+
+	m_VertexBytes = vertices.size() * sizeof( PackedVertex );
+	m_IndexBytes = 3 * m_NumTris * sizeof( uint32_t );
+	m_IndexType = GL_UNSIGNED_INT;
+	m_IsPooled = true;
 }
 
 
 Mesh::~Mesh()
 {
+	if( m_IsPooled )
+	{
+		GeometryPool & pool = GetScene().m_GeometryPool;
+		pool.FreeVertices( m_PoolFirstVertex, m_VertexBytes / sizeof( PackedVertex ) );
+		pool.FreeIndices( m_PoolFirstIndex, GetNumIndices() );
+
+		if( m_HasAdjacency )
+			pool.FreeAdjacencyIndices( m_PoolFirstAdjacencyIndex, 2 * GetNumIndices() );
+	}
+
+	// Deleting the zero IDs of a mesh that was never uploaded is harmless.
+	glDeleteBuffers( 1, & m_VertexBufferId );
+	glDeleteBuffers( 1, & m_TexCoordBufferId );
+	glDeleteBuffers( 1, & m_NormalBufferId );
+	glDeleteBuffers( 1, & m_IndexBufferId );
+	glDeleteBuffers( 1, & m_AdjacencyBufferId );
+	glDeleteVertexArrays( 1, & m_VertexArrayId );
+	glDeleteVertexArrays( 1, & m_AdjacencyArrayId );
+}
+
+
+void Mesh::DropCpuGeometry()
+{
+	// Swap with empty vectors as clear doesn't free the memory.
+	vector< aiVector3D >().swap( m_Vertices );
+	vector< uint32_t >().swap( m_TriIndices );
+}
+
+
+MemoryUsage Mesh::GetMemoryUsage() const
+{
+	const size_t cpuBytes = sizeof( * this ) + m_Name.capacity() + m_Vertices.capacity() * sizeof( aiVector3D ) + m_TriIndices.capacity() * sizeof( uint32_t ) + m_Clusters.capacity() * sizeof( MeshCluster );
+	return MemoryUsage( cpuBytes, m_GpuBytes );
+}
+
+
+size_t Mesh::SelectLod( const Affine3f & modelView, const float lodScale, const float maxPixelError ) const
+{
+	if( m_Lods.size() == 1 || lodScale <= 0.0f )
+		return 0;
+
+	// Use the nearest point of the bounding sphere, allowing for any scaling
+	// in the transform. The camera looks down +z.
+	const float scale = modelView.linear().colwise().norm().maxCoeff();
+	const float distance = ( modelView * m_BoundsCentre ).z() - m_BoundsRadius * scale;
+
+	if( distance <= 0.0f )
+		return 0;
+
+	// The largest error in model units that is acceptable at that distance.
+	const float maxError = maxPixelError * distance / ( lodScale * scale );
+	size_t lodIndex = 0;
+
+	while( lodIndex + 1 < m_Lods.size() && m_Lods[ lodIndex + 1 ].m_Error <= maxError )
+		++lodIndex;
+
+	return lodIndex;
 }
 
 
@@ -101,25 +497,144 @@ void Mesh::RegisterInstance( MeshInstance & instance )
 }
 
 
-void Mesh::Render()
+void Mesh::Render( const size_t lodIndex, const size_t firstInstance, const size_t numInstances, DrawBatch & batch )
 {
-	glBindVertexArray( m_VertexArrayId );
+	if( ! IsUploaded() )
+		return;
 
-	GetMaterial()->RenderSetup();
+	if( m_IsPooled )
+	{
+		const TriRange range = { m_Lods[ lodIndex ].m_FirstTri, m_Lods[ lodIndex ].m_NumTris };
+
+		DrawCommand command;
+		GetPoolCommand( range, false, firstInstance, numInstances, command );
+		batch.Add( GetMaterial(), command );
+		return;
+	}
 
-	if( m_TexCoordBufferId == 0 )
+	glBindVertexArray( m_VertexArrayId );
+	ShaderProgram::GetCurrent()->SetFirstInstance( static_cast< GLint >( firstInstance ) );
+
+	if( ! m_IsTextured )
 		glDisable( GL_TEXTURE_2D );
 
-	glDrawElements( GL_TRIANGLES, 3 * m_TriIndexBuffer.size(), GL_UNSIGNED_INT, 0 );
+	DrawLod( lodIndex, numInstances );
 }
 
 
-void Mesh::RenderShadowVolumes()
+bool Mesh::UsesShadowPass( const ShadowPass pass ) const
 {
-	glBindVertexArray( m_VertexArrayId );
+	const bool useSilhouettes = HasAdjacency() && GetOptions().m_SilhouetteShadows;
+	return useSilhouettes == ( pass != ShadowPass_Triangles );
+}
 
-	if( m_TexCoordBufferId == 0 )
-		glDisable( GL_TEXTURE_2D );
 
-	glDrawElements( GL_TRIANGLES, 3 * m_TriIndexBuffer.size(), GL_UNSIGNED_INT, 0 );
+void Mesh::RenderShadowVolumes( const size_t lodIndex, const ShadowPass pass, const size_t firstInstance, const size_t numInstances, const Matrix4f * pModelViews, DrawBatch & batch, ShadowCulling * pCulling )
+{
+	if( ! IsUploaded() || ! UsesShadowPass( pass ) )
+		return;
+
+	const bool useSilhouettes = ( pass != ShadowPass_Triangles );
+
+	// Draw the clusters that survive culling, merging neighbouring ones into
+	// a single range.
+	m_DrawRanges.clear();
+
+	if( pCulling != nullptr && ! m_Clusters.empty() )
+	{
+		const size_t firstCluster = m_LodFirstClusters[ lodIndex ];
+		const size_t numClusters = m_LodFirstClusters[ lodIndex + 1 ] - firstCluster;
+
+		m_IsClusterVisible.assign( numClusters, 0 );
+
+		for( size_t instanceIndex = 0; instanceIndex < numInstances; ++instanceIndex )
+		{
+			pCulling->SetModelView( Affine3f( pModelViews[ instanceIndex ] ) );
+
+			for( size_t clusterIndex = 0; clusterIndex < numClusters; ++clusterIndex )
+				if( pCulling->IsClusterVisible( m_Clusters[ firstCluster + clusterIndex ] ) )
+					m_IsClusterVisible[ clusterIndex ] = 1;
+		}
+
+		for( size_t clusterIndex = 0; clusterIndex < numClusters; ++clusterIndex )
+		{
+			if( ! m_IsClusterVisible[ clusterIndex ] )
+				continue;
+
+			const MeshCluster & cluster = m_Clusters[ firstCluster + clusterIndex ];
+
+			if( ! m_DrawRanges.empty() && m_DrawRanges.back().m_FirstTri + m_DrawRanges.back().m_NumTris == cluster.m_FirstTri )
+				m_DrawRanges.back().m_NumTris += cluster.m_NumTris;
+			else
+			{
+				const TriRange range = { cluster.m_FirstTri, cluster.m_NumTris };
+				m_DrawRanges.push_back( range );
+			}
+		}
+
+		if( m_DrawRanges.empty() )
+			return;
+	}
+	else
+	{
+		const TriRange range = { m_Lods[ lodIndex ].m_FirstTri, m_Lods[ lodIndex ].m_NumTris };
+		m_DrawRanges.push_back( range );
+	}
+
+	if( m_IsPooled )
+	{
+		foreach( const TriRange & range, m_DrawRanges )
+		{
+			DrawCommand command;
+			GetPoolCommand( range, useSilhouettes, firstInstance, numInstances, command );
+			batch.Add( nullptr, command );
+		}
+
+		return;
+	}
+
+	ShaderProgram::GetCurrent()->SetFirstInstance( static_cast< GLint >( firstInstance ) );
+
+	if( useSilhouettes )
+	{
+		glBindVertexArray( m_AdjacencyArrayId );
+		DrawRanges( GL_TRIANGLES_ADJACENCY, MeshAdjacency::IndicesPerTri, numInstances );
+	}
+	else
+	{
+		glBindVertexArray( m_VertexArrayId );
+
+		if( ! m_IsTextured )
+			glDisable( GL_TEXTURE_2D );
+
+		DrawRanges( GL_TRIANGLES, 3, numInstances );
+	}
+}
+
+
+void Mesh::DrawLod( const size_t lodIndex, const size_t numInstances )
+{
+	const MeshLod & lod = m_Lods[ lodIndex ];
+	glDrawElementsInstanced( GL_TRIANGLES, 3 * lod.m_NumTris, m_IndexType, reinterpret_cast< const GLvoid * >( 3 * lod.m_FirstTri * GetIndexSize() ), static_cast< GLsizei >( numInstances ) );
+}
+
+
+void Mesh::DrawRanges( const GLenum mode, const size_t indicesPerTri, const size_t numInstances )
+{
+	// There's no instanced glMultiDrawElements, but culling rarely leaves
+	// more than a few ranges.
+	foreach( const TriRange & range, m_DrawRanges )
+		glDrawElementsInstanced( mode, static_cast< GLsizei >( indicesPerTri * range.m_NumTris ), m_IndexType, reinterpret_cast< const GLvoid * >( indicesPerTri * range.m_FirstTri * GetIndexSize() ), static_cast< GLsizei >( numInstances ) );
+}
+
+
+void Mesh::GetPoolCommand( const TriRange & range, const bool withAdjacency, const size_t firstInstance, const size_t numInstances, DrawCommand & command ) const
+{
+	const size_t indicesPerTri = withAdjacency ? MeshAdjacency::IndicesPerTri : 3;
+
+	command.m_NumIndices = static_cast< GLuint >( indicesPerTri * range.m_NumTris );
+	command.m_NumInstances = static_cast< GLuint >( numInstances );
+	command.m_FirstIndex = static_cast< GLuint >( ( withAdjacency ? m_PoolFirstAdjacencyIndex : m_PoolFirstIndex ) + indicesPerTri * range.m_FirstTri );
+	command.m_BaseVertex = static_cast< GLint >( m_PoolFirstVertex );
+	command.m_BaseInstance = static_cast< GLuint >( firstInstance );
 }
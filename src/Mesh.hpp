@@ -18,36 +18,173 @@
 
 
 #include "List.hpp"
+#include "ShadowPass.hpp"
+#include "MemoryUsage.hpp"
 
 
 class Material;
+class DrawBatch;
 class MeshInstance;
+class ShadowCulling;
+struct DrawCommand;
+
+
+// A level of detail of a mesh (see MeshSimplifier). All of a mesh's LODs
+// share its vertices, and each is a range of its triangles. LOD 0 is the full
+// detail mesh. The error is an estimate of how far the LOD strays from the
+// full detail mesh, in model units. These are stored in the scene cache as is.
+struct MeshLod
+{
+	uint32_t							m_FirstTri;
+	uint32_t							m_NumTris;
+	float								m_Error;
+};
+
+
+// A run of a LOD's triangles that is culled as one when casting shadows (see
+// MeshClusters). The cone contains the normals of the cluster's triangles:
+// they are all within the cone's half angle of its axis, and the cutoff is
+// the sine of that angle, or 1 if the cone is too wide to cull with. These
+// are stored in the scene cache as is.
+struct MeshCluster
+{
+	uint32_t							m_FirstTri;
+	uint32_t							m_NumTris;
+	float								m_Centre[3];
+	float								m_Radius;
+	float								m_ConeAxis[3];
+	float								m_ConeCutoff;
+};
+
+
+// Tightly packed vertex/index streams that a Mesh is built from. The pointers
+// aren't owned by this structure and only need to stay valid until the Mesh
+// has been uploaded.
+struct MeshStreams
+{
+	const char *						m_pName;
+	size_t								m_NumVertices;
+	size_t								m_NumTris;			// In the full detail mesh.
+	size_t								m_NumLods;
+	const aiVector3D *					m_pVertices;
+	const aiVector3D *					m_pNormals;
+	const aiVector3D *					m_pTexCoords;		// May be nullptr if the mesh isn't textured.
+	const uint32_t *					m_pTriIndices;		// Three indices per triangle, for every LOD.
+	const MeshLod *						m_pLods;
+
+	// Six indices per triangle for every LOD (see MeshAdjacency), or nullptr
+	// if the mesh isn't closed.
+	const uint32_t *					m_pAdjacencyIndices;
+
+	// The clusters of every LOD, in triangle order.
+	size_t								m_NumClusters;
+	const MeshCluster *					m_pClusters;
+};
+
+
+// The compact vertex layout that meshes are uploaded in (unless
+// Options::m_CompactVertices is turned off), 16 bytes rather than the 36 of
+// separate float streams. Positions are quantised to 16 bits across the
+// mesh's bounding box and scaled back by the vertex shaders (see
+// DrawBatch::AddInstance). Normals are signed normalised
+// 10_10_10_2 and texture coordinates are half floats.
+struct PackedVertex
+{
+	int16_t								m_Position[3];
+	int16_t								m_Padding;			// Keeps the normal 4-byte aligned.
+	uint32_t							m_Normal;
+	uint16_t							m_TexCoord[2];
+};
 
 
 class Mesh : private List< MeshInstance, Mesh >,
 			 private List< Mesh, Material >::Item
 {
 public:
-										Mesh( const aiMesh & assimpMesh, const size_t baseMaterialIndex );
+	// Meshes are created in two steps so that scenes can be loaded
+	// progressively: the constructor only records the size of the mesh, then
+	// Upload transfers the streams to the GL. Meshes that haven't been
+	// uploaded yet are skipped when rendering.
+										Mesh( const MeshStreams & streams, Material & material );
 										~Mesh();
 
+	// Uploading can also keep a CPU copy of the vertex positions and indices,
+	// for working on the geometry without reading it back from the GL, if
+	// Options::m_KeepCpuGeometry is turned on. The format the mesh is stored
+	// in on the GL depends on Options::m_CompactVertices, and compact meshes
+	// go in the scene's GeometryPool if Options::m_SceneBuffers is turned on.
+	void								Upload( const MeshStreams & streams );
+	bool								IsUploaded() const			{ return m_VertexArrayId != 0 || m_IsPooled; }
+	bool								IsPooled() const			{ return m_IsPooled; }
+
+	// Whether this mesh was built from the same geometry as the streams and
+	// belongs to the material. Meshes are shared by the hash of their streams
+	// (see SceneCache::MeshRecord), and this makes sure a match isn't a
+	// collision. The streams' sizes, LODs and clusters are compared, along
+	// with their bounds.
+	bool								Matches( const MeshStreams & streams, const Material & material ) const;
+
+	// Frees the CPU copy of the geometry, if there is one.
+	void								DropCpuGeometry();
+	bool								HasCpuGeometry() const		{ return ! m_TriIndices.empty(); }
+
+	const vector< aiVector3D > &		GetVertices() const			{ return m_Vertices; }
+	const vector< uint32_t > &			GetTriIndices() const		{ return m_TriIndices; }
+
+	// Memory used by this mesh, including its GL buffers once uploaded.
+	MemoryUsage							GetMemoryUsage() const;
+
+	// Size of the vertices and indices that are fetched each time the full
+	// detail mesh is drawn.
+	size_t								GetVertexBytes() const		{ return m_VertexBytes; }
+	size_t								GetIndexBytes() const		{ return m_IndexBytes; }
+
+	const vector< MeshLod > &			GetLods() const				{ return m_Lods; }
+	const vector< MeshCluster > &		GetClusters() const			{ return m_Clusters; }
+
+	// Bounding box in model space, which is empty if the mesh has no
+	// vertices.
+	const AlignedBox3f &				GetBounds() const			{ return m_Bounds; }
+
+	// Picks the coarsest LOD whose error projects to no more than
+	// maxPixelError pixels. lodScale is the number of pixels that a unit
+	// length covers at a distance of one unit in front of the camera (zero
+	// always picks the full detail mesh).
+	size_t								SelectLod( const Affine3f & modelView, const float lodScale, const float maxPixelError ) const;
+
 	void								RegisterInstance( MeshInstance & instance );
 
-	void								Render();
-	void								RenderShadowVolumes();
+	// Draws instances of a LOD, whose transforms are firstInstance onwards
+	// in the batch (see DrawBatch::AddInstance). Pooled meshes are added to
+	// the batch as one instanced draw, to be drawn later. Otherwise they are
+	// drawn straight away with glDrawElementsInstanced, so the instances
+	// must have been uploaded already, and the material has already been set
+	// up (see RenderQueue).
+	void								Render( const size_t lodIndex, const size_t firstInstance, const size_t numInstances, DrawBatch & batch );
+
+	// Closed meshes are uploaded with triangle adjacency too, which lets the
+	// shadow shaders extrude them along their silhouettes (see ShadowPass).
+	// Each mesh only draws anything in the passes that apply to it. Every
+	// instance draws the same triangles, so a cluster of the LOD is drawn if
+	// it passes the culling for any of the instances, whose model view
+	// transforms are in pModelViews, unless pCulling is nullptr.
+	void								RenderShadowVolumes( const size_t lodIndex, const ShadowPass pass, const size_t firstInstance, const size_t numInstances, const Matrix4f * pModelViews, DrawBatch & batch, ShadowCulling * pCulling );
+	bool								UsesShadowPass( const ShadowPass pass ) const;
+	bool								HasAdjacency() const		{ return m_HasAdjacency; }
+
+	// Maps the vertex positions in the GL buffers to model space. This is an
+	// identity transform for float vertices.
+	const Vector3f &					GetPositionScale() const	{ return m_PositionScale; }
+	const Vector3f &					GetPositionOffset() const	{ return m_PositionOffset; }
 
 	Material *							GetMaterial()				{ return GetList(); }
 
 private:
-	typedef vector< aiVector3D >		UvBuffer;
-	typedef vector< aiColor4D >			ColourBuffer;
-	typedef std::array< uint32_t, 3 >	TriVertIndices;
-
-	vector< aiVector3D >				m_VertexBuffer;
-	//vector< aiVector3D >				m_VertexNormals;
-	//vector< ColourBuffer >				m_ColourBuffers;
-	//vector< UvBuffer >					m_UvBuffers;
-	vector< TriVertIndices >			m_TriIndexBuffer;
+	// Bounding box of the streams' vertices in model space.
+	static AlignedBox3f					GetBounds( const MeshStreams & streams );
+
+	size_t								m_NumVertices;
+	size_t								m_NumTris;
 	string								m_Name;
 	GLuint								m_VertexArrayId;
 	GLuint								m_VertexBufferId;
@@ -56,6 +193,82 @@ private:
 	GLuint								m_NormalBufferId;
 	GLuint								m_IndexBufferId;
 
+	// Positions only, with the adjacency indices.
+	GLuint								m_AdjacencyArrayId;
+	GLuint								m_AdjacencyBufferId;
+	bool								m_HasAdjacency;
+
+	// Where a pooled mesh's vertices and indices are in the GeometryPool.
+	// Its indices are relative to its first vertex.
+	bool								m_IsPooled;
+	size_t								m_PoolFirstVertex;
+	size_t								m_PoolFirstIndex;
+	size_t								m_PoolFirstAdjacencyIndex;
+
+	// Converts the streams to the compact layout, returning the scale and
+	// offset that map the quantised positions back to model space.
+	static void							PackVertices( const MeshStreams & streams, vector< PackedVertex > & vertices, Vector3f & positionScale, Vector3f & positionOffset );
+
+	void								UploadFloatVertices( const MeshStreams & streams );
+	void								UploadPackedVertices( const MeshStreams & streams );
+	void								UploadAdjacency( const MeshStreams & streams, const bool isPacked );
+	void								UploadToPool( const MeshStreams & streams );
+
+	// A run of triangles to draw.
+	struct TriRange
+	{
+		uint32_t						m_FirstTri;
+		uint32_t						m_NumTris;
+	};
+
+	// The command that draws instances of a run of triangles out of the pool.
+	void								GetPoolCommand( const TriRange & range, const bool withAdjacency, const size_t firstInstance, const size_t numInstances, DrawCommand & command ) const;
+
+	// Draws instances of one LOD with the vertex array and shader already
+	// set up.
+	void								DrawLod( const size_t lodIndex, const size_t numInstances );
+
+	// Draws instances of m_DrawRanges, likewise.
+	void								DrawRanges( const GLenum mode, const size_t indicesPerTri, const size_t numInstances );
+
+	// Number of indices in the index buffers, which hold every LOD rather
+	// than just the full detail mesh.
+	size_t								GetNumIndices() const		{ return 3 * ( m_Lods.back().m_FirstTri + m_Lods.back().m_NumTris ); }
+	size_t								GetIndexSize() const		{ return ( m_IndexType == GL_UNSIGNED_SHORT ) ? sizeof( uint16_t ) : sizeof( uint32_t ); }
+
+	// Size of the GL buffers, and of the full detail parts of them.
+	size_t								m_GpuBytes;
+	size_t								m_VertexBytes;
+	size_t								m_IndexBytes;
+
+	// Either GL_UNSIGNED_INT, or GL_UNSIGNED_SHORT for compact meshes with
+	// few enough vertices.
+	GLenum								m_IndexType;
+	bool								m_IsTextured;
+
+	Vector3f							m_PositionScale;
+	Vector3f							m_PositionOffset;
+
+	vector< MeshLod >					m_Lods;
+
+	// The clusters of every LOD, and the index of each LOD's first cluster
+	// (with one past the end of the last LOD's at the end).
+	vector< MeshCluster >				m_Clusters;
+	vector< size_t >					m_LodFirstClusters;
+
+	// Scratch space for drawing the clusters that survive culling.
+	vector< uint8_t >					m_IsClusterVisible;
+	vector< TriRange >					m_DrawRanges;
+
+	// Bounding box and sphere in model space, for culling and choosing LODs.
+	AlignedBox3f						m_Bounds;
+	Vector3f							m_BoundsCentre;
+	float								m_BoundsRadius;
+
+	// CPU copy of the full detail geometry (see Upload).
+	vector< aiVector3D >				m_Vertices;
+	vector< uint32_t >					m_TriIndices;
+
 	friend class List< Mesh, Material >;
 	friend class List< Mesh, Material >::Item;
 
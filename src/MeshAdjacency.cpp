@@ -0,0 +1,148 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Precomp.hpp"
+#include "Common.hpp"
+
+#include "MeshAdjacency.hpp"
+
+#include "Mesh.hpp"
+
+
+namespace
+{
+	// A triangle edge between two welded vertices, in the direction that the
+	// triangle winds it.
+	struct Edge
+	{
+		uint32_t		m_From;
+		uint32_t		m_To;
+		uint32_t		m_Tri;
+		uint32_t		m_Corner;		// The edge runs from this corner of the triangle to the next.
+
+		bool operator < ( const Edge & other ) const
+		{
+			return ( m_From != other.m_From ) ? m_From < other.m_From : m_To < other.m_To;
+		}
+	};
+}
+
+
+bool MeshAdjacency::Build( const aiVector3D * pVertices, const size_t numVertices, const vector< uint32_t > & triIndices, const vector< MeshLod > & lods, vector< uint32_t > & adjacencyIndices )
+{
+	adjacencyIndices.clear();
+
+	if( triIndices.empty() )
+		return false;
+
+	// Weld vertices by sorting them by position. Each vertex is mapped to the
+	// first vertex in sorted order with the same position.
+	vector< uint32_t > sortedVertices( numVertices );
+
+	for( size_t vertexIndex = 0; vertexIndex < numVertices; ++vertexIndex )
+		sortedVertices[ vertexIndex ] = static_cast< uint32_t >( vertexIndex );
+
+	sort( sortedVertices.begin(), sortedVertices.end(), [ pVertices ]( const uint32_t a, const uint32_t b )
+	{
+		if( pVertices[a].x != pVertices[b].x )
+			return pVertices[a].x < pVertices[b].x;
+
+		if( pVertices[a].y != pVertices[b].y )
+			return pVertices[a].y < pVertices[b].y;
+
+		return pVertices[a].z < pVertices[b].z;
+	} );
+
+	vector< uint32_t > vertexGroups( numVertices );
+	uint32_t group = 0;
+
+	for( size_t sortedIndex = 0; sortedIndex < numVertices; ++sortedIndex )
+	{
+		if( sortedIndex > 0 && pVertices[ sortedVertices[ sortedIndex ] ] != pVertices[ sortedVertices[ sortedIndex - 1 ] ] )
+			group = static_cast< uint32_t >( sortedIndex );
+
+		vertexGroups[ sortedVertices[ sortedIndex ] ] = group;
+	}
+
+	adjacencyIndices.resize( triIndices.size() / 3 * IndicesPerTri );
+	vector< Edge > edges;
+
+	foreach( const MeshLod & lod, lods )
+	{
+		edges.clear();
+
+		for( uint32_t triIndex = lod.m_FirstTri; triIndex < lod.m_FirstTri + lod.m_NumTris; ++triIndex )
+		{
+			const uint32_t * const pTri = & triIndices[ triIndex * 3 ];
+			uint32_t * const pAdjacency = & adjacencyIndices[ triIndex * IndicesPerTri ];
+
+			// Start off with each triangle adjacent to itself, which is all
+			// that degenerate triangles get.
+			for( uint32_t corner = 0; corner < 3; ++corner )
+			{
+				pAdjacency[ corner * 2 ] = pTri[ corner ];
+				pAdjacency[ corner * 2 + 1 ] = pTri[ ( corner + 2 ) % 3 ];
+			}
+
+			const uint32_t triGroups[3] = { vertexGroups[ pTri[0] ], vertexGroups[ pTri[1] ], vertexGroups[ pTri[2] ] };
+
+			if( triGroups[0] == triGroups[1] || triGroups[1] == triGroups[2] || triGroups[2] == triGroups[0] )
+				continue;
+
+			for( uint32_t corner = 0; corner < 3; ++corner )
+			{
+				Edge edge;
+				edge.m_From = triGroups[ corner ];
+				edge.m_To = triGroups[ ( corner + 1 ) % 3 ];
+				edge.m_Tri = triIndex;
+				edge.m_Corner = corner;
+				edges.push_back( edge );
+			}
+		}
+
+		sort( edges.begin(), edges.end() );
+
+		for( size_t edgeIndex = 0; edgeIndex < edges.size(); ++edgeIndex )
+		{
+			const Edge & edge = edges[ edgeIndex ];
+
+			// Two triangles winding the edge the same way means the mesh is
+			// either non-manifold or inconsistently wound.
+			if( edgeIndex + 1 < edges.size() && ! ( edge < edges[ edgeIndex + 1 ] ) )
+			{
+				adjacencyIndices.clear();
+				return false;
+			}
+
+			Edge twinKey;
+			twinKey.m_From = edge.m_To;
+			twinKey.m_To = edge.m_From;
+
+			const vector< Edge >::const_iterator twin = lower_bound( edges.begin(), edges.end(), twinKey );
+
+			if( twin == edges.end() || twinKey < * twin )
+			{
+				// An open edge.
+				adjacencyIndices.clear();
+				return false;
+			}
+
+			adjacencyIndices[ edge.m_Tri * IndicesPerTri + edge.m_Corner * 2 + 1 ] = triIndices[ twin->m_Tri * 3 + ( twin->m_Corner + 2 ) % 3 ];
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,49 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Builds the triangle adjacency that the silhouette shadow shaders need (see
+// Mesh::RenderShadowVolumes). Each triangle is given the vertex opposite each
+// of its edges in the neighbouring triangle, in the layout that
+// GL_TRIANGLES_ADJACENCY expects, so that a geometry shader can tell which
+// edges are on the silhouette as seen from the light.
+//
+// This only works for closed meshes, where every edge is shared by exactly
+// two triangles. Vertices are welded by position first, as meshes are split
+// along texture and normal seams, which would otherwise look like holes.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+
+struct MeshLod;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// MeshAdjacency class
+///////////////////////////////////////////////////////////////////////////////
+class MeshAdjacency
+{
+public:
+	// Number of indices per triangle in the adjacency index buffer. Triangle
+	// N's indices start at N * IndicesPerTri.
+	static const size_t		IndicesPerTri = 6;
+
+	// Builds the adjacency indices of every LOD of a mesh, in the same order
+	// as its triangles. Returns false, with no indices, if any LOD isn't
+	// closed, ie if an edge isn't shared by exactly two triangles that wind
+	// it in opposite directions. Triangles that are degenerate once welded
+	// don't count and are made adjacent to themselves.
+	static bool				Build( const aiVector3D * pVertices, const size_t numVertices, const vector< uint32_t > & triIndices, const vector< MeshLod > & lods, vector< uint32_t > & adjacencyIndices );
+};
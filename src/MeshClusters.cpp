@@ -0,0 +1,149 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Precomp.hpp"
+#include "Common.hpp"
+
+#include "MeshClusters.hpp"
+
+#include "Mesh.hpp"
+
+
+namespace
+{
+	// A run is cut early (once it has MinTris triangles) at a triangle whose
+	// normal is more than 45 degrees from the run's average normal.
+	const float CutCosine = 0.7f;
+
+	Vector3f ToVector( const aiVector3D & vector )
+	{
+		return Vector3f( vector.x, vector.y, vector.z );
+	}
+
+	// Fills in the bounds and cone of a cluster whose triangle range is set.
+	void FinishCluster( const aiVector3D * pVertices, const vector< uint32_t > & triIndices, const vector< Vector3f > & normals, MeshCluster & cluster )
+	{
+		const uint32_t * const pFirst = & triIndices[ cluster.m_FirstTri * 3 ];
+		const uint32_t * const pEnd = pFirst + cluster.m_NumTris * 3;
+
+		// The sphere is centred on the bounding box, as for whole meshes.
+		Vector3f boundsMin = Vector3f::Constant( numeric_limits< float >::max() );
+		Vector3f boundsMax = Vector3f::Constant( -numeric_limits< float >::max() );
+
+		for( const uint32_t * pIndex = pFirst; pIndex != pEnd; ++pIndex )
+		{
+			boundsMin = boundsMin.cwiseMin( ToVector( pVertices[ * pIndex ] ) );
+			boundsMax = boundsMax.cwiseMax( ToVector( pVertices[ * pIndex ] ) );
+		}
+
+		const Vector3f centre = 0.5f * ( boundsMin + boundsMax );
+		float radius = 0.0f;
+
+		for( const uint32_t * pIndex = pFirst; pIndex != pEnd; ++pIndex )
+			radius = max( radius, ( ToVector( pVertices[ * pIndex ] ) - centre ).norm() );
+
+		// The axis is the average normal and the cone is widened until it
+		// takes in every normal. Degenerate triangles have a zero normal and
+		// don't count.
+		Vector3f axis = Vector3f::Zero();
+
+		for( uint32_t triIndex = cluster.m_FirstTri; triIndex < cluster.m_FirstTri + cluster.m_NumTris; ++triIndex )
+			axis += normals[ triIndex ];
+
+		float minDot = -1.0f;
+
+		if( axis.squaredNorm() > 0.0f )
+		{
+			axis.normalize();
+			minDot = 1.0f;
+
+			for( uint32_t triIndex = cluster.m_FirstTri; triIndex < cluster.m_FirstTri + cluster.m_NumTris; ++triIndex )
+			{
+				if( normals[ triIndex ].squaredNorm() > 0.0f )
+					minDot = min( minDot, axis.dot( normals[ triIndex ] ) );
+			}
+		}
+
+		for( int axisIndex = 0; axisIndex < 3; ++axisIndex )
+		{
+			cluster.m_Centre[ axisIndex ] = centre[ axisIndex ];
+			cluster.m_ConeAxis[ axisIndex ] = axis[ axisIndex ];
+		}
+
+		// A cone of 90 degrees or more always has some triangle facing the
+		// light, so it can never be culled.
+		cluster.m_Radius = radius;
+		cluster.m_ConeCutoff = ( minDot > 0.0f ) ? sqrt( 1.0f - minDot * minDot ) : 1.0f;
+	}
+}
+
+
+void MeshClusters::Build( const aiVector3D * pVertices, const vector< uint32_t > & triIndices, const vector< MeshLod > & lods, vector< MeshCluster > & clusters )
+{
+	clusters.clear();
+
+	// Same winding as the shadow shaders use to decide which way a triangle
+	// faces.
+	const size_t numTris = triIndices.size() / 3;
+	vector< Vector3f > normals( numTris );
+
+	for( size_t triIndex = 0; triIndex < numTris; ++triIndex )
+	{
+		const Vector3f v0 = ToVector( pVertices[ triIndices[ triIndex * 3 ] ] );
+		const Vector3f v1 = ToVector( pVertices[ triIndices[ triIndex * 3 + 1 ] ] );
+		const Vector3f v2 = ToVector( pVertices[ triIndices[ triIndex * 3 + 2 ] ] );
+
+		const Vector3f normal = ( v1 - v0 ).cross( v2 - v1 );
+		const float length = normal.norm();
+		normals[ triIndex ] = ( length > 0.0f ) ? Vector3f( normal / length ) : Vector3f::Zero();
+	}
+
+	foreach( const MeshLod & lod, lods )
+	{
+		MeshCluster cluster;
+		cluster.m_FirstTri = lod.m_FirstTri;
+		cluster.m_NumTris = 0;
+
+		Vector3f normalSum = Vector3f::Zero();
+
+		for( uint32_t triIndex = lod.m_FirstTri; triIndex < lod.m_FirstTri + lod.m_NumTris; ++triIndex )
+		{
+			const Vector3f & normal = normals[ triIndex ];
+
+			const bool isFull = ( cluster.m_NumTris == MaxTris );
+			const bool turns = ( cluster.m_NumTris >= MinTris && normalSum.squaredNorm() > 0.0f && normal.squaredNorm() > 0.0f && normal.dot( normalSum.normalized() ) < CutCosine );
+
+			if( isFull || turns )
+			{
+				FinishCluster( pVertices, triIndices, normals, cluster );
+				clusters.push_back( cluster );
+
+				cluster.m_FirstTri = triIndex;
+				cluster.m_NumTris = 0;
+				normalSum = Vector3f::Zero();
+			}
+
+			++cluster.m_NumTris;
+			normalSum += normal;
+		}
+
+		if( cluster.m_NumTris > 0 )
+		{
+			FinishCluster( pVertices, triIndices, normals, cluster );
+			clusters.push_back( cluster );
+		}
+	}
+}
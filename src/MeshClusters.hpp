@@ -0,0 +1,52 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Splits each LOD of a mesh into small clusters of triangles, each with a
+// bounding sphere and a cone that contains the normals of its triangles, so
+// that shadow casting can be culled a cluster at a time (see ShadowCulling).
+// The shadow shaders throw away every triangle that faces away from the
+// light, which is about half of them, but only after they have been
+// transformed; a cluster whose whole normal cone faces away isn't drawn at
+// all.
+//
+// Clusters are runs of consecutive triangles, so they can be drawn as ranges
+// of the index buffer. The triangles have already been ordered for the vertex
+// cache, which keeps neighbouring triangles together, so runs are cut from
+// that order rather than the mesh being reordered. A run is also cut early
+// where the surface turns sharply, to keep the cones narrow.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+
+struct MeshLod;
+struct MeshCluster;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// MeshClusters class
+///////////////////////////////////////////////////////////////////////////////
+class MeshClusters
+{
+public:
+	// The most triangles in a cluster, and the fewest a cluster can be cut
+	// down to when the surface turns.
+	static const size_t		MaxTris = 32;
+	static const size_t		MinTris = 8;
+
+	// Builds the clusters of every LOD, in triangle order. A LOD's clusters
+	// cover exactly its triangles.
+	static void				Build( const aiVector3D * pVertices, const vector< uint32_t > & triIndices, const vector< MeshLod > & lods, vector< MeshCluster > & clusters );
+};
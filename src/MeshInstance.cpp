@@ -20,6 +20,7 @@
 #include "MeshInstance.hpp"
 
 #include "Mesh.hpp"
+#include "Options.hpp"
 
 
 MeshInstance::MeshInstance( Mesh & mesh )
@@ -33,13 +34,17 @@ MeshInstance::~MeshInstance()
 }
 
 
-void MeshInstance::Render()
+void MeshInstance::Render( const Affine3f & modelView, const float lodScale, const size_t nodeIndex, RenderQueue::DrawList & list )
 {
-	GetList()->Render();
+	Mesh & mesh = * GetList();
+	RenderQueue::AddDraw( list, mesh, mesh.SelectLod( modelView, lodScale, GetOptions().m_LodPixelError ), nodeIndex, modelView );
 }
 
 
-void MeshInstance::RenderShadowVolumes()
+void MeshInstance::RenderShadowVolumes( const Affine3f & modelView, const float lodScale, const size_t nodeIndex, const ShadowPass pass, RenderQueue::DrawList & list )
 {
-	GetList()->RenderShadowVolumes();
+	Mesh & mesh = * GetList();
+
+	if( mesh.UsesShadowPass( pass ) )
+		RenderQueue::AddDraw( list, mesh, mesh.SelectLod( modelView, lodScale, GetOptions().m_ShadowLodPixelError ), nodeIndex, modelView );
 }
@@ -18,6 +18,8 @@
 
 
 #include "List.hpp"
+#include "ShadowPass.hpp"
+#include "RenderQueue.hpp"
 
 
 class Mesh;
@@ -29,8 +31,16 @@ public:
 						MeshInstance( Mesh & mesh );
 						~MeshInstance();
 
-	void				Render();
-	void				RenderShadowVolumes();
+	// The LOD drawn is chosen from the model view transform (see
+	// Mesh::SelectLod). Shadow volumes use a coarser LOD than the surface
+	// itself as they only need to be about right. Either is added to the
+	// list to be drawn with the transform of the instance's node (see
+	// RenderQueue), and shadow volumes only if the mesh draws anything in the
+	// pass. Safe to call from several threads at once.
+	void				Render( const Affine3f & modelView, const float lodScale, const size_t nodeIndex, RenderQueue::DrawList & list );
+	void				RenderShadowVolumes( const Affine3f & modelView, const float lodScale, const size_t nodeIndex, const ShadowPass pass, RenderQueue::DrawList & list );
+
+	Mesh &				GetMesh() const			{ return * GetList(); }
 
 private:
 	friend class List< MeshInstance, Mesh >;
@@ -0,0 +1,478 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Precomp.hpp"
+#include "Common.hpp"
+
+#include "MeshSimplifier.hpp"
+
+#include "Mesh.hpp"
+
+
+namespace
+{
+	Vector3d ToVector3d( const aiVector3D & vector )
+	{
+		return Vector3d( vector.x, vector.y, vector.z );
+	}
+
+
+	// Appends the distinct groups, other than exclude, of the corners of the
+	// triangles around a group.
+	void GetNeighbourGroups( const vector< uint32_t > & triIndices, const vector< uint32_t > & vertexGroups, const uint32_t * pTrisBegin, const uint32_t * pTrisEnd, const uint32_t exclude, vector< uint32_t > & neighbours )
+	{
+		neighbours.clear();
+
+		for( const uint32_t * pTri = pTrisBegin; pTri != pTrisEnd; ++pTri )
+		{
+			for( int cornerIndex = 0; cornerIndex < 3; ++cornerIndex )
+			{
+				const uint32_t group = vertexGroups[ triIndices[ * pTri * 3 + cornerIndex ] ];
+
+				if( group != exclude )
+					neighbours.push_back( group );
+			}
+		}
+
+		sort( neighbours.begin(), neighbours.end() );
+		neighbours.erase( unique( neighbours.begin(), neighbours.end() ), neighbours.end() );
+	}
+}
+
+
+void MeshSimplifier::BuildLods( const aiVector3D * pVertices, const size_t numVertices, vector< uint32_t > & triIndices, vector< MeshLod > & lods )
+{
+	const size_t numTris = triIndices.size() / 3;
+
+	MeshLod lod;
+	lod.m_FirstTri = 0;
+	lod.m_NumTris = static_cast< uint32_t >( numTris );
+	lod.m_Error = 0.0f;
+
+	lods.clear();
+	lods.push_back( lod );
+
+	if( numTris < 2 * MinLodTris )
+		return;
+
+	MeshSimplifier simplifier( pVertices, numVertices, triIndices.data(), numTris );
+
+	while( lods.size() < MaxLods && lods.back().m_NumTris >= 2 * MinLodTris )
+	{
+		const size_t previousNumTris = lods.back().m_NumTris;
+		simplifier.Simplify( previousNumTris / 2 );
+
+		// A LOD that barely saves anything isn't worth the memory.
+		if( simplifier.GetNumTris() > previousNumTris * 3 / 4 )
+			break;
+
+		lod.m_FirstTri = static_cast< uint32_t >( triIndices.size() / 3 );
+		lod.m_NumTris = static_cast< uint32_t >( simplifier.GetNumTris() );
+		lod.m_Error = simplifier.GetError();
+
+		triIndices.insert( triIndices.end(), simplifier.GetTriIndices().begin(), simplifier.GetTriIndices().end() );
+		lods.push_back( lod );
+	}
+}
+
+
+MeshSimplifier::MeshSimplifier( const aiVector3D * pVertices, const size_t numVertices, const uint32_t * pTriIndices, const size_t numTris )
+	: m_pVertices		( pVertices )
+	, m_VertexGroups	( numVertices )
+	, m_Error			( 0.0f )
+{
+	// Weld vertices by sorting them by position, so that vertices with the
+	// same position end up next to each other.
+	m_GroupVertices.resize( numVertices );
+
+	for( size_t vertexIndex = 0; vertexIndex < numVertices; ++vertexIndex )
+		m_GroupVertices[ vertexIndex ] = static_cast< uint32_t >( vertexIndex );
+
+	sort( m_GroupVertices.begin(), m_GroupVertices.end(), [ pVertices ]( const uint32_t a, const uint32_t b )
+	{
+		if( pVertices[a].x != pVertices[b].x )
+			return pVertices[a].x < pVertices[b].x;
+
+		if( pVertices[a].y != pVertices[b].y )
+			return pVertices[a].y < pVertices[b].y;
+
+		return pVertices[a].z < pVertices[b].z;
+	} );
+
+	for( size_t sortedIndex = 0; sortedIndex < numVertices; ++sortedIndex )
+	{
+		const aiVector3D & position = pVertices[ m_GroupVertices[ sortedIndex ] ];
+
+		if( sortedIndex == 0 || ! ( position == pVertices[ m_GroupVertices[ sortedIndex - 1 ] ] ) )
+			m_FirstGroupVertices.push_back( static_cast< uint32_t >( sortedIndex ) );
+
+		m_VertexGroups[ m_GroupVertices[ sortedIndex ] ] = static_cast< uint32_t >( m_FirstGroupVertices.size() - 1 );
+	}
+
+	const size_t numGroups = m_FirstGroupVertices.size();
+	m_FirstGroupVertices.push_back( static_cast< uint32_t >( numVertices ) );
+
+	// Triangles that are already degenerate once vertices are welded would
+	// only get in the way.
+	m_TriIndices.reserve( numTris * 3 );
+
+	for( size_t triIndex = 0; triIndex < numTris; ++triIndex )
+	{
+		const uint32_t * const pTri = pTriIndices + triIndex * 3;
+
+		if( m_VertexGroups[ pTri[0] ] != m_VertexGroups[ pTri[1] ] &&
+			m_VertexGroups[ pTri[1] ] != m_VertexGroups[ pTri[2] ] &&
+			m_VertexGroups[ pTri[2] ] != m_VertexGroups[ pTri[0] ] )
+			m_TriIndices.insert( m_TriIndices.end(), pTri, pTri + 3 );
+	}
+
+	// Each group starts with the planes of the triangles around it, weighted
+	// by their area so that small triangles don't have too much say.
+	Quadric zero;
+	memset( & zero, 0, sizeof( zero ) );
+	m_Quadrics.assign( numGroups, zero );
+
+	for( size_t cornerIndex = 0; cornerIndex < m_TriIndices.size(); cornerIndex += 3 )
+	{
+		const Vector3d a = ToVector3d( pVertices[ m_TriIndices[ cornerIndex ] ] );
+		const Vector3d b = ToVector3d( pVertices[ m_TriIndices[ cornerIndex + 1 ] ] );
+		const Vector3d c = ToVector3d( pVertices[ m_TriIndices[ cornerIndex + 2 ] ] );
+		const Vector3d normal = ( b - a ).cross( c - a );
+		const double doubleArea = normal.norm();
+
+		if( doubleArea <= 0.0 )
+			continue;
+
+		const Vector3d unitNormal = normal / doubleArea;
+		const double distance = -unitNormal.dot( a );
+		const double weight = 0.5 * doubleArea;
+
+		Quadric plane;
+		plane.m_A[0] = weight * unitNormal.x() * unitNormal.x();
+		plane.m_A[1] = weight * unitNormal.x() * unitNormal.y();
+		plane.m_A[2] = weight * unitNormal.x() * unitNormal.z();
+		plane.m_A[3] = weight * unitNormal.y() * unitNormal.y();
+		plane.m_A[4] = weight * unitNormal.y() * unitNormal.z();
+		plane.m_A[5] = weight * unitNormal.z() * unitNormal.z();
+		plane.m_B[0] = weight * distance * unitNormal.x();
+		plane.m_B[1] = weight * distance * unitNormal.y();
+		plane.m_B[2] = weight * distance * unitNormal.z();
+		plane.m_C = weight * distance * distance;
+		plane.m_Weight = weight;
+
+		for( int cornerOffset = 0; cornerOffset < 3; ++cornerOffset )
+			AddQuadric( m_Quadrics[ m_VertexGroups[ m_TriIndices[ cornerIndex + cornerOffset ] ] ], plane );
+	}
+}
+
+
+void MeshSimplifier::AddQuadric( Quadric & quadric, const Quadric & other )
+{
+	for( int index = 0; index < 6; ++index )
+		quadric.m_A[ index ] += other.m_A[ index ];
+
+	for( int index = 0; index < 3; ++index )
+		quadric.m_B[ index ] += other.m_B[ index ];
+
+	quadric.m_C += other.m_C;
+	quadric.m_Weight += other.m_Weight;
+}
+
+
+double MeshSimplifier::EvaluateQuadric( const Quadric & quadric, const uint32_t group ) const
+{
+	const aiVector3D & position = GetGroupPosition( group );
+	const double x = position.x;
+	const double y = position.y;
+	const double z = position.z;
+
+	const double value =
+		quadric.m_A[0] * x * x + 2.0 * quadric.m_A[1] * x * y + 2.0 * quadric.m_A[2] * x * z +
+		quadric.m_A[3] * y * y + 2.0 * quadric.m_A[4] * y * z +
+		quadric.m_A[5] * z * z +
+		2.0 * ( quadric.m_B[0] * x + quadric.m_B[1] * y + quadric.m_B[2] * z ) +
+		quadric.m_C;
+
+	// Rounding can make it slightly negative.
+	return max( value, 0.0 );
+}
+
+
+void MeshSimplifier::Simplify( const size_t targetNumTris )
+{
+	const size_t numGroups = m_Quadrics.size();
+
+	vector< uint32_t > firstGroupTris;
+	vector< uint32_t > groupTris;
+	vector< uint32_t > nextGroupTris;
+	vector< uint64_t > edges;
+	vector< bool > isLocked;
+	vector< bool > isTouched;
+	vector< Collapse > collapses;
+	vector< uint32_t > vertexRemap;
+
+	// Collapses are made in passes. Each pass finds the cost of collapsing
+	// every edge and makes as many of the cheapest collapses as it can
+	// without two of them touching the same triangles.
+	while( GetNumTris() > targetNumTris )
+	{
+		const size_t numTris = GetNumTris();
+
+		// The triangles around each group.
+		// groupTris[ firstGroupTris[g] ] to groupTris[ firstGroupTris[g + 1] ]
+		// are the triangles that use group g.
+		firstGroupTris.assign( numGroups + 1, 0 );
+
+		for( size_t cornerIndex = 0; cornerIndex < numTris * 3; ++cornerIndex )
+			++firstGroupTris[ m_VertexGroups[ m_TriIndices[ cornerIndex ] ] + 1 ];
+
+		for( size_t groupIndex = 0; groupIndex < numGroups; ++groupIndex )
+			firstGroupTris[ groupIndex + 1 ] += firstGroupTris[ groupIndex ];
+
+		groupTris.resize( numTris * 3 );
+		nextGroupTris.assign( firstGroupTris.begin(), firstGroupTris.end() - 1 );
+
+		for( size_t cornerIndex = 0; cornerIndex < numTris * 3; ++cornerIndex )
+			groupTris[ nextGroupTris[ m_VertexGroups[ m_TriIndices[ cornerIndex ] ] ]++ ] = static_cast< uint32_t >( cornerIndex / 3 );
+
+		// Every edge between groups, as the pair of groups with the lowest
+		// first.
+		edges.clear();
+
+		for( size_t cornerIndex = 0; cornerIndex < numTris * 3; ++cornerIndex )
+		{
+			const size_t nextCornerIndex = ( cornerIndex % 3 == 2 ) ? cornerIndex - 2 : cornerIndex + 1;
+			const uint64_t a = m_VertexGroups[ m_TriIndices[ cornerIndex ] ];
+			const uint64_t b = m_VertexGroups[ m_TriIndices[ nextCornerIndex ] ];
+
+			edges.push_back( ( min( a, b ) << 32 ) | max( a, b ) );
+		}
+
+		sort( edges.begin(), edges.end() );
+
+		// Groups on edges that aren't shared by exactly two triangles are on
+		// a border or non-manifold, and stay where they are.
+		isLocked.assign( numGroups, false );
+
+		for( size_t edgeIndex = 0; edgeIndex < edges.size(); )
+		{
+			size_t edgeEnd = edgeIndex + 1;
+
+			while( edgeEnd < edges.size() && edges[ edgeEnd ] == edges[ edgeIndex ] )
+				++edgeEnd;
+
+			if( edgeEnd - edgeIndex != 2 )
+			{
+				isLocked[ edges[ edgeIndex ] >> 32 ] = true;
+				isLocked[ edges[ edgeIndex ] & 0xffffffff ] = true;
+			}
+
+			edgeIndex = edgeEnd;
+		}
+
+		// Each edge can collapse either way. Only the cheaper way is kept.
+		collapses.clear();
+
+		for( size_t edgeIndex = 0; edgeIndex + 1 < edges.size(); ++edgeIndex )
+		{
+			if( edges[ edgeIndex ] != edges[ edgeIndex + 1 ] || ( edgeIndex > 0 && edges[ edgeIndex - 1 ] == edges[ edgeIndex ] ) )
+				continue;
+
+			const uint32_t a = static_cast< uint32_t >( edges[ edgeIndex ] >> 32 );
+			const uint32_t b = static_cast< uint32_t >( edges[ edgeIndex ] & 0xffffffff );
+
+			Quadric combined = m_Quadrics[a];
+			AddQuadric( combined, m_Quadrics[b] );
+
+			Collapse collapse;
+			collapse.m_Cost = numeric_limits< double >::max();
+
+			if( ! isLocked[a] )
+			{
+				collapse.m_Cost = EvaluateQuadric( combined, b );
+				collapse.m_From = a;
+				collapse.m_To = b;
+			}
+
+			if( ! isLocked[b] && EvaluateQuadric( combined, a ) < collapse.m_Cost )
+			{
+				collapse.m_Cost = EvaluateQuadric( combined, a );
+				collapse.m_From = b;
+				collapse.m_To = a;
+			}
+
+			if( collapse.m_Cost < numeric_limits< double >::max() )
+				collapses.push_back( collapse );
+		}
+
+		sort( collapses.begin(), collapses.end(), []( const Collapse & a, const Collapse & b ) { return a.m_Cost < b.m_Cost; } );
+
+		vertexRemap.resize( m_VertexGroups.size() );
+
+		for( size_t vertexIndex = 0; vertexIndex < vertexRemap.size(); ++vertexIndex )
+			vertexRemap[ vertexIndex ] = static_cast< uint32_t >( vertexIndex );
+
+		isTouched.assign( numGroups, false );
+		size_t numTrisRemoved = 0;
+
+		foreach( const Collapse & collapse, collapses )
+		{
+			// Each collapse removes the two triangles on the edge.
+			if( numTris - numTrisRemoved <= targetNumTris )
+				break;
+
+			if( isTouched[ collapse.m_From ] || isTouched[ collapse.m_To ] )
+				continue;
+
+			if( ! TryCollapse( collapse, firstGroupTris, groupTris, vertexRemap ) )
+				continue;
+
+			// The triangles around the group that moved have changed, so
+			// nothing else can be collapsed around them this pass.
+			for( uint32_t groupTriIndex = firstGroupTris[ collapse.m_From ]; groupTriIndex < firstGroupTris[ collapse.m_From + 1 ]; ++groupTriIndex )
+			{
+				for( int cornerIndex = 0; cornerIndex < 3; ++cornerIndex )
+					isTouched[ m_VertexGroups[ m_TriIndices[ groupTris[ groupTriIndex ] * 3 + cornerIndex ] ] ] = true;
+			}
+
+			AddQuadric( m_Quadrics[ collapse.m_To ], m_Quadrics[ collapse.m_From ] );
+
+			// The quadric holds the area weighted sum of squared distances,
+			// so dividing by the area gives a mean squared distance.
+			if( m_Quadrics[ collapse.m_To ].m_Weight > 0.0 )
+				m_Error = max( m_Error, static_cast< float >( sqrt( collapse.m_Cost / m_Quadrics[ collapse.m_To ].m_Weight ) ) );
+
+			numTrisRemoved += 2;
+		}
+
+		if( numTrisRemoved == 0 )
+			break;
+
+		// Move the vertices and drop the triangles that have collapsed.
+		size_t numKeptTris = 0;
+
+		for( size_t triIndex = 0; triIndex < numTris; ++triIndex )
+		{
+			uint32_t tri[3];
+
+			for( int cornerIndex = 0; cornerIndex < 3; ++cornerIndex )
+				tri[ cornerIndex ] = vertexRemap[ m_TriIndices[ triIndex * 3 + cornerIndex ] ];
+
+			if( m_VertexGroups[ tri[0] ] != m_VertexGroups[ tri[1] ] &&
+				m_VertexGroups[ tri[1] ] != m_VertexGroups[ tri[2] ] &&
+				m_VertexGroups[ tri[2] ] != m_VertexGroups[ tri[0] ] )
+			{
+				copy( tri, tri + 3, m_TriIndices.begin() + numKeptTris * 3 );
+				++numKeptTris;
+			}
+		}
+
+		m_TriIndices.resize( numKeptTris * 3 );
+	}
+}
+
+
+bool MeshSimplifier::TryCollapse( const Collapse & collapse, const vector< uint32_t > & firstGroupTris, const vector< uint32_t > & groupTris, vector< uint32_t > & vertexRemap )
+{
+	const uint32_t * const pFromTrisBegin = groupTris.data() + firstGroupTris[ collapse.m_From ];
+	const uint32_t * const pFromTrisEnd = groupTris.data() + firstGroupTris[ collapse.m_From + 1 ];
+	const uint32_t * const pToTrisBegin = groupTris.data() + firstGroupTris[ collapse.m_To ];
+	const uint32_t * const pToTrisEnd = groupTris.data() + firstGroupTris[ collapse.m_To + 1 ];
+
+	// The only groups next to both ends of the edge must be the far corners
+	// of the edge's two triangles, otherwise the collapse would pinch the
+	// surface and make non-manifold edges.
+	vector< uint32_t > fromNeighbours;
+	vector< uint32_t > toNeighbours;
+	vector< uint32_t > sharedNeighbours;
+
+	GetNeighbourGroups( m_TriIndices, m_VertexGroups, pFromTrisBegin, pFromTrisEnd, collapse.m_From, fromNeighbours );
+	GetNeighbourGroups( m_TriIndices, m_VertexGroups, pToTrisBegin, pToTrisEnd, collapse.m_To, toNeighbours );
+	set_intersection( fromNeighbours.begin(), fromNeighbours.end(), toNeighbours.begin(), toNeighbours.end(), back_inserter( sharedNeighbours ) );
+
+	if( sharedNeighbours.size() != 2 )
+		return false;
+
+	// None of the triangles that remain may flip over.
+	const Vector3d toPosition = ToVector3d( GetGroupPosition( collapse.m_To ) );
+
+	for( const uint32_t * pTri = pFromTrisBegin; pTri != pFromTrisEnd; ++pTri )
+	{
+		const uint32_t * const pCorners = & m_TriIndices[ * pTri * 3 ];
+		Vector3d oldPositions[3];
+		Vector3d newPositions[3];
+		bool isRemoved = false;
+
+		for( int cornerIndex = 0; cornerIndex < 3; ++cornerIndex )
+		{
+			const uint32_t group = m_VertexGroups[ pCorners[ cornerIndex ] ];
+
+			isRemoved = isRemoved || ( group == collapse.m_To );
+			oldPositions[ cornerIndex ] = ToVector3d( m_pVertices[ pCorners[ cornerIndex ] ] );
+			newPositions[ cornerIndex ] = ( group == collapse.m_From ) ? toPosition : oldPositions[ cornerIndex ];
+		}
+
+		if( isRemoved )
+			continue;
+
+		const Vector3d oldNormal = ( oldPositions[1] - oldPositions[0] ).cross( oldPositions[2] - oldPositions[0] );
+		const Vector3d newNormal = ( newPositions[1] - newPositions[0] ).cross( newPositions[2] - newPositions[0] );
+
+		if( oldNormal.dot( newNormal ) <= 0.0 )
+			return false;
+	}
+
+	// Each vertex in the group moves onto a vertex of the other group that
+	// it shares a triangle with, so that at a seam the vertices on each side
+	// stay on their own side. If a vertex doesn't share a triangle with the
+	// other group, the seam can't follow the edge and the collapse isn't
+	// allowed.
+	vector< pair< uint32_t, uint32_t > > moves;
+
+	for( uint32_t groupVertexIndex = m_FirstGroupVertices[ collapse.m_From ]; groupVertexIndex < m_FirstGroupVertices[ collapse.m_From + 1 ]; ++groupVertexIndex )
+	{
+		const uint32_t vertexIndex = m_GroupVertices[ groupVertexIndex ];
+		bool isUsed = false;
+		bool isMoved = false;
+
+		for( const uint32_t * pTri = pFromTrisBegin; pTri != pFromTrisEnd && ! isMoved; ++pTri )
+		{
+			const uint32_t * const pCorners = & m_TriIndices[ * pTri * 3 ];
+
+			if( pCorners[0] != vertexIndex && pCorners[1] != vertexIndex && pCorners[2] != vertexIndex )
+				continue;
+
+			isUsed = true;
+
+			for( int cornerIndex = 0; cornerIndex < 3 && ! isMoved; ++cornerIndex )
+			{
+				if( m_VertexGroups[ pCorners[ cornerIndex ] ] == collapse.m_To )
+				{
+					moves.push_back( make_pair( vertexIndex, pCorners[ cornerIndex ] ) );
+					isMoved = true;
+				}
+			}
+		}
+
+		if( isUsed && ! isMoved )
+			return false;
+	}
+
+	for( size_t moveIndex = 0; moveIndex < moves.size(); ++moveIndex )
+		vertexRemap[ moves[ moveIndex ].first ] = moves[ moveIndex ].second;
+
+	return true;
+}
@@ -0,0 +1,113 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Simplifies meshes by collapsing edges, choosing the collapses with quadric
+// error metrics (Garland & Heckbert, "Surface Simplification Using Quadric
+// Error Metrics", 1997). This is used to build a chain of levels of detail
+// for each mesh when the scene cache is built.
+//
+// Vertices are only ever collapsed onto other vertices, never moved, so the
+// simplified meshes can share the vertices of the original and a LOD is just
+// a different set of triangles. Vertices that share a position (ie at normal
+// or texture coordinate seams) are collapsed together so the seams don't
+// open up. Vertices on borders and non-manifold edges are never moved at all.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+
+struct MeshLod;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// MeshSimplifier class
+///////////////////////////////////////////////////////////////////////////////
+class MeshSimplifier
+{
+public:
+	// Limits on the LOD chains built by BuildLods. The chain ends early if a
+	// mesh can't be simplified much further.
+	static const size_t			MaxLods = 6;
+	static const size_t			MinLodTris = 64;
+
+	// Builds a chain of LODs, each with about half the triangles of the one
+	// before, and appends their triangles to triIndices after those of the
+	// full detail mesh. lods[0] is always the full detail mesh.
+	static void					BuildLods( const aiVector3D * pVertices, const size_t numVertices, vector< uint32_t > & triIndices, vector< MeshLod > & lods );
+
+								MeshSimplifier( const aiVector3D * pVertices, const size_t numVertices, const uint32_t * pTriIndices, const size_t numTris );
+
+	// Collapses edges until there are no more than targetNumTris triangles,
+	// or until no more edges can be collapsed. Each call carries on from the
+	// result of the last.
+	void						Simplify( const size_t targetNumTris );
+
+	const vector< uint32_t > &	GetTriIndices() const		{ return m_TriIndices; }
+	size_t						GetNumTris() const			{ return m_TriIndices.size() / 3; }
+
+	// Estimate of how far the simplified surface strays from the original, in
+	// model units.
+	float						GetError() const			{ return m_Error; }
+
+private:
+	// Area weighted sum of the squared distances to a set of planes. The
+	// symmetric matrix is stored as its upper triangle.
+	struct Quadric
+	{
+		double					m_A[6];
+		double					m_B[3];
+		double					m_C;
+		double					m_Weight;
+	};
+
+	// An edge collapse, moving every vertex in group m_From onto a vertex in
+	// group m_To.
+	struct Collapse
+	{
+		double					m_Cost;
+		uint32_t				m_From;
+		uint32_t				m_To;
+	};
+
+	// Revoked.
+								MeshSimplifier( const MeshSimplifier & copy );
+	MeshSimplifier &			operator = ( const MeshSimplifier & copy );
+
+	static void					AddQuadric( Quadric & quadric, const Quadric & other );
+	double						EvaluateQuadric( const Quadric & quadric, const uint32_t group ) const;
+
+	// Checks whether a collapse can be made. If it can, the vertices of the
+	// group being moved are remapped in vertexRemap. groupTris lists the
+	// current triangles around each group (see Simplify).
+	bool						TryCollapse( const Collapse & collapse, const vector< uint32_t > & firstGroupTris, const vector< uint32_t > & groupTris, vector< uint32_t > & vertexRemap );
+
+	const aiVector3D &			GetGroupPosition( const uint32_t group ) const	{ return m_pVertices[ m_GroupVertices[ m_FirstGroupVertices[ group ] ] ]; }
+
+	const aiVector3D *			m_pVertices;
+
+	// Vertices with exactly the same position are welded into one group.
+	// m_GroupVertices[ m_FirstGroupVertices[g] ] to
+	// m_GroupVertices[ m_FirstGroupVertices[g + 1] ] are the vertices in
+	// group g.
+	vector< uint32_t >			m_VertexGroups;
+	vector< uint32_t >			m_FirstGroupVertices;
+	vector< uint32_t >			m_GroupVertices;
+
+	// One quadric per group, accumulated as groups are collapsed together.
+	vector< Quadric >			m_Quadrics;
+
+	vector< uint32_t >			m_TriIndices;
+	float						m_Error;
+};
@@ -0,0 +1,364 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Precomp.hpp"
+#include "Common.hpp"
+
+#include "OcclusionCulling.hpp"
+
+#include "Scene.hpp"
+#include "ShaderProgram.hpp"
+
+
+namespace
+{
+	// The depth buffer is halved on the GL until neither side is longer than
+	// this, and then read back.
+	const int MaxReadBackSize = 256;
+
+	// Boxes are tested on the first level of the pyramid where their
+	// footprint spans no more than this many texels each way.
+	const int MaxFootprintTexels = 4;
+
+	// Points with a smaller clip space w than this are taken to be behind the
+	// camera, and anything with such a point is kept.
+	const float MinClipW = 1e-5f;
+
+	// How much nearer a box has to be than the depth buffer to be kept, to
+	// allow for it being worked out slightly differently from the GL.
+	const float DepthTolerance = 1e-6f;
+}
+
+
+OcclusionCulling::OcclusionCulling()
+	: m_DepthTextureId	( 0 )
+	, m_Width			( 0 )
+	, m_Height			( 0 )
+	, m_FirstLevelShift	( 0 )
+{
+	m_ViewProjection.setIdentity();
+
+	glGenFramebuffers( 1, & m_FramebufferId );
+
+	glBindFramebuffer( GL_FRAMEBUFFER, m_FramebufferId );
+	{
+		glDrawBuffer( GL_COLOR_ATTACHMENT0 );
+		glReadBuffer( GL_COLOR_ATTACHMENT0 );
+	}
+
+	glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+}
+
+
+OcclusionCulling::~OcclusionCulling()
+{
+	if( ! m_LevelTextureIds.empty() )
+		glDeleteTextures( static_cast< GLsizei >( m_LevelTextureIds.size() ), m_LevelTextureIds.data() );
+
+	glDeleteFramebuffers( 1, & m_FramebufferId );
+}
+
+
+void OcclusionCulling::SetDepthTexture( const GLuint depthTextureId, const GLint width, const GLint height )
+{
+	m_DepthTextureId = depthTextureId;
+	m_Width = width;
+	m_Height = height;
+
+	if( ! m_LevelTextureIds.empty() )
+		glDeleteTextures( static_cast< GLsizei >( m_LevelTextureIds.size() ), m_LevelTextureIds.data() );
+
+	m_LevelTextureIds.clear();
+	m_LevelSizes.clear();
+	m_Levels.clear();
+
+	// Rounding the sizes up means that each texel covers two by two texels
+	// of the level above, and the last row or column of an odd sized level
+	// only has one texel above it on that side.
+	Vector2i size( max( width, 1 ), max( height, 1 ) );
+
+	do
+	{
+		size = Vector2i( ( size.x() + 1 ) / 2, ( size.y() + 1 ) / 2 );
+		m_LevelSizes.push_back( size );
+	}
+	while( size.maxCoeff() > MaxReadBackSize );
+
+	m_LevelTextureIds.resize( m_LevelSizes.size() );
+	glGenTextures( static_cast< GLsizei >( m_LevelTextureIds.size() ), m_LevelTextureIds.data() );
+
+	for( size_t levelIndex = 0; levelIndex < m_LevelTextureIds.size(); ++levelIndex )
+	{
+		glBindTexture( GL_TEXTURE_RECTANGLE, m_LevelTextureIds[ levelIndex ] );
+		glTexImage2D( GL_TEXTURE_RECTANGLE, 0, GL_R32F, m_LevelSizes[ levelIndex ].x(), m_LevelSizes[ levelIndex ].y(), 0, GL_RED, GL_FLOAT, nullptr );
+	}
+
+	glBindTexture( GL_TEXTURE_RECTANGLE, 0 );
+
+	// The CPU levels carry on from the last GL level down to a single texel.
+	m_FirstLevelShift = static_cast< int >( m_LevelSizes.size() );
+
+	for( ;; )
+	{
+		Level level;
+		level.m_Width = size.x();
+		level.m_Height = size.y();
+		m_Levels.push_back( level );
+
+		if( size.maxCoeff() == 1 )
+			break;
+
+		size = Vector2i( ( size.x() + 1 ) / 2, ( size.y() + 1 ) / 2 );
+	}
+
+	// Nothing is hidden until the pyramid has been built.
+	foreach( Level & level, m_Levels )
+		level.m_Depths.assign( level.m_Width * level.m_Height, 1.0f );
+}
+
+
+void OcclusionCulling::Build( const Matrix4f & viewProjection )
+{
+	m_ViewProjection = viewProjection;
+
+	GLint drawFramebufferId;
+	GLint readFramebufferId;
+	GLint viewport[4];
+	glGetIntegerv( GL_DRAW_FRAMEBUFFER_BINDING, & drawFramebufferId );
+	glGetIntegerv( GL_READ_FRAMEBUFFER_BINDING, & readFramebufferId );
+	glGetIntegerv( GL_VIEWPORT, viewport );
+
+	ShaderProgram & program = * GetScene().m_pDepthPyramidShaderProgram;
+	program.SetCurrent();
+	const GLint sourceSizeLocation = glGetUniformLocation( program.GetID(), "sourceSize" );
+
+	glBindFramebuffer( GL_FRAMEBUFFER, m_FramebufferId );
+	glDisable( GL_DEPTH_TEST );
+	glActiveTexture( GL_TEXTURE0 );
+
+	// Each GL level is drawn from the one above it, starting with the depth
+	// texture itself.
+	GLuint sourceTextureId = m_DepthTextureId;
+	Vector2i sourceSize( m_Width, m_Height );
+
+	for( size_t levelIndex = 0; levelIndex < m_LevelTextureIds.size(); ++levelIndex )
+	{
+		const Vector2i & size = m_LevelSizes[ levelIndex ];
+
+		glFramebufferTexture2D( GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_RECTANGLE, m_LevelTextureIds[ levelIndex ], 0 );
+		glViewport( 0, 0, size.x(), size.y() );
+
+		glBindTexture( GL_TEXTURE_RECTANGLE, sourceTextureId );
+		glUniform2i( sourceSizeLocation, sourceSize.x(), sourceSize.y() );
+
+		glBegin( GL_TRIANGLE_STRIP );
+		{
+			glVertex3f( -1.0f,  1.0f, 0.0f );
+			glVertex3f(  1.0f,  1.0f, 0.0f );
+			glVertex3f( -1.0f, -1.0f, 0.0f );
+			glVertex3f(  1.0f, -1.0f, 0.0f );
+		}
+		glEnd();
+
+		sourceTextureId = m_LevelTextureIds[ levelIndex ];
+		sourceSize = size;
+	}
+
+	// This waits for the GL to finish everything drawn so far.
+	glReadPixels( 0, 0, m_Levels[0].m_Width, m_Levels[0].m_Height, GL_RED, GL_FLOAT, m_Levels[0].m_Depths.data() );
+
+	glBindTexture( GL_TEXTURE_RECTANGLE, 0 );
+	glBindFramebuffer( GL_DRAW_FRAMEBUFFER, drawFramebufferId );
+	glBindFramebuffer( GL_READ_FRAMEBUFFER, readFramebufferId );
+	glViewport( viewport[0], viewport[1], viewport[2], viewport[3] );
+	glEnable( GL_DEPTH_TEST );
+
+	// The rest of the levels are small enough to build here.
+	for( size_t levelIndex = 1; levelIndex < m_Levels.size(); ++levelIndex )
+	{
+		const Level & source = m_Levels[ levelIndex - 1 ];
+		Level & level = m_Levels[ levelIndex ];
+
+		for( int y = 0; y < level.m_Height; ++y )
+		{
+			const float * pRow = & source.m_Depths[ 2 * y * source.m_Width ];
+			const float * pNextRow = ( 2 * y + 1 < source.m_Height ) ? pRow + source.m_Width : pRow;
+
+			for( int x = 0; x < level.m_Width; ++x )
+			{
+				const int sourceX = 2 * x;
+				const int nextSourceX = min( sourceX + 1, source.m_Width - 1 );
+
+				level.m_Depths[ y * level.m_Width + x ] = max( max( pRow[ sourceX ], pRow[ nextSourceX ] ), max( pNextRow[ sourceX ], pNextRow[ nextSourceX ] ) );
+			}
+		}
+	}
+}
+
+
+void OcclusionCulling::Cull( const TransformHierarchy::InstanceBounds & bounds, const size_t firstInstance, const size_t endInstance, uint8_t * pIsVisible, Stats & stats ) const
+{
+	for( size_t instanceIndex = firstInstance; instanceIndex < endInstance; ++instanceIndex )
+	{
+		uint8_t & isVisible = pIsVisible[ instanceIndex - firstInstance ];
+
+		if( ! isVisible )
+			continue;
+
+		const Vector3f centre( bounds.m_Centres[0][ instanceIndex ], bounds.m_Centres[1][ instanceIndex ], bounds.m_Centres[2][ instanceIndex ] );
+		const Vector3f extent( bounds.m_Extents[0][ instanceIndex ], bounds.m_Extents[1][ instanceIndex ], bounds.m_Extents[2][ instanceIndex ] );
+
+		++stats.m_NumTested;
+
+		if( ! IsBoxVisible( centre, extent ) )
+		{
+			isVisible = 0;
+			++stats.m_NumOccluded;
+		}
+	}
+}
+
+
+void OcclusionCulling::CullShadows( const TransformHierarchy::InstanceBounds & bounds, const size_t firstInstance, const size_t endInstance, const Vector3f & lightPosition, const float lightRadius, uint8_t * pIsVisible, Stats & stats ) const
+{
+	for( size_t instanceIndex = firstInstance; instanceIndex < endInstance; ++instanceIndex )
+	{
+		uint8_t & isVisible = pIsVisible[ instanceIndex - firstInstance ];
+
+		if( ! isVisible )
+			continue;
+
+		const Vector3f centre( bounds.m_Centres[0][ instanceIndex ], bounds.m_Centres[1][ instanceIndex ], bounds.m_Centres[2][ instanceIndex ] );
+		const Vector3f extent( bounds.m_Extents[0][ instanceIndex ], bounds.m_Extents[1][ instanceIndex ], bounds.m_Extents[2][ instanceIndex ] );
+
+		++stats.m_NumTested;
+
+		if( ! IsShadowVisible( centre, extent, lightPosition, lightRadius ) )
+		{
+			isVisible = 0;
+			++stats.m_NumOccluded;
+		}
+	}
+}
+
+
+bool OcclusionCulling::IsBoxVisible( const Vector3f & centre, const Vector3f & extent ) const
+{
+	Vector4f points[8];
+
+	for( int cornerIndex = 0; cornerIndex < 8; ++cornerIndex )
+	{
+		const Vector3f corner( ( cornerIndex & 1 ) ? extent.x() : -extent.x(),
+							   ( cornerIndex & 2 ) ? extent.y() : -extent.y(),
+							   ( cornerIndex & 4 ) ? extent.z() : -extent.z() );
+
+		points[ cornerIndex ] = m_ViewProjection * ( centre + corner ).homogeneous();
+
+		if( points[ cornerIndex ].w() < MinClipW )
+			return true;
+	}
+
+	return IsHullVisible( points, 8 );
+}
+
+
+bool OcclusionCulling::IsShadowVisible( const Vector3f & centre, const Vector3f & extent, const Vector3f & lightPosition, const float lightRadius ) const
+{
+	// Every point in the shadow volume is on a ray from some point on the
+	// light through some point in the box, past the box. Those rays point
+	// from the light's centre towards the box grown by the light's radius,
+	// so the volume is inside the box swept along the directions to the
+	// corners of the grown box, which are points at infinity (w = 0). All of
+	// it projects inside the hull of the sixteen points, as long as none of
+	// them are behind the camera.
+	Vector4f points[16];
+
+	for( int cornerIndex = 0; cornerIndex < 8; ++cornerIndex )
+	{
+		const Vector3f sign( ( cornerIndex & 1 ) ? 1.0f : -1.0f,
+							 ( cornerIndex & 2 ) ? 1.0f : -1.0f,
+							 ( cornerIndex & 4 ) ? 1.0f : -1.0f );
+
+		const Vector3f corner = centre + sign.cwiseProduct( extent );
+		const Vector3f direction = centre + sign.cwiseProduct( extent + Vector3f::Constant( lightRadius ) ) - lightPosition;
+
+		points[ cornerIndex ] = m_ViewProjection * corner.homogeneous();
+		points[ cornerIndex + 8 ] = m_ViewProjection * Vector4f( direction.x(), direction.y(), direction.z(), 0.0f );
+
+		if( points[ cornerIndex ].w() < MinClipW || points[ cornerIndex + 8 ].w() < MinClipW )
+			return true;
+	}
+
+	return IsHullVisible( points, 16 );
+}
+
+
+bool OcclusionCulling::IsHullVisible( const Vector4f * pPoints, const size_t numPoints ) const
+{
+	if( m_Levels.empty() )
+		return true;
+
+	// The footprint in normalised device coordinates, and the nearest depth.
+	Vector2f minPosition( Vector2f::Constant( numeric_limits< float >::max() ) );
+	Vector2f maxPosition( Vector2f::Constant( -numeric_limits< float >::max() ) );
+	float minDepth = numeric_limits< float >::max();
+
+	for( size_t pointIndex = 0; pointIndex < numPoints; ++pointIndex )
+	{
+		const Vector3f position = pPoints[ pointIndex ].head< 3 >() / pPoints[ pointIndex ].w();
+
+		minPosition = minPosition.cwiseMin( position.head< 2 >() );
+		maxPosition = maxPosition.cwiseMax( position.head< 2 >() );
+		minDepth = min( minDepth, position.z() );
+	}
+
+	// In pixels. Nothing off the screen can be seen.
+	const Vector2f screenSize( static_cast< float >( m_Width ), static_cast< float >( m_Height ) );
+	const Vector2f minPixel = ( minPosition * 0.5f + Vector2f::Constant( 0.5f ) ).cwiseProduct( screenSize );
+	const Vector2f maxPixel = ( maxPosition * 0.5f + Vector2f::Constant( 0.5f ) ).cwiseProduct( screenSize );
+
+	if( maxPixel.x() < 0.0f || maxPixel.y() < 0.0f || minPixel.x() >= screenSize.x() || minPixel.y() >= screenSize.y() )
+		return false;
+
+	const int minX = static_cast< int >( max( minPixel.x(), 0.0f ) );
+	const int minY = static_cast< int >( max( minPixel.y(), 0.0f ) );
+	const int maxX = static_cast< int >( min( maxPixel.x(), screenSize.x() - 1.0f ) );
+	const int maxY = static_cast< int >( min( maxPixel.y(), screenSize.y() - 1.0f ) );
+
+	// The first level that the footprint is small enough on, unless it's
+	// bigger than the smallest level.
+	size_t levelIndex = 0;
+	int shift = m_FirstLevelShift;
+
+	while( levelIndex + 1 < m_Levels.size() && ( ( maxX >> shift ) - ( minX >> shift ) >= MaxFootprintTexels || ( maxY >> shift ) - ( minY >> shift ) >= MaxFootprintTexels ) )
+	{
+		++levelIndex;
+		++shift;
+	}
+
+	const Level & level = m_Levels[ levelIndex ];
+	float maxDepth = 0.0f;
+
+	for( int y = minY >> shift; y <= maxY >> shift; ++y )
+	{
+		for( int x = minX >> shift; x <= maxX >> shift; ++x )
+			maxDepth = max( maxDepth, level.m_Depths[ y * level.m_Width + x ] );
+	}
+
+	// Depths go from 0 at the near plane to 1 at the far plane, or at
+	// infinity.
+	return minDepth * 0.5f + 0.5f <= maxDepth + DepthTolerance;
+}
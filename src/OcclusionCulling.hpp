@@ -0,0 +1,127 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Culls mesh instances that are hidden behind what has already been drawn,
+// using a hierarchical depth buffer: a pyramid of ever smaller copies of the
+// depth buffer, each texel of which holds the furthest depth of the texels it
+// covers in the level above. A box is hidden if its nearest point is further
+// away than the furthest depth under its footprint on the screen, which a
+// level where the footprint only spans a few texels each way answers in a
+// handful of reads.
+//
+// The depth buffer is shrunk on the GL until it is small enough to read back
+// cheaply, and the rest of the pyramid is built on the CPU, where the boxes
+// are tested. Reading it back waits for the GL to finish drawing the depth, so
+// Camera::Render draws the instances that were visible last frame first,
+// builds the pyramid from their depth, and then only draws the instances
+// that turn out to be visible in a second pass.
+//
+// Shadow casters can't be culled by whether they are hidden themselves, as
+// their shadows may still fall somewhere visible. Instead, their shadow
+// volumes are bounded by the caster's box together with its extrusion away
+// from the light, and culled if the whole volume is behind everything drawn,
+// as it then can't contain anything that is lit.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+
+#include "TransformHierarchy.hpp"
+
+
+///////////////////////////////////////////////////////////////////////////////
+// OcclusionCulling class
+///////////////////////////////////////////////////////////////////////////////
+class OcclusionCulling
+{
+public:
+	// How many instances were tested and how many of them were hidden.
+	struct Stats
+	{
+							Stats()									: m_NumTested( 0 ), m_NumOccluded( 0 ) {}
+
+		Stats &				operator += ( const Stats & other )		{ m_NumTested += other.m_NumTested; m_NumOccluded += other.m_NumOccluded; return * this; }
+
+		size_t				m_NumTested;
+		size_t				m_NumOccluded;
+	};
+
+							OcclusionCulling();
+							~OcclusionCulling();
+
+	// Sets the depth texture that the pyramid is built from, which must be a
+	// rectangle texture of the given size. Call this again whenever the
+	// texture is resized.
+	void					SetDepthTexture( const GLuint depthTextureId, const GLint width, const GLint height );
+
+	// Builds the pyramid from what is in the depth texture now, which was
+	// drawn with the given projection * view matrix. Leaves the framebuffer
+	// and viewport as they were, and the depth test enabled.
+	void					Build( const Matrix4f & viewProjection );
+
+	// Tests the boxes from firstInstance up to endInstance whose entries in
+	// pIsVisible, counting from the first box, are set, and clears the
+	// entries of those that are hidden. The boxes tested are added to stats.
+	// Testing doesn't change anything in here, so ranges of boxes can be
+	// tested on several threads at once.
+	void					Cull( const TransformHierarchy::InstanceBounds & bounds, const size_t firstInstance, const size_t endInstance, uint8_t * pIsVisible, Stats & stats ) const;
+
+	// Culls shadow casters in the same way, by their shadow volumes. The
+	// light position is in world space, and the light is treated as a sphere
+	// of the given radius (see ShadowCulling::LightRadius).
+	void					CullShadows( const TransformHierarchy::InstanceBounds & bounds, const size_t firstInstance, const size_t endInstance, const Vector3f & lightPosition, const float lightRadius, uint8_t * pIsVisible, Stats & stats ) const;
+
+	// Tests a single box, given by its centre and half extents in world
+	// space, or the shadow volume that it casts.
+	bool					IsBoxVisible( const Vector3f & centre, const Vector3f & extent ) const;
+	bool					IsShadowVisible( const Vector3f & centre, const Vector3f & extent, const Vector3f & lightPosition, const float lightRadius ) const;
+
+	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+	// Revoked.
+							OcclusionCulling( const OcclusionCulling & copy );
+	OcclusionCulling &		operator = ( const OcclusionCulling & copy );
+
+	// Tests the convex hull of some points, each in clip space, which must
+	// all be in front of the camera.
+	bool					IsHullVisible( const Vector4f * pPoints, const size_t numPoints ) const;
+
+	// A level of the pyramid on the CPU, with its depths in rows
+	// from the bottom of the screen up, like the GL.
+	struct Level
+	{
+		int					m_Width;
+		int					m_Height;
+		vector< float >		m_Depths;
+	};
+
+	GLuint					m_FramebufferId;
+	GLuint					m_DepthTextureId;
+	GLint					m_Width;
+	GLint					m_Height;
+
+	// The levels built on the GL, largest first, each half the size of the
+	// one before rounded up. Only the last one is read back.
+	vector< GLuint >		m_LevelTextureIds;
+	vector< Vector2i >		m_LevelSizes;
+
+	// The levels on the CPU, largest first, and how many times the first of
+	// them was halved from the depth buffer.
+	vector< Level >			m_Levels;
+	int						m_FirstLevelShift;
+
+	Matrix4f				m_ViewProjection;
+};
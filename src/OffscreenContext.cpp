@@ -0,0 +1,152 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Precomp.hpp"
+#include "Common.hpp"
+
+#include "OffscreenContext.hpp"
+
+#if defined( __linux__ )
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#else
+#include <GL/osmesa.h>
+#endif
+
+
+#if defined( __linux__ )
+
+// Not all versions of eglext.h have this.
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+
+OffscreenContext::OffscreenContext()
+	: m_pDisplay	( EGL_NO_DISPLAY )
+	, m_pContext	( EGL_NO_CONTEXT )
+{
+	// Prefer the surfaceless platform as it doesn't need a display server or
+	// a GPU. If the EGL implementation doesn't know about it, the default
+	// display is the next best thing.
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = reinterpret_cast< PFNEGLGETPLATFORMDISPLAYEXTPROC >( eglGetProcAddress( "eglGetPlatformDisplayEXT" ) );
+
+	if( getPlatformDisplay != nullptr )
+		m_pDisplay = getPlatformDisplay( EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr );
+
+	if( m_pDisplay == EGL_NO_DISPLAY )
+		m_pDisplay = eglGetDisplay( EGL_DEFAULT_DISPLAY );
+
+	EGLint majorVersion, minorVersion;
+
+	if( m_pDisplay == EGL_NO_DISPLAY || ! eglInitialize( m_pDisplay, & majorVersion, & minorVersion ) )
+		throw runtime_error( "Error initialising EGL" );
+
+	// We need desktop GL rather than GLES.
+	if( ! eglBindAPI( EGL_OPENGL_API ) )
+	{
+		eglTerminate( m_pDisplay );
+		throw runtime_error( "EGL implementation doesn't support desktop OpenGL" );
+	}
+
+	// We never render to a surface so any config that supports desktop GL
+	// will do.
+	const EGLint configAttributes[] =
+	{
+		EGL_RENDERABLE_TYPE,	EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+
+	EGLConfig config = nullptr;
+	EGLint numConfigs = 0;
+
+	eglChooseConfig( m_pDisplay, configAttributes, & config, 1, & numConfigs );
+
+	// The renderer uses the fixed function matrix stack and lights as well as
+	// shaders, so it needs a compatibility profile. Without a version number
+	// Mesa gives us the newest compatibility profile it supports.
+	const EGLint contextAttributes[] =
+	{
+		EGL_CONTEXT_OPENGL_PROFILE_MASK,	EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+		EGL_NONE
+	};
+
+	m_pContext = eglCreateContext( m_pDisplay, numConfigs > 0 ? config : nullptr, EGL_NO_CONTEXT, contextAttributes );
+
+	if( m_pContext == EGL_NO_CONTEXT || ! eglMakeCurrent( m_pDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, m_pContext ) )
+	{
+		if( m_pContext != EGL_NO_CONTEXT )
+			eglDestroyContext( m_pDisplay, m_pContext );
+
+		eglTerminate( m_pDisplay );
+		throw runtime_error( "Error creating surfaceless EGL context" );
+	}
+
+	clog << "Created EGL " << majorVersion << "." << minorVersion << " context" << endl;
+}
+
+
+OffscreenContext::~OffscreenContext()
+{
+	eglMakeCurrent( m_pDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT );
+	eglDestroyContext( m_pDisplay, m_pContext );
+	eglTerminate( m_pDisplay );
+}
+
+#else
+
+OffscreenContext::OffscreenContext()
+	: m_pDisplay	( nullptr )
+	, m_pContext	( nullptr )
+	, m_Buffer		( 4 )
+{
+	// As with EGL, we need a compatibility profile (which is what OSMesa gives
+	// us by default).
+	OSMesaContext context = OSMesaCreateContextExt( OSMESA_RGBA, 24, 8, 0, nullptr );
+
+	if( context == nullptr )
+		throw runtime_error( "Error creating OSMesa context" );
+
+	if( ! OSMesaMakeCurrent( context, m_Buffer.data(), GL_UNSIGNED_BYTE, 1, 1 ) )
+	{
+		OSMesaDestroyContext( context );
+		throw runtime_error( "Error making OSMesa context current" );
+	}
+
+	m_pContext = context;
+
+	clog << "Created OSMesa context" << endl;
+}
+
+
+OffscreenContext::~OffscreenContext()
+{
+	OSMesaDestroyContext( static_cast< OSMesaContext >( m_pContext ) );
+}
+
+#endif
+
+
+string OffscreenContext::GetRenderer()
+{
+	const GLubyte * pRenderer = glGetString( GL_RENDERER );
+	const GLubyte * pVersion = glGetString( GL_VERSION );
+
+	if( pRenderer == nullptr || pVersion == nullptr )
+		return "unknown";
+
+	return string( reinterpret_cast< const char * >( pRenderer ) ) + ", OpenGL " + reinterpret_cast< const char * >( pVersion );
+}
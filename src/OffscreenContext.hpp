@@ -0,0 +1,55 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// An OpenGL context that isn't attached to a window, for rendering without a
+// display (eg on a build server). On Linux this uses EGL with Mesa's
+// surfaceless platform, which works on any Mesa driver including the llvmpipe
+// software rasteriser. Elsewhere it falls back to OSMesa. There is no default
+// framebuffer to speak of, so everything should be rendered into a
+// framebuffer object.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+
+///////////////////////////////////////////////////////////////////////////////
+// OffscreenContext class
+///////////////////////////////////////////////////////////////////////////////
+class OffscreenContext
+{
+public:
+	// Creates the context and makes it current on the calling thread. Throws
+	// if no suitable context could be created.
+							OffscreenContext();
+							~OffscreenContext();
+
+	// Returns a description of the driver that is doing the rendering, eg
+	// "llvmpipe (LLVM 15.0.7, 256 bits)".
+	static string			GetRenderer();
+
+private:
+	// Revoked.
+							OffscreenContext( const OffscreenContext & copy );
+	OffscreenContext &		operator = ( const OffscreenContext & copy );
+
+	// Platform specific handles. These are stored as opaque pointers so that
+	// the platform headers don't leak into everything that includes this.
+	void *					m_pDisplay;
+	void *					m_pContext;
+
+	// OSMesa insists on having somewhere to render to, even though we only
+	// ever render into framebuffer objects.
+	vector< uint8_t >		m_Buffer;
+};
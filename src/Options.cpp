@@ -0,0 +1,143 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Precomp.hpp"
+#include "Common.hpp"
+
+#include "Options.hpp"
+
+
+Options::Options()
+	: m_ImportProfile	( SceneImporter::Profile_MaxQuality )
+	, m_TriangleOrder	( TriangleOrder::Mode_Overdraw )
+	, m_KeepCpuGeometry	( false )
+	, m_CompactVertices	( true )
+	, m_SceneBuffers	( true )
+	, m_UseLods			( true )
+	, m_LodPixelError	( 1.0f )
+	, m_ShadowLodPixelError( 4.0f )
+	, m_SilhouetteShadows( true )
+	, m_ShadowCulling	( true )
+	, m_FrustumCulling	( true )
+	, m_Instancing		( true )
+	, m_OcclusionCulling( true )
+	, m_ShadowVolumeCache( true )
+	, m_LightRange		( 0.0f )
+{}
+
+
+Options & GetOptions()
+{
+	static Options options;
+	return options;
+}
+
+
+void AddOptions( wxCmdLineParser & parser )
+{
+	string profileNames;
+
+	for( int profileIndex = 0; profileIndex < SceneImporter::NumProfiles; ++profileIndex )
+		profileNames += string( profileNames.empty() ? "" : ", " ) + SceneImporter::GetProfileName( static_cast< SceneImporter::Profile >( profileIndex ) );
+
+	string modeNames;
+
+	for( int modeIndex = 0; modeIndex < TriangleOrder::NumModes; ++modeIndex )
+		modeNames += string( modeNames.empty() ? "" : ", " ) + TriangleOrder::GetModeName( static_cast< TriangleOrder::Mode >( modeIndex ) );
+
+	parser.AddOption( "p", "import-profile", "Post-processing used when importing scenes (" + profileNames + ")" );
+	parser.AddOption( "r", "triangle-order", "How triangles are ordered when building the scene cache (" + modeNames + ")" );
+	parser.AddSwitch( "k", "keep-cpu-geometry", "Keep CPU copies of meshes once they are uploaded" );
+	parser.AddSwitch( "F", "float-vertices", "Upload meshes as float streams rather than compact vertices" );
+	parser.AddSwitch( "B", "no-scene-buffers", "Give each mesh its own buffers rather than pooling them and drawing with multi-draws" );
+	parser.AddSwitch( "L", "no-lods", "Always draw meshes at full detail" );
+	parser.AddOption( "e", "lod-error", "Largest error in pixels allowed when choosing LODs (default 1)", wxCMD_LINE_VAL_DOUBLE );
+	parser.AddOption( "E", "shadow-lod-error", "Largest error in pixels allowed when choosing LODs for shadows (default 4)", wxCMD_LINE_VAL_DOUBLE );
+	parser.AddSwitch( "S", "triangle-shadows", "Extrude shadows from every triangle, even for closed meshes" );
+	parser.AddSwitch( "C", "no-shadow-culling", "Draw every triangle in the shadow passes rather than culling clusters" );
+	parser.AddSwitch( "U", "no-frustum-culling", "Draw every mesh instance rather than culling those outside the view" );
+	parser.AddSwitch( "I", "no-instancing", "Draw each mesh instance on its own rather than all instances of a mesh at once" );
+	parser.AddSwitch( "O", "no-occlusion-culling", "Draw every mesh instance and shadow caster in the frustum rather than culling hidden ones" );
+	parser.AddSwitch( "V", "no-shadow-cache", "Extrude every shadow volume every frame rather than caching those of static casters" );
+	parser.AddOption( "R", "light-range", "How far the shadowed light reaches, or 0 for no limit (default 0)", wxCMD_LINE_VAL_DOUBLE );
+}
+
+
+bool ParseOptions( const wxCmdLineParser & parser )
+{
+	wxString profileName;
+
+	if( parser.Found( "import-profile", & profileName ) &&
+		! SceneImporter::FindProfile( profileName.ToStdString(), GetOptions().m_ImportProfile ) )
+	{
+		wxLogError( "Unknown import profile '%s'", profileName );
+		return false;
+	}
+
+	wxString modeName;
+
+	if( parser.Found( "triangle-order", & modeName ) &&
+		! TriangleOrder::FindMode( modeName.ToStdString(), GetOptions().m_TriangleOrder ) )
+	{
+		wxLogError( "Unknown triangle order '%s'", modeName );
+		return false;
+	}
+
+	if( parser.Found( "keep-cpu-geometry" ) )
+		GetOptions().m_KeepCpuGeometry = true;
+
+	if( parser.Found( "float-vertices" ) )
+		GetOptions().m_CompactVertices = false;
+
+	if( parser.Found( "no-scene-buffers" ) )
+		GetOptions().m_SceneBuffers = false;
+
+	if( parser.Found( "no-lods" ) )
+		GetOptions().m_UseLods = false;
+
+	double pixelError;
+
+	if( parser.Found( "lod-error", & pixelError ) )
+		GetOptions().m_LodPixelError = static_cast< float >( pixelError );
+
+	if( parser.Found( "shadow-lod-error", & pixelError ) )
+		GetOptions().m_ShadowLodPixelError = static_cast< float >( pixelError );
+
+	if( parser.Found( "triangle-shadows" ) )
+		GetOptions().m_SilhouetteShadows = false;
+
+	if( parser.Found( "no-shadow-culling" ) )
+		GetOptions().m_ShadowCulling = false;
+
+	if( parser.Found( "no-frustum-culling" ) )
+		GetOptions().m_FrustumCulling = false;
+
+	if( parser.Found( "no-instancing" ) )
+		GetOptions().m_Instancing = false;
+
+	if( parser.Found( "no-occlusion-culling" ) )
+		GetOptions().m_OcclusionCulling = false;
+
+	if( parser.Found( "no-shadow-cache" ) )
+		GetOptions().m_ShadowVolumeCache = false;
+
+	double lightRange;
+
+	if( parser.Found( "light-range", & lightRange ) )
+		GetOptions().m_LightRange = static_cast< float >( max( lightRange, 0.0 ) );
+
+	return true;
+}
@@ -0,0 +1,106 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Settings that can be chosen from the command line and/or the UI. There is
+// one global set of options (see GetOptions).
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+
+#include "SceneImporter.hpp"
+#include "TriangleOrder.hpp"
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Options struct
+///////////////////////////////////////////////////////////////////////////////
+struct Options
+{
+								Options();
+
+	// Post-processing steps used when importing scenes that aren't in the
+	// scene cache yet.
+	SceneImporter::Profile		m_ImportProfile;
+
+	// How the triangles of each mesh are ordered when building the scene
+	// cache.
+	TriangleOrder::Mode			m_TriangleOrder;
+
+	// Keep a CPU copy of each mesh's geometry after uploading it to the GL
+	// (see Mesh::Upload). Off by default, as nothing reads the copies yet and
+	// they cost as much memory as the meshes themselves.
+	bool						m_KeepCpuGeometry;
+
+	// Upload meshes in the compact, quantised vertex layout (see Mesh.hpp)
+	// rather than as separate float streams.
+	bool						m_CompactVertices;
+
+	// Upload compact meshes into the scene's shared GeometryPool and draw
+	// them with indirect multi-draws (see DrawBatch), rather than giving each
+	// mesh buffers of its own. Ignored if the GL doesn't support it.
+	bool						m_SceneBuffers;
+
+	// Draw simplified LODs of meshes (see MeshSimplifier) where the
+	// difference from the full detail mesh would project to no more than the
+	// given number of pixels. Shadow volumes can get away with a much coarser
+	// LOD than the surfaces themselves.
+	bool						m_UseLods;
+	float						m_LodPixelError;
+	float						m_ShadowLodPixelError;
+
+	// Extrude the shadows of closed meshes from their silhouettes rather than
+	// from every triangle (see ShadowPass.hpp).
+	bool						m_SilhouetteShadows;
+
+	// Skip mesh instances and clusters of triangles that can't cast a
+	// visible shadow when drawing the shadow passes (see FrustumCulling and
+	// ShadowCulling).
+	bool						m_ShadowCulling;
+
+	// Skip mesh instances that are outside the view frustum when drawing the
+	// scene (see FrustumCulling).
+	bool						m_FrustumCulling;
+
+	// Draw all the instances of the same LOD of a mesh with one instanced
+	// draw, in the G-buffer and shadow passes alike (see RenderQueue).
+	bool						m_Instancing;
+
+	// Skip mesh instances that are hidden behind what has already been
+	// drawn, and shadow casters whose shadows are, using a depth pyramid
+	// built partway through the frame (see OcclusionCulling).
+	bool						m_OcclusionCulling;
+
+	// Capture the per-triangle shadow volumes of casters that aren't moving,
+	// and draw them from the capture while neither they nor the light move
+	// (see ShadowVolumeCache).
+	bool						m_ShadowVolumeCache;
+
+	// How far the shadowed light reaches, or zero if it reaches everywhere.
+	// The shadow passes are limited to the part of the screen, and the range
+	// of depths, that the light's sphere of influence covers.
+	float						m_LightRange;
+};
+
+
+Options & GetOptions();
+
+// Adds the command line options that set the global options, which the app
+// and the headless renderer share.
+void AddOptions( wxCmdLineParser & parser );
+
+// Sets the global options from a parsed command line. Logs an error and
+// returns false if a value isn't valid.
+bool ParseOptions( const wxCmdLineParser & parser );
@@ -19,32 +19,57 @@
 #define _CRT_SECURE_NO_WARNINGS
 #define _SCL_SECURE_NO_WARNINGS
 
+#include <map>
+#include <set>
 #include <array>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <random>
 #include <vector>
 #include <string>
 #include <memory>
 #include <bitset>
+#include <exception>
+#include <type_traits>
+#include <functional>
+#include <unordered_map>
+#include <condition_variable>
 #include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
 #include <cstdint>
+#include <emmintrin.h>
 
 #include <boost/foreach.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/mpl/vector_c.hpp>
 #include <boost/intrusive/set.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
 #include <boost/mpl/max_element.hpp>
 #include <boost/ptr_container/ptr_list.hpp>
 #include <boost/ptr_container/ptr_vector.hpp>
 #include <boost/math/constants/constants.hpp>
 
-#include <gl/glew.h>
+#include <GL/glew.h>
 
 #include <wx/wxprec.h>
+#include <wx/cmdline.h>
+
+// The headless renderer is built against wxBase alone on Linux.
+#if wxUSE_GUI
 #include <wx/glcanvas.h>
 #include <wx/splitter.h>
 #include <wx/notebook.h>
 #include <wx/propgrid/propgrid.h>
+#endif
 
 #include <assimp/Importer.hpp>
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include <assimp/DefaultLogger.hpp>
@@ -0,0 +1,263 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Precomp.hpp"
+#include "Common.hpp"
+
+#include "RenderQueue.hpp"
+
+#include "Mesh.hpp"
+#include "Options.hpp"
+#include "Texture.hpp"
+#include "Material.hpp"
+#include "DrawBatch.hpp"
+#include "ShaderProgram.hpp"
+#include "MeshSimplifier.hpp"
+
+
+RenderQueue::RenderQueue()
+	: m_NumStateChanges( 0 )
+{}
+
+
+void RenderQueue::Clear()
+{
+	m_Items.clear();
+	m_Instances.clear();
+	m_Entries.clear();
+	m_ItemsByLod.clear();
+	m_NumStateChanges = 0;
+}
+
+
+void RenderQueue::AddDraw( DrawList & list, Mesh & mesh, const size_t lodIndex, const size_t nodeIndex, const Affine3f & modelView )
+{
+	const Material & material = * mesh.GetMaterial();
+	const GLuint programId = material.m_pShaderProgram ? material.m_pShaderProgram->GetID() : 0;
+	const GLuint textureId = material.m_pDiffuseTexture ? material.m_pDiffuseTexture->GetID() : 0;
+	const float depth = ( modelView * mesh.GetBounds().center() ).z();
+
+	Draw draw;
+	draw.m_pMesh = & mesh;
+	draw.m_Key = MakeKey( mesh.IsPooled() ? Pass_Pooled : Pass_Direct, programId, textureId, depth );
+	draw.m_LodIndex = static_cast< uint32_t >( lodIndex );
+	draw.m_NodeIndex = static_cast< uint32_t >( nodeIndex );
+
+	list.push_back( draw );
+}
+
+
+void RenderQueue::Merge( const DrawList & list )
+{
+	const bool isInstancing = GetOptions().m_Instancing;
+
+	foreach( const Draw & draw, list )
+	{
+		// Instances of a LOD that is already queued join its draw, which
+		// moves forward to the nearest of them. Only the depth differs
+		// between their keys.
+		uint32_t itemIndex = static_cast< uint32_t >( m_Items.size() );
+
+		if( isInstancing )
+		{
+			static_assert( MeshSimplifier::MaxLods <= 8, "LODs don't fit in the low bits of a mesh's address" );
+
+			const uint64_t lodKey = ( static_cast< uint64_t >( reinterpret_cast< uintptr_t >( draw.m_pMesh ) ) << 3 ) | draw.m_LodIndex;
+			const auto insertion = m_ItemsByLod.insert( make_pair( lodKey, itemIndex ) );
+
+			if( ! insertion.second )
+			{
+				itemIndex = insertion.first->second;
+				m_Entries[ itemIndex ].m_Key = min( m_Entries[ itemIndex ].m_Key, draw.m_Key );
+			}
+		}
+
+		if( itemIndex == m_Items.size() )
+		{
+			Item item;
+			item.m_pMesh = draw.m_pMesh;
+			item.m_LodIndex = draw.m_LodIndex;
+			item.m_FirstInstance = 0;
+			item.m_NumInstances = 0;
+			item.m_FirstBatchInstance = 0;
+
+			SortEntry entry;
+			entry.m_Key = draw.m_Key;
+			entry.m_ItemIndex = itemIndex;
+
+			m_Items.push_back( item );
+			m_Entries.push_back( entry );
+		}
+
+		Instance instance;
+		instance.m_ItemIndex = itemIndex;
+		instance.m_NodeIndex = draw.m_NodeIndex;
+
+		m_Instances.push_back( instance );
+		++m_Items[ itemIndex ].m_NumInstances;
+	}
+}
+
+
+void RenderQueue::Submit( const TransformHierarchy::MatrixArray & modelViews, DrawBatch & batch )
+{
+	GatherInstances();
+	RadixSort( m_Entries, m_Scratch );
+
+	// Every instance goes in the batch before anything is drawn, so that the
+	// transforms are only uploaded once.
+	foreach( const SortEntry & entry, m_Entries )
+		AddInstances( m_Items[ entry.m_ItemIndex ], modelViews, batch );
+
+	batch.UploadInstances();
+
+	// Meshes are drawn with whatever program and texture are current, so
+	// they are only changed between draws that need different ones.
+	const ShaderProgram * pCurrentProgram = nullptr;
+	const Texture * pCurrentTexture = nullptr;
+
+	m_NumStateChanges = 0;
+
+	foreach( const SortEntry & entry, m_Entries )
+	{
+		const Item & item = m_Items[ entry.m_ItemIndex ];
+		Mesh & mesh = * item.m_pMesh;
+
+		// The batch sets up each material itself.
+		if( ! mesh.IsPooled() )
+		{
+			Material & material = * mesh.GetMaterial();
+
+			if( material.m_pShaderProgram.get() != pCurrentProgram )
+			{
+				material.m_pShaderProgram->SetCurrent();
+				pCurrentProgram = material.m_pShaderProgram.get();
+				++m_NumStateChanges;
+			}
+
+			if( material.m_pDiffuseTexture && material.m_pDiffuseTexture.get() != pCurrentTexture )
+			{
+				material.m_pDiffuseTexture->Bind();
+				pCurrentTexture = material.m_pDiffuseTexture.get();
+				++m_NumStateChanges;
+			}
+		}
+
+		mesh.Render( item.m_LodIndex, item.m_FirstBatchInstance, item.m_NumInstances, batch );
+	}
+}
+
+
+void RenderQueue::SubmitShadowVolumes( const ShadowPass pass, const TransformHierarchy::MatrixArray & modelViews, DrawBatch & batch, ShadowCulling * pCulling )
+{
+	GatherInstances();
+
+	foreach( Item & item, m_Items )
+		AddInstances( item, modelViews, batch );
+
+	batch.UploadInstances();
+
+	foreach( const Item & item, m_Items )
+	{
+		m_InstanceModelViews.clear();
+
+		for( size_t instanceIndex = item.m_FirstInstance; instanceIndex < item.m_FirstInstance + item.m_NumInstances; ++instanceIndex )
+			m_InstanceModelViews.push_back( modelViews[ m_NodeIndices[ instanceIndex ] ] );
+
+		item.m_pMesh->RenderShadowVolumes( item.m_LodIndex, pass, item.m_FirstBatchInstance, item.m_NumInstances, m_InstanceModelViews.data(), batch, pCulling );
+	}
+}
+
+
+void RenderQueue::GatherInstances()
+{
+	// A counting sort by item, which keeps each item's instances in the
+	// order they were queued.
+	uint32_t firstInstance = 0;
+
+	foreach( Item & item, m_Items )
+	{
+		item.m_FirstInstance = firstInstance;
+		firstInstance += item.m_NumInstances;
+		item.m_NumInstances = 0;
+	}
+
+	m_NodeIndices.resize( m_Instances.size() );
+
+	foreach( const Instance & instance, m_Instances )
+	{
+		Item & item = m_Items[ instance.m_ItemIndex ];
+		m_NodeIndices[ item.m_FirstInstance + item.m_NumInstances++ ] = instance.m_NodeIndex;
+	}
+}
+
+
+void RenderQueue::AddInstances( Item & item, const TransformHierarchy::MatrixArray & modelViews, DrawBatch & batch ) const
+{
+	const Mesh & mesh = * item.m_pMesh;
+	item.m_FirstBatchInstance = static_cast< uint32_t >( batch.GetNumInstances() );
+
+	for( size_t instanceIndex = item.m_FirstInstance; instanceIndex < item.m_FirstInstance + item.m_NumInstances; ++instanceIndex )
+		batch.AddInstance( Affine3f( modelViews[ m_NodeIndices[ instanceIndex ] ] ), mesh.GetPositionScale(), mesh.GetPositionOffset() );
+}
+
+
+uint64_t RenderQueue::MakeKey( const Pass pass, const GLuint programId, const GLuint textureId, const float depth )
+{
+	// The bits of a positive float sort in the same order as its value.
+	uint32_t depthBits;
+	const float clampedDepth = max( depth, 0.0f );
+	memcpy( & depthBits, & clampedDepth, sizeof( depthBits ) );
+
+	return ( static_cast< uint64_t >( pass & 0xf ) << 60 ) |
+		   ( static_cast< uint64_t >( programId & 0xfff ) << 48 ) |
+		   ( static_cast< uint64_t >( textureId & 0xffff ) << 32 ) |
+		   depthBits;
+}
+
+
+void RenderQueue::RadixSort( vector< SortEntry > & entries, vector< SortEntry > & scratch )
+{
+	const size_t numEntries = entries.size();
+	scratch.resize( numEntries );
+
+	for( int shift = 0; shift < 64; shift += 8 )
+	{
+		size_t offsets[256] = {};
+
+		foreach( const SortEntry & entry, entries )
+			++offsets[ ( entry.m_Key >> shift ) & 0xff ];
+
+		// Every key has the same byte here, so this pass wouldn't move
+		// anything.
+		if( numEntries == 0 || offsets[ ( entries.front().m_Key >> shift ) & 0xff ] == numEntries )
+			continue;
+
+		size_t offset = 0;
+
+		for( int digit = 0; digit < 256; ++digit )
+		{
+			const size_t count = offsets[ digit ];
+			offsets[ digit ] = offset;
+			offset += count;
+		}
+
+		foreach( const SortEntry & entry, entries )
+			scratch[ offsets[ ( entry.m_Key >> shift ) & 0xff ]++ ] = entry;
+
+		entries.swap( scratch );
+	}
+}
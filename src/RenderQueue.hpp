@@ -0,0 +1,161 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Collects the draws of the G-buffer pass and sorts them before drawing, so
+// that draws sharing a shader program and texture are drawn together and
+// state only changes when it has to. Each draw has a 64-bit key, which from
+// the most significant bits down holds the pass, the program, the texture and
+// the depth, so that within each program and texture draws go front to back
+// and the depth test can reject hidden fragments before they are shaded. The
+// keys are sorted with a radix sort, which is linear in the number of draws.
+//
+// Unless Options::m_Instancing is turned off, every instance of the same LOD
+// of a mesh is gathered into one instanced draw, so forests, crowds and
+// repeated props cost a draw per mesh rather than one per instance. The
+// shadow passes queue their casters the same way, but draw them unsorted.
+//
+// Draws are worked out on the scene's workers, each into a list of its own,
+// and the lists are merged into the queue on the main thread, which is the
+// only one that draws.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+
+#include "ShadowPass.hpp"
+#include "TransformHierarchy.hpp"
+
+
+class Mesh;
+class DrawBatch;
+class ShadowCulling;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// RenderQueue class
+///////////////////////////////////////////////////////////////////////////////
+class RenderQueue
+{
+public:
+	// Meshes with their own buffers are drawn as the queue is submitted, and
+	// pooled meshes are then added to the batch in order (see DrawBatch).
+	enum Pass
+	{
+		Pass_Direct,
+		Pass_Pooled
+	};
+
+	// A draw in a list, with its key worked out.
+	struct Draw
+	{
+		Mesh *					m_pMesh;
+		uint64_t				m_Key;
+		uint32_t				m_LodIndex;
+		uint32_t				m_NodeIndex;
+	};
+
+	typedef vector< Draw >		DrawList;
+
+								RenderQueue();
+
+	void						Clear();
+
+	// Adds a LOD of a mesh to a list, to be drawn with the model view
+	// transform of a node in the scene's TransformHierarchy. The depth it is
+	// sorted by is that of the centre of the mesh's bounds. This only reads
+	// the mesh and its material, so lists can be built on several threads at
+	// once.
+	static void					AddDraw( DrawList & list, Mesh & mesh, const size_t lodIndex, const size_t nodeIndex, const Affine3f & modelView );
+
+	// Queues the draws of a list, in order. Instances that are drawn
+	// together are sorted by the depth of the nearest.
+	void						Merge( const DrawList & list );
+
+	// Sorts the queue and draws it, with each node's model view transform
+	// taken from modelViews. The instances are added to the batch, as are the
+	// draws of pooled meshes, and the batch is left for the caller to submit.
+	void						Submit( const TransformHierarchy::MatrixArray & modelViews, DrawBatch & batch );
+
+	// Draws the shadow volumes of the queue for one pass, in the order the
+	// draws were queued, likewise.
+	void						SubmitShadowVolumes( const ShadowPass pass, const TransformHierarchy::MatrixArray & modelViews, DrawBatch & batch, ShadowCulling * pCulling );
+
+	size_t						GetNumDraws() const						{ return m_Items.size(); }
+	size_t						GetNumInstances() const					{ return m_Instances.size(); }
+
+	// Number of times the program or texture was changed by the last Submit,
+	// or zero if the queue has been cleared since.
+	size_t						GetNumStateChanges() const				{ return m_NumStateChanges; }
+
+	// Only the lowest 12 bits of the program ID and 16 bits of the texture
+	// ID are used, which is plenty for GL names. Depths behind the camera
+	// sort as zero.
+	static uint64_t				MakeKey( const Pass pass, const GLuint programId, const GLuint textureId, const float depth );
+
+private:
+	// A draw of one or more instances, which are m_FirstInstance onwards in
+	// m_NodeIndices once the queue is submitted, and m_FirstBatchInstance
+	// onwards in the batch.
+	struct Item
+	{
+		Mesh *					m_pMesh;
+		uint32_t				m_LodIndex;
+		uint32_t				m_FirstInstance;
+		uint32_t				m_NumInstances;
+		uint32_t				m_FirstBatchInstance;
+	};
+
+	struct Instance
+	{
+		uint32_t				m_ItemIndex;
+		uint32_t				m_NodeIndex;
+	};
+
+	struct SortEntry
+	{
+		uint64_t				m_Key;
+		uint32_t				m_ItemIndex;
+	};
+
+	// Revoked.
+								RenderQueue( const RenderQueue & copy );
+	RenderQueue &				operator = ( const RenderQueue & copy );
+
+	// Lays the instances out in m_NodeIndices, item by item.
+	void						GatherInstances();
+
+	// Adds the transforms of an item's instances to the batch.
+	void						AddInstances( Item & item, const TransformHierarchy::MatrixArray & modelViews, DrawBatch & batch ) const;
+
+	// Sorts the entries by key, a byte at a time from the least significant,
+	// using scratch as the other buffer. Bytes that are the same in every key
+	// are skipped.
+	static void					RadixSort( vector< SortEntry > & entries, vector< SortEntry > & scratch );
+
+	vector< Item >				m_Items;
+	vector< Instance >			m_Instances;
+	vector< uint32_t >			m_NodeIndices;
+	vector< SortEntry >			m_Entries;
+	vector< SortEntry >			m_Scratch;
+	size_t						m_NumStateChanges;
+
+	// The item that each LOD of a mesh is drawn by, keyed by the mesh's
+	// address with the LOD in its low bits (see MeshSimplifier::MaxLods).
+	unordered_map< uint64_t, uint32_t >	m_ItemsByLod;
+
+	// The model view transforms of an item's instances, for culling their
+	// shadows.
+	TransformHierarchy::MatrixArray	m_InstanceModelViews;
+};
@@ -23,14 +23,16 @@
 #include "Light.hpp"
 #include "Shader.hpp"
 #include "Texture.hpp"
+#include "Options.hpp"
 #include "Material.hpp"
+#include "SceneCache.hpp"
+#include "SceneLoader.hpp"
+#include "SceneImporter.hpp"
+#include "LightClusters.hpp"
 #include "ShaderProgram.hpp"
-
-
-namespace
-{
-	const unsigned int ImportFlags = aiProcessPreset_TargetRealtime_MaxQuality | aiProcess_ConvertToLeftHanded;
-}
+#include "ShadowCulling.hpp"
+#include "FrustumCulling.hpp"
+#include "ShadowVolumeCache.hpp"
 
 
 Scene * Scene::m_gpSingleton = nullptr;
@@ -78,6 +80,8 @@ void APIENTRY Scene::OnOpenGlDebugMessage( GLenum			source,
 
 
 Scene::Scene()
+	: m_BvhLayoutRevision( 0 )
+	, m_BvhBoundsRevision( 0 )
 {
 	// TODO: This is hacky.
 	m_gpSingleton = this;
@@ -89,21 +93,48 @@ Scene::Scene()
 
 	m_pGeometryShaderProgram.reset( new ShaderProgram( "GeometryShaderProgram", GetAsset< VertexShader >( "GBuffer.VertexShader.glsl" ), GetAsset< FragmentShader >( "GBuffer.FragmentShader.glsl" ) ) );
 	m_pShadowShaderProgram.reset( new ShaderProgram( "ShadowShaderProgram", GetAsset< VertexShader >( "Shadow.VertexShader.glsl" ), GetAsset< FragmentShader >( "Shadow.FragmentShader.glsl" ), GetAsset< GeometryShader >( "Shadow.GeometryShader.glsl" ) ) );
+	m_pShadowWedgeShaderProgram.reset( new ShaderProgram( "ShadowWedgeShaderProgram", GetAsset< VertexShader >( "Shadow.VertexShader.glsl" ), GetAsset< FragmentShader >( "ShadowWedge.FragmentShader.glsl" ), GetAsset< GeometryShader >( "ShadowWedge.GeometryShader.glsl" ) ) );
+	m_pShadowVolumeShaderProgram.reset( new ShaderProgram( "ShadowVolumeShaderProgram", GetAsset< VertexShader >( "Shadow.VertexShader.glsl" ), GetAsset< FragmentShader >( "ShadowVolume.FragmentShader.glsl" ), GetAsset< GeometryShader >( "ShadowVolume.GeometryShader.glsl" ) ) );
+	m_pShadowFillShaderProgram.reset( new ShaderProgram( "ShadowFillShaderProgram", GetAsset< VertexShader >( "Lighting.VertexShader.glsl" ), GetAsset< FragmentShader >( "ShadowVolume.FragmentShader.glsl" ) ) );
 	m_pLightingShaderProgram.reset( new ShaderProgram( "LightingShaderProgram", GetAsset< VertexShader >( "Lighting.VertexShader.glsl" ), GetAsset< FragmentShader >( "Lighting.FragmentShader.glsl" ) ) );
+	m_pDepthPyramidShaderProgram.reset( new ShaderProgram( "DepthPyramidShaderProgram", GetAsset< VertexShader >( "Lighting.VertexShader.glsl" ), GetAsset< FragmentShader >( "DepthPyramid.FragmentShader.glsl" ) ) );
+	m_pShadowCaptureShaderProgram.reset( new ShaderProgram( "ShadowCaptureShaderProgram", GetAsset< VertexShader >( "Shadow.VertexShader.glsl" ), GetAsset< FragmentShader >( "ShadowVolume.FragmentShader.glsl" ), GetAsset< GeometryShader >( "ShadowCapture.GeometryShader.glsl" ) ) );
+	m_pShadowCaptureShaderProgram->SetFeedbackVaryings( ShadowVolumeCache::GetFeedbackVaryings() );
+	m_pShadowCacheShaderProgram.reset( new ShaderProgram( "ShadowCacheShaderProgram", GetAsset< VertexShader >( "ShadowCache.VertexShader.glsl" ), GetAsset< FragmentShader >( "Shadow.FragmentShader.glsl" ) ) );
 
 	m_pShadowShaderProgram->SetCurrent();
 	glUniform1i( glGetUniformLocation( m_pShadowShaderProgram->GetID(), "positionTexture" ), 0 );
+	glUniform1f( glGetUniformLocation( m_pShadowShaderProgram->GetID(), "lightRadius" ), ShadowCulling::LightRadius );
+
+	m_pShadowWedgeShaderProgram->SetCurrent();
+	glUniform1i( glGetUniformLocation( m_pShadowWedgeShaderProgram->GetID(), "positionTexture" ), 0 );
+	glUniform1f( glGetUniformLocation( m_pShadowWedgeShaderProgram->GetID(), "lightRadius" ), ShadowCulling::LightRadius );
+
+	m_pShadowCaptureShaderProgram->SetCurrent();
+	glUniform1f( glGetUniformLocation( m_pShadowCaptureShaderProgram->GetID(), "lightRadius" ), ShadowCulling::LightRadius );
+
+	m_pShadowCacheShaderProgram->SetCurrent();
+	glUniform1i( glGetUniformLocation( m_pShadowCacheShaderProgram->GetID(), "positionTexture" ), 0 );
+	glUniform1i( glGetUniformLocation( m_pShadowCacheShaderProgram->GetID(), "shadowVolumes" ), ShadowVolumeCache::VolumesTextureUnit );
 
 	m_pLightingShaderProgram->SetCurrent();
 	glUniform1i( glGetUniformLocation( m_pLightingShaderProgram->GetID(), "positionTexture" ), 0 );
 	glUniform1i( glGetUniformLocation( m_pLightingShaderProgram->GetID(), "normalTexture" ), 1 );
 	glUniform1i( glGetUniformLocation( m_pLightingShaderProgram->GetID(), "diffuseTexture" ), 2 );
 	glUniform1i( glGetUniformLocation( m_pLightingShaderProgram->GetID(), "shadowTexture" ), 3 );
+	glUniform1i( glGetUniformLocation( m_pLightingShaderProgram->GetID(), "lightClusters" ), LightClusters::ClustersTextureUnit );
+	glUniform1i( glGetUniformLocation( m_pLightingShaderProgram->GetID(), "lightIndices" ), LightClusters::LightIndicesTextureUnit );
+	glUniform1i( glGetUniformLocation( m_pLightingShaderProgram->GetID(), "lights" ), LightClusters::LightsTextureUnit );
+
+	m_pDepthPyramidShaderProgram->SetCurrent();
+	glUniform1i( glGetUniformLocation( m_pDepthPyramidShaderProgram->GetID(), "sourceTexture" ), 0 );
 
 	glUseProgram( 0 );
 
 	glEnable( GL_CULL_FACE );
 	glFrontFace( GL_CW );
+
+	m_Transforms.Rebuild( m_RootNode );
 }
 
 
@@ -113,27 +144,349 @@ Scene::~Scene()
 
 void Scene::LoadFromFile( const string & fileName )
 {
-	Assimp::Importer assimpImporter;
-	const aiScene & assimpScene = * assimpImporter.ReadFile( fileName, ImportFlags );
+	const unsigned int importFlags = SceneImporter::GetProfileFlags( GetOptions().m_ImportProfile );
+	m_Files.push_back( new SceneFile( fileName ) );
+
+	const std::shared_ptr< SceneLoader > pLoader( new SceneLoader( m_Files.back(), importFlags, GetOptions().m_TriangleOrder ) );
+	pLoader->Start( m_ThreadPool );
+	m_Loaders.push_back( pLoader );
+}
+
+
+void Scene::Unload( SceneFile & file )
+{
+	const MemoryUsage fileUsage = file.GetMemoryUsage();
+
+	// Abandon the load if it's still going. If the import is still running
+	// on a worker the loader stays alive until it finishes, but it doesn't
+	// touch the scene after that.
+	for( auto ppLoader = m_Loaders.begin(); ppLoader != m_Loaders.end(); )
+	{
+		if( & ( * ppLoader )->GetFile() == & file )
+			ppLoader = m_Loaders.erase( ppLoader );
+		else ++ppLoader;
+	}
+
+	// Removing the nodes also removes the file's mesh instances.
+	for( auto pNode = m_RootNode.m_ChildNodes.begin(); pNode != m_RootNode.m_ChildNodes.end(); ++pNode )
+	{
+		if( & * pNode == file.m_pRootNode )
+		{
+			m_RootNode.m_ChildNodes.erase( pNode );
+			break;
+		}
+	}
+
+	m_Transforms.Rebuild( m_RootNode );
+
+	// Meshes and materials can only be freed if no other file uses them.
+	set< const Mesh * > sharedMeshes;
+	set< const Material * > sharedMaterials;
+
+	foreach( const SceneFile & otherFile, m_Files )
+	{
+		if( & otherFile != & file )
+		{
+			sharedMeshes.insert( otherFile.m_Meshes.begin(), otherFile.m_Meshes.end() );
+			sharedMaterials.insert( otherFile.m_Materials.begin(), otherFile.m_Materials.end() );
+		}
+	}
+
+	const set< const Mesh * > fileMeshes( file.m_Meshes.begin(), file.m_Meshes.end() );
+	const set< const Material * > fileMaterials( file.m_Materials.begin(), file.m_Materials.end() );
+	const set< const Light * > fileLights( file.m_Lights.begin(), file.m_Lights.end() );
+	size_t numMeshesFreed = 0;
+
+	// Meshes have to go before their materials.
+	for( auto pMesh = m_Meshes.begin(); pMesh != m_Meshes.end(); )
+	{
+		if( fileMeshes.count( & * pMesh ) != 0 && sharedMeshes.count( & * pMesh ) == 0 )
+		{
+			pMesh = m_Meshes.erase( pMesh );
+			++numMeshesFreed;
+		}
+		else ++pMesh;
+	}
+
+	for( auto pMaterial = m_Materials.begin(); pMaterial != m_Materials.end(); )
+	{
+		if( fileMaterials.count( & * pMaterial ) != 0 && sharedMaterials.count( & * pMaterial ) == 0 )
+			pMaterial = m_Materials.erase( pMaterial );
+		else ++pMaterial;
+	}
+
+	for( auto pLight = m_Lights.begin(); pLight != m_Lights.end(); )
+	{
+		if( fileLights.count( & * pLight ) != 0 )
+			pLight = m_Lights.erase( pLight );
+		else ++pLight;
+	}
+
+	// Forget the hashes of anything that was freed.
+	for( auto pEntry = m_MeshesByHash.begin(); pEntry != m_MeshesByHash.end(); )
+	{
+		if( fileMeshes.count( pEntry->second ) != 0 && sharedMeshes.count( pEntry->second ) == 0 )
+			pEntry = m_MeshesByHash.erase( pEntry );
+		else ++pEntry;
+	}
+
+	for( auto pEntry = m_MaterialsByHash.begin(); pEntry != m_MaterialsByHash.end(); )
+	{
+		if( fileMaterials.count( pEntry->second ) != 0 && sharedMaterials.count( pEntry->second ) == 0 )
+			pEntry = m_MaterialsByHash.erase( pEntry );
+		else ++pEntry;
+	}
+
+	clog << "Unloaded " << file.m_FileName << " (" << fileUsage.ToString() << "), freed " << numMeshesFreed << " of " << fileMeshes.size() << " meshes" << endl;
+
+	for( auto pFile = m_Files.begin(); pFile != m_Files.end(); ++pFile )
+	{
+		if( & * pFile == & file )
+		{
+			m_Files.erase( pFile );
+			break;
+		}
+	}
+}
+
+
+void Scene::UpdateLoading( const long budget )
+{
+	wxStopWatch updateWatch;
+
+	// Loaders are updated in the order they were started, each getting
+	// whatever is left of the budget.
+	for( auto ppLoader = m_Loaders.begin(); ppLoader != m_Loaders.end(); )
+	{
+		bool isFinished;
+
+		try
+		{
+			isFinished = ( * ppLoader )->Update( max( budget - updateWatch.Time(), 0l ) );
+		}
+		catch( const std::exception & exception )
+		{
+			clog << "Error loading " << ( * ppLoader )->GetFileName() << ": " << exception.what() << endl;
+			isFinished = true;
+		}
+
+		if( isFinished )
+			ppLoader = m_Loaders.erase( ppLoader );
+		else ++ppLoader;
+	}
 
-	if( & assimpScene == nullptr )
-		throw runtime_error( "Error loading scene from " + fileName );
+	// Swap in textures that have finished decoding. At least one is done per
+	// update, so that textures still trickle in while scenes are loading.
+	bool isFirstTexture = true;
 
-	const size_t baseMaterialIndex = m_Materials.size();
-	const filesystem::path scenePath = filesystem::path( fileName ).parent_path();
+	foreach( Texture & texture, GetAssetSet< Texture >() )
+	{
+		if( ! isFirstTexture && updateWatch.Time() >= budget )
+			break;
+
+		if( texture.IsDecoded() )
+		{
+			texture.FinishLoading();
+			isFirstTexture = false;
+		}
+	}
+}
 
-	for( unsigned materialIndex = 0; materialIndex < assimpScene.mNumMaterials; ++materialIndex )
-		m_Materials.push_back( new Material( * assimpScene.mMaterials[ materialIndex ], scenePath ) );
 
-	const size_t baseMeshIndex = m_Meshes.size();
+void Scene::FinishLoading()
+{
+	while( IsLoading() )
+	{
+		UpdateLoading( numeric_limits< long >::max() );
 
-	for( unsigned meshIndex = 0; meshIndex < assimpScene.mNumMeshes; ++meshIndex )
-		m_Meshes.push_back( new Mesh( * assimpScene.mMeshes[ meshIndex ], baseMaterialIndex ) );
+		// Give the workers a chance to finish whatever we are waiting for.
+		if( IsLoading() )
+			std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+	}
+}
 
-	for( unsigned lightIndex = 0; lightIndex < assimpScene.mNumLights; ++lightIndex )
-		m_Lights.push_back( new Light( * assimpScene.mLights[ lightIndex ] ) );
 
-	m_RootNode.m_ChildNodes.push_back( new SceneNode( * assimpScene.mRootNode, baseMeshIndex ) );
+bool Scene::IsLoading()
+{
+	if( ! m_Loaders.empty() )
+		return true;
+
+	foreach( const Texture & texture, GetAssetSet< Texture >() )
+	{
+		if( texture.IsLoading() )
+			return true;
+	}
+
+	return false;
+}
+
+
+void Scene::BenchmarkLoad( const string & fileName )
+{
+	// Compares the time it takes to get GPU-ready streams for a scene by
+	// importing it with Assimp (and building the cache, as happens on a cold
+	// load) against loading them from the cache. Uploading to the GL costs the
+	// same either way so it isn't included. Each path is run several times and
+	// the best time is reported to reduce noise. The time taken by each
+	// post-processing step is logged first.
+	const int numRuns = 3;
+	const unsigned int importFlags = SceneImporter::GetProfileFlags( GetOptions().m_ImportProfile );
+
+	SceneImporter( importFlags ).LogSteps( fileName );
+
+	long coldTime = numeric_limits< long >::max();
+	long warmTime = numeric_limits< long >::max();
+
+	for( int runIndex = 0; runIndex < numRuns; ++runIndex )
+	{
+		wxStopWatch coldWatch;
+
+		SceneCache cache( fileName, importFlags, GetOptions().m_TriangleOrder );
+		SceneImporter importer( importFlags );
+		const aiScene & assimpScene = importer.Import( fileName );
+		cache.Build( assimpScene, importer.GetFilesRead() );
+
+		coldTime = min( coldTime, coldWatch.Time() );
+	}
+
+	size_t cacheSize = 0;
+
+	for( int runIndex = 0; runIndex < numRuns; ++runIndex )
+	{
+		wxStopWatch warmWatch;
+
+		SceneCache cache( fileName, importFlags, GetOptions().m_TriangleOrder );
+
+		if( ! cache.Open() )
+			throw runtime_error( "Error loading scene cache for " + fileName );
+
+		// Mapping a file doesn't actually read anything, so touch every page
+		// to make sure we are measuring the time taken to get the data.
+		volatile char pageSum = 0;
+
+		for( size_t offset = 0; offset < cache.GetSize(); offset += 4096 )
+			pageSum += cache.GetData()[ offset ];
+
+		warmTime = min( warmTime, warmWatch.Time() );
+		cacheSize = cache.GetSize();
+	}
+
+	clog << "Load benchmark for " << fileName << " (best of " << numRuns << " runs, " << SceneImporter::GetProfileName( GetOptions().m_ImportProfile ) << " profile, " << cacheSize / 1024 << "KB cache)" << endl;
+	clog << "  Assimp import: " << coldTime << "ms" << endl;
+	clog << "  Scene cache:   " << warmTime << "ms" << endl;
+	clog << "  Speed up:      " << static_cast< float >( coldTime ) / max( warmTime, 1l ) << "x" << endl;
+}
+
+
+void Scene::QueryFrustum( const Matrix4f & viewProjection, vector< uint32_t > & instances )
+{
+	UpdateInstanceBvh();
+	m_InstanceBvh.QueryFrustum( m_Transforms.GetInstanceBounds(), FrustumCulling( viewProjection ), instances );
+}
+
+
+void Scene::QuerySphere( const Vector3f & centre, const float radius, vector< uint32_t > & instances )
+{
+	UpdateInstanceBvh();
+	m_InstanceBvh.QuerySphere( m_Transforms.GetInstanceBounds(), centre, radius, instances );
+}
+
+
+void Scene::QueryRay( const Vector3f & origin, const Vector3f & direction, const float maxDistance, vector< InstanceBvh::RayHit > & hits )
+{
+	UpdateInstanceBvh();
+	m_InstanceBvh.QueryRay( m_Transforms.GetInstanceBounds(), origin, direction, maxDistance, hits );
+}
+
+
+void Scene::UpdateInstanceBvh()
+{
+	m_Transforms.Update( m_ThreadPool );
+
+	if( m_BvhLayoutRevision != m_Transforms.GetLayoutRevision() )
+		m_InstanceBvh.Build( m_Transforms.GetInstanceBounds(), m_Transforms.GetNumInstances(), m_ThreadPool );
+	else if( m_BvhBoundsRevision != m_Transforms.GetBoundsRevision() )
+		m_InstanceBvh.Refit( m_Transforms.GetInstanceBounds() );
+
+	m_BvhLayoutRevision = m_Transforms.GetLayoutRevision();
+	m_BvhBoundsRevision = m_Transforms.GetBoundsRevision();
+}
+
+
+MemoryUsage Scene::GetMemoryUsage( const MemoryCategory category )
+{
+	MemoryUsage usage;
+
+	switch( category )
+	{
+	case MemoryCategory_Meshes:
+		foreach( const Mesh & mesh, m_Meshes )
+			usage += mesh.GetMemoryUsage();
+		break;
+
+	case MemoryCategory_Materials:
+		usage += MemoryUsage( m_Materials.size() * sizeof( Material ), 0 );
+		break;
+
+	case MemoryCategory_Textures:
+		foreach( const Texture & texture, GetAssetSet< Texture >() )
+			usage += texture.GetMemoryUsage();
+		break;
+
+	case MemoryCategory_Nodes:
+		usage += m_RootNode.GetMemoryUsage();
+		usage += MemoryUsage( m_Transforms.GetMemoryUsage() + m_InstanceBvh.GetMemoryUsage(), 0 );
+		break;
+
+	case MemoryCategory_GeometryPool:
+		usage += m_GeometryPool.GetMemoryUsage();
+		break;
+
+	default:
+		assert( false );
+	}
+
+	return usage;
+}
+
+
+const char * Scene::GetMemoryCategoryName( const MemoryCategory category )
+{
+	static const char * const names[ NumMemoryCategories ] = { "Meshes", "Materials", "Textures", "Nodes", "Geometry pool" };
+
+	assert( category < NumMemoryCategories );
+	return names[ category ];
+}
+
+
+void Scene::DumpMemoryUsage()
+{
+	MemoryUsage total;
+
+	clog << "Memory usage (GPU sizes are estimates)" << endl;
+
+	for( int categoryIndex = 0; categoryIndex < NumMemoryCategories; ++categoryIndex )
+	{
+		const MemoryCategory category = static_cast< MemoryCategory >( categoryIndex );
+		const MemoryUsage usage = GetMemoryUsage( category );
+
+		clog << "  " << GetMemoryCategoryName( category ) << ": " << usage.ToString() << endl;
+		total += usage;
+	}
+
+	clog << "  Total: " << total.ToString() << endl;
+
+	// Shared objects are counted against every file that uses them, so these
+	// may add up to more than the total.
+	foreach( const SceneFile & file, m_Files )
+		clog << "  " << file.m_FileName << ": " << file.GetMemoryUsage().ToString() << endl;
+}
+
+
+void Scene::DropCpuGeometry()
+{
+	foreach( Mesh & mesh, m_Meshes )
+		mesh.DropCpuGeometry();
 }
 
 
@@ -164,12 +517,30 @@ void Scene::ReloadShaders()
 
 	m_pShadowShaderProgram->SetCurrent();
 	glUniform1i( glGetUniformLocation( m_pShadowShaderProgram->GetID(), "positionTexture" ), 0 );
+	glUniform1f( glGetUniformLocation( m_pShadowShaderProgram->GetID(), "lightRadius" ), ShadowCulling::LightRadius );
+
+	m_pShadowWedgeShaderProgram->SetCurrent();
+	glUniform1i( glGetUniformLocation( m_pShadowWedgeShaderProgram->GetID(), "positionTexture" ), 0 );
+	glUniform1f( glGetUniformLocation( m_pShadowWedgeShaderProgram->GetID(), "lightRadius" ), ShadowCulling::LightRadius );
+
+	m_pShadowCaptureShaderProgram->SetCurrent();
+	glUniform1f( glGetUniformLocation( m_pShadowCaptureShaderProgram->GetID(), "lightRadius" ), ShadowCulling::LightRadius );
+
+	m_pShadowCacheShaderProgram->SetCurrent();
+	glUniform1i( glGetUniformLocation( m_pShadowCacheShaderProgram->GetID(), "positionTexture" ), 0 );
+	glUniform1i( glGetUniformLocation( m_pShadowCacheShaderProgram->GetID(), "shadowVolumes" ), ShadowVolumeCache::VolumesTextureUnit );
 
 	m_pLightingShaderProgram->SetCurrent();
 	glUniform1i( glGetUniformLocation( m_pLightingShaderProgram->GetID(), "positionTexture" ), 0 );
 	glUniform1i( glGetUniformLocation( m_pLightingShaderProgram->GetID(), "normalTexture" ), 1 );
 	glUniform1i( glGetUniformLocation( m_pLightingShaderProgram->GetID(), "diffuseTexture" ), 2 );
 	glUniform1i( glGetUniformLocation( m_pLightingShaderProgram->GetID(), "shadowTexture" ), 3 );
+	glUniform1i( glGetUniformLocation( m_pLightingShaderProgram->GetID(), "lightClusters" ), LightClusters::ClustersTextureUnit );
+	glUniform1i( glGetUniformLocation( m_pLightingShaderProgram->GetID(), "lightIndices" ), LightClusters::LightIndicesTextureUnit );
+	glUniform1i( glGetUniformLocation( m_pLightingShaderProgram->GetID(), "lights" ), LightClusters::LightsTextureUnit );
+
+	m_pDepthPyramidShaderProgram->SetCurrent();
+	glUniform1i( glGetUniformLocation( m_pDepthPyramidShaderProgram->GetID(), "sourceTexture" ), 0 );
 }
 
 
@@ -18,13 +18,20 @@
 
 
 #include "Asset.hpp"
+#include "SceneFile.hpp"
 #include "SceneNode.hpp"
+#include "ThreadPool.hpp"
+#include "MemoryUsage.hpp"
+#include "InstanceBvh.hpp"
+#include "GeometryPool.hpp"
+#include "TransformHierarchy.hpp"
 
 
 class Mesh;
 class Light;
 class Texture;
 class Material;
+class SceneLoader;
 class VertexShader;
 class ShaderProgram;
 class FragmentShader;
@@ -38,9 +45,68 @@ class Scene : public AssetCache< Texture >,
 			  public AssetCache< GeometryShader >
 {
 public:
+	// Types of object that memory usage is reported for.
+	enum MemoryCategory
+	{
+		MemoryCategory_Meshes,
+		MemoryCategory_Materials,
+		MemoryCategory_Textures,
+		MemoryCategory_Nodes,
+		MemoryCategory_GeometryPool,
+		NumMemoryCategories
+	};
+
 											~Scene();
 
+	// Starts loading a scene in the background. The import runs on the worker
+	// threads, after which the scene is added and uploaded to the GL a bit at
+	// a time by UpdateLoading, so meshes appear progressively. The file is
+	// added to m_Files straight away.
 	void									LoadFromFile( const string & fileName );
+
+	// Removes everything a file added to the scene, abandoning the load if it
+	// is still in progress. Meshes and materials that other files share are
+	// kept; textures and other assets are freed once nothing references them.
+	void									Unload( SceneFile & file );
+
+	// Does up to budget milliseconds of work towards finishing any scenes
+	// that are being loaded and swaps in any textures that have finished
+	// decoding. Must be called from the thread that owns the GL context.
+	// Errors are logged and the failed load is abandoned.
+	void									UpdateLoading( const long budget );
+	bool									IsLoading();
+
+	// Blocks until everything that is being loaded has been added to the
+	// scene, including textures.
+	void									FinishLoading();
+
+	// Worker threads for loading. Tasks must not use the GL.
+	ThreadPool &							GetThreadPool()				{ return m_ThreadPool; }
+
+	// Logs the time taken by each of Assimp's post-processing steps, then
+	// times loading a scene with Assimp against loading it from the scene
+	// cache and logs the results. Doesn't add anything to the scene.
+	void									BenchmarkLoad( const string & fileName );
+
+	// Spatial queries over the mesh instances in m_Transforms, by their world
+	// space bounds (see InstanceBvh). Instances are given by their index in
+	// m_Transforms. The transforms are brought up to date first, and the BVH
+	// is rebuilt if nodes have been added or removed since the last query, or
+	// refitted if any have moved.
+	void									QueryFrustum( const Matrix4f & viewProjection, vector< uint32_t > & instances );
+	void									QuerySphere( const Vector3f & centre, const float radius, vector< uint32_t > & instances );
+	void									QueryRay( const Vector3f & origin, const Vector3f & direction, const float maxDistance, vector< InstanceBvh::RayHit > & hits );
+
+	// Memory used by all objects of a particular type.
+	MemoryUsage								GetMemoryUsage( const MemoryCategory category );
+	static const char *						GetMemoryCategoryName( const MemoryCategory category );
+
+	// Logs the memory used by each type of object and each file.
+	void									DumpMemoryUsage();
+
+	// Frees the CPU copies of every mesh's geometry (see Mesh::Upload).
+	void									DropCpuGeometry();
+
 	void									ReloadShaders();
 	void									Render();
 
@@ -49,12 +115,38 @@ public:
 
 	std::shared_ptr< ShaderProgram >		m_pGeometryShaderProgram;
 	std::shared_ptr< ShaderProgram >		m_pShadowShaderProgram;
+	std::shared_ptr< ShaderProgram >		m_pShadowWedgeShaderProgram;
+	std::shared_ptr< ShaderProgram >		m_pShadowVolumeShaderProgram;
+	std::shared_ptr< ShaderProgram >		m_pShadowFillShaderProgram;
 	std::shared_ptr< ShaderProgram >		m_pLightingShaderProgram;
+	std::shared_ptr< ShaderProgram >		m_pDepthPyramidShaderProgram;
+	std::shared_ptr< ShaderProgram >		m_pShadowCaptureShaderProgram;
+	std::shared_ptr< ShaderProgram >		m_pShadowCacheShaderProgram;
+
+	// Declared before the meshes, which give their ranges back to it when
+	// they are destroyed.
+	GeometryPool							m_GeometryPool;
 	ptr_vector< Material >					m_Materials;
 	ptr_vector< Mesh >						m_Meshes;
 	ptr_vector< Light >						m_Lights;
+
+	// Meshes and materials keyed by a hash of their contents. Loading the
+	// same data more than once (eg the same prop file several times) shares
+	// them rather than creating and uploading copies. A match is checked
+	// against the data before it is shared (see Mesh::Matches and
+	// Material::Matches), and a collision is given an unshared copy.
+	map< uint64_t, Material * >				m_MaterialsByHash;
+	map< uint64_t, Mesh * >					m_MeshesByHash;
 	SceneNode								m_RootNode;
 
+	// The nodes under m_RootNode, flattened. Rebuilt whenever a file's nodes
+	// are added or removed.
+	TransformHierarchy						m_Transforms;
+
+	// The files that have been loaded, or are being loaded, in the order they
+	// were loaded in.
+	ptr_list< SceneFile >					m_Files;
+
 	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
 private:
@@ -113,6 +205,20 @@ private:
 	template< class ShaderType >
 	void ReloadShadersOfType();
 
+	void									UpdateInstanceBvh();
+
+	vector< std::shared_ptr< SceneLoader > >	m_Loaders;
+
+	// Built over m_Transforms' instance bounds the first time it's queried.
+	// The revisions are the ones it was last brought up to date with.
+	InstanceBvh								m_InstanceBvh;
+	size_t									m_BvhLayoutRevision;
+	size_t									m_BvhBoundsRevision;
+
+	// Declared last so that it is destroyed first, ie worker threads are
+	// stopped before anything they might be using is destroyed.
+	ThreadPool								m_ThreadPool;
+
 	static void CreateSingleton();
 	static void DestroySingleton();
 
@@ -127,6 +233,7 @@ private:
 	friend class Asset;
 
 	friend class Application;
+	friend class HeadlessRenderer;
 	friend Scene & GetScene();
 	friend class ShaderProgram;
 };
@@ -138,7 +245,7 @@ inline Scene & GetScene() { return * Scene::m_gpSingleton; }
 template< class AssetType >
 std::shared_ptr< AssetType > Scene::GetAsset( const string & fileName )
 {
-	AssetCache< AssetType >::AssetSet::insert_commit_data insertData;
+	typename AssetCache< AssetType >::AssetSet::insert_commit_data insertData;
 	const auto insertCheck = GetAssetSet< AssetType >().insert_check( fileName, AssetFileNameComparator< AssetType >(), insertData );
 
 	if( insertCheck.second )
@@ -149,3 +256,13 @@ std::shared_ptr< AssetType > Scene::GetAsset( const string & fileName )
 	}
 	else return insertCheck.first->shared_from_this();
 }
+
+
+template< class AssetType >
+Asset< AssetType >::~Asset()
+{
+	// Remove assets from the cache automatically when they are deallocated
+	// (if they are in the cache).
+	if( is_linked() )
+		GetScene().GetAssetSet< AssetType >().erase( GetScene().GetAssetSet< AssetType >().iterator_to( * static_cast< AssetType * >( this ) ) );
+}
@@ -0,0 +1,529 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Precomp.hpp"
+#include "Common.hpp"
+
+#include "SceneCache.hpp"
+
+#include "Mesh.hpp"
+#include "Material.hpp"
+#include "MeshClusters.hpp"
+#include "MeshAdjacency.hpp"
+#include "MeshSimplifier.hpp"
+
+
+namespace
+{
+	// Bump this whenever the layout of the cache file, or the way its
+	// contents are imported, changes. Cache files with a different version
+	// are ignored and rebuilt.
+	const uint32_t CacheVersion = 9;
+
+	const char CacheMagic[8] = { 'S', 'S', 'C', 'A', 'C', 'H', 'E', '\0' };
+
+	// Cache files live in here, relative to the working directory.
+	const char CacheDirectory[] = "Cache";
+
+	// Everything in the cache file is aligned to this many bytes so that the
+	// records and streams can be used in place once the file is mapped.
+	const size_t CacheAlignment = 8;
+
+
+	// Helper for building a cache file image in memory.
+	class ImageBuilder
+	{
+	public:
+		ImageBuilder( vector< char > & image )
+			: m_Image( image )
+		{}
+
+		// Appends a block of data to the image, returning its offset.
+		uint64_t Append( const void * pData, const size_t size )
+		{
+			const size_t offset = ( m_Image.size() + CacheAlignment - 1 ) & ~( CacheAlignment - 1 );
+			m_Image.resize( offset + size );
+
+			if( size > 0 )
+				memcpy( & m_Image[ offset ], pData, size );
+
+			return offset;
+		}
+
+		template< class RecordType >
+		uint64_t Append( const vector< RecordType > & records )
+		{
+			return records.empty() ? Append( nullptr, 0 ) : Append( records.data(), records.size() * sizeof( RecordType ) );
+		}
+
+		// Adds a string to the string table, returning its offset in the
+		// table.
+		uint32_t AddString( const char * pString )
+		{
+			const uint32_t offset = static_cast< uint32_t >( m_Strings.size() );
+			m_Strings.insert( m_Strings.end(), pString, pString + strlen( pString ) + 1 );
+			return offset;
+		}
+
+		// Adds the node and all of its descendents, depth first.
+		void AddNode( const aiNode & assimpNode )
+		{
+			SceneCache::NodeRecord node;
+			copy( assimpNode.mTransformation[0], assimpNode.mTransformation[0] + 16, node.m_Transform );
+			node.m_Name = AddString( assimpNode.mName.C_Str() );
+			node.m_NumChildren = assimpNode.mNumChildren;
+			node.m_FirstMesh = static_cast< uint32_t >( m_NodeMeshes.size() );
+			node.m_NumMeshes = assimpNode.mNumMeshes;
+
+			m_Nodes.push_back( node );
+			m_NodeMeshes.insert( m_NodeMeshes.end(), assimpNode.mMeshes, assimpNode.mMeshes + assimpNode.mNumMeshes );
+
+			for( unsigned childNodeIndex = 0; childNodeIndex < assimpNode.mNumChildren; ++childNodeIndex )
+				AddNode( * assimpNode.mChildren[ childNodeIndex ] );
+		}
+
+		vector< char > &						m_Image;
+		vector< char >							m_Strings;
+		vector< SceneCache::MaterialRecord >	m_Materials;
+		vector< SceneCache::MeshRecord >		m_Meshes;
+		vector< SceneCache::NodeRecord >		m_Nodes;
+		vector< uint32_t >						m_NodeMeshes;
+	};
+}
+
+
+SceneCache::SceneCache( const string & sourceFileName, const unsigned int importFlags, const TriangleOrder::Mode triangleOrder )
+	: m_SourceFileName	( sourceFileName )
+	, m_ImportFlags		( importFlags )
+	, m_TriangleOrder	( triangleOrder )
+	, m_pData			( nullptr )
+	, m_Size			( 0 )
+{
+	// Hash the contents of the source file. Mapping the file saves us from
+	// having to read it into a buffer first.
+	try
+	{
+		const iostreams::mapped_file_source sourceFile( sourceFileName );
+		m_SourceHash = Hash( sourceFile.data(), sourceFile.size() );
+	}
+	catch( const std::exception & )
+	{
+		throw runtime_error( "Error reading scene from " + sourceFileName );
+	}
+
+	// The file is named after the source file's path rather than its
+	// contents, so that a rebuilt cache replaces the old one rather than
+	// piling up next to it.
+	const string sourcePath = filesystem::absolute( sourceFileName ).string();
+	const uint64_t sourcePathHash = Hash( sourcePath.data(), sourcePath.size() );
+
+	ostringstream cacheFileName;
+	cacheFileName << filesystem::path( sourceFileName ).stem().string() << '.' << hex << setfill( '0' ) << setw( 16 ) << sourcePathHash << '.' << setw( 8 ) << importFlags << '.' << TriangleOrder::GetModeName( triangleOrder ) << ".scenecache";
+
+	m_FileName = GetCachePath( cacheFileName.str() );
+}
+
+
+string SceneCache::GetCachePath( const string & cacheFileName )
+{
+	return ( filesystem::path( CacheDirectory ) / cacheFileName ).string();
+}
+
+
+uint64_t SceneCache::Hash( const void * pData, const size_t size, const uint64_t seed )
+{
+	// 64-bit FNV-1a. Not cryptographic, but it's fast and good enough to tell
+	// whether a file has changed.
+	const uint8_t * const pBytes = static_cast< const uint8_t * >( pData );
+	uint64_t hash = seed;
+
+	for( size_t byteIndex = 0; byteIndex < size; ++byteIndex )
+	{
+		hash ^= pBytes[ byteIndex ];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+
+bool SceneCache::Open()
+{
+	if( ! filesystem::exists( m_FileName ) )
+		return false;
+
+	try
+	{
+		m_MappedFile.open( m_FileName );
+	}
+	catch( const std::exception & exception )
+	{
+		clog << "Can't open scene cache " << m_FileName << ": " << exception.what() << endl;
+		return false;
+	}
+
+	m_pData = m_MappedFile.data();
+	m_Size = m_MappedFile.size();
+
+	if( ! Validate() )
+	{
+		clog << "Ignoring invalid scene cache " << m_FileName << endl;
+
+		m_MappedFile.close();
+		m_pData = nullptr;
+		m_Size = 0;
+
+		return false;
+	}
+
+	return true;
+}
+
+
+bool SceneCache::Validate() const
+{
+	if( m_Size < sizeof( Header ) )
+		return false;
+
+	const Header & header = GetHeader();
+
+	if( ! equal( CacheMagic, CacheMagic + sizeof( CacheMagic ), header.m_Magic ) ||
+		header.m_Version != CacheVersion ||
+		header.m_ImportFlags != m_ImportFlags ||
+		header.m_TriangleOrder != static_cast< uint32_t >( m_TriangleOrder ) ||
+		header.m_SourceHash != m_SourceHash ||
+		header.m_FileSize != m_Size )
+		return false;
+
+	// Catch truncated files. The string table is always last.
+	if( header.m_StringsOffset > m_Size )
+		return false;
+
+	const DependencyRecord * const pDependencies = GetRecords< DependencyRecord >( header.m_DependenciesOffset );
+
+	for( uint32_t dependencyIndex = 0; dependencyIndex < header.m_NumDependencies; ++dependencyIndex )
+	{
+		const DependencyRecord & dependency = pDependencies[ dependencyIndex ];
+		const char * const pFileName = GetString( dependency.m_Path );
+
+		DependencyRecord current;
+		StatDependency( pFileName, current );
+
+		if( current.m_Exists != dependency.m_Exists ||
+			current.m_Size != dependency.m_Size ||
+			current.m_WriteTime != dependency.m_WriteTime )
+		{
+			clog << "Scene cache " << m_FileName << " is out of date, " << pFileName << " has changed" << endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+void SceneCache::StatDependency( const string & fileName, DependencyRecord & dependency )
+{
+	boost::system::error_code errorCode;
+	const uintmax_t size = filesystem::file_size( fileName, errorCode );
+
+	dependency.m_Exists = ! errorCode;
+	dependency.m_Size = dependency.m_Exists ? size : 0;
+	dependency.m_WriteTime = dependency.m_Exists ? filesystem::last_write_time( fileName, errorCode ) : 0;
+}
+
+
+void SceneCache::Build( const aiScene & assimpScene, const vector< string > & filesRead )
+{
+	m_MappedFile.close();
+	m_Image.clear();
+
+	ImageBuilder builder( m_Image );
+
+	// Reserve space for the header, we fill it in at the end.
+	Header header;
+	memset( & header, 0, sizeof( header ) );
+	builder.Append( & header, sizeof( header ) );
+
+	// The scene depends on every file Assimp read apart from the source file,
+	// which is covered by its hash, and on the textures its materials use.
+	// Textures are resolved in the same way as the materials resolve them
+	// when the scene is loaded.
+	const filesystem::path scenePath = filesystem::path( m_SourceFileName ).parent_path();
+	vector< string > dependencies;
+
+	foreach( const string & fileName, filesRead )
+	{
+		boost::system::error_code errorCode;
+
+		if( ! filesystem::equivalent( fileName, m_SourceFileName, errorCode ) )
+			dependencies.push_back( fileName );
+	}
+
+	for( unsigned materialIndex = 0; materialIndex < assimpScene.mNumMaterials; ++materialIndex )
+	{
+		MaterialRecord material;
+		aiString diffuseTexturePath;
+
+		if( assimpScene.mMaterials[ materialIndex ]->GetTexture( aiTextureType_DIFFUSE, 0, & diffuseTexturePath ) == aiReturn_SUCCESS )
+		{
+			material.m_DiffuseTexturePath = builder.AddString( diffuseTexturePath.C_Str() );
+			dependencies.push_back( Material::GetTexturePath( diffuseTexturePath.C_Str(), scenePath ) );
+		}
+		else
+			material.m_DiffuseTexturePath = NoString;
+
+		builder.m_Materials.push_back( material );
+	}
+
+	sort( dependencies.begin(), dependencies.end() );
+	dependencies.erase( unique( dependencies.begin(), dependencies.end() ), dependencies.end() );
+
+	vector< DependencyRecord > dependencyRecords( dependencies.size() );
+
+	for( size_t dependencyIndex = 0; dependencyIndex < dependencies.size(); ++dependencyIndex )
+	{
+		dependencyRecords[ dependencyIndex ].m_Path = builder.AddString( dependencies[ dependencyIndex ].c_str() );
+		StatDependency( dependencies[ dependencyIndex ], dependencyRecords[ dependencyIndex ] );
+	}
+
+	// The streams are written first and in bulk, they make up the majority of
+	// the file.
+	vector< uint32_t > triIndices;
+	vector< MeshLod > lods;
+	vector< uint32_t > adjacencyIndices;
+	vector< MeshCluster > clusters;
+	size_t numClosedMeshes = 0;
+	size_t totalTris = 0;
+	float totalMissesBefore = 0.0f;
+	float totalMissesAfter = 0.0f;
+
+	clog << "Vertex cache statistics with " << TriangleOrder::GetModeName( m_TriangleOrder ) << " triangle order" << endl;
+
+	for( unsigned meshIndex = 0; meshIndex < assimpScene.mNumMeshes; ++meshIndex )
+	{
+		const aiMesh & assimpMesh = * assimpScene.mMeshes[ meshIndex ];
+
+		assert( assimpMesh.HasNormals() );
+
+		// Only triangles are rendered. Assimp's SortByPType step puts points
+		// and lines into separate meshes, which will just end up empty.
+		triIndices.clear();
+
+		for( unsigned faceIndex = 0; faceIndex < assimpMesh.mNumFaces; ++faceIndex )
+		{
+			const aiFace & face = assimpMesh.mFaces[ faceIndex ];
+
+			if( face.mNumIndices == 3 )
+				triIndices.insert( triIndices.end(), face.mIndices, face.mIndices + 3 );
+		}
+
+		// Reordered before hashing, as the hash is meant to cover what ends
+		// up on the GPU.
+		const size_t numTris = triIndices.size() / 3;
+		const TriangleOrder::CacheStats statsBefore = TriangleOrder::MeasureCache( triIndices.data(), numTris, assimpMesh.mNumVertices );
+		TriangleOrder::Optimise( m_TriangleOrder, triIndices.data(), numTris, assimpMesh.mVertices, assimpMesh.mNumVertices );
+		const TriangleOrder::CacheStats statsAfter = TriangleOrder::MeasureCache( triIndices.data(), numTris, assimpMesh.mNumVertices );
+
+		// The LODs are appended to the full detail triangles, and ordered in
+		// the same way.
+		MeshSimplifier::BuildLods( assimpMesh.mVertices, assimpMesh.mNumVertices, triIndices, lods );
+
+		for( size_t lodIndex = 1; lodIndex < lods.size(); ++lodIndex )
+			TriangleOrder::Optimise( m_TriangleOrder, & triIndices[ lods[ lodIndex ].m_FirstTri * 3 ], lods[ lodIndex ].m_NumTris, assimpMesh.mVertices, assimpMesh.mNumVertices );
+
+		// Closed meshes can have their shadows extruded from the silhouette
+		// alone. The adjacency follows the final triangle order.
+		const bool isClosed = MeshAdjacency::Build( assimpMesh.mVertices, assimpMesh.mNumVertices, triIndices, lods, adjacencyIndices );
+
+		if( isClosed )
+			++numClosedMeshes;
+
+		// Shadow casting is culled a cluster at a time.
+		MeshClusters::Build( assimpMesh.mVertices, triIndices, lods, clusters );
+
+		// This runs on a worker, so build each line up first (as the
+		// importer does).
+		ostringstream message;
+		message << fixed << setprecision( 3 ) << "  " << left << setw( 26 ) << assimpMesh.mName.C_Str() << right << setw( 10 ) << numTris << " tris, ACMR " << statsBefore.m_Acmr << " -> " << statsAfter.m_Acmr << ", ATVR " << statsBefore.m_Atvr << " -> " << statsAfter.m_Atvr;
+
+		if( lods.size() > 1 )
+		{
+			message << ", LODs" << setprecision( 4 );
+
+			for( size_t lodIndex = 1; lodIndex < lods.size(); ++lodIndex )
+				message << " " << lods[ lodIndex ].m_NumTris << " (" << lods[ lodIndex ].m_Error << ")";
+		}
+
+		message << ", " << clusters.size() << " clusters";
+
+		if( isClosed )
+			message << ", closed";
+
+		message << "\n";
+		clog << message.str();
+
+		totalTris += numTris;
+		totalMissesBefore += statsBefore.m_Acmr * numTris;
+		totalMissesAfter += statsAfter.m_Acmr * numTris;
+
+		const size_t streamSize = assimpMesh.mNumVertices * sizeof( aiVector3D );
+
+		// Hash everything that ends up on the GPU. The sizes and the mesh's
+		// components go in first so that eg a mesh without texture
+		// coordinates can't match one with.
+		const uint32_t meshShape[4] = { assimpMesh.mNumVertices, static_cast< uint32_t >( triIndices.size() ), assimpMesh.HasNormals(), assimpMesh.HasTextureCoords( 0 ) };
+		uint64_t meshHash = Hash( meshShape, sizeof( meshShape ) );
+		meshHash = Hash( assimpMesh.mVertices, streamSize, meshHash );
+
+		if( assimpMesh.HasNormals() )
+			meshHash = Hash( assimpMesh.mNormals, streamSize, meshHash );
+
+		if( assimpMesh.HasTextureCoords( 0 ) )
+			meshHash = Hash( assimpMesh.mTextureCoords[0], streamSize, meshHash );
+
+		meshHash = Hash( triIndices.data(), triIndices.size() * sizeof( uint32_t ), meshHash );
+		meshHash = Hash( lods.data(), lods.size() * sizeof( MeshLod ), meshHash );
+
+		MeshRecord mesh;
+		mesh.m_Name = builder.AddString( assimpMesh.mName.C_Str() );
+		mesh.m_MaterialIndex = assimpMesh.mMaterialIndex;
+		mesh.m_NumVertices = assimpMesh.mNumVertices;
+		mesh.m_NumTris = static_cast< uint32_t >( numTris );
+		mesh.m_NumLods = static_cast< uint32_t >( lods.size() );
+		mesh.m_NumClusters = static_cast< uint32_t >( clusters.size() );
+		mesh.m_Hash = meshHash;
+		mesh.m_VerticesOffset = builder.Append( assimpMesh.mVertices, streamSize );
+		mesh.m_NormalsOffset = assimpMesh.HasNormals() ? builder.Append( assimpMesh.mNormals, streamSize ) : 0;
+		mesh.m_TexCoordsOffset = assimpMesh.HasTextureCoords( 0 ) ? builder.Append( assimpMesh.mTextureCoords[0], streamSize ) : 0;
+		mesh.m_TriIndicesOffset = builder.Append( triIndices );
+		mesh.m_LodsOffset = builder.Append( lods );
+		mesh.m_AdjacencyOffset = isClosed ? builder.Append( adjacencyIndices ) : 0;
+		mesh.m_ClustersOffset = builder.Append( clusters );
+
+		builder.m_Meshes.push_back( mesh );
+	}
+
+	if( totalTris > 0 )
+		clog << "Overall ACMR " << totalMissesBefore / totalTris << " -> " << totalMissesAfter / totalTris << " over " << totalTris << " tris" << endl;
+
+	clog << numClosedMeshes << " of " << assimpScene.mNumMeshes << " meshes are closed and have silhouette shadows" << endl;
+
+	builder.AddNode( * assimpScene.mRootNode );
+
+	header.m_MaterialsOffset = builder.Append( builder.m_Materials );
+	header.m_MeshesOffset = builder.Append( builder.m_Meshes );
+	header.m_NodesOffset = builder.Append( builder.m_Nodes );
+	header.m_NodeMeshesOffset = builder.Append( builder.m_NodeMeshes );
+
+	// Lights are tiny and there aren't many of them, so we just store Assimp's
+	// own structure as is.
+	vector< aiLight > lights;
+
+	for( unsigned lightIndex = 0; lightIndex < assimpScene.mNumLights; ++lightIndex )
+		lights.push_back( * assimpScene.mLights[ lightIndex ] );
+
+	header.m_LightsOffset = builder.Append( lights );
+	header.m_DependenciesOffset = builder.Append( dependencyRecords );
+
+	header.m_StringsOffset = builder.Append( builder.m_Strings );
+
+	copy( CacheMagic, CacheMagic + sizeof( CacheMagic ), header.m_Magic );
+	header.m_Version = CacheVersion;
+	header.m_ImportFlags = m_ImportFlags;
+	header.m_TriangleOrder = m_TriangleOrder;
+	header.m_SourceHash = m_SourceHash;
+	header.m_NumMaterials = static_cast< uint32_t >( builder.m_Materials.size() );
+	header.m_NumMeshes = static_cast< uint32_t >( builder.m_Meshes.size() );
+	header.m_NumNodes = static_cast< uint32_t >( builder.m_Nodes.size() );
+	header.m_NumLights = assimpScene.mNumLights;
+	header.m_NumDependencies = static_cast< uint32_t >( dependencyRecords.size() );
+	header.m_FileSize = m_Image.size();
+
+	memcpy( & m_Image.front(), & header, sizeof( header ) );
+
+	m_pData = & m_Image.front();
+	m_Size = m_Image.size();
+
+	WriteFile( m_FileName, m_pData, m_Size );
+}
+
+
+bool SceneCache::WriteFile( const string & fileName, const char * pData, const size_t size )
+{
+	// Write to a temporary file first and then rename it, so that we never
+	// leave a half written cache file lying around if something goes wrong.
+	const string tempFileName = fileName + ".tmp";
+
+	try
+	{
+		filesystem::create_directories( filesystem::path( fileName ).parent_path() );
+
+		{
+			ofstream cacheFile( tempFileName, ios::binary | ios::trunc );
+			cacheFile.write( pData, size );
+
+			if( ! cacheFile )
+				throw runtime_error( "write failed" );
+		}
+
+		filesystem::rename( tempFileName, fileName );
+		clog << "Wrote cache file " << fileName << endl;
+		return true;
+	}
+	catch( const std::exception & exception )
+	{
+		clog << "Can't write cache file " << fileName << ": " << exception.what() << endl;
+
+		boost::system::error_code errorCode;
+		filesystem::remove( tempFileName, errorCode );
+		return false;
+	}
+}
+
+
+const uint32_t * SceneCache::GetNodeMeshes( const NodeRecord & node ) const
+{
+	return GetRecords< uint32_t >( GetHeader().m_NodeMeshesOffset ) + node.m_FirstMesh;
+}
+
+
+const char * SceneCache::GetString( const uint32_t offset ) const
+{
+	return ( offset == NoString ) ? nullptr : m_pData + GetHeader().m_StringsOffset + offset;
+}
+
+
+MeshStreams SceneCache::GetMeshStreams( const size_t index ) const
+{
+	const MeshRecord & mesh = GetMesh( index );
+
+	MeshStreams streams;
+	streams.m_pName = GetString( mesh.m_Name );
+	streams.m_NumVertices = mesh.m_NumVertices;
+	streams.m_NumTris = mesh.m_NumTris;
+	streams.m_NumLods = mesh.m_NumLods;
+	streams.m_pVertices = GetRecords< aiVector3D >( mesh.m_VerticesOffset );
+	streams.m_pNormals = ( mesh.m_NormalsOffset != 0 ) ? GetRecords< aiVector3D >( mesh.m_NormalsOffset ) : nullptr;
+	streams.m_pTexCoords = ( mesh.m_TexCoordsOffset != 0 ) ? GetRecords< aiVector3D >( mesh.m_TexCoordsOffset ) : nullptr;
+	streams.m_pTriIndices = GetRecords< uint32_t >( mesh.m_TriIndicesOffset );
+	streams.m_pLods = GetRecords< MeshLod >( mesh.m_LodsOffset );
+	streams.m_pAdjacencyIndices = ( mesh.m_AdjacencyOffset != 0 ) ? GetRecords< uint32_t >( mesh.m_AdjacencyOffset ) : nullptr;
+	streams.m_NumClusters = mesh.m_NumClusters;
+	streams.m_pClusters = GetRecords< MeshCluster >( mesh.m_ClustersOffset );
+
+	return streams;
+}
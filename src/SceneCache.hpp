@@ -0,0 +1,213 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Importing a scene with Assimp is slow, especially with all of the
+// post-processing steps turned on. A SceneCache stores the result of an import
+// in a binary file that is laid out exactly the way we need it in memory:
+// vertex, normal, texture coordinate and index streams are stored tightly
+// packed so they can be handed straight to glBufferData, followed by the
+// materials and the node hierarchy. The cache file is memory mapped when it is
+// loaded, so there is no parsing and no per-element copying on a warm load.
+//
+// Cache files are named after the path of the source file, the Assimp import
+// flags used and the order triangles are sorted into (see TriangleOrder), so
+// there is only ever one cache file for each source file and set of options,
+// and rebuilding it replaces the old one. The file records a hash of the
+// contents of the source file, and the size and last write time of every
+// other file the scene depends on (see DependencyRecord), so editing any of
+// them automatically results in the cache file being rebuilt.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+
+#include "TriangleOrder.hpp"
+
+
+struct MeshStreams;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SceneCache class
+///////////////////////////////////////////////////////////////////////////////
+class SceneCache
+{
+public:
+	// Record types stored in the cache file. These are plain old data and are
+	// written to/read from the file as is. Offsets are in bytes from the start
+	// of the file. String members are offsets into the string table, or
+	// NoString if there is no string.
+	static const uint32_t	NoString = ~0u;
+
+	struct Header
+	{
+		char				m_Magic[8];
+		uint32_t			m_Version;
+		uint32_t			m_ImportFlags;
+		uint32_t			m_TriangleOrder;
+		uint32_t			m_NumDependencies;
+		uint64_t			m_SourceHash;
+		uint32_t			m_NumMaterials;
+		uint32_t			m_NumMeshes;
+		uint32_t			m_NumNodes;
+		uint32_t			m_NumLights;
+		uint64_t			m_MaterialsOffset;
+		uint64_t			m_MeshesOffset;
+		uint64_t			m_NodesOffset;
+		uint64_t			m_NodeMeshesOffset;
+		uint64_t			m_LightsOffset;
+		uint64_t			m_DependenciesOffset;
+		uint64_t			m_StringsOffset;
+		uint64_t			m_FileSize;
+	};
+
+	struct MaterialRecord
+	{
+		uint32_t			m_DiffuseTexturePath;
+	};
+
+	// The normal and texture coordinate offsets are zero if the mesh doesn't
+	// have normals/texture coordinates. The hash covers the contents of the
+	// streams (but not the name or material) so that identical meshes can be
+	// shared. The triangle indices of every LOD are stored one after the
+	// other, starting with the full detail mesh, and the LODs themselves are
+	// stored as an array of MeshLod. Closed meshes also store their triangle
+	// adjacency (see MeshAdjacency) in the same order; the offset is zero for
+	// meshes that aren't closed. The clusters of every LOD (see MeshClusters)
+	// are stored as an array of MeshCluster.
+	struct MeshRecord
+	{
+		uint32_t			m_Name;
+		uint32_t			m_MaterialIndex;
+		uint32_t			m_NumVertices;
+		uint32_t			m_NumTris;
+		uint32_t			m_NumLods;
+		uint32_t			m_NumClusters;
+		uint64_t			m_Hash;
+		uint64_t			m_VerticesOffset;
+		uint64_t			m_NormalsOffset;
+		uint64_t			m_TexCoordsOffset;
+		uint64_t			m_TriIndicesOffset;
+		uint64_t			m_LodsOffset;
+		uint64_t			m_AdjacencyOffset;
+		uint64_t			m_ClustersOffset;
+	};
+
+	// Nodes are stored depth first, so a node's children immediately follow
+	// it (and all of their descendents). The node's mesh indices are stored
+	// in a separate array starting at m_FirstMesh. The transform is stored in
+	// the same order as Assimp's aiMatrix4x4.
+	struct NodeRecord
+	{
+		float				m_Transform[16];
+		uint32_t			m_Name;
+		uint32_t			m_NumChildren;
+		uint32_t			m_FirstMesh;
+		uint32_t			m_NumMeshes;
+	};
+
+	// A file the scene was built from other than the source file: one that
+	// Assimp read while importing it (eg an OBJ's material library), or a
+	// texture that one of its materials references. The cache is out of date
+	// if the file has been created, deleted or written to since.
+	struct DependencyRecord
+	{
+		uint32_t			m_Path;
+		uint32_t			m_Exists;
+		uint64_t			m_Size;
+		int64_t				m_WriteTime;
+	};
+
+	// The cache is keyed by the path and contents of the source file, the
+	// files it depends on, the import flags and the triangle order. Nothing
+	// is loaded until Open or Build are called.
+							SceneCache( const string & sourceFileName, const unsigned int importFlags, const TriangleOrder::Mode triangleOrder );
+
+	// Tries to load the cache file for the source file. Returns false if
+	// there is no cache file or it is out of date/unreadable, in which case
+	// you need to import the scene yourself and call Build.
+	bool					Open();
+
+	// Builds the cache from a scene that was imported using the import flags
+	// given to the constructor, writes it to disk and opens it. filesRead are
+	// the files Assimp opened while importing it (see
+	// SceneImporter::GetFilesRead). The triangles of each mesh are reordered
+	// on the way in, and the vertex cache statistics before and after are
+	// logged. If the cache file can't be written the cache is kept in memory
+	// instead, so it is always safe to read from the cache after calling
+	// this.
+	void					Build( const aiScene & assimpScene, const vector< string > & filesRead );
+
+	const Header &			GetHeader() const							{ return * GetRecords< Header >( 0 ); }
+	const MaterialRecord &	GetMaterial( const size_t index ) const		{ return GetRecords< MaterialRecord >( GetHeader().m_MaterialsOffset )[ index ]; }
+	const MeshRecord &		GetMesh( const size_t index ) const			{ return GetRecords< MeshRecord >( GetHeader().m_MeshesOffset )[ index ]; }
+	const NodeRecord &		GetNode( const size_t index ) const			{ return GetRecords< NodeRecord >( GetHeader().m_NodesOffset )[ index ]; }
+	const aiLight &			GetLight( const size_t index ) const		{ return GetRecords< aiLight >( GetHeader().m_LightsOffset )[ index ]; }
+
+	// Returns the mesh indices referenced by a node.
+	const uint32_t *		GetNodeMeshes( const NodeRecord & node ) const;
+
+	// Returns a string from the string table, or nullptr for NoString.
+	const char *			GetString( const uint32_t offset ) const;
+
+	// Returns pointers to the streams of the specified mesh. The pointers are
+	// into the mapped cache file, so they are only valid while this object is.
+	MeshStreams				GetMeshStreams( const size_t index ) const;
+
+	const string &			GetFileName() const							{ return m_FileName; }
+	const char *			GetData() const								{ return m_pData; }
+	size_t					GetSize() const								{ return m_Size; }
+
+	// Hashes a block of memory. Used to key cache files by the contents of
+	// their source file, and to find duplicate data. Blocks can be hashed
+	// together by passing the hash of the previous block as the seed.
+	static const uint64_t	HashSeed = 14695981039346656037ull;
+	static uint64_t			Hash( const void * pData, const size_t size, const uint64_t seed = HashSeed );
+
+	// Writes a cache file, creating the cache directory if necessary. Returns
+	// false (after logging why) if the file couldn't be written. Never leaves
+	// a partially written file behind.
+	static bool				WriteFile( const string & fileName, const char * pData, const size_t size );
+
+	// Returns the path of a cache file in the cache directory.
+	static string			GetCachePath( const string & cacheFileName );
+
+private:
+	template< class RecordType >
+	const RecordType *		GetRecords( const uint64_t offset ) const	{ return reinterpret_cast< const RecordType * >( m_pData + offset ); }
+
+	// Checks that the mapped data looks like a valid cache file for our source
+	// file and import flags, and that none of the files it depends on have
+	// changed.
+	bool					Validate() const;
+
+	// Fills in everything but the path of a dependency from the file as it is
+	// now.
+	static void				StatDependency( const string & fileName, DependencyRecord & dependency );
+
+	const string			m_SourceFileName;
+	const unsigned int		m_ImportFlags;
+	const TriangleOrder::Mode	m_TriangleOrder;
+	uint64_t				m_SourceHash;
+	string					m_FileName;
+
+	// An existing cache file is memory mapped. When the cache has just been
+	// built it is read from the in-memory image instead.
+	iostreams::mapped_file_source	m_MappedFile;
+	vector< char >					m_Image;
+
+	const char *			m_pData;
+	size_t					m_Size;
+};
@@ -0,0 +1,59 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Precomp.hpp"
+#include "Common.hpp"
+
+#include "SceneFile.hpp"
+
+#include "Mesh.hpp"
+#include "Light.hpp"
+#include "Texture.hpp"
+#include "Material.hpp"
+#include "SceneNode.hpp"
+
+
+SceneFile::SceneFile( const string & fileName )
+	: m_FileName	( fileName )
+	, m_pRootNode	( nullptr )
+{}
+
+
+MemoryUsage SceneFile::GetMemoryUsage() const
+{
+	MemoryUsage usage( sizeof( * this ) + m_FileName.capacity(), 0 );
+
+	if( m_pRootNode != nullptr )
+		usage += m_pRootNode->GetMemoryUsage();
+
+	foreach( const Mesh * pMesh, m_Meshes )
+		usage += pMesh->GetMemoryUsage();
+
+	// Materials can share textures too.
+	set< const Texture * > textures;
+
+	foreach( const Material * pMaterial, m_Materials )
+	{
+		usage += MemoryUsage( sizeof( Material ), 0 );
+
+		if( pMaterial->m_pDiffuseTexture && textures.insert( pMaterial->m_pDiffuseTexture.get() ).second )
+			usage += pMaterial->m_pDiffuseTexture->GetMemoryUsage();
+	}
+
+	usage += MemoryUsage( m_Lights.size() * sizeof( Light ), 0 );
+
+	return usage;
+}
@@ -0,0 +1,60 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// A SceneFile records everything that loading a scene file added to the scene,
+// so that it can be reported on and unloaded again. The scene owns the
+// objects themselves. Meshes and materials can be shared between files (see
+// Scene::m_MeshesByHash), so unloading a file only frees the ones that no
+// other file uses.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+
+#include "MemoryUsage.hpp"
+
+
+class Mesh;
+class Light;
+class Material;
+class SceneNode;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SceneFile class
+///////////////////////////////////////////////////////////////////////////////
+class SceneFile
+{
+public:
+	explicit					SceneFile( const string & fileName );
+
+	// Memory used by everything the file references. Shared meshes, materials
+	// and textures are included in the usage of every file that uses them.
+	MemoryUsage					GetMemoryUsage() const;
+
+	const string				m_FileName;
+
+	// These are empty until the loader has added the scene (see
+	// SceneLoader::Update). Each mesh and material is only listed once.
+	SceneNode *					m_pRootNode;
+	vector< Mesh * >			m_Meshes;
+	vector< Material * >		m_Materials;
+	vector< Light * >			m_Lights;
+
+private:
+	// Revoked.
+								SceneFile( const SceneFile & copy );
+	SceneFile &					operator = ( const SceneFile & copy );
+};
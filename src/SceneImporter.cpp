@@ -0,0 +1,270 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Precomp.hpp"
+#include "Common.hpp"
+
+#include "SceneImporter.hpp"
+
+
+namespace
+{
+	struct ProfileInfo
+	{
+		const char *	m_pName;
+		const char *	m_pLabel;
+		unsigned int	m_Flags;
+	};
+
+	// We never use tangents, so none of the profiles bother calculating them
+	// apart from max quality, which is kept the same as it has always been so
+	// that existing scene caches stay valid.
+	const ProfileInfo Profiles[ SceneImporter::NumProfiles ] =
+	{
+		{ "fast",		"&Fast",			( aiProcessPreset_TargetRealtime_Fast & ~aiProcess_CalcTangentSpace ) | aiProcess_ConvertToLeftHanded },
+		{ "balanced",	"&Balanced",		( aiProcessPreset_TargetRealtime_Quality & ~( aiProcess_CalcTangentSpace | aiProcess_ImproveCacheLocality | aiProcess_FindDegenerates ) ) | aiProcess_ConvertToLeftHanded },
+		{ "max",		"&Max Quality",		aiProcessPreset_TargetRealtime_MaxQuality | aiProcess_ConvertToLeftHanded }
+	};
+
+	struct PostProcessStep
+	{
+		unsigned int	m_Flag;
+		const char *	m_pName;
+	};
+
+	// Post-processing steps in the order that Assimp runs them in. Running
+	// them one at a time in this order gives the same result as running them
+	// all at once, apart from aiProcess_SplitLargeMeshes, which Assimp splits
+	// into two passes, one before normals are generated and one after. That's
+	// why only SceneImporter::Import's scenes go into the scene cache.
+	const PostProcessStep PostProcessSteps[] =
+	{
+		{ aiProcess_ValidateDataStructure,		"ValidateDataStructure" },
+		{ aiProcess_RemoveComponent,			"RemoveComponent" },
+		{ aiProcess_RemoveRedundantMaterials,	"RemoveRedundantMaterials" },
+		{ aiProcess_FindInstances,				"FindInstances" },
+		{ aiProcess_OptimizeGraph,				"OptimizeGraph" },
+		{ aiProcess_OptimizeMeshes,				"OptimizeMeshes" },
+		{ aiProcess_FindDegenerates,			"FindDegenerates" },
+		{ aiProcess_GenUVCoords,				"GenUVCoords" },
+		{ aiProcess_TransformUVCoords,			"TransformUVCoords" },
+		{ aiProcess_PreTransformVertices,		"PreTransformVertices" },
+		{ aiProcess_Triangulate,				"Triangulate" },
+		{ aiProcess_SortByPType,				"SortByPType" },
+		{ aiProcess_FindInvalidData,			"FindInvalidData" },
+		{ aiProcess_FixInfacingNormals,			"FixInfacingNormals" },
+		{ aiProcess_SplitByBoneCount,			"SplitByBoneCount" },
+		{ aiProcess_SplitLargeMeshes,			"SplitLargeMeshes" },
+		{ aiProcess_GenNormals,					"GenNormals" },
+		{ aiProcess_GenSmoothNormals,			"GenSmoothNormals" },
+		{ aiProcess_CalcTangentSpace,			"CalcTangentSpace" },
+		{ aiProcess_JoinIdenticalVertices,		"JoinIdenticalVertices" },
+		{ aiProcess_MakeLeftHanded,				"MakeLeftHanded" },
+		{ aiProcess_FlipUVs,					"FlipUVs" },
+		{ aiProcess_FlipWindingOrder,			"FlipWindingOrder" },
+		{ aiProcess_Debone,						"Debone" },
+		{ aiProcess_LimitBoneWeights,			"LimitBoneWeights" },
+		{ aiProcess_ImproveCacheLocality,		"ImproveCacheLocality" }
+	};
+
+
+	// Reads files with the C runtime, as Assimp's own IO handler does.
+	class FileStream : public Assimp::IOStream
+	{
+	public:
+		explicit FileStream( FILE * pFile )
+			: m_pFile( pFile )
+		{}
+
+		virtual ~FileStream()
+		{
+			fclose( m_pFile );
+		}
+
+		virtual size_t Read( void * pBuffer, size_t size, size_t count )			{ return fread( pBuffer, size, count, m_pFile ); }
+		virtual size_t Write( const void * pBuffer, size_t size, size_t count )	{ return fwrite( pBuffer, size, count, m_pFile ); }
+		virtual size_t Tell() const													{ return ftell( m_pFile ); }
+		virtual void Flush()														{ fflush( m_pFile ); }
+
+		virtual aiReturn Seek( size_t offset, aiOrigin origin )
+		{
+			const int seekOrigin = ( origin == aiOrigin_SET ) ? SEEK_SET : ( origin == aiOrigin_CUR ) ? SEEK_CUR : SEEK_END;
+			return ( fseek( m_pFile, static_cast< long >( offset ), seekOrigin ) == 0 ) ? aiReturn_SUCCESS : aiReturn_FAILURE;
+		}
+
+		virtual size_t FileSize() const
+		{
+			const long position = ftell( m_pFile );
+			fseek( m_pFile, 0, SEEK_END );
+			const long size = ftell( m_pFile );
+			fseek( m_pFile, position, SEEK_SET );
+			return size;
+		}
+
+	private:
+		FILE * const m_pFile;
+	};
+
+	// Opens files like Assimp's own IO handler, and notes the name of every
+	// file that is opened. Importers read more than the file they are given
+	// (eg an OBJ's material library), and the scene cache needs to know
+	// about them to tell when it is out of date.
+	class FileRecorder : public Assimp::IOSystem
+	{
+	public:
+		explicit FileRecorder( vector< string > & filesRead )
+			: m_FilesRead( filesRead )
+		{}
+
+		virtual bool Exists( const char * pFileName ) const
+		{
+			FILE * const pFile = fopen( pFileName, "rb" );
+
+			if( pFile == nullptr )
+				return false;
+
+			fclose( pFile );
+			return true;
+		}
+
+		virtual char getOsSeparator() const
+		{
+			return static_cast< char >( filesystem::path::preferred_separator );
+		}
+
+		virtual Assimp::IOStream * Open( const char * pFileName, const char * pMode )
+		{
+			FILE * const pFile = fopen( pFileName, pMode );
+
+			if( pFile == nullptr )
+				return nullptr;
+
+			if( find( m_FilesRead.begin(), m_FilesRead.end(), pFileName ) == m_FilesRead.end() )
+				m_FilesRead.push_back( pFileName );
+
+			return new FileStream( pFile );
+		}
+
+		virtual void Close( Assimp::IOStream * pStream )
+		{
+			delete pStream;
+		}
+
+	private:
+		vector< string > &	m_FilesRead;
+	};
+
+
+	void LogSceneSize( const string & stepName, const long time, const aiScene & assimpScene )
+	{
+		size_t numFaces = 0;
+		size_t numVertices = 0;
+
+		for( unsigned meshIndex = 0; meshIndex < assimpScene.mNumMeshes; ++meshIndex )
+		{
+			numFaces += assimpScene.mMeshes[ meshIndex ]->mNumFaces;
+			numVertices += assimpScene.mMeshes[ meshIndex ]->mNumVertices;
+		}
+
+		// Build the line up first so that lines from imports running on other
+		// threads don't get mixed up with it.
+		ostringstream message;
+		message << "  " << left << setw( 26 ) << stepName << right << setw( 6 ) << time << "ms " << setw( 10 ) << numFaces << " faces " << setw( 10 ) << numVertices << " vertices " << assimpScene.mNumMeshes << " meshes\n";
+		clog << message.str();
+	}
+}
+
+
+const char * SceneImporter::GetProfileName( const Profile profile )
+{
+	return Profiles[ profile ].m_pName;
+}
+
+
+const char * SceneImporter::GetProfileLabel( const Profile profile )
+{
+	return Profiles[ profile ].m_pLabel;
+}
+
+
+unsigned int SceneImporter::GetProfileFlags( const Profile profile )
+{
+	return Profiles[ profile ].m_Flags;
+}
+
+
+bool SceneImporter::FindProfile( const string & name, Profile & profile )
+{
+	for( int profileIndex = 0; profileIndex < NumProfiles; ++profileIndex )
+	{
+		if( name == Profiles[ profileIndex ].m_pName )
+		{
+			profile = static_cast< Profile >( profileIndex );
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+SceneImporter::SceneImporter( const unsigned int importFlags )
+	: m_ImportFlags( importFlags )
+{
+	// The importer owns its IO handler and deletes it.
+	m_Importer.SetIOHandler( new FileRecorder( m_FilesRead ) );
+}
+
+
+const aiScene & SceneImporter::Import( const string & fileName )
+{
+	const aiScene * const pAssimpScene = m_Importer.ReadFile( fileName, m_ImportFlags );
+
+	if( pAssimpScene == nullptr )
+		throw runtime_error( "Error loading scene from " + fileName + ": " + m_Importer.GetErrorString() );
+
+	return * pAssimpScene;
+}
+
+
+void SceneImporter::LogSteps( const string & fileName )
+{
+	clog << "Importing " << fileName << " with flags " << hex << m_ImportFlags << dec << endl;
+
+	wxStopWatch stepWatch;
+	const aiScene * pAssimpScene = m_Importer.ReadFile( fileName, 0 );
+
+	if( pAssimpScene == nullptr )
+		throw runtime_error( "Error loading scene from " + fileName + ": " + m_Importer.GetErrorString() );
+
+	LogSceneSize( "ReadFile", stepWatch.Time(), * pAssimpScene );
+
+	foreach( const PostProcessStep & step, PostProcessSteps )
+	{
+		if( ( m_ImportFlags & step.m_Flag ) == 0 )
+			continue;
+
+		stepWatch.Start();
+		pAssimpScene = m_Importer.ApplyPostProcessing( step.m_Flag );
+
+		if( pAssimpScene == nullptr )
+			throw runtime_error( string( "Error post-processing scene from " ) + fileName + " (" + step.m_pName + "): " + m_Importer.GetErrorString() );
+
+		LogSceneSize( step.m_pName, stepWatch.Time(), * pAssimpScene );
+	}
+
+	m_Importer.FreeScene();
+}
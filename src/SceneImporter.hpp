@@ -0,0 +1,82 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Wraps the Assimp importer. Which post-processing steps are run is chosen
+// from a few named profiles, trading import time against mesh quality. Some
+// steps (eg cache locality optimisation and finding degenerates) can take most
+// of the import time for some scenes, so the importer can also run the steps
+// one at a time and log the time taken and the size of the scene after each
+// one. That makes it easy to see what each profile costs for a particular
+// scene. Running the steps one at a time doesn't always give the same scene
+// as running them together, so scenes imported that way are only logged, and
+// never used to build the scene cache.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SceneImporter class
+///////////////////////////////////////////////////////////////////////////////
+class SceneImporter
+{
+public:
+	enum Profile
+	{
+		Profile_Fast,
+		Profile_Balanced,
+		Profile_MaxQuality,
+		NumProfiles
+	};
+
+	// Returns the short name of a profile, as used on the command line.
+	static const char *		GetProfileName( const Profile profile );
+
+	// Returns a human readable name for a profile, for use in the UI.
+	static const char *		GetProfileLabel( const Profile profile );
+
+	// Returns the Assimp post-processing flags used by a profile.
+	static unsigned int		GetProfileFlags( const Profile profile );
+
+	// Looks up a profile by its short name. Returns false if there isn't a
+	// profile with that name.
+	static bool				FindProfile( const string & name, Profile & profile );
+
+	explicit				SceneImporter( const unsigned int importFlags );
+
+	// Imports a scene, throwing if it can't be loaded. The scene belongs to
+	// the importer, so it is only valid while the importer is.
+	const aiScene &			Import( const string & fileName );
+
+	// Imports a scene one post-processing step at a time, logging the time
+	// taken by each step along with the number of faces and vertices
+	// afterwards, and then frees it. Throws if it can't be loaded.
+	void					LogSteps( const string & fileName );
+
+	// The names of the files that Assimp opened while importing, including
+	// the scene file itself, in the order they were first opened.
+	const vector< string > &	GetFilesRead() const					{ return m_FilesRead; }
+
+private:
+	// Revoked.
+							SceneImporter( const SceneImporter & copy );
+	SceneImporter &			operator = ( const SceneImporter & copy );
+
+	// Declared before the importer, which writes to it through its IO
+	// handler.
+	vector< string >		m_FilesRead;
+	Assimp::Importer		m_Importer;
+	const unsigned int		m_ImportFlags;
+};
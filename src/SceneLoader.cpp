@@ -0,0 +1,246 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Precomp.hpp"
+#include "Common.hpp"
+
+#include "SceneLoader.hpp"
+
+#include "Mesh.hpp"
+#include "Light.hpp"
+#include "Scene.hpp"
+#include "Material.hpp"
+#include "SceneFile.hpp"
+#include "SceneCache.hpp"
+#include "ThreadPool.hpp"
+#include "SceneImporter.hpp"
+
+
+SceneLoader::SceneLoader( SceneFile & file, const unsigned int importFlags, const TriangleOrder::Mode triangleOrder )
+	: m_File			( file )
+	, m_FileName		( file.m_FileName )
+	, m_ImportFlags		( importFlags )
+	, m_TriangleOrder	( triangleOrder )
+	, m_IsImported		( false )
+	, m_Stage			( Stage_Importing )
+	, m_NextIndex		( 0 )
+	, m_NumUploaded		( 0 )
+{}
+
+
+SceneLoader::~SceneLoader()
+{}
+
+
+void SceneLoader::Start( ThreadPool & threadPool )
+{
+	assert( m_Stage == Stage_Importing && ! m_IsImported );
+
+	m_LoadWatch.Start();
+	threadPool.Submit( std::bind( & SceneLoader::Import, shared_from_this() ) );
+}
+
+
+void SceneLoader::Import()
+{
+	try
+	{
+		// Only run the Assimp importer if we don't have an up to date cache of
+		// the scene. Either way, the scene is then built from the cache.
+		m_pCache.reset( new SceneCache( m_FileName, m_ImportFlags, m_TriangleOrder ) );
+
+		if( m_pCache->Open() )
+			clog << "Loading " << m_FileName << " from " << m_pCache->GetFileName() << endl;
+		else
+		{
+			SceneImporter importer( m_ImportFlags );
+			const aiScene & assimpScene = importer.Import( m_FileName );
+			m_pCache->Build( assimpScene, importer.GetFilesRead() );
+		}
+	}
+	catch( ... )
+	{
+		// Rethrown on the main thread by Update.
+		m_pError = std::current_exception();
+	}
+
+	m_IsImported = true;
+}
+
+
+bool SceneLoader::Update( const long budget )
+{
+	if( m_Stage == Stage_Importing )
+	{
+		if( ! m_IsImported )
+			return false;
+
+		if( m_pError )
+			std::rethrow_exception( m_pError );
+
+		clog << "Imported " << m_FileName << " in " << m_LoadWatch.Time() << "ms" << endl;
+		m_Stage = Stage_Scene;
+	}
+
+	wxStopWatch updateWatch;
+
+	// Always do at least one step so that loading can't stall, even if the
+	// budget is tiny.
+	do
+	{
+		switch( m_Stage )
+		{
+		case Stage_Scene:
+			{
+				// Creating the scene objects is cheap as the meshes aren't
+				// uploaded yet and textures are decoded in the background, so
+				// it's done in one go. Materials and meshes that are identical
+				// to ones already in the scene are shared instead.
+				const SceneCache::Header & header = m_pCache->GetHeader();
+				const filesystem::path scenePath = filesystem::path( m_FileName ).parent_path();
+				vector< uint64_t > materialHashes;
+
+				for( size_t materialIndex = 0; materialIndex < header.m_NumMaterials; ++materialIndex )
+				{
+					// The diffuse texture is the only material parameter, and
+					// texture paths are relative to the scene, so materials
+					// are keyed by the full path of their texture.
+					const char * const pDiffuseTexturePath = m_pCache->GetString( m_pCache->GetMaterial( materialIndex ).m_DiffuseTexturePath );
+					const string diffuseTexturePath = ( pDiffuseTexturePath != nullptr ) ? pDiffuseTexturePath : "";
+					const string materialKey = diffuseTexturePath.empty() ? "" : Material::GetTexturePath( diffuseTexturePath, scenePath );
+					const uint64_t materialHash = SceneCache::Hash( materialKey.data(), materialKey.size() );
+
+					// A hash collision gets a material of its own, which
+					// isn't shared.
+					Material * & pSharedMaterial = GetScene().m_MaterialsByHash[ materialHash ];
+					Material * pMaterial = pSharedMaterial;
+
+					if( pMaterial != nullptr && ! pMaterial->Matches( materialKey ) )
+					{
+						clog << m_FileName << ": material hash collision with " << materialKey << endl;
+						pMaterial = nullptr;
+					}
+
+					if( pMaterial == nullptr )
+					{
+						pMaterial = new Material( diffuseTexturePath, scenePath );
+						GetScene().m_Materials.push_back( pMaterial );
+
+						if( pSharedMaterial == nullptr )
+							pSharedMaterial = pMaterial;
+					}
+
+					if( find( m_File.m_Materials.begin(), m_File.m_Materials.end(), pMaterial ) == m_File.m_Materials.end() )
+						m_File.m_Materials.push_back( pMaterial );
+
+					m_Materials.push_back( pMaterial );
+					materialHashes.push_back( materialHash );
+				}
+
+				set< Mesh * > fileMeshes;
+				size_t numNewMeshes = 0;
+
+				for( size_t meshIndex = 0; meshIndex < header.m_NumMeshes; ++meshIndex )
+				{
+					// A mesh belongs to a material, so identical geometry with
+					// a different material has to be a different mesh.
+					const SceneCache::MeshRecord & meshRecord = m_pCache->GetMesh( meshIndex );
+					const uint64_t meshHash = SceneCache::Hash( & materialHashes[ meshRecord.m_MaterialIndex ], sizeof( uint64_t ), meshRecord.m_Hash );
+
+					// Likewise for meshes.
+					const MeshStreams streams = m_pCache->GetMeshStreams( meshIndex );
+					Material & material = * m_Materials[ meshRecord.m_MaterialIndex ];
+					Mesh * & pSharedMesh = GetScene().m_MeshesByHash[ meshHash ];
+					Mesh * pMesh = pSharedMesh;
+
+					if( pMesh != nullptr && ! pMesh->Matches( streams, material ) )
+					{
+						clog << m_FileName << ": mesh hash collision with " << streams.m_pName << endl;
+						pMesh = nullptr;
+					}
+
+					if( pMesh == nullptr )
+					{
+						pMesh = new Mesh( streams, material );
+						GetScene().m_Meshes.push_back( pMesh );
+						++numNewMeshes;
+
+						if( pSharedMesh == nullptr )
+							pSharedMesh = pMesh;
+					}
+
+					if( fileMeshes.insert( pMesh ).second )
+						m_File.m_Meshes.push_back( pMesh );
+
+					m_Meshes.push_back( pMesh );
+				}
+
+				clog << m_FileName << ": " << numNewMeshes << " of " << header.m_NumMeshes << " meshes are new" << endl;
+
+				size_t nodeIndex = 0;
+				m_File.m_pRootNode = new SceneNode( * m_pCache, nodeIndex, m_Meshes );
+				GetScene().m_RootNode.m_ChildNodes.push_back( m_File.m_pRootNode );
+				GetScene().m_Transforms.Rebuild( GetScene().m_RootNode );
+
+				// Each light is placed relative to the node with its name.
+				for( size_t lightIndex = 0; lightIndex < header.m_NumLights; ++lightIndex )
+				{
+					const aiLight & assimpLight = m_pCache->GetLight( lightIndex );
+					Light * const pLight = new Light( assimpLight, m_File.m_pRootNode->FindNode( assimpLight.mName.C_Str() ) );
+					GetScene().m_Lights.push_back( pLight );
+					m_File.m_Lights.push_back( pLight );
+				}
+
+				m_NextIndex = 0;
+				m_Stage = Stage_Meshes;
+			}
+			break;
+
+		case Stage_Meshes:
+			if( m_NextIndex < m_Meshes.size() )
+			{
+				// Shared meshes are uploaded by whichever loader gets to them
+				// first. Usually that's the loader that created them, but not
+				// if it was abandoned because its file was unloaded.
+				const size_t meshIndex = m_NextIndex++;
+
+				if( ! m_Meshes[ meshIndex ]->IsUploaded() )
+				{
+					m_Meshes[ meshIndex ]->Upload( m_pCache->GetMeshStreams( meshIndex ) );
+
+					if( m_NumUploaded++ == 0 )
+						clog << "First mesh of " << m_FileName << " uploaded after " << m_LoadWatch.Time() << "ms" << endl;
+				}
+			}
+			else
+			{
+				// The meshes have their own copies of the streams now, so the
+				// cache can be closed.
+				m_pCache.reset();
+				m_Stage = Stage_Done;
+
+				clog << "Loaded " << m_FileName << " in " << m_LoadWatch.Time() << "ms" << endl;
+			}
+			break;
+
+		default:
+			assert( false );
+		}
+	}
+	while( m_Stage != Stage_Done && updateWatch.Time() < budget );
+
+	return m_Stage == Stage_Done;
+}
@@ -0,0 +1,103 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// A SceneLoader loads a scene file in the background. Importing with Assimp
+// (or loading the scene cache) runs as a task on the scene's thread pool.
+// Everything that needs the GL has to happen on the main thread, so once the
+// import is done the loader adds the scene a little at a time
+// whenever Update is called, uploading as many meshes as it can within the
+// time budget it is given. Meshes become visible as soon as they are uploaded,
+// so large scenes appear progressively rather than blocking the UI.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+
+#include "TriangleOrder.hpp"
+
+
+class Mesh;
+class Material;
+class SceneFile;
+class SceneCache;
+class ThreadPool;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SceneLoader class
+///////////////////////////////////////////////////////////////////////////////
+class SceneLoader : public std::enable_shared_from_this< SceneLoader >
+{
+public:
+	// Everything the loader adds to the scene is recorded in file, which must
+	// outlive the loader's use of it on the main thread (ie until Update
+	// returns true, or the loader is abandoned).
+								SceneLoader( SceneFile & file, const unsigned int importFlags, const TriangleOrder::Mode triangleOrder );
+								~SceneLoader();
+
+	// Queues the import on the thread pool. The loader keeps itself alive
+	// until its tasks are finished.
+	void						Start( ThreadPool & threadPool );
+
+	// Adds the loaded scene to the global scene, spending no more than about
+	// budget milliseconds doing so. Returns true once the scene has been
+	// completely loaded. Rethrows any error that happened on the workers.
+	// Must be called from the main thread.
+	bool						Update( const long budget );
+
+	const string &				GetFileName() const				{ return m_FileName; }
+	SceneFile &					GetFile() const					{ return m_File; }
+
+private:
+	// The order things are done in on the main thread.
+	enum Stage
+	{
+		Stage_Importing,
+		Stage_Scene,
+		Stage_Meshes,
+		Stage_Done
+	};
+
+	// Revoked.
+								SceneLoader( const SceneLoader & copy );
+	SceneLoader &				operator = ( const SceneLoader & copy );
+
+	// Runs on a worker thread.
+	void						Import();
+
+	// The file name is copied as the file record is only safe to use on the
+	// main thread.
+	SceneFile &					m_File;
+	const string				m_FileName;
+	const unsigned int			m_ImportFlags;
+	const TriangleOrder::Mode	m_TriangleOrder;
+	unique_ptr< SceneCache >	m_pCache;
+
+	// The main thread doesn't touch anything the import writes to until this
+	// is set.
+	std::atomic< bool >			m_IsImported;
+	std::exception_ptr			m_pError;
+
+	Stage						m_Stage;
+	size_t						m_NextIndex;
+	size_t						m_NumUploaded;
+
+	// The meshes/materials used by the scene, in cache order. These may be
+	// shared with scenes that were loaded before.
+	vector< Mesh * >			m_Meshes;
+	vector< Material * >		m_Materials;
+
+	wxStopWatch					m_LoadWatch;
+};
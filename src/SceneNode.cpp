@@ -19,27 +19,39 @@
 
 #include "SceneNode.hpp"
 
+#include "Mesh.hpp"
 #include "Scene.hpp"
+#include "SceneCache.hpp"
 #include "MeshInstance.hpp"
 
 
 SceneNode::SceneNode()
-	: m_Name( "Root" )
+	: m_Name			( "Root" )
+	, m_HierarchyIndex	( 0 )
 {
 	m_Transform.setIdentity();
 }
 
 
-SceneNode::SceneNode( const aiNode & assimpNode, const size_t baseMeshIndex )
-	: m_Name( assimpNode.mName.C_Str() )
+// Nodes are stored depth first in the cache. This constructs the node at
+// nodeIndex and all of its descendents, leaving nodeIndex pointing at the next
+// node after them. The node's mesh indices are looked up in meshes, which holds
+// the meshes created from the cache in the same order.
+SceneNode::SceneNode( const SceneCache & cache, size_t & nodeIndex, const vector< Mesh * > & meshes )
+	: m_HierarchyIndex( 0 )
 {
-	copy( assimpNode.mTransformation[0], assimpNode.mTransformation[0] + 16, m_Transform.matrix().data() );
+	const SceneCache::NodeRecord & node = cache.GetNode( nodeIndex++ );
 
-	for( unsigned meshInstanceIndex = 0; meshInstanceIndex < assimpNode.mNumMeshes; ++meshInstanceIndex )
-		m_MeshInstances.push_back( new MeshInstance( GetScene().m_Meshes[ baseMeshIndex + assimpNode.mMeshes[ meshInstanceIndex ] ] ) );
+	m_Name = cache.GetString( node.m_Name );
+	copy( node.m_Transform, node.m_Transform + 16, m_Transform.matrix().data() );
 
-	for( unsigned childNodeIndex = 0; childNodeIndex < assimpNode.mNumChildren; ++childNodeIndex )
-		m_ChildNodes.push_back( new SceneNode( * assimpNode.mChildren[ childNodeIndex ], baseMeshIndex ) );
+	const uint32_t * const pMeshIndices = cache.GetNodeMeshes( node );
+
+	for( unsigned meshInstanceIndex = 0; meshInstanceIndex < node.m_NumMeshes; ++meshInstanceIndex )
+		m_MeshInstances.push_back( new MeshInstance( * meshes[ pMeshIndices[ meshInstanceIndex ] ] ) );
+
+	for( unsigned childNodeIndex = 0; childNodeIndex < node.m_NumChildren; ++childNodeIndex )
+		m_ChildNodes.push_back( new SceneNode( cache, nodeIndex, meshes ) );
 }
 
 
@@ -47,27 +59,47 @@ SceneNode::~SceneNode()
 {}
 
 
-void SceneNode::Render( const Affine3f & parentTransform )
+void SceneNode::SetTransform( const Affine3f & transform )
+{
+	m_Transform = transform;
+	GetScene().m_Transforms.SetLocalTransform( m_HierarchyIndex, transform );
+}
+
+
+void SceneNode::Move( const Vector3f & offset )
+{
+	const TransformHierarchy & transforms = GetScene().m_Transforms;
+	const int32_t parentIndex = transforms.GetParent( m_HierarchyIndex );
+	Vector3f localOffset = offset;
+
+	if( parentIndex >= 0 )
+		localOffset = transforms.GetWorldTransform( parentIndex ).topLeftCorner< 3, 3 >().inverse() * offset;
+
+	SetTransform( Translation3f( localOffset ) * m_Transform );
+}
+
+
+const SceneNode * SceneNode::FindNode( const string & name ) const
 {
-	const Affine3f worldTransform = parentTransform * m_Transform;
-	glLoadMatrixf( worldTransform.data() );
+	if( m_Name == name )
+		return this;
 
-	foreach( MeshInstance & instance, m_MeshInstances )
-		instance.Render();
+	foreach( const SceneNode & child, m_ChildNodes )
+	{
+		if( const SceneNode * const pNode = child.FindNode( name ) )
+			return pNode;
+	}
 
-	foreach( SceneNode & child, m_ChildNodes )
-		child.Render( worldTransform );
+	return nullptr;
 }
 
 
-void SceneNode::RenderShadowVolumes( const Affine3f & parentTransform )
+MemoryUsage SceneNode::GetMemoryUsage() const
 {
-	const Affine3f worldTransform = parentTransform * m_Transform;
-	glLoadMatrixf( worldTransform.data() );
+	MemoryUsage usage( sizeof( * this ) + m_Name.capacity() + m_MeshInstances.size() * sizeof( MeshInstance ), 0 );
 
-	foreach( MeshInstance & instance, m_MeshInstances )
-		instance.RenderShadowVolumes();
+	foreach( const SceneNode & child, m_ChildNodes )
+		usage += child.GetMemoryUsage();
 
-	foreach( SceneNode & child, m_ChildNodes )
-		child.RenderShadowVolumes( worldTransform );
+	return usage;
 }
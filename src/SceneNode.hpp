@@ -17,6 +17,11 @@
 #pragma once
 
 
+#include "MemoryUsage.hpp"
+
+
+class Mesh;
+class SceneCache;
 class MeshInstance;
 
 
@@ -24,11 +29,28 @@ class SceneNode
 {
 public:
 								SceneNode();
-								SceneNode( const aiNode & assimpNode, const size_t baseMeshIndex );
+								SceneNode( const SceneCache & cache, size_t & nodeIndex, const vector< Mesh * > & meshes );
 								~SceneNode();
 
-	void						Render( const Affine3f & parentTransform );
-	void						RenderShadowVolumes( const Affine3f & parentTransform );
+	// Changes the transform relative to the parent node, and marks the node's
+	// world transform to be recomputed (see TransformHierarchy).
+	void						SetTransform( const Affine3f & transform );
+
+	// Moves the node by an offset in world space, through SetTransform. The
+	// offset is taken into the parent's space with the parent's world
+	// transform as of the last TransformHierarchy::Update.
+	void						Move( const Vector3f & offset );
+
+	// Where the node is in the scene's TransformHierarchy.
+	size_t						GetHierarchyIndex() const		{ return m_HierarchyIndex; }
+
+	// Returns this node or the first of its descendents, depth first, with
+	// the given name, or nullptr if there isn't one.
+	const SceneNode *			FindNode( const string & name ) const;
+
+	// Memory used by this node and all of its descendents, not including the
+	// meshes they instance.
+	MemoryUsage					GetMemoryUsage() const;
 
 	ptr_list< MeshInstance >	m_MeshInstances;
 	ptr_list< SceneNode >		m_ChildNodes;
@@ -36,4 +58,9 @@ public:
 	string						m_Name;
 
 	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+	size_t						m_HierarchyIndex;
+
+	friend class TransformHierarchy;
 };
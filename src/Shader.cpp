@@ -22,6 +22,41 @@
 #include "Scene.hpp"
 
 
+namespace
+{
+	// Reads a shader's source, pasting in the contents of each file named by
+	// an #include "file" line, which is found next to the file including it.
+	// GLSL has no includes of its own, so this is how shaders share code
+	// (see Shadow.Common.glsl).
+	string ReadSource( const string & fileName )
+	{
+		ifstream shaderFile( fileName );
+
+		if( ! shaderFile )
+			throw runtime_error( "Failed to open shader " + fileName );
+
+		string source;
+		string line;
+
+		while( getline( shaderFile, line ) )
+		{
+			const size_t nameStart = line.find( '"' ) + 1;
+			const size_t nameEnd = line.rfind( '"' );
+
+			if( line.compare( 0, 8, "#include" ) == 0 && nameStart > 0 && nameEnd > nameStart )
+			{
+				const filesystem::path includePath = filesystem::path( fileName ).parent_path() / line.substr( nameStart, nameEnd - nameStart );
+				source += ReadSource( includePath.string() );
+			}
+			else
+				source += line + '\n';
+		}
+
+		return source;
+	}
+}
+
+
 ShaderBase::ShaderBase( const string & fileName, const GLenum typeEnum )
 	: m_Id		( glCreateShader( typeEnum ) )		// Create an OpenGL shader object and save the unique ID value that the GL assigned to it.
 	, m_TypeEnum( typeEnum )
@@ -33,20 +68,12 @@ ShaderBase::ShaderBase( const string & fileName, const GLenum typeEnum )
 
 void ShaderBase::Load( const string & fileName )
 {
-	// Open the source file.
-	ifstream shaderFile( fileName );
-
-	// Find out how long it is.
-	shaderFile.seekg( 0, ifstream::end );
-	const GLint size = shaderFile.tellg();
-
-	// Read it into a buffer.
-	vector< char > sourceString( size );
-	shaderFile.seekg( 0, ifstream::beg );
-	shaderFile.read( & sourceString.front(), size );
+	// Read the source, with any files that it includes.
+	const string sourceString = ReadSource( fileName );
 
 	// Upload it to the GL and compile it.
-	const char * pString = & sourceString.front();
+	const char * pString = sourceString.c_str();
+	const GLint size = static_cast< GLint >( sourceString.size() );
 	glShaderSource( m_Id, 1, & pString, & size );
 	glCompileShader( m_Id );
 
@@ -52,7 +52,8 @@ protected:
 	// this is (eg GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, etc.).
 					ShaderBase( const string & fileName, const GLenum typeEnum );
 
-	// Loads (or reloads) the shader from the specified file.
+	// Loads (or reloads) the shader from the specified file. An #include
+	// "file" line is replaced by the contents of that file.
 	void			Load( const string & fileName );
 
 private:
@@ -20,6 +20,10 @@
 #include "ShaderProgram.hpp"
 
 #include "Scene.hpp"
+#include "DrawBatch.hpp"
+
+
+ShaderProgram * ShaderProgram::m_gpCurrent = nullptr;
 
 
 ShaderProgram::ShaderProgram( const string & name,
@@ -31,6 +35,7 @@ ShaderProgram::ShaderProgram( const string & name,
 	, m_pVertexShader( pVertexShader )
 	, m_pFragmentShader( pFragmentShader )
 	, m_pGeometryShader( pGeometryShader )
+	, m_FirstInstanceLocation( -1 )
 {
 	// Attach the vertex and fragment shaders.
 	glAttachShader( m_Id, m_pVertexShader->GetId() );
@@ -40,6 +45,11 @@ ShaderProgram::ShaderProgram( const string & name,
 	if( m_pGeometryShader )
 		glAttachShader( m_Id, m_pGeometryShader->GetId() );
 
+	// Every program takes the draw index from the same attribute, as the
+	// geometry pool's vertex arrays are shared by all of them. This has no
+	// effect on programs that don't use it.
+	glBindAttribLocation( m_Id, DrawBatch::DrawIndexAttribute, "drawIndex" );
+
 	// Link the shaders into a program.
 	Link();
 
@@ -54,6 +64,18 @@ ShaderProgram::ShaderProgram( const string & name,
 
 void ShaderProgram::Link()
 {
+	// Which outputs transform feedback captures only takes effect when the
+	// program is linked.
+	if( ! m_FeedbackVaryings.empty() )
+	{
+		vector< const GLchar * > varyings;
+
+		foreach( const string & varying, m_FeedbackVaryings )
+			varyings.push_back( varying.c_str() );
+
+		glTransformFeedbackVaryings( m_Id, static_cast< GLsizei >( varyings.size() ), varyings.data(), GL_INTERLEAVED_ATTRIBS );
+	}
+
 	// Link the program.
 	glLinkProgram( m_Id );
 
@@ -79,6 +101,26 @@ void ShaderProgram::Link()
 		//		exception here. Logging an error gives the user a chance to fix
 		//		the shader files and re-compile them.
 		throw runtime_error( "Failed to link shader program" );
+
+	m_FirstInstanceLocation = glGetUniformLocation( m_Id, "firstInstance" );
+
+	// The sampler never changes, so it's set once here. That needs the
+	// program to be current, so whichever program was current is restored.
+	const GLint drawTransformsLocation = glGetUniformLocation( m_Id, "drawTransforms" );
+
+	if( drawTransformsLocation != -1 )
+	{
+		glUseProgram( m_Id );
+		glUniform1i( drawTransformsLocation, DrawBatch::DrawTransformsTextureUnit );
+		glUseProgram( ( m_gpCurrent != nullptr ) ? m_gpCurrent->m_Id : 0 );
+	}
+}
+
+
+void ShaderProgram::SetFeedbackVaryings( const vector< string > & varyings )
+{
+	m_FeedbackVaryings = varyings;
+	Link();
 }
 
 
@@ -86,4 +128,14 @@ void ShaderProgram::Link()
 void ShaderProgram::SetCurrent()
 {
 	glUseProgram( m_Id );
+	m_gpCurrent = this;
+}
+
+
+void ShaderProgram::SetFirstInstance( const GLint firstInstance )
+{
+	assert( m_gpCurrent == this );
+
+	if( m_FirstInstanceLocation != -1 )
+		glUniform1i( m_FirstInstanceLocation, firstInstance );
 }
@@ -44,6 +44,17 @@ public:
 	// Sets this as the current program used for rendering.
 	void										SetCurrent();
 
+	// Returns the program most recently made current with SetCurrent.
+	static ShaderProgram *						GetCurrent()						{ return m_gpCurrent; }
+
+	// Sets where the vertex shader finds the transforms of the instances it
+	// draws (see DrawBatch). Meshes with their own buffers are drawn with
+	// glDrawElementsInstanced, and their instances are firstInstance onwards.
+	// Pooled meshes pass -1, to take the index of each instance from the draw
+	// index attribute instead. Does nothing if the program doesn't transform
+	// positions. The program must be current.
+	void										SetFirstInstance( const GLint firstInstance );
+
 	// Returns the unique integer value that OpenGL uses to identify this
 	// program.
 	GLint										GetID() const						{ return m_Id; }
@@ -57,9 +68,21 @@ public:
 	// in order for the program to link successfully.
 	void										Link();
 
+	// Captures the named outputs of the last shader stage with transform
+	// feedback, interleaved in the order given, whenever the program is
+	// linked from now on. Re-links the program.
+	void										SetFeedbackVaryings( const vector< string > & varyings );
+
 private:
 	const GLint									m_Id;
 	std::shared_ptr< VertexShader >				m_pVertexShader;
 	std::shared_ptr< FragmentShader >			m_pFragmentShader;
 	std::shared_ptr< GeometryShader >			m_pGeometryShader;
+	vector< string >							m_FeedbackVaryings;
+
+	// Uniform locations, looked up whenever the program is linked. -1 if the
+	// program doesn't have the uniform.
+	GLint										m_FirstInstanceLocation;
+
+	static ShaderProgram *						m_gpCurrent;
 };
@@ -0,0 +1,84 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+
+// The plane and penumbral wedge maths shared by the geometry shaders that
+// extrude soft shadows from triangles: Shadow.GeometryShader.glsl,
+// ShadowWedge.GeometryShader.glsl and ShadowCapture.GeometryShader.glsl. The
+// light and the triangles can be in any space, as long as it's the same one.
+// Pasted in with #include when the shaders are loaded (see Shader.cpp).
+
+
+// The radius of the spherical light, which is ShadowCulling::LightRadius.
+uniform float lightRadius;
+
+
+// Returns the plane of a triangle facing the light, pushed one unit away
+// from the light so that lit surfaces don't shadow themselves.
+vec4 ComputeShadowPlane( vec3 vertPos, vec3 triNormal )
+{
+	return vec4( triNormal, -dot( vertPos, triNormal ) + 1.0 );
+}
+
+
+// Clamps the radius of the light so that it doesn't go "through" the plane
+// of the triangle, lightDistance away. This prevents weird effects like
+// penumbral wedges that go "up" towards the light and bad maths calls like
+// sqrt(-1).
+float ClampLightRadius( float lightDistance )
+{
+	return clamp( abs( lightDistance ) - 0.9 * lightRadius, 0.0, lightRadius );
+}
+
+
+// Works out the penumbral wedge of the edge from vertPos along edge, and
+// returns the normal of its outer face.
+vec3 ComputePenumbraWedge( vec3 vertPos, vec3 edge, vec3 lightPos, float clampedLightRadius, out vec4 penumbraNormal, out vec4 penumbraDirection, out float penumbraTangent )
+{
+	vec3 lightToVert = vertPos - lightPos;
+
+	// This is the normal of the inner hard/dark face of the penumbral wedge
+	// (ie the face that would be used for regular stencil shadows).
+	vec3 innerNormal = normalize( cross( lightToVert, edge ) );
+
+	float sinAngleSqr = clampedLightRadius * clampedLightRadius / dot( lightToVert, lightToVert );
+	float cosAngle = sqrt( 1.0 - sinAngleSqr );
+
+	// This is the first point on the sphere light that will be occluded as
+	// you enter the penumbra from the un-shadowed side. The outer face of the
+	// penumbral wedge is projected from this point.
+	vec3 farLightPos = lightPos + sinAngleSqr * lightToVert - clampedLightRadius * cosAngle * innerNormal;
+
+	vec3 outerNormal = normalize( cross( vertPos - farLightPos, edge ) );
+
+	penumbraNormal.xyz = normalize( innerNormal + outerNormal );
+	penumbraNormal.w = -dot( vertPos, penumbraNormal.xyz );
+
+	penumbraDirection.xyz = cross( edge, penumbraNormal.xyz );
+	penumbraDirection.w = -dot( vertPos, penumbraDirection.xyz );
+
+	// TODO: This should be faster, but it doesn't work. Why not??!!
+	/*cosAngle = dot( innerNormal, penumbraNormal.xyz );
+	float sinAngle = dot( innerNormal, penumbraDirection.xyz );
+	penumbraTangent = sinAngle / cosAngle;*/
+
+	// Backup plan for calculating the tangent, along the outer face at right
+	// angles to the edge.
+	vec3 outerTangent = cross( edge, outerNormal );
+	penumbraTangent = dot( outerTangent, penumbraNormal.xyz ) / dot( outerTangent, penumbraDirection.xyz );
+
+	return outerNormal;
+}
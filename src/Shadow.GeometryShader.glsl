@@ -21,6 +21,9 @@ layout( triangles ) in;
 layout( triangle_strip, max_vertices = 10 ) out;
 
 
+#include "Shadow.Common.glsl"
+
+
 // The fragment shader works out whether pixels are in shadow by clipping the
 // position against the planes of the shadow volume. We don't need a plane for
 // the far cap as nothing can be beyond that. However, we need to output the
@@ -70,7 +73,6 @@ void EmitShadowVertex( vec4 position )
 
 void main()
 {
-	const float lightRadius = 10.0;
 	vec3 lightPos = gl_LightSource[0].position.xyz;
 
 	// Cache vectors for each edge.
@@ -91,54 +93,18 @@ void main()
 		return;
 
 	// Cache the plane equation corresponding to the original triangle.
-	shadowPlaneCache.xyz = triNormal;
-	shadowPlaneCache.w = -dot( gl_in[ 0 ].gl_Position.xyz, triNormal ) + 1.0;
+	shadowPlaneCache = ComputeShadowPlane( gl_in[0].gl_Position.xyz, triNormal );
 
-	// Clamp the radius of the light so that it doesn't go "through" the plane
-	// of the triangle. This prevents weird effects like penumbral wedges that
-	// go "up" towards the light and bad maths calls like sqrt(-1).
-	float clampedLightRadius = clamp( abs( lightDistance ) - 0.9 * lightRadius, 0.0, lightRadius );
+	float clampedLightRadius = ClampLightRadius( lightDistance );
 
-	// Calculate the outer face of each penumbral wedge and cache the normals.
+	// Calculate the outer face of each penumbral wedge and cache the normals,
+	// along with the penumbral wedge info.
 	vec3 outerNormal[3];
 
 	for( int vertNumber = 0; vertNumber != 3; ++vertNumber )
 	{
-		vec3 vertPos = gl_in[ vertNumber ].gl_Position.xyz;
-		vec3 lightToVert = vertPos - lightPos;
-
-		// This is the normal of the inner hard/dark face of the penumbral
-		// wedge (ie the face that would be used for regular stencil shadows).
-		vec3 innerNormal = normalize( cross( lightToVert, edges[ vertNumber ] ) );
-
-		float sinAngleSqr = clampedLightRadius * clampedLightRadius / dot( lightToVert, lightToVert );
-		float cosAngle = sqrt( 1.0 - sinAngleSqr );
-
-		// This is the first point on the sphere light that will be occluded as
-		// you enter the penumbra from the un-shadowed side. The outer face of
-		// the penumbral wedge is projected from this point.
-		vec3 farLightPos = lightPos + sinAngleSqr * lightToVert - clampedLightRadius * cosAngle * innerNormal;
-
-		outerNormal[ vertNumber ] = normalize( cross( vertPos - farLightPos, edges[ vertNumber ] ) );
-
-		// Calculate penumbral wedge info.
-		penumbraNormalCache[ vertNumber ].xyz = normalize( innerNormal + outerNormal[ vertNumber ] );
-		//penumbraNormalCache[ vertNumber ].xyz = outerNormal[ vertNumber ];
-		//penumbraNormalCache[ vertNumber ].xyz = innerNormal;
-		penumbraNormalCache[ vertNumber ].w = -dot( vertPos, penumbraNormalCache[ vertNumber ].xyz );
-
-		penumbraDirectionCache[ vertNumber ].xyz = cross( edges[ vertNumber ], penumbraNormalCache[ vertNumber ].xyz );
-		penumbraDirectionCache[ vertNumber ].w = -dot( vertPos, penumbraDirectionCache[ vertNumber ].xyz );
-
-		// TODO: This should be faster, but it doesn't work. Why not??!!
-		/*cosAngle = dot( innerNormal, penumbraNormalCache[ vertNumber ].xyz );
-		float sinAngle = dot( innerNormal, penumbraDirectionCache[ vertNumber ].xyz );
-		penumbraTangentCache[ vertNumber ] = sinAngle / cosAngle;*/
-
-		// Backup plan for calculating the tangent.
-		vec3 foo = cross( edges[ vertNumber ], outerNormal[ vertNumber ] );
-		penumbraTangentCache[ vertNumber ] = dot( foo, penumbraNormalCache[ vertNumber ].xyz );
-		penumbraTangentCache[ vertNumber ] /= dot( foo, penumbraDirectionCache[ vertNumber ].xyz );
+		outerNormal[ vertNumber ] = ComputePenumbraWedge( gl_in[ vertNumber ].gl_Position.xyz, edges[ vertNumber ], lightPos, clampedLightRadius,
+														  penumbraNormalCache[ vertNumber ], penumbraDirectionCache[ vertNumber ], penumbraTangentCache[ vertNumber ] );
 	}
 
 	vec4 extrudedShadowVerts[3];
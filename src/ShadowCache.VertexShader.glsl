@@ -0,0 +1,78 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+#version 150 compatibility
+
+
+// Draws shadow volumes that were captured by ShadowCapture.GeometryShader.glsl
+// (see ShadowVolumeCache), for Shadow.FragmentShader.glsl, without a geometry
+// shader. Each captured triangle is drawn as the same eight triangles that
+// Shadow.GeometryShader.glsl would have emitted as a strip, so there are
+// VerticesPerTriangle vertices per triangle, and each vertex looks up its
+// triangle's record by gl_VertexID. The records are in world space, so the
+// planes are taken to view space here, and positions to clip space. The
+// model view matrix is the camera's view matrix.
+uniform samplerBuffer shadowVolumes;
+
+
+out vec4 fragCoord;
+out vec4 shadowPlane;
+out vec4 penumbraDirection[3];
+out vec4 penumbraNormal[3];
+out float penumbraTangent[3];
+
+
+// Texels per captured triangle, and vertices drawn for each.
+const int TexelsPerTriangle = 14;
+const int VerticesPerTriangle = 24;
+
+// The corner of the record that each vertex is at: the front cap, then the
+// strip around the extruded edges, then the far cap, in the winding order of
+// the strip in Shadow.GeometryShader.glsl.
+const int cornerIndices[ VerticesPerTriangle ] = int[ VerticesPerTriangle ]
+(
+	0, 1, 2,
+	2, 1, 5,
+	2, 5, 0,
+	0, 5, 3,
+	0, 3, 1,
+	1, 3, 4,
+	1, 4, 5,
+	5, 4, 3
+);
+
+
+void main()
+{
+	int record = TexelsPerTriangle * ( gl_VertexID / VerticesPerTriangle );
+	vec4 corner = texelFetch( shadowVolumes, record + cornerIndices[ gl_VertexID % VerticesPerTriangle ] );
+
+	// Planes transform by the inverse transpose, which multiplying on the
+	// left by the inverse does.
+	shadowPlane = texelFetch( shadowVolumes, record + 6 ) * gl_ModelViewMatrixInverse;
+
+	vec3 tangents = texelFetch( shadowVolumes, record + 13 ).xyz;
+
+	for( int shadowPlaneIndex = 0; shadowPlaneIndex != 3; ++shadowPlaneIndex )
+	{
+		penumbraDirection[ shadowPlaneIndex ] = texelFetch( shadowVolumes, record + 7 + shadowPlaneIndex ) * gl_ModelViewMatrixInverse;
+		penumbraNormal[ shadowPlaneIndex ] = texelFetch( shadowVolumes, record + 10 + shadowPlaneIndex ) * gl_ModelViewMatrixInverse;
+		penumbraTangent[ shadowPlaneIndex ] = tangents[ shadowPlaneIndex ];
+	}
+
+	fragCoord = gl_ModelViewProjectionMatrix * corner;
+	gl_Position = fragCoord;
+}
@@ -0,0 +1,95 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+#version 150 compatibility
+
+
+// Captures the per-triangle shadow volumes of a static caster with transform
+// feedback, so that they can be drawn again without this shader (see
+// ShadowVolumeCache and ShadowCache.VertexShader.glsl). The volumes are worked
+// out with the same maths as in Shadow.GeometryShader.glsl (see
+// Shadow.Common.glsl), but in world space rather than view space, so that
+// they stay valid however the camera moves. Rather than a strip for each
+// triangle, a single point is written out, holding the triangle, the
+// directions its corners are extruded in, and its planes.
+
+
+layout( triangles ) in;
+layout( points, max_vertices = 1 ) out;
+
+
+#include "Shadow.Common.glsl"
+
+
+// The light's position in world space.
+uniform vec3 lightPosition;
+
+
+// Corners 0 to 2 are the triangle and 3 to 5 the directions (with w = 0)
+// that they are extruded to infinity in. The penumbra tangents are in xyz of
+// cachedPenumbraTangents.
+out vec4 cachedCorners[6];
+out vec4 cachedShadowPlane;
+out vec4 cachedPenumbraDirections[3];
+out vec4 cachedPenumbraNormals[3];
+out vec4 cachedPenumbraTangents;
+
+
+void main()
+{
+	vec3 lightPos = lightPosition;
+
+	vec3 edges[3];
+
+	for( int vertNumber = 0; vertNumber != 3; ++vertNumber )
+	{
+		edges[ vertNumber ] = gl_in[ ( vertNumber + 1 ) % 3 ].gl_Position.xyz - gl_in[ vertNumber ].gl_Position.xyz;
+	}
+
+	vec3 triNormal = normalize( cross( edges[0], edges[1] ) );
+
+	float lightDistance = dot( gl_in[0].gl_Position.xyz - lightPos, triNormal );
+
+	if( lightDistance >= 0.0 )
+		return;
+
+	cachedShadowPlane = ComputeShadowPlane( gl_in[0].gl_Position.xyz, triNormal );
+
+	float clampedLightRadius = ClampLightRadius( lightDistance );
+
+	vec3 outerNormal[3];
+	float penumbraTangents[3];
+
+	for( int vertNumber = 0; vertNumber != 3; ++vertNumber )
+	{
+		outerNormal[ vertNumber ] = ComputePenumbraWedge( gl_in[ vertNumber ].gl_Position.xyz, edges[ vertNumber ], lightPos, clampedLightRadius,
+														  cachedPenumbraNormals[ vertNumber ], cachedPenumbraDirections[ vertNumber ], penumbraTangents[ vertNumber ] );
+	}
+
+	cachedPenumbraTangents = vec4( penumbraTangents[0], penumbraTangents[1], penumbraTangents[2], 0.0 );
+
+	for( int vertNumber = 0; vertNumber != 3; ++vertNumber )
+	{
+		cachedCorners[ vertNumber ] = gl_in[ vertNumber ].gl_Position;
+		cachedCorners[ vertNumber + 3 ] = vec4( normalize( cross( outerNormal[ vertNumber ], outerNormal[ ( vertNumber + 2 ) % 3 ] ) ), 0.0 );
+	}
+
+	// Nothing is rasterised while capturing.
+	gl_Position = vec4( 0.0 );
+
+	EmitVertex();
+	EndPrimitive();
+}
@@ -0,0 +1,109 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Precomp.hpp"
+#include "Common.hpp"
+
+#include "ShadowCulling.hpp"
+
+#include "Mesh.hpp"
+
+
+const float ShadowCulling::LightRadius = 10.0f;
+
+
+ShadowCulling::ShadowCulling( const Vector3f & lightPosition, const Matrix4f & projection )
+	: m_LightPosition		( lightPosition )
+	, m_ModelView			( Affine3f::Identity() )
+	, m_ModelLightPosition	( lightPosition )
+	, m_ModelScale			( 1.0f )
+	, m_IsMirrored			( false )
+{
+	// Gribb and Hartmann's method: each clip plane is the last row of the
+	// projection plus or minus one of the others. There is no far plane, as
+	// the projection is usually infinite.
+	const Vector4f rowW = projection.row( 3 );
+
+	m_Planes[0] = rowW + projection.row( 0 ).transpose();
+	m_Planes[1] = rowW - projection.row( 0 ).transpose();
+	m_Planes[2] = rowW + projection.row( 1 ).transpose();
+	m_Planes[3] = rowW - projection.row( 1 ).transpose();
+	m_Planes[4] = rowW + projection.row( 2 ).transpose();
+
+	for( int planeIndex = 0; planeIndex < 5; ++planeIndex )
+	{
+		m_Planes[ planeIndex ] /= m_Planes[ planeIndex ].head< 3 >().norm();
+		m_LightDistances[ planeIndex ] = m_Planes[ planeIndex ].head< 3 >().dot( m_LightPosition ) + m_Planes[ planeIndex ].w();
+	}
+}
+
+
+void ShadowCulling::SetModelView( const Affine3f & modelView )
+{
+	m_ModelView = modelView;
+	m_ModelLightPosition = modelView.inverse() * m_LightPosition;
+	m_ModelScale = modelView.linear().colwise().norm().maxCoeff();
+	m_IsMirrored = ( modelView.linear().determinant() < 0.0f );
+}
+
+
+bool ShadowCulling::IsClusterVisible( const MeshCluster & cluster )
+{
+	++m_Stats.m_NumClusters;
+
+	const Vector3f centre( cluster.m_Centre[0], cluster.m_Centre[1], cluster.m_Centre[2] );
+
+	// Facing is tested in model space, where the cone is. The shaders keep
+	// triangles with the light in front of them, so the cluster is culled if
+	// the light is behind every triangle, ie if the direction from the light
+	// to anywhere in the bounding sphere is within the cone's complement
+	// (Kapoulkine's cone test, with the light as the viewer).
+	if( cluster.m_ConeCutoff < 1.0f )
+	{
+		Vector3f axis( cluster.m_ConeAxis[0], cluster.m_ConeAxis[1], cluster.m_ConeAxis[2] );
+
+		if( m_IsMirrored )
+			axis = -axis;
+
+		const Vector3f fromLight = centre - m_ModelLightPosition;
+
+		if( fromLight.dot( axis ) >= cluster.m_ConeCutoff * fromLight.norm() + cluster.m_Radius )
+		{
+			++m_Stats.m_NumCulled;
+			return false;
+		}
+	}
+
+	// The shadow volume is inside the cones from every point of the light to
+	// the bounding sphere. It can't reach the frustum if, for some plane, the
+	// sphere is outside it and no nearer to it than any point of the light,
+	// as it only gets further away as it's extruded.
+	const Vector3f viewCentre = m_ModelView * centre;
+	const float viewRadius = cluster.m_Radius * m_ModelScale;
+
+	for( int planeIndex = 0; planeIndex < 5; ++planeIndex )
+	{
+		const float distance = m_Planes[ planeIndex ].head< 3 >().dot( viewCentre ) + m_Planes[ planeIndex ].w() + viewRadius;
+
+		if( distance < 0.0f && distance <= m_LightDistances[ planeIndex ] - LightRadius )
+		{
+			++m_Stats.m_NumCulled;
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,86 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Culls the parts of the scene that can't cast a shadow that would be seen,
+// before they are drawn in the shadow passes. Clusters of triangles (see
+// MeshClusters) are skipped if every triangle in them faces away from the
+// light, as the shadow shaders would throw them away anyway, or if their
+// shadow volume can't reach the view frustum.
+//
+// The light is treated as a sphere of LightRadius so that penumbral wedges,
+// which reach further than the shadow of a point light, aren't cut off. The
+// tests are conservative: anything that might cast a visible shadow is kept.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+
+struct MeshCluster;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ShadowCulling class
+///////////////////////////////////////////////////////////////////////////////
+class ShadowCulling
+{
+public:
+	// Must match lightRadius in the shadow geometry shaders.
+	static const float		LightRadius;
+
+	// How many clusters were tested and how many of them were culled.
+	struct Stats
+	{
+							Stats()									: m_NumClusters( 0 ), m_NumCulled( 0 ) {}
+
+		size_t				m_NumClusters;
+		size_t				m_NumCulled;
+	};
+
+	// The light position is in view space. The frustum is taken from the
+	// projection matrix, which may be infinite.
+							ShadowCulling( const Vector3f & lightPosition, const Matrix4f & projection );
+
+	const Vector3f &		GetLightPosition() const				{ return m_LightPosition; }
+
+	// Starts testing the clusters of a mesh instance with the given model
+	// view transform.
+	void					SetModelView( const Affine3f & modelView );
+
+	// Returns true if the cluster, in the model space of the current
+	// instance, might cast a visible shadow.
+	bool					IsClusterVisible( const MeshCluster & cluster );
+
+	const Stats &			GetStats() const						{ return m_Stats; }
+
+	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+	Vector3f				m_LightPosition;
+
+	// Left, right, bottom, top and near, in view space, normalised and facing
+	// into the frustum. The light's distance from each is cached.
+	Vector4f				m_Planes[5];
+	float					m_LightDistances[5];
+
+	// The current instance's transform, the light in its model space, and
+	// how much it scales lengths by at most. Mirrored instances wind their
+	// triangles the other way in view space.
+	Affine3f				m_ModelView;
+	Vector3f				m_ModelLightPosition;
+	float					m_ModelScale;
+	bool					m_IsMirrored;
+
+	Stats					m_Stats;
+};
@@ -0,0 +1,32 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Shadow volumes are drawn in up to three passes (see Viewport::Render).
+// Closed meshes are extruded along their silhouettes only: their hard shadow
+// volumes are counted into the stencil buffer and penumbral wedges are drawn
+// along the silhouette edges. Anything else, or everything if
+// Options::m_SilhouetteShadows is turned off, is extruded one triangle at a
+// time as before.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+
+enum ShadowPass
+{
+	ShadowPass_Triangles,		// Per-triangle volumes, for meshes without adjacency.
+	ShadowPass_Umbra,			// Hard shadow volumes of closed meshes, into the stencil buffer.
+	ShadowPass_Wedges			// Penumbral wedges along the silhouettes of closed meshes.
+};
@@ -0,0 +1,114 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#version 150 compatibility
+
+
+// Extrudes the hard shadow volume of a closed mesh, which is counted into the
+// stencil buffer (z-fail). Each triangle facing the light (the same triangles
+// that Shadow.GeometryShader.glsl extrudes one at a time) emits its part of
+// the front cap and the back cap at infinity, but the sides are only emitted
+// along silhouette edges, where the neighbouring triangle doesn't face the
+// light. Together the triangles make a single volume for the whole mesh. The
+// soft edges are added by ShadowWedge.GeometryShader.glsl.
+
+
+layout( triangles_adjacency ) in;
+layout( triangle_strip, max_vertices = 18 ) out;
+
+
+// The front cap is pushed this far away from the light so that lit surfaces
+// don't shadow themselves. This matches the offset of the shadow plane in
+// Shadow.GeometryShader.glsl.
+const float shadowBias = 1.0;
+
+vec3 lightPos;
+
+
+// The same test that Shadow.GeometryShader.glsl uses to pick which triangles
+// cast shadows.
+bool IsCaster( vec3 vert0, vec3 vert1, vec3 vert2 )
+{
+	return dot( vert0 - lightPos, cross( vert1 - vert0, vert2 - vert1 ) ) < 0.0;
+}
+
+
+void main()
+{
+	lightPos = gl_LightSource[0].position.xyz;
+
+	// The triangle itself is every other vertex. The vertex in between each
+	// pair is the far corner of the triangle on the other side of that edge.
+	vec3 verts[3];
+
+	for( int vertNumber = 0; vertNumber != 3; ++vertNumber )
+	{
+		verts[ vertNumber ] = gl_in[ vertNumber * 2 ].gl_Position.xyz;
+	}
+
+	if( ! IsCaster( verts[0], verts[1], verts[2] ) )
+		return;
+
+	vec4 capVerts[3];
+	vec4 extrudedVerts[3];
+
+	for( int vertNumber = 0; vertNumber != 3; ++vertNumber )
+	{
+		vec3 lightToVert = normalize( verts[ vertNumber ] - lightPos );
+
+		capVerts[ vertNumber ] = gl_ProjectionMatrix * vec4( verts[ vertNumber ] + shadowBias * lightToVert, 1.0 );
+		extrudedVerts[ vertNumber ] = gl_ProjectionMatrix * vec4( lightToVert, 0.0 );
+	}
+
+	// Front cap, wound the same way as the triangle.
+	for( int vertNumber = 0; vertNumber != 3; ++vertNumber )
+	{
+		gl_Position = capVerts[ vertNumber ];
+		EmitVertex();
+	}
+
+	EndPrimitive();
+
+	// Back cap at infinity, wound the other way as it faces away from the
+	// light.
+	for( int vertNumber = 2; vertNumber != -1; --vertNumber )
+	{
+		gl_Position = extrudedVerts[ vertNumber ];
+		EmitVertex();
+	}
+
+	EndPrimitive();
+
+	// A side for each silhouette edge. The edge is wound backwards compared
+	// to the cap, so that the volume is consistently wound.
+	for( int vertNumber = 0; vertNumber != 3; ++vertNumber )
+	{
+		int nextVertNumber = ( vertNumber + 1 ) % 3;
+
+		if( IsCaster( verts[ nextVertNumber ], verts[ vertNumber ], gl_in[ vertNumber * 2 + 1 ].gl_Position.xyz ) )
+			continue;
+
+		gl_Position = capVerts[ nextVertNumber ];
+		EmitVertex();
+		gl_Position = capVerts[ vertNumber ];
+		EmitVertex();
+		gl_Position = extrudedVerts[ nextVertNumber ];
+		EmitVertex();
+		gl_Position = extrudedVerts[ vertNumber ];
+		EmitVertex();
+
+		EndPrimitive();
+	}
+}
@@ -0,0 +1,397 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Precomp.hpp"
+#include "Common.hpp"
+
+#include "ShadowVolumeCache.hpp"
+
+#include "Mesh.hpp"
+#include "Scene.hpp"
+#include "MeshInstance.hpp"
+#include "ShaderProgram.hpp"
+
+
+ShadowVolumeCache::Entry::Entry()
+	: m_pInstance		( nullptr )
+	, m_pMesh			( nullptr )
+	, m_LodIndex		( 0 )
+	, m_CaptureLodIndex	( 0 )
+	, m_NumTris			( 0 )
+	, m_NumBytes		( 0 )
+	, m_BufferId		( 0 )
+	, m_QueryId			( 0 )
+{
+	fill( m_World, m_World + 16, 0.0f );
+}
+
+
+ShadowVolumeCache::ShadowVolumeCache()
+	: m_LightPosition	( Vector3f::Constant( numeric_limits< float >::max() ) )
+	, m_IsLightStatic	( false )
+	, m_LayoutRevision	( numeric_limits< size_t >::max() )
+	, m_VolumesTextureId( 0 )
+{}
+
+
+ShadowVolumeCache::~ShadowVolumeCache()
+{
+	foreach( Entry & entry, m_Entries )
+		Free( entry );
+
+	foreach( const CaptureBuffer & buffer, m_CaptureBuffers )
+		glDeleteBuffers( 1, & buffer.m_BufferId );
+
+	glDeleteTextures( 1, & m_VolumesTextureId );
+}
+
+
+vector< string > ShadowVolumeCache::GetFeedbackVaryings()
+{
+	// In the order of the texels of a record.
+	const char * const varyings[] =
+	{
+		"cachedCorners",
+		"cachedShadowPlane",
+		"cachedPenumbraDirections",
+		"cachedPenumbraNormals",
+		"cachedPenumbraTangents"
+	};
+
+	return vector< string >( varyings, varyings + sizeof( varyings ) / sizeof( varyings[0] ) );
+}
+
+
+void ShadowVolumeCache::BeginFrame( const Vector3f & lightPosition )
+{
+	const TransformHierarchy & transforms = GetScene().m_Transforms;
+
+	if( transforms.GetLayoutRevision() != m_LayoutRevision )
+		Remap( transforms );
+
+	// Every volume depends on the light.
+	m_IsLightStatic = ( lightPosition == m_LightPosition );
+
+	if( ! m_IsLightStatic )
+	{
+		foreach( Entry & entry, m_Entries )
+			Free( entry );
+
+		m_PendingInstances.clear();
+		m_LightPosition = lightPosition;
+	}
+
+	// Collect the counts of last frame's captures, which are usually ready by
+	// now. Anything that isn't is drawn the usual way for another frame.
+	for( size_t pendingIndex = 0; pendingIndex < m_PendingInstances.size(); )
+	{
+		Entry & entry = m_Entries[ m_PendingInstances[ pendingIndex ] ];
+		GLuint isAvailable = GL_TRUE;
+
+		if( entry.m_QueryId != 0 )
+			glGetQueryObjectuiv( entry.m_QueryId, GL_QUERY_RESULT_AVAILABLE, & isAvailable );
+
+		if( ! isAvailable )
+		{
+			++pendingIndex;
+			continue;
+		}
+
+		if( entry.m_QueryId != 0 )
+		{
+			glGetQueryObjectuiv( entry.m_QueryId, GL_QUERY_RESULT, & entry.m_NumTris );
+			glDeleteQueries( 1, & entry.m_QueryId );
+			entry.m_QueryId = 0;
+			Trim( entry );
+		}
+
+		m_PendingInstances[ pendingIndex ] = m_PendingInstances.back();
+		m_PendingInstances.pop_back();
+	}
+
+	m_Actions.assign( transforms.GetNumInstances(), Action_None );
+	m_Stats.m_NumDrawn = 0;
+	m_Stats.m_NumCaptured = 0;
+	m_Stats.m_NumDiscarded = 0;
+}
+
+
+bool ShadowVolumeCache::Use( const size_t instanceIndex, const size_t lodIndex, const Matrix4f & world )
+{
+	Entry & entry = m_Entries[ instanceIndex ];
+	uint8_t & action = m_Actions[ instanceIndex ];
+
+	// A caster that has moved loses its volumes, and is only captured again
+	// once it has stopped.
+	if( ! equal( entry.m_World, entry.m_World + 16, world.data() ) )
+	{
+		copy( world.data(), world.data() + 16, entry.m_World );
+		action = ( entry.m_BufferId != 0 ) ? Action_Discard : Action_None;
+		return false;
+	}
+
+	if( entry.m_QueryId != 0 )
+		return false;
+
+	if( entry.m_BufferId != 0 && entry.m_LodIndex == lodIndex )
+	{
+		action = Action_Draw;
+		return true;
+	}
+
+	if( m_IsLightStatic )
+	{
+		entry.m_CaptureLodIndex = static_cast< uint32_t >( lodIndex );
+		action = Action_Capture;
+	}
+
+	return false;
+}
+
+
+void ShadowVolumeCache::Render()
+{
+	ShaderProgram * const pProgram = ShaderProgram::GetCurrent();
+	Scene & scene = GetScene();
+	const size_t numInstances = m_Actions.size();
+
+	// Captures are drawn with nothing rasterised. The volumes that are
+	// captured have already been drawn the usual way this frame.
+	bool isCapturing = false;
+
+	for( size_t instanceIndex = 0; instanceIndex < numInstances; ++instanceIndex )
+	{
+		if( m_Actions[ instanceIndex ] == Action_Discard )
+		{
+			Free( m_Entries[ instanceIndex ] );
+			++m_Stats.m_NumDiscarded;
+		}
+		else if( m_Actions[ instanceIndex ] == Action_Capture && m_Stats.m_NumCaptured < MaxCapturesPerFrame )
+		{
+			if( ! isCapturing )
+			{
+				scene.m_pShadowCaptureShaderProgram->SetCurrent();
+				glUniform3fv( glGetUniformLocation( scene.m_pShadowCaptureShaderProgram->GetID(), "lightPosition" ), 1, m_LightPosition.data() );
+				glEnable( GL_RASTERIZER_DISCARD );
+				isCapturing = true;
+			}
+
+			Capture( instanceIndex );
+		}
+	}
+
+	if( isCapturing )
+		glDisable( GL_RASTERIZER_DISCARD );
+
+	// The cached volumes need no vertex attributes, as the vertex shader
+	// fetches everything from their buffers.
+	scene.m_pShadowCacheShaderProgram->SetCurrent();
+
+	GLint dimensions[4];
+	glGetIntegerv( GL_VIEWPORT, dimensions );
+	glUniform2iv( glGetUniformLocation( scene.m_pShadowCacheShaderProgram->GetID(), "viewport" ), 1, & dimensions[2] );
+
+	if( m_VolumesTextureId == 0 )
+		glGenTextures( 1, & m_VolumesTextureId );
+
+	glBindVertexArray( 0 );
+	glActiveTexture( GL_TEXTURE0 + VolumesTextureUnit );
+	glBindTexture( GL_TEXTURE_BUFFER, m_VolumesTextureId );
+
+	for( size_t instanceIndex = 0; instanceIndex < numInstances; ++instanceIndex )
+	{
+		const Entry & entry = m_Entries[ instanceIndex ];
+
+		if( m_Actions[ instanceIndex ] != Action_Draw || entry.m_NumTris == 0 )
+			continue;
+
+		glTexBuffer( GL_TEXTURE_BUFFER, GL_RGBA32F, entry.m_BufferId );
+		glDrawArrays( GL_TRIANGLES, 0, static_cast< GLsizei >( entry.m_NumTris * VerticesPerTriangle ) );
+		++m_Stats.m_NumDrawn;
+	}
+
+	glBindTexture( GL_TEXTURE_BUFFER, 0 );
+	glActiveTexture( GL_TEXTURE0 );
+
+	if( pProgram != nullptr )
+		pProgram->SetCurrent();
+}
+
+
+void ShadowVolumeCache::Capture( const size_t instanceIndex )
+{
+	Entry & entry = m_Entries[ instanceIndex ];
+	Mesh & mesh = GetScene().m_Transforms.GetInstance( instanceIndex ).GetMesh();
+
+	if( ! mesh.IsUploaded() )
+		return;
+
+	Free( entry );
+
+	// Every triangle of the LOD might face the light.
+	const size_t numTris = mesh.GetLods()[ entry.m_CaptureLodIndex ].m_NumTris;
+	const size_t numBytes = numTris * TexelsPerTriangle * 4 * sizeof( float );
+
+	if( numTris == 0 )
+		return;
+
+	const Matrix4f world = Map< const Matrix4f >( entry.m_World );
+
+	entry.m_LodIndex = entry.m_CaptureLodIndex;
+
+	// Reuse a capture buffer that's big enough if there is one, or else grow
+	// one, or make a new one if none are free.
+	CaptureBuffer buffer = { 0, 0 };
+	auto pBuffer = m_CaptureBuffers.begin();
+
+	while( pBuffer != m_CaptureBuffers.end() && pBuffer->m_NumBytes < numBytes )
+		++pBuffer;
+
+	if( pBuffer == m_CaptureBuffers.end() && ! m_CaptureBuffers.empty() )
+		--pBuffer;
+
+	if( pBuffer != m_CaptureBuffers.end() )
+	{
+		buffer = * pBuffer;
+		m_CaptureBuffers.erase( pBuffer );
+	}
+	else
+		glGenBuffers( 1, & buffer.m_BufferId );
+
+	if( buffer.m_NumBytes < numBytes )
+	{
+		glBindBuffer( GL_TRANSFORM_FEEDBACK_BUFFER, buffer.m_BufferId );
+		glBufferData( GL_TRANSFORM_FEEDBACK_BUFFER, numBytes, nullptr, GL_DYNAMIC_COPY );
+		glBindBuffer( GL_TRANSFORM_FEEDBACK_BUFFER, 0 );
+
+		m_Stats.m_NumBytes += numBytes - buffer.m_NumBytes;
+		buffer.m_NumBytes = numBytes;
+	}
+
+	entry.m_BufferId = buffer.m_BufferId;
+	entry.m_NumBytes = buffer.m_NumBytes;
+
+	// The instance is drawn in world space, with the world transform in
+	// place of the model view.
+	m_CaptureBatch.Clear();
+	m_CaptureBatch.AddInstance( Affine3f( world ), mesh.GetPositionScale(), mesh.GetPositionOffset() );
+	m_CaptureBatch.UploadInstances();
+
+	glGenQueries( 1, & entry.m_QueryId );
+	glBindBufferBase( GL_TRANSFORM_FEEDBACK_BUFFER, 0, entry.m_BufferId );
+	glBeginQuery( GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, entry.m_QueryId );
+	glBeginTransformFeedback( GL_POINTS );
+
+	mesh.RenderShadowVolumes( entry.m_LodIndex, ShadowPass_Triangles, 0, 1, & world, m_CaptureBatch, nullptr );
+	m_CaptureBatch.Submit( false );
+
+	glEndTransformFeedback();
+	glEndQuery( GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN );
+	glBindBufferBase( GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0 );
+
+	m_PendingInstances.push_back( instanceIndex );
+
+	++m_Stats.m_NumCaptured;
+}
+
+
+void ShadowVolumeCache::Trim( Entry & entry )
+{
+	const CaptureBuffer buffer = { entry.m_BufferId, entry.m_NumBytes };
+
+	entry.m_NumBytes = entry.m_NumTris * TexelsPerTriangle * 4 * sizeof( float );
+
+	// A caster with nothing facing the light still gets a buffer, empty, so
+	// that it isn't captured again.
+	glGenBuffers( 1, & entry.m_BufferId );
+	glBindBuffer( GL_COPY_WRITE_BUFFER, entry.m_BufferId );
+	glBufferData( GL_COPY_WRITE_BUFFER, entry.m_NumBytes, nullptr, GL_STATIC_COPY );
+
+	if( entry.m_NumBytes > 0 )
+	{
+		glBindBuffer( GL_COPY_READ_BUFFER, buffer.m_BufferId );
+		glCopyBufferSubData( GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, entry.m_NumBytes );
+		glBindBuffer( GL_COPY_READ_BUFFER, 0 );
+	}
+
+	glBindBuffer( GL_COPY_WRITE_BUFFER, 0 );
+	m_CaptureBuffers.push_back( buffer );
+
+	++m_Stats.m_NumCached;
+	m_Stats.m_NumBytes += entry.m_NumBytes;
+}
+
+
+void ShadowVolumeCache::Free( Entry & entry )
+{
+	if( entry.m_QueryId != 0 )
+	{
+		const CaptureBuffer buffer = { entry.m_BufferId, entry.m_NumBytes };
+		m_CaptureBuffers.push_back( buffer );
+	}
+	else if( entry.m_BufferId != 0 )
+	{
+		--m_Stats.m_NumCached;
+		m_Stats.m_NumBytes -= entry.m_NumBytes;
+		glDeleteBuffers( 1, & entry.m_BufferId );
+	}
+
+	glDeleteQueries( 1, & entry.m_QueryId );
+
+	entry.m_BufferId = 0;
+	entry.m_QueryId = 0;
+	entry.m_NumTris = 0;
+	entry.m_NumBytes = 0;
+}
+
+
+void ShadowVolumeCache::Remap( const TransformHierarchy & transforms )
+{
+	map< const MeshInstance *, size_t > oldIndices;
+
+	for( size_t entryIndex = 0; entryIndex < m_Entries.size(); ++entryIndex )
+		oldIndices[ m_Entries[ entryIndex ].m_pInstance ] = entryIndex;
+
+	vector< Entry > entries( transforms.GetNumInstances() );
+	m_PendingInstances.clear();
+
+	for( size_t instanceIndex = 0; instanceIndex < entries.size(); ++instanceIndex )
+	{
+		const MeshInstance * const pInstance = & transforms.GetInstance( instanceIndex );
+		const auto pOldIndex = oldIndices.find( pInstance );
+
+		// An instance at the same address as one that has gone might be a
+		// different one, but it can't reuse volumes of another mesh.
+		if( pOldIndex != oldIndices.end() && m_Entries[ pOldIndex->second ].m_pMesh == & pInstance->GetMesh() )
+		{
+			Entry & oldEntry = m_Entries[ pOldIndex->second ];
+			entries[ instanceIndex ] = oldEntry;
+			oldEntry = Entry();
+
+			if( entries[ instanceIndex ].m_QueryId != 0 )
+				m_PendingInstances.push_back( instanceIndex );
+		}
+
+		entries[ instanceIndex ].m_pInstance = pInstance;
+		entries[ instanceIndex ].m_pMesh = & pInstance->GetMesh();
+	}
+
+	foreach( Entry & entry, m_Entries )
+		Free( entry );
+
+	m_Entries.swap( entries );
+	m_LayoutRevision = transforms.GetLayoutRevision();
+}
@@ -0,0 +1,181 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Keeps the per-triangle shadow volumes (see ShadowPass_Triangles) of casters
+// that aren't moving, so that the geometry shader doesn't have to work out
+// the same planes and extrusions again every frame. Once neither a caster nor
+// the light has moved since the last frame, the caster is drawn through
+// ShadowCapture.GeometryShader.glsl with transform feedback, which writes one
+// record per triangle facing the light, in world space, into a capture buffer
+// big enough for every triangle. Once the GL has counted the records, they
+// are copied into a buffer of the caster's own that holds just those, and the
+// capture buffer is kept for the next capture. From then on the caster is
+// drawn from its buffer by ShadowCache.VertexShader.glsl alone, until it or
+// the light moves, which only throws away the volumes that changed.
+//
+// Casters are drawn the usual way in the frame they are captured in, as the
+// number of triangles captured isn't known until the GL has finished, and
+// only a few are captured each frame so that the light stopping doesn't
+// stall a frame. Cached volumes are drawn one caster at a time and skip
+// ShadowCulling, as they hold every triangle of the LOD that faces the
+// light; anything off screen is clipped.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+
+#include "DrawBatch.hpp"
+
+
+class Mesh;
+class MeshInstance;
+class TransformHierarchy;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ShadowVolumeCache class
+///////////////////////////////////////////////////////////////////////////////
+class ShadowVolumeCache
+{
+public:
+	// The texture unit the captured volumes are bound to when drawn.
+	static const GLuint			VolumesTextureUnit = 8;
+
+	// Texels of a record per captured triangle, and the vertices that each
+	// is drawn with. Must match ShadowCache.VertexShader.glsl.
+	static const size_t			TexelsPerTriangle = 14;
+	static const size_t			VerticesPerTriangle = 24;
+
+	// Casters captured per frame at most.
+	static const size_t			MaxCapturesPerFrame = 16;
+
+	// The casters drawn from the cache, captured, and thrown away for having
+	// moved in the last frame, and how many casters the cache holds volumes
+	// for, in how many bytes including the capture buffers.
+	struct Stats
+	{
+								Stats()									: m_NumDrawn( 0 ), m_NumCaptured( 0 ), m_NumDiscarded( 0 ), m_NumCached( 0 ), m_NumBytes( 0 ) {}
+
+		size_t					m_NumDrawn;
+		size_t					m_NumCaptured;
+		size_t					m_NumDiscarded;
+		size_t					m_NumCached;
+		size_t					m_NumBytes;
+	};
+
+								ShadowVolumeCache();
+								~ShadowVolumeCache();
+
+	// The outputs of the capture program that transform feedback records
+	// (see ShaderProgram::SetFeedbackVaryings).
+	static vector< string >		GetFeedbackVaryings();
+
+	// Starts a frame's per-triangle pass. Throws everything away if the
+	// light has moved since the last frame, and catches up with the scene's
+	// instances if any have been added or removed. The light position is in
+	// world space.
+	void						BeginFrame( const Vector3f & lightPosition );
+
+	// Returns true if a visible caster, which draws the given LOD in the
+	// per-triangle pass, will be drawn from the cache by Render, in which
+	// case it shouldn't be drawn the usual way. Otherwise, if neither it nor
+	// the light has moved since the last frame, it may be captured. Different
+	// instances can be tested on several threads at once.
+	bool						Use( const size_t instanceIndex, const size_t lodIndex, const Matrix4f & world );
+
+	// Captures casters that Use picked, then draws every caster that it
+	// said would be drawn from the cache. Leaves the current program as it
+	// found it.
+	void						Render();
+
+	const Stats &				GetStats() const						{ return m_Stats; }
+
+private:
+	// Revoked.
+								ShadowVolumeCache( const ShadowVolumeCache & copy );
+	ShadowVolumeCache &			operator = ( const ShadowVolumeCache & copy );
+
+	// What happens to each instance's entry in Render.
+	enum Action
+	{
+		Action_None,
+		Action_Draw,
+		Action_Capture,
+		Action_Discard
+	};
+
+	// The volumes of an instance, and the world transform it had when it was
+	// last seen. The buffer is zero if nothing has been captured, and the
+	// query non-zero while the GL is still counting what was captured, in
+	// which case the buffer is a capture buffer and the size is its size.
+	// The LOD to capture is picked by Use.
+	struct Entry
+	{
+								Entry();
+
+		const MeshInstance *	m_pInstance;
+		const Mesh *			m_pMesh;
+		float					m_World[16];
+		uint32_t				m_LodIndex;
+		uint32_t				m_CaptureLodIndex;
+		uint32_t				m_NumTris;
+		size_t					m_NumBytes;
+		GLuint					m_BufferId;
+		GLuint					m_QueryId;
+	};
+
+	// A buffer that volumes are captured into, which is bigger than they
+	// usually need.
+	struct CaptureBuffer
+	{
+		GLuint					m_BufferId;
+		size_t					m_NumBytes;
+	};
+
+	// Captures an instance's volumes, with the capture program current.
+	void						Capture( const size_t instanceIndex );
+
+	// Moves an entry's volumes, once they've been counted, out of its
+	// capture buffer into a buffer of their own, and keeps the capture
+	// buffer to be reused.
+	void						Trim( Entry & entry );
+
+	// Frees an entry's volumes, keeping its capture buffer if it has one.
+	void						Free( Entry & entry );
+
+	// Matches the entries up with the instances after the hierarchy has been
+	// rebuilt, freeing those whose instances have gone.
+	void						Remap( const TransformHierarchy & transforms );
+
+	vector< Entry >				m_Entries;
+	vector< uint8_t >			m_Actions;
+
+	// The instances whose captures the GL hasn't counted yet.
+	vector< size_t >			m_PendingInstances;
+
+	// Capture buffers not in use. They're kept when the light moves, so that
+	// capturing everything again doesn't allocate them again.
+	vector< CaptureBuffer >		m_CaptureBuffers;
+
+	Vector3f					m_LightPosition;
+	bool						m_IsLightStatic;
+	size_t						m_LayoutRevision;
+
+	// Instances are captured one at a time through their own batch.
+	DrawBatch					m_CaptureBatch;
+	GLuint						m_VolumesTextureId;
+
+	Stats						m_Stats;
+};
@@ -0,0 +1,56 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#version 150 compatibility
+
+
+uniform ivec2 viewport;
+uniform sampler2DRect positionTexture;
+
+
+in vec4 fragCoord;
+in vec4 shadowPlane;
+in vec4 penumbraDirection;
+in vec4 penumbraNormal;
+in float penumbraTangent;
+in vec4 edgeStartPlane;
+in vec4 edgeEndPlane;
+
+
+void main()
+{
+	vec2 windowPos = 0.5 * viewport * ( vec2( 1.0 ) + fragCoord.xy / fragCoord.w );
+	vec4 position = vec4( texture( positionTexture, windowPos ).xyz, 1.0 );
+
+	// Leave anything that isn't inside the wedge alone. Positions in front of
+	// the occluder or beyond the ends of the edge aren't shadowed by it, and
+	// the hard shadow on the far side of the wedge comes from the stencil
+	// buffer.
+	if( dot( position, shadowPlane ) >= 0.0 ||
+		dot( position, edgeStartPlane ) < 0.0 ||
+		dot( position, edgeEndPlane ) < 0.0 )
+		discard;
+
+	float penumbraDist = dot( position, penumbraNormal );
+	float shadowDist = abs( dot( position, penumbraDirection ) );
+	float penumbraWidth = shadowDist * penumbraTangent;
+
+	if( penumbraDist >= penumbraWidth || penumbraDist <= -penumbraWidth )
+		discard;
+
+	float shadow = 0.5 + 0.5 * penumbraDist / penumbraWidth;
+
+	gl_FragColor.r = shadow * shadow * ( 3.0 - 2.0 * shadow );
+}
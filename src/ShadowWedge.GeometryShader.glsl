@@ -0,0 +1,156 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#version 150 compatibility
+
+
+// Extrudes penumbral wedges along the silhouette edges of a closed mesh, as
+// seen from the light. The wedges are worked out in the same way as in
+// Shadow.GeometryShader.glsl, but only for silhouette edges, where the
+// neighbouring triangle doesn't face the light. Interior edges don't need a
+// wedge as the shadow carries on across them. The fully shadowed part of the
+// volume is handled by the stencil pass (see ShadowVolume.GeometryShader.glsl).
+
+
+layout( triangles_adjacency ) in;
+layout( triangle_strip, max_vertices = 18 ) out;
+
+
+#include "Shadow.Common.glsl"
+
+
+vec3 lightPos;
+
+vec4 shadowPlaneCache;
+vec4 penumbraDirectionCache;
+vec4 penumbraNormalCache;
+float penumbraTangentCache;
+vec4 edgeStartPlaneCache;
+vec4 edgeEndPlaneCache;
+
+
+out vec4 fragCoord;
+out vec4 shadowPlane;
+out vec4 penumbraDirection;
+out vec4 penumbraNormal;
+out float penumbraTangent;
+out vec4 edgeStartPlane;
+out vec4 edgeEndPlane;
+
+
+// The same test that Shadow.GeometryShader.glsl uses to pick which triangles
+// cast shadows.
+bool IsCaster( vec3 vert0, vec3 vert1, vec3 vert2 )
+{
+	return dot( vert0 - lightPos, cross( vert1 - vert0, vert2 - vert1 ) ) < 0.0;
+}
+
+
+void EmitWedgeVertex( vec4 position )
+{
+	fragCoord = position;
+	shadowPlane = shadowPlaneCache;
+	penumbraDirection = penumbraDirectionCache;
+	penumbraNormal = penumbraNormalCache;
+	penumbraTangent = penumbraTangentCache;
+	edgeStartPlane = edgeStartPlaneCache;
+	edgeEndPlane = edgeEndPlaneCache;
+	gl_Position = position;
+
+	EmitVertex();
+}
+
+
+void main()
+{
+	lightPos = gl_LightSource[0].position.xyz;
+
+	// The triangle itself is every other vertex. The vertex in between each
+	// pair is the far corner of the triangle on the other side of that edge.
+	vec3 verts[3];
+
+	for( int vertNumber = 0; vertNumber != 3; ++vertNumber )
+	{
+		verts[ vertNumber ] = gl_in[ vertNumber * 2 ].gl_Position.xyz;
+	}
+
+	vec3 triNormal = normalize( cross( verts[1] - verts[0], verts[2] - verts[1] ) );
+	float lightDistance = dot( verts[0] - lightPos, triNormal );
+
+	if( lightDistance >= 0.0 )
+		return;
+
+	// Only the part of each wedge behind the triangle is shadowed by it.
+	shadowPlaneCache = ComputeShadowPlane( verts[0], triNormal );
+
+	float clampedLightRadius = ClampLightRadius( lightDistance );
+
+	for( int vertNumber = 0; vertNumber != 3; ++vertNumber )
+	{
+		int nextVertNumber = ( vertNumber + 1 ) % 3;
+
+		if( IsCaster( verts[ nextVertNumber ], verts[ vertNumber ], gl_in[ vertNumber * 2 + 1 ].gl_Position.xyz ) )
+			continue;
+
+		vec3 vertPos = verts[ vertNumber ];
+		vec3 edge = verts[ nextVertNumber ] - vertPos;
+		vec3 lightToVert = vertPos - lightPos;
+
+		// The inner face of the wedge is the side of the hard shadow volume,
+		// the outer face is projected from the edge of the light.
+		vec3 innerNormal = normalize( cross( lightToVert, edge ) );
+		vec3 outerNormal = ComputePenumbraWedge( vertPos, edge, lightPos, clampedLightRadius, penumbraNormalCache, penumbraDirectionCache, penumbraTangentCache );
+
+		// Unlike a whole triangle's volume, a wedge has to be cut off at the
+		// ends of its edge.
+		edgeStartPlaneCache = vec4( edge, -dot( vertPos, edge ) );
+		edgeEndPlaneCache = vec4( -edge, dot( verts[ nextVertNumber ], edge ) );
+
+		// The wedge runs out to infinity between its inner and outer faces,
+		// at right angles to the edge.
+		vec3 innerDirection = cross( edge, innerNormal );
+		vec3 outerDirection = cross( edge, outerNormal );
+
+		if( dot( innerDirection, lightToVert ) < 0.0 )
+			innerDirection = -innerDirection;
+
+		if( dot( outerDirection, lightToVert ) < 0.0 )
+			outerDirection = -outerDirection;
+
+		// Swap the directions if need be so that the faces of the wedge are
+		// wound to face outwards, like the triangle's own volume.
+		if( dot( cross( innerDirection, outerDirection ), edge ) < 0.0 )
+		{
+			vec3 direction = innerDirection;
+			innerDirection = outerDirection;
+			outerDirection = direction;
+		}
+
+		vec4 startVert = gl_ProjectionMatrix * vec4( vertPos, 1.0 );
+		vec4 endVert = gl_ProjectionMatrix * vec4( verts[ nextVertNumber ], 1.0 );
+		vec4 innerVert = gl_ProjectionMatrix * vec4( innerDirection, 0.0 );
+		vec4 outerVert = gl_ProjectionMatrix * vec4( outerDirection, 0.0 );
+
+		// One strip covers all four faces of the wedge.
+		EmitWedgeVertex( innerVert );
+		EmitWedgeVertex( startVert );
+		EmitWedgeVertex( outerVert );
+		EmitWedgeVertex( endVert );
+		EmitWedgeVertex( innerVert );
+		EmitWedgeVertex( startVert );
+
+		EndPrimitive();
+	}
+}
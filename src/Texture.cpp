@@ -23,6 +23,7 @@
 #include <Magick++.h>
 
 #include "Scene.hpp"
+#include "TextureCache.hpp"
 
 
 // We use GraphicsMagick to do all the hard work of loading an image from a
@@ -52,40 +53,127 @@ template<> struct GetGlTypeId< double >		{ static const GLenum value = GL_DOUBLE
 
 Texture::Texture( const string & fileName )
 	: Asset< Texture >( fileName )
+	, m_GpuBytes	( 0 )
+	, m_pDecodeJob	( new DecodeJob )
 {
-	clog << "Loading texture " << fileName << endl;
-
-	// Use GraphicsMagick to load the image from the file.
-	const Image image( fileName );
-
 	// Create a texture object in OpenGL.
 	glGenTextures( 1, & m_Id );
 	glBindTexture( GL_TEXTURE_2D, m_Id );
 
-	// Use linear filtering as we're not using mip-maps.
+	// The placeholder doesn't have mip-maps, so just use linear filtering
+	// until the real image is loaded.
 	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
 	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
 
-#if( MAGICK_PIXELS_RGBA == 1 )
-#	define MAGICK_GL_FORMAT GL_RGBA
-#elif( MAGICK_PIXELS_BGRA == 1 )
-#	define MAGICK_GL_FORMAT GL_BGRA
-#else
-#	error( "Unsupported image format, expected RGBA or BGRA" )
-#endif
+	// Use a single mid-grey texel until the real image has been loaded.
+	TextureImage placeholder;
+	placeholder.m_Width = 1;
+	placeholder.m_Height = 1;
+	placeholder.m_Pixels.resize( 4, 128 );
+	placeholder.m_Pixels[3] = 255;
+
+	Upload( placeholder );
+
+	// Load on the worker threads. The job is captured by value so that it
+	// stays alive even if this texture doesn't. GraphicsMagick is only needed
+	// if the texture cache doesn't exist yet.
+	const std::shared_ptr< DecodeJob > pDecodeJob = m_pDecodeJob;
+	pDecodeJob->m_IsFinished = false;
+
+	GetScene().GetThreadPool().Submit( [ pDecodeJob, fileName ]()
+	{
+		try
+		{
+			pDecodeJob->m_pCache.reset( new TextureCache( fileName ) );
+
+			if( ! pDecodeJob->m_pCache->Open() )
+			{
+				TextureImage image;
+				Decode( fileName, image );
+				pDecodeJob->m_pCache->Build( image );
+			}
+		}
+		catch( ... )
+		{
+			pDecodeJob->m_pError = std::current_exception();
+		}
+
+		pDecodeJob->m_IsFinished = true;
+	} );
+}
+
+
+Texture::~Texture()
+{
+	// Any decode that is still running carries on and its result is thrown
+	// away, as the job is shared with the worker.
+	glDeleteTextures( 1, & m_Id );
+}
+
+
+void Texture::FinishLoading()
+{
+	assert( IsDecoded() );
+
+	if( m_pDecodeJob->m_pError )
+	{
+		try
+		{
+			std::rethrow_exception( m_pDecodeJob->m_pError );
+		}
+		catch( const std::exception & exception )
+		{
+			clog << "Error loading texture " << m_FileName << ": " << exception.what() << endl;
+		}
+	}
+	else Upload( * m_pDecodeJob->m_pCache );
+
+	m_pDecodeJob.reset();
+}
+
+
+void Texture::Decode( const string & fileName, TextureImage & image )
+{
+	clog << "Loading texture " << fileName << endl;
+
+	// Use GraphicsMagick to load the image from the file.
+	const Image magickImage( fileName );
+
+	// Have GraphicsMagick convert the pixels to 8-bit RGBA for us. Its
+	// internal format depends on how it was built (the "Quantum" type and
+	// channel order both vary).
+	image.m_Width = magickImage.columns();
+	image.m_Height = magickImage.rows();
+	image.m_Pixels.resize( 4 * image.m_Width * image.m_Height );
+
+	magickImage.write( 0, 0, image.m_Width, image.m_Height, "RGBA", CharPixel, image.m_Pixels.data() );
+}
+
+
+void Texture::Upload( const TextureImage & image )
+{
+	glBindTexture( GL_TEXTURE_2D, m_Id );
 
 	// Transfer image data to the GL.
 	glTexImage2D(
 		GL_TEXTURE_2D,		// All textures are simple 2D in this app.
-		0,					// Level-of-detail 0, no mip-mapping in this app either.
+		0,					// Level-of-detail 0, uncompressed images (ie the placeholder) don't have mip-maps.
 		GL_RGBA8,			// The internal format that OpenGL will use to store the texture. OpenGL converts the image to this format if necessary. We'll just use standard 32-bit RGBA true colour (8-bits per channel) for simplicity.
-		image.columns(),	// Width of the texture.
-		image.rows(),		// Height of the texture.
+		image.m_Width,		// Width of the texture.
+		image.m_Height,		// Height of the texture.
 		0,					// Texture border width. Not used by OpenGL anymore, should always be zero.
-		MAGICK_GL_FORMAT,	// The format of the image data. GraphicsMagick is always either RGBA or BGRA depending on the value of a preprocessor constant (see above).
-		GetGlTypeId< Quantum >::value,	// The data type of pixels in the image. This is dictated by the GraphicsMagick "Quantum" type. Note that OpenGL wants an integer constant to identify the type, hence the use of GetGlTypeId.
-		image.getConstPixels( 0, 0, image.columns(), image.rows() )		// And finally, give OpenGL a pointer to the actual image data.
+		GL_RGBA,			// The format of the image data. Decode always gives us RGBA, as does the placeholder.
+		GetGlTypeId< uint8_t >::value,	// The data type of pixels in the image. Note that OpenGL wants an integer constant to identify the type, hence the use of GetGlTypeId.
+		image.m_Pixels.data()			// And finally, give OpenGL a pointer to the actual image data.
 	);
+
+	m_GpuBytes = image.m_Pixels.size();
+}
+
+
+MemoryUsage Texture::GetMemoryUsage() const
+{
+	return MemoryUsage( sizeof( * this ) + m_FileName.capacity(), m_GpuBytes );
 }
 
 
@@ -93,3 +181,23 @@ void Texture::Bind()
 {
 	glBindTexture( GL_TEXTURE_2D, m_Id );
 }
+
+
+void Texture::Upload( const TextureCache & cache )
+{
+	glBindTexture( GL_TEXTURE_2D, m_Id );
+
+	const TextureCache::Header & header = cache.GetHeader();
+	m_GpuBytes = 0;
+
+	for( uint32_t levelIndex = 0; levelIndex < header.m_NumLevels; ++levelIndex )
+	{
+		const TextureCache::LevelRecord & level = cache.GetLevel( levelIndex );
+		glCompressedTexImage2D( GL_TEXTURE_2D, levelIndex, header.m_Format, level.m_Width, level.m_Height, 0, static_cast< GLsizei >( level.m_Size ), cache.GetLevelData( levelIndex ) );
+		m_GpuBytes += level.m_Size;
+	}
+
+	// Now that we have the full mip chain we can use trilinear filtering.
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, header.m_NumLevels - 1 );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR );
+}
@@ -15,12 +15,35 @@
 //
 // Very basic C++ wrapper class for an OpenGL 2D texture object. Doesn't do
 // much other than loading a texture from a file.
+//
+// Decoding image files is slow, so textures are loaded on the scene's worker
+// threads. Until loading finishes the texture is a single grey texel, so it can
+// be bound and rendered with straight away. The scene swaps the real image in
+// (see Scene::UpdateLoading) when it is ready. Images are converted to
+// compressed, mip-mapped texture caches the first time they are loaded (see
+// TextureCache.hpp), so usually loading is just mapping the cache file.
 ///////////////////////////////////////////////////////////////////////////////
 
 #pragma once
 
 
 #include "Asset.hpp"
+#include "MemoryUsage.hpp"
+
+
+class TextureCache;
+
+///////////////////////////////////////////////////////////////////////////////
+// TextureImage struct
+// An image that has been decoded from a file but not uploaded to the GL yet.
+// Pixels are always 8-bit RGBA.
+///////////////////////////////////////////////////////////////////////////////
+struct TextureImage
+{
+	GLsizei				m_Width;
+	GLsizei				m_Height;
+	vector< uint8_t >	m_Pixels;
+};
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -29,16 +52,63 @@
 class Texture : public Asset< Texture >
 {
 public:
+						~Texture();
+
 	// Binds this texture to the active texture unit (ie just calls
 	// glBindTexture).
 	void				Bind();
+	GLuint				GetID() const					{ return m_Id; }
+
+	// Returns true until the real image has been swapped in for the
+	// placeholder (or loading failed).
+	bool				IsLoading() const				{ return m_pDecodeJob != nullptr; }
+
+	// Returns true if the image has been loaded and is waiting for
+	// FinishLoading to be called.
+	bool				IsDecoded() const				{ return m_pDecodeJob && m_pDecodeJob->m_IsFinished; }
+
+	// Uploads the loaded image, replacing the placeholder. If loading failed
+	// the error is logged and the placeholder is kept. Only call this if
+	// IsDecoded returns true.
+	void				FinishLoading();
+
+	// Decodes an image file. This doesn't touch the GL so, unlike creating a
+	// texture, it is safe to call from worker threads.
+	static void			Decode( const string & fileName, TextureImage & image );
+
+	// Memory used by this texture. The GPU size is that of the image that is
+	// currently uploaded, ie the placeholder while loading.
+	MemoryUsage			GetMemoryUsage() const;
 
 private:
-	// The constructor loads a texture from the specified file.
+	// The result of loading the image on a worker thread. This is shared
+	// with the worker, so it is safe for the texture to be destroyed before
+	// loading finishes.
+	struct DecodeJob
+	{
+		unique_ptr< TextureCache >	m_pCache;
+		std::exception_ptr			m_pError;
+		std::atomic< bool >			m_IsFinished;
+	};
+
+	// The constructor creates the placeholder and starts loading the
+	// specified file.
 						Texture( const string & fileName );
 
+	// Transfers an uncompressed image to the GL texture object.
+	void				Upload( const TextureImage & image );
+
+	// Transfers all of the compressed levels in a cache to the GL texture
+	// object.
+	void				Upload( const TextureCache & cache );
+
 	// The OpenGL ID reserved for this texture object.
 	GLuint				m_Id;
 
+	// Total size of the uploaded image, including mip-maps.
+	size_t				m_GpuBytes;
+
+	std::shared_ptr< DecodeJob >	m_pDecodeJob;
+
 	friend class Scene;
 };
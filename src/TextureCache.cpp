@@ -0,0 +1,461 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Precomp.hpp"
+#include "Common.hpp"
+
+#include "TextureCache.hpp"
+
+#include "Texture.hpp"
+#include "SceneCache.hpp"
+
+
+namespace
+{
+	// Bump this whenever the layout of the cache file or the way the levels
+	// are generated changes. Cache files with a different version are ignored
+	// and rebuilt.
+	const uint32_t CacheVersion = 1;
+
+	const char CacheMagic[8] = { 'S', 'S', 'T', 'E', 'X', 'C', 'H', '\0' };
+
+	// Level data is aligned to this many bytes in the cache file.
+	const size_t CacheAlignment = 8;
+
+
+	// Adds each pair of horizontally adjacent pixels in top to the pair below
+	// them in bottom. The inputs hold four 8-bit RGBA pixels each, the result
+	// holds the two 16-bit RGBA sums.
+	inline __m128i SumPixelQuads( const __m128i top, const __m128i bottom )
+	{
+		const __m128i zero = _mm_setzero_si128();
+
+		// Vertical sums of pixels 0 and 1 in low, 2 and 3 in high.
+		const __m128i low = _mm_add_epi16( _mm_unpacklo_epi8( top, zero ), _mm_unpacklo_epi8( bottom, zero ) );
+		const __m128i high = _mm_add_epi16( _mm_unpackhi_epi8( top, zero ), _mm_unpackhi_epi8( bottom, zero ) );
+
+		// Add each pixel to its neighbour and pack the results together.
+		return _mm_unpacklo_epi64( _mm_add_epi16( low, _mm_srli_si128( low, 8 ) ),
+								   _mm_add_epi16( high, _mm_srli_si128( high, 8 ) ) );
+	}
+
+
+	uint16_t PackRgb565( const uint8_t * const pColour )
+	{
+		return static_cast< uint16_t >( ( ( pColour[0] >> 3 ) << 11 ) | ( ( pColour[1] >> 2 ) << 5 ) | ( pColour[2] >> 3 ) );
+	}
+
+
+	// Expands a 565 colour back to 8-bits per channel the same way the GPU
+	// does, by replicating the high bits into the low bits.
+	void UnpackRgb565( const uint16_t packed, int * const pColour )
+	{
+		const int red = ( packed >> 11 ) & 31;
+		const int green = ( packed >> 5 ) & 63;
+		const int blue = packed & 31;
+
+		pColour[0] = ( red << 3 ) | ( red >> 2 );
+		pColour[1] = ( green << 2 ) | ( green >> 4 );
+		pColour[2] = ( blue << 3 ) | ( blue >> 2 );
+	}
+
+
+	// Compresses the colour of a 4x4 block of RGBA pixels to an 8 byte BC1
+	// block. The end points are opposite corners of the bounding box of the
+	// colours in the block, inset slightly to reduce the error for the colours
+	// in between. Much cheaper than fitting a line through the colours and
+	// the quality is fine for diffuse maps.
+	void CompressColourBlock( const uint8_t * const pBlock, uint8_t * const pOutput )
+	{
+		uint8_t minColour[3] = { 255, 255, 255 };
+		uint8_t maxColour[3] = { 0, 0, 0 };
+		int sum[3] = { 0, 0, 0 };
+
+		for( int pixelIndex = 0; pixelIndex < 16; ++pixelIndex )
+		{
+			for( int channel = 0; channel < 3; ++channel )
+			{
+				minColour[ channel ] = min( minColour[ channel ], pBlock[ 4 * pixelIndex + channel ] );
+				maxColour[ channel ] = max( maxColour[ channel ], pBlock[ 4 * pixelIndex + channel ] );
+				sum[ channel ] += pBlock[ 4 * pixelIndex + channel ];
+			}
+		}
+
+		// Pick the diagonal of the box that the colours lie along. Green is
+		// the most important channel, so red and blue are flipped if they
+		// go down as green goes up.
+		int covariance[3] = { 0, 0, 0 };
+
+		for( int pixelIndex = 0; pixelIndex < 16; ++pixelIndex )
+		{
+			const int green = 16 * pBlock[ 4 * pixelIndex + 1 ] - sum[1];
+			covariance[0] += green * ( 16 * pBlock[ 4 * pixelIndex ] - sum[0] );
+			covariance[2] += green * ( 16 * pBlock[ 4 * pixelIndex + 2 ] - sum[2] );
+		}
+
+		for( int channel = 0; channel < 3; ++channel )
+		{
+			const uint8_t inset = ( maxColour[ channel ] - minColour[ channel ] ) >> 4;
+			minColour[ channel ] += inset;
+			maxColour[ channel ] -= inset;
+
+			if( covariance[ channel ] < 0 )
+				swap( minColour[ channel ], maxColour[ channel ] );
+		}
+
+		// The first colour must be greater than the second to select the four
+		// colour mode. If they are the same the block is a flat colour and
+		// all of the indices can just be left at zero.
+		uint16_t colour0 = PackRgb565( maxColour );
+		uint16_t colour1 = PackRgb565( minColour );
+
+		if( colour0 < colour1 )
+			swap( colour0, colour1 );
+
+		uint32_t indices = 0;
+
+		if( colour0 != colour1 )
+		{
+			int palette[4][3];
+			UnpackRgb565( colour0, palette[0] );
+			UnpackRgb565( colour1, palette[1] );
+
+			for( int channel = 0; channel < 3; ++channel )
+			{
+				palette[2][ channel ] = ( 2 * palette[0][ channel ] + palette[1][ channel ] ) / 3;
+				palette[3][ channel ] = ( palette[0][ channel ] + 2 * palette[1][ channel ] ) / 3;
+			}
+
+			for( int pixelIndex = 0; pixelIndex < 16; ++pixelIndex )
+			{
+				int bestIndex = 0;
+				int bestError = numeric_limits< int >::max();
+
+				for( int paletteIndex = 0; paletteIndex < 4; ++paletteIndex )
+				{
+					int error = 0;
+
+					for( int channel = 0; channel < 3; ++channel )
+					{
+						const int difference = pBlock[ 4 * pixelIndex + channel ] - palette[ paletteIndex ][ channel ];
+						error += difference * difference;
+					}
+
+					if( error < bestError )
+					{
+						bestIndex = paletteIndex;
+						bestError = error;
+					}
+				}
+
+				indices |= bestIndex << ( 2 * pixelIndex );
+			}
+		}
+
+		// Everything is little endian.
+		pOutput[0] = static_cast< uint8_t >( colour0 );
+		pOutput[1] = static_cast< uint8_t >( colour0 >> 8 );
+		pOutput[2] = static_cast< uint8_t >( colour1 );
+		pOutput[3] = static_cast< uint8_t >( colour1 >> 8 );
+
+		for( int byteIndex = 0; byteIndex < 4; ++byteIndex )
+			pOutput[ 4 + byteIndex ] = static_cast< uint8_t >( indices >> ( 8 * byteIndex ) );
+	}
+
+
+	// Compresses the alpha of a 4x4 block of RGBA pixels to the 8 byte alpha
+	// block at the start of a BC3 block, using the eight alpha mode.
+	void CompressAlphaBlock( const uint8_t * const pBlock, uint8_t * const pOutput )
+	{
+		uint8_t minAlpha = 255;
+		uint8_t maxAlpha = 0;
+
+		for( int pixelIndex = 0; pixelIndex < 16; ++pixelIndex )
+		{
+			minAlpha = min( minAlpha, pBlock[ 4 * pixelIndex + 3 ] );
+			maxAlpha = max( maxAlpha, pBlock[ 4 * pixelIndex + 3 ] );
+		}
+
+		uint64_t indices = 0;
+
+		if( maxAlpha != minAlpha )
+		{
+			int palette[8] = { maxAlpha, minAlpha };
+
+			for( int step = 1; step < 7; ++step )
+				palette[ step + 1 ] = ( ( 7 - step ) * maxAlpha + step * minAlpha ) / 7;
+
+			for( int pixelIndex = 0; pixelIndex < 16; ++pixelIndex )
+			{
+				int bestIndex = 0;
+				int bestError = numeric_limits< int >::max();
+
+				for( int paletteIndex = 0; paletteIndex < 8; ++paletteIndex )
+				{
+					const int error = abs( pBlock[ 4 * pixelIndex + 3 ] - palette[ paletteIndex ] );
+
+					if( error < bestError )
+					{
+						bestIndex = paletteIndex;
+						bestError = error;
+					}
+				}
+
+				indices |= static_cast< uint64_t >( bestIndex ) << ( 3 * pixelIndex );
+			}
+		}
+
+		pOutput[0] = maxAlpha;
+		pOutput[1] = minAlpha;
+
+		for( int byteIndex = 0; byteIndex < 6; ++byteIndex )
+			pOutput[ 2 + byteIndex ] = static_cast< uint8_t >( indices >> ( 8 * byteIndex ) );
+	}
+
+
+	// Returns the size of an image once it is compressed. Images are
+	// compressed in 4x4 blocks, partial blocks at the edges take up a whole
+	// block.
+	size_t GetCompressedSize( const GLsizei width, const GLsizei height, const bool hasAlpha )
+	{
+		return ( ( width + 3 ) / 4 ) * ( ( height + 3 ) / 4 ) * ( hasAlpha ? 16 : 8 );
+	}
+
+
+	// Compresses an image to BC1, or BC3 if hasAlpha is set. Partial blocks
+	// at the edges of the image are padded by repeating the last row/column.
+	void CompressImage( const TextureImage & image, const bool hasAlpha, uint8_t * pOutput )
+	{
+		uint8_t block[ 4 * 16 ];
+
+		for( GLsizei blockY = 0; blockY < image.m_Height; blockY += 4 )
+		{
+			for( GLsizei blockX = 0; blockX < image.m_Width; blockX += 4 )
+			{
+				for( GLsizei y = 0; y < 4; ++y )
+				{
+					for( GLsizei x = 0; x < 4; ++x )
+					{
+						const size_t sourceIndex = min( blockY + y, image.m_Height - 1 ) * image.m_Width + min( blockX + x, image.m_Width - 1 );
+						copy( & image.m_Pixels[ 4 * sourceIndex ], & image.m_Pixels[ 4 * sourceIndex ] + 4, block + 4 * ( 4 * y + x ) );
+					}
+				}
+
+				if( hasAlpha )
+				{
+					CompressAlphaBlock( block, pOutput );
+					pOutput += 8;
+				}
+
+				CompressColourBlock( block, pOutput );
+				pOutput += 8;
+			}
+		}
+	}
+}
+
+
+TextureCache::TextureCache( const string & sourceFileName )
+	: m_SourceFileName	( sourceFileName )
+	, m_pData			( nullptr )
+	, m_Size			( 0 )
+{
+	try
+	{
+		const iostreams::mapped_file_source sourceFile( sourceFileName );
+		m_SourceHash = SceneCache::Hash( sourceFile.data(), sourceFile.size() );
+	}
+	catch( const std::exception & )
+	{
+		throw runtime_error( "Error reading texture from " + sourceFileName );
+	}
+
+	ostringstream cacheFileName;
+	cacheFileName << filesystem::path( sourceFileName ).stem().string() << '.' << hex << setfill( '0' ) << setw( 16 ) << m_SourceHash << ".texturecache";
+
+	m_FileName = SceneCache::GetCachePath( cacheFileName.str() );
+}
+
+
+bool TextureCache::Open()
+{
+	if( ! filesystem::exists( m_FileName ) )
+		return false;
+
+	try
+	{
+		m_MappedFile.open( m_FileName );
+	}
+	catch( const std::exception & exception )
+	{
+		clog << "Can't open texture cache " << m_FileName << ": " << exception.what() << endl;
+		return false;
+	}
+
+	m_pData = m_MappedFile.data();
+	m_Size = m_MappedFile.size();
+
+	if( ! Validate() )
+	{
+		clog << "Ignoring invalid texture cache " << m_FileName << endl;
+
+		m_MappedFile.close();
+		m_pData = nullptr;
+		m_Size = 0;
+
+		return false;
+	}
+
+	return true;
+}
+
+
+bool TextureCache::Validate() const
+{
+	if( m_Size < sizeof( Header ) )
+		return false;
+
+	const Header & header = GetHeader();
+
+	if( ! equal( CacheMagic, CacheMagic + sizeof( CacheMagic ), header.m_Magic ) ||
+		header.m_Version != CacheVersion ||
+		header.m_SourceHash != m_SourceHash ||
+		header.m_FileSize != m_Size ||
+		header.m_NumLevels == 0 ||
+		sizeof( Header ) + header.m_NumLevels * sizeof( LevelRecord ) > m_Size )
+		return false;
+
+	// Catch truncated files. The smallest level is always last.
+	const LevelRecord & lastLevel = GetLevel( header.m_NumLevels - 1 );
+	return lastLevel.m_Offset + lastLevel.m_Size <= m_Size;
+}
+
+
+void TextureCache::Build( const TextureImage & image )
+{
+	m_MappedFile.close();
+	m_Image.clear();
+
+	// BC1 is half the size of BC3, so only use BC3 if the image actually has
+	// some transparency.
+	bool hasAlpha = false;
+
+	for( size_t alphaIndex = 3; alphaIndex < image.m_Pixels.size() && ! hasAlpha; alphaIndex += 4 )
+		hasAlpha = ( image.m_Pixels[ alphaIndex ] != 255 );
+
+	// Levels go all the way down to 1x1.
+	uint32_t numLevels = 1;
+
+	for( GLsizei size = max( image.m_Width, image.m_Height ); size > 1; size /= 2 )
+		++numLevels;
+
+	Header header;
+	memset( & header, 0, sizeof( header ) );
+	copy( CacheMagic, CacheMagic + sizeof( CacheMagic ), header.m_Magic );
+	header.m_Version = CacheVersion;
+	header.m_Format = hasAlpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	header.m_SourceHash = m_SourceHash;
+	header.m_Width = image.m_Width;
+	header.m_Height = image.m_Height;
+	header.m_NumLevels = numLevels;
+
+	vector< LevelRecord > levels( numLevels );
+	m_Image.resize( sizeof( Header ) + numLevels * sizeof( LevelRecord ) );
+
+	// Each level is generated from the one before it. Two images are enough
+	// to ping-pong between.
+	TextureImage mipImages[2];
+	const TextureImage * pLevelImage = & image;
+
+	for( uint32_t levelIndex = 0; levelIndex < numLevels; ++levelIndex )
+	{
+		LevelRecord & level = levels[ levelIndex ];
+		level.m_Width = pLevelImage->m_Width;
+		level.m_Height = pLevelImage->m_Height;
+		level.m_Offset = ( m_Image.size() + CacheAlignment - 1 ) & ~( CacheAlignment - 1 );
+		level.m_Size = GetCompressedSize( pLevelImage->m_Width, pLevelImage->m_Height, hasAlpha );
+
+		m_Image.resize( static_cast< size_t >( level.m_Offset + level.m_Size ) );
+		CompressImage( * pLevelImage, hasAlpha, reinterpret_cast< uint8_t * >( & m_Image[ static_cast< size_t >( level.m_Offset ) ] ) );
+
+		if( levelIndex + 1 < numLevels )
+		{
+			TextureImage & nextLevelImage = mipImages[ levelIndex % 2 ];
+			Downsample( * pLevelImage, nextLevelImage );
+			pLevelImage = & nextLevelImage;
+		}
+	}
+
+	header.m_FileSize = m_Image.size();
+
+	memcpy( & m_Image.front(), & header, sizeof( header ) );
+	memcpy( & m_Image.front() + sizeof( header ), levels.data(), numLevels * sizeof( LevelRecord ) );
+
+	m_pData = & m_Image.front();
+	m_Size = m_Image.size();
+
+	clog << "Compressed " << m_SourceFileName << " from " << image.m_Pixels.size() / 1024 << "KB to " << m_Size / 1024 << "KB (" << ( hasAlpha ? "BC3" : "BC1" ) << ", " << numLevels << " levels)" << endl;
+
+	SceneCache::WriteFile( m_FileName, m_pData, m_Size );
+}
+
+
+void TextureCache::Downsample( const TextureImage & source, TextureImage & destination )
+{
+	destination.m_Width = max( source.m_Width / 2, 1 );
+	destination.m_Height = max( source.m_Height / 2, 1 );
+	destination.m_Pixels.resize( 4 * destination.m_Width * destination.m_Height );
+
+	const __m128i two = _mm_set1_epi16( 2 );
+
+	for( GLsizei y = 0; y < destination.m_Height; ++y )
+	{
+		// The bottom row is the same as the top if the source is only one
+		// pixel high.
+		const uint8_t * const pTop = & source.m_Pixels[ 4 * source.m_Width * min( 2 * y, source.m_Height - 1 ) ];
+		const uint8_t * const pBottom = & source.m_Pixels[ 4 * source.m_Width * min( 2 * y + 1, source.m_Height - 1 ) ];
+		uint8_t * const pDestination = & destination.m_Pixels[ 4 * destination.m_Width * y ];
+
+		GLsizei x = 0;
+
+		// Do four destination pixels at a time with SSE2 for as much of the
+		// row as possible.
+		for( ; 2 * x + 8 <= source.m_Width; x += 4 )
+		{
+			const __m128i sum0 = SumPixelQuads( _mm_loadu_si128( reinterpret_cast< const __m128i * >( pTop + 8 * x ) ),
+												_mm_loadu_si128( reinterpret_cast< const __m128i * >( pBottom + 8 * x ) ) );
+
+			const __m128i sum1 = SumPixelQuads( _mm_loadu_si128( reinterpret_cast< const __m128i * >( pTop + 8 * x + 16 ) ),
+												_mm_loadu_si128( reinterpret_cast< const __m128i * >( pBottom + 8 * x + 16 ) ) );
+
+			// Divide by four, rounding to nearest.
+			const __m128i average0 = _mm_srli_epi16( _mm_add_epi16( sum0, two ), 2 );
+			const __m128i average1 = _mm_srli_epi16( _mm_add_epi16( sum1, two ), 2 );
+
+			_mm_storeu_si128( reinterpret_cast< __m128i * >( pDestination + 4 * x ), _mm_packus_epi16( average0, average1 ) );
+		}
+
+		// Then finish off the rest of the row one pixel at a time.
+		for( ; x < destination.m_Width; ++x )
+		{
+			const GLsizei left = min( 2 * x, source.m_Width - 1 );
+			const GLsizei right = min( 2 * x + 1, source.m_Width - 1 );
+
+			for( int channel = 0; channel < 4; ++channel )
+				pDestination[ 4 * x + channel ] = static_cast< uint8_t >( ( pTop[ 4 * left + channel ] + pTop[ 4 * right + channel ] + pBottom[ 4 * left + channel ] + pBottom[ 4 * right + channel ] + 2 ) / 4 );
+		}
+	}
+}
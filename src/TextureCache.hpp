@@ -0,0 +1,105 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Decoding images with GraphicsMagick is slow, and uploading them to the GL
+// uncompressed with no mip-maps wastes a lot of memory and texture bandwidth.
+// A TextureCache converts an image once into a full mip chain of S3TC blocks:
+// BC1 (DXT1) for opaque images and BC3 (DXT5) for images with alpha. The
+// result is stored in a cache file that is memory mapped on later loads, so
+// the levels can be handed straight to glCompressedTexImage2D without
+// touching GraphicsMagick at all.
+//
+// As with the scene cache, cache files are keyed by a hash of the contents of
+// the source file.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+
+struct TextureImage;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// TextureCache class
+///////////////////////////////////////////////////////////////////////////////
+class TextureCache
+{
+public:
+	// Records stored in the cache file. The header is followed by one level
+	// record per mip-map level, largest first. Offsets are in bytes from the
+	// start of the file.
+	struct Header
+	{
+		char				m_Magic[8];
+		uint32_t			m_Version;
+		uint32_t			m_Format;			// GL_COMPRESSED_RGB_S3TC_DXT1_EXT or GL_COMPRESSED_RGBA_S3TC_DXT5_EXT.
+		uint64_t			m_SourceHash;
+		uint32_t			m_Width;
+		uint32_t			m_Height;
+		uint32_t			m_NumLevels;
+		uint32_t			m_Padding;
+		uint64_t			m_FileSize;
+	};
+
+	struct LevelRecord
+	{
+		uint32_t			m_Width;
+		uint32_t			m_Height;
+		uint64_t			m_Offset;
+		uint64_t			m_Size;
+	};
+
+	// The cache is keyed by the contents of the source file. Nothing is
+	// loaded until Open or Build are called.
+	explicit				TextureCache( const string & sourceFileName );
+
+	// Tries to load the cache file for the source file. Returns false if
+	// there is no cache file or it is out of date/unreadable, in which case
+	// you need to decode the image yourself and call Build.
+	bool					Open();
+
+	// Builds the mip chain, compresses it, writes it to disk and opens it. As
+	// with the scene cache, the result is kept in memory if it can't be
+	// written.
+	void					Build( const TextureImage & image );
+
+	const Header &			GetHeader() const							{ return * reinterpret_cast< const Header * >( m_pData ); }
+	const LevelRecord &		GetLevel( const size_t index ) const		{ return reinterpret_cast< const LevelRecord * >( m_pData + sizeof( Header ) )[ index ]; }
+	const char *			GetLevelData( const size_t index ) const	{ return m_pData + GetLevel( index ).m_Offset; }
+
+	const string &			GetFileName() const							{ return m_FileName; }
+	size_t					GetSize() const								{ return m_Size; }
+
+	// Halves the size of an 8-bit RGBA image with a box filter. Dimensions
+	// are rounded down, but never below one pixel.
+	static void				Downsample( const TextureImage & source, TextureImage & destination );
+
+private:
+	// Checks that the mapped data looks like a valid cache file for our
+	// source file.
+	bool					Validate() const;
+
+	const string			m_SourceFileName;
+	uint64_t				m_SourceHash;
+	string					m_FileName;
+
+	// An existing cache file is memory mapped. When the cache has just been
+	// built it is read from the in-memory image instead.
+	iostreams::mapped_file_source	m_MappedFile;
+	vector< char >					m_Image;
+
+	const char *			m_pData;
+	size_t					m_Size;
+};
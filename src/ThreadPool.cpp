@@ -0,0 +1,181 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Precomp.hpp"
+#include "Common.hpp"
+
+#include "ThreadPool.hpp"
+
+
+struct ThreadPool::RangeContext
+{
+	const RangeTask *						m_pTask;
+	size_t									m_NumItems;
+	size_t									m_Grain;
+	size_t									m_NumChunks;
+
+	// Chunks are taken in order. A chunk that is taken is always finished,
+	// so the task is never run once every chunk is done, even by workers
+	// that only get to the context after ParallelFor has returned.
+	std::atomic< size_t >					m_NextChunk;
+
+	std::mutex								m_Mutex;
+	std::condition_variable					m_Finished;
+	size_t									m_NumFinished;
+	std::exception_ptr						m_pError;
+};
+
+
+ThreadPool::ThreadPool( unsigned int numThreads )
+	: m_Quit( false )
+{
+	if( numThreads == 0 )
+		numThreads = max( std::thread::hardware_concurrency(), 2u ) - 1;
+
+	for( unsigned int threadIndex = 0; threadIndex < numThreads; ++threadIndex )
+		m_Threads.push_back( std::thread( & ThreadPool::RunWorker, this ) );
+}
+
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard< std::mutex > lock( m_Mutex );
+		m_Quit = true;
+		m_Tasks.clear();
+	}
+
+	m_TaskAvailable.notify_all();
+
+	foreach( std::thread & thread, m_Threads )
+		thread.join();
+}
+
+
+void ThreadPool::Submit( const Task & task )
+{
+	{
+		std::lock_guard< std::mutex > lock( m_Mutex );
+		m_Tasks.push_back( task );
+	}
+
+	m_TaskAvailable.notify_one();
+}
+
+
+void ThreadPool::RunWorker()
+{
+	for( ;; )
+	{
+		Task task;
+
+		{
+			std::unique_lock< std::mutex > lock( m_Mutex );
+
+			while( ! m_Quit && m_Tasks.empty() )
+				m_TaskAvailable.wait( lock );
+
+			if( m_Quit )
+				return;
+
+			task = m_Tasks.front();
+			m_Tasks.pop_front();
+		}
+
+		// Tasks are responsible for handling their own errors. There's nobody
+		// to report an exception to from here, so just log it.
+		try
+		{
+			task();
+		}
+		catch( const std::exception & exception )
+		{
+			clog << "Unhandled exception in worker thread: " << exception.what() << endl;
+		}
+	}
+}
+
+
+void ThreadPool::ParallelFor( const size_t numItems, const size_t grain, const RangeTask & task )
+{
+	assert( grain > 0 );
+
+	const size_t numChunks = ( numItems + grain - 1 ) / grain;
+
+	// Nothing to share.
+	if( numChunks <= 1 || m_Threads.empty() )
+	{
+		for( size_t firstItem = 0; firstItem < numItems; firstItem += grain )
+			task( firstItem, min( firstItem + grain, numItems ) );
+
+		return;
+	}
+
+	const std::shared_ptr< RangeContext > pContext = std::make_shared< RangeContext >();
+	pContext->m_pTask = & task;
+	pContext->m_NumItems = numItems;
+	pContext->m_Grain = grain;
+	pContext->m_NumChunks = numChunks;
+	pContext->m_NextChunk = 0;
+	pContext->m_NumFinished = 0;
+
+	const size_t numHelpers = min( m_Threads.size(), numChunks - 1 );
+
+	for( size_t helperIndex = 0; helperIndex < numHelpers; ++helperIndex )
+		Submit( [ pContext ] () { RunChunks( * pContext ); } );
+
+	RunChunks( * pContext );
+
+	std::unique_lock< std::mutex > lock( pContext->m_Mutex );
+
+	while( pContext->m_NumFinished < numChunks )
+		pContext->m_Finished.wait( lock );
+
+	if( pContext->m_pError )
+		std::rethrow_exception( pContext->m_pError );
+}
+
+
+void ThreadPool::RunChunks( RangeContext & context )
+{
+	for( ;; )
+	{
+		const size_t chunkIndex = context.m_NextChunk++;
+
+		if( chunkIndex >= context.m_NumChunks )
+			return;
+
+		const size_t firstItem = chunkIndex * context.m_Grain;
+		std::exception_ptr pError;
+
+		try
+		{
+			( * context.m_pTask )( firstItem, min( firstItem + context.m_Grain, context.m_NumItems ) );
+		}
+		catch( ... )
+		{
+			pError = std::current_exception();
+		}
+
+		std::lock_guard< std::mutex > lock( context.m_Mutex );
+
+		if( pError && ! context.m_pError )
+			context.m_pError = pError;
+
+		if( ++context.m_NumFinished == context.m_NumChunks )
+			context.m_Finished.notify_all();
+	}
+}
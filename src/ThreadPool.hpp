@@ -0,0 +1,82 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// A simple fixed-size pool of worker threads that run tasks from a shared
+// queue in the order they were submitted. Used for CPU heavy work that doesn't
+// need the GL, eg importing scenes. Only the main thread owns the GL context,
+// so tasks must never make GL calls; they should hand their results back to
+// the main thread for uploading instead.
+//
+// The pool can also split a loop between the workers and the calling thread
+// (see ParallelFor), which is how the per-frame work of culling and building
+// draw lists keeps up with large scenes.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ThreadPool class
+///////////////////////////////////////////////////////////////////////////////
+class ThreadPool
+{
+public:
+	typedef std::function< void () >		Task;
+
+	// Called with the first item of a chunk and one past its last.
+	typedef std::function< void ( size_t, size_t ) >	RangeTask;
+
+	// Starts the worker threads. By default there is one worker for each
+	// hardware thread, minus one for the main thread.
+	explicit								ThreadPool( unsigned int numThreads = 0 );
+
+	// Tasks that haven't started yet are discarded. Waits for any tasks that
+	// are currently running to finish.
+											~ThreadPool();
+
+	// Queues a task to be run on one of the worker threads.
+	void									Submit( const Task & task );
+
+	// Splits numItems items into chunks of grain items and runs task once
+	// for each chunk, returning when they are all done. Chunks run on the
+	// workers and on the calling thread, which takes whichever chunks the
+	// workers don't get to, so this never waits for tasks queued ahead of
+	// it. Which thread runs a chunk varies, but the chunks don't, so tasks
+	// that write to storage of their own for each chunk give the same result
+	// every time. Any exception a chunk throws is rethrown here.
+	void									ParallelFor( const size_t numItems, const size_t grain, const RangeTask & task );
+
+	size_t									GetNumThreads() const				{ return m_Threads.size(); }
+
+private:
+	// The state of one ParallelFor, shared by every thread that takes part.
+	struct RangeContext;
+
+	// Revoked.
+											ThreadPool( const ThreadPool & copy );
+	ThreadPool &							operator = ( const ThreadPool & copy );
+
+	// Each worker thread runs this until the pool is destroyed.
+	void									RunWorker();
+
+	// Runs chunks of a ParallelFor until there are none left to take.
+	static void								RunChunks( RangeContext & context );
+
+	vector< std::thread >					m_Threads;
+	std::deque< Task >						m_Tasks;
+	std::mutex								m_Mutex;
+	std::condition_variable					m_TaskAvailable;
+	bool									m_Quit;
+};
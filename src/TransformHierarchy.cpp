@@ -0,0 +1,279 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Precomp.hpp"
+#include "Common.hpp"
+
+#include "TransformHierarchy.hpp"
+
+#include "Mesh.hpp"
+#include "SceneNode.hpp"
+#include "ThreadPool.hpp"
+#include "MeshInstance.hpp"
+
+
+namespace
+{
+	// Nodes are updated on the scene's workers in chunks of this many. Most
+	// of a chunk is usually clean, and checking a clean node is cheap.
+	const size_t NodesPerTask = 4096;
+
+	// Multiplies column major 4x4 matrices with SSE: out = left * right. Each
+	// column of the result is the columns of left weighted by one column of
+	// right. The matrices must be 16-byte aligned, and out mustn't be either
+	// of the inputs.
+	inline void MultiplyTransform( const float * const pLeft, const float * const pRight, float * const pOut )
+	{
+		const __m128 left0 = _mm_load_ps( pLeft );
+		const __m128 left1 = _mm_load_ps( pLeft + 4 );
+		const __m128 left2 = _mm_load_ps( pLeft + 8 );
+		const __m128 left3 = _mm_load_ps( pLeft + 12 );
+
+		for( size_t column = 0; column < 4; ++column )
+		{
+			const float * const pColumn = pRight + 4 * column;
+
+			__m128 sum = _mm_mul_ps( left0, _mm_set1_ps( pColumn[0] ) );
+			sum = _mm_add_ps( sum, _mm_mul_ps( left1, _mm_set1_ps( pColumn[1] ) ) );
+			sum = _mm_add_ps( sum, _mm_mul_ps( left2, _mm_set1_ps( pColumn[2] ) ) );
+			sum = _mm_add_ps( sum, _mm_mul_ps( left3, _mm_set1_ps( pColumn[3] ) ) );
+
+			_mm_store_ps( pOut + 4 * column, sum );
+		}
+	}
+}
+
+
+TransformHierarchy::TransformHierarchy()
+	: m_NumUpdated		( 0 )
+	, m_LayoutRevision	( 0 )
+	, m_BoundsRevision	( 0 )
+{}
+
+
+void TransformHierarchy::Rebuild( SceneNode & root )
+{
+	m_Nodes.clear();
+	m_Parents.clear();
+	m_LocalTransforms.clear();
+	m_LevelStarts.clear();
+	m_Instances.clear();
+	m_InstanceNodes.clear();
+	m_NodeFirstInstances.clear();
+
+	m_Nodes.push_back( & root );
+	m_Parents.push_back( -1 );
+
+	// The nodes of the next depth are appended while the nodes of this one
+	// are visited.
+	for( size_t levelStart = 0; levelStart < m_Nodes.size(); )
+	{
+		const size_t levelEnd = m_Nodes.size();
+		m_LevelStarts.push_back( levelStart );
+
+		for( size_t nodeIndex = levelStart; nodeIndex < levelEnd; ++nodeIndex )
+		{
+			SceneNode & node = * m_Nodes[ nodeIndex ];
+			node.m_HierarchyIndex = nodeIndex;
+			m_LocalTransforms.push_back( node.m_Transform.matrix() );
+			m_NodeFirstInstances.push_back( static_cast< uint32_t >( m_Instances.size() ) );
+
+			foreach( MeshInstance & instance, node.m_MeshInstances )
+			{
+				m_Instances.push_back( & instance );
+				m_InstanceNodes.push_back( static_cast< uint32_t >( nodeIndex ) );
+			}
+
+			foreach( SceneNode & child, node.m_ChildNodes )
+			{
+				m_Nodes.push_back( & child );
+				m_Parents.push_back( static_cast< int32_t >( nodeIndex ) );
+			}
+		}
+
+		levelStart = levelEnd;
+	}
+
+	m_LevelStarts.push_back( m_Nodes.size() );
+	m_NodeFirstInstances.push_back( static_cast< uint32_t >( m_Instances.size() ) );
+
+	const size_t paddedSize = ( m_Instances.size() + 3 ) & ~3;
+
+	for( int axis = 0; axis < 3; ++axis )
+	{
+		m_InstanceBounds.m_Centres[ axis ].assign( paddedSize, 0.0f );
+		m_InstanceBounds.m_Extents[ axis ].assign( paddedSize, 0.0f );
+	}
+
+	m_WorldTransforms.resize( m_Nodes.size() );
+	m_IsDirty.assign( m_Nodes.size(), 1 );
+	++m_LayoutRevision;
+}
+
+
+void TransformHierarchy::SetLocalTransform( const size_t nodeIndex, const Affine3f & transform )
+{
+	m_LocalTransforms[ nodeIndex ] = transform.matrix();
+	m_IsDirty[ nodeIndex ] = 1;
+}
+
+
+void TransformHierarchy::Update( ThreadPool & threadPool )
+{
+	m_NumUpdated = 0;
+
+	if( m_Nodes.empty() )
+		return;
+
+	// The root has no parent to concatenate with.
+	if( m_IsDirty[0] )
+	{
+		m_WorldTransforms[0] = m_LocalTransforms[0];
+		UpdateInstanceBounds( 0 );
+		++m_NumUpdated;
+	}
+
+	// The nodes at each depth only read the depth above, so each depth is
+	// split between the workers.
+	std::atomic< size_t > numUpdated( m_NumUpdated );
+
+	for( size_t level = 1; level + 1 < m_LevelStarts.size(); ++level )
+	{
+		const size_t levelStart = m_LevelStarts[ level ];
+
+		threadPool.ParallelFor( m_LevelStarts[ level + 1 ] - levelStart, NodesPerTask, [ & ] ( const size_t firstNode, const size_t endNode )
+		{
+			numUpdated += UpdateNodes( levelStart + firstNode, levelStart + endNode );
+		} );
+	}
+
+	m_NumUpdated = numUpdated;
+
+	fill( m_IsDirty.begin(), m_IsDirty.end(), 0 );
+
+	if( m_NumUpdated > 0 )
+		++m_BoundsRevision;
+}
+
+
+void TransformHierarchy::ComputeModelViews( const Affine3f & view, MatrixArray & modelViews, ThreadPool & threadPool ) const
+{
+	modelViews.resize( m_Nodes.size() );
+	const Matrix4f viewMatrix = view.matrix();
+
+	threadPool.ParallelFor( m_Nodes.size(), NodesPerTask, [ & ] ( const size_t firstNode, const size_t endNode )
+	{
+		for( size_t nodeIndex = firstNode; nodeIndex < endNode; ++nodeIndex )
+			MultiplyTransform( viewMatrix.data(), m_WorldTransforms[ nodeIndex ].data(), modelViews[ nodeIndex ].data() );
+	} );
+}
+
+
+size_t TransformHierarchy::CountMismatches( ThreadPool & threadPool ) const
+{
+	if( m_Nodes.empty() )
+		return 0;
+
+	// Rebuilding stores the same indices in the nodes again.
+	TransformHierarchy full;
+	full.Rebuild( * m_Nodes[0] );
+	full.Update( threadPool );
+
+	if( full.m_Nodes != m_Nodes || full.m_Instances != m_Instances )
+		return max( m_Nodes.size(), full.m_Nodes.size() );
+
+	// Both use the same kernel on the same transforms, so they match exactly.
+	size_t numMismatches = 0;
+
+	for( size_t nodeIndex = 0; nodeIndex < m_Nodes.size(); ++nodeIndex )
+	{
+		if( full.m_WorldTransforms[ nodeIndex ] != m_WorldTransforms[ nodeIndex ] )
+			++numMismatches;
+	}
+
+	for( size_t instanceIndex = 0; instanceIndex < m_Instances.size(); ++instanceIndex )
+	{
+		for( int axis = 0; axis < 3; ++axis )
+		{
+			if( full.m_InstanceBounds.m_Centres[ axis ][ instanceIndex ] != m_InstanceBounds.m_Centres[ axis ][ instanceIndex ] ||
+				full.m_InstanceBounds.m_Extents[ axis ][ instanceIndex ] != m_InstanceBounds.m_Extents[ axis ][ instanceIndex ] )
+			{
+				++numMismatches;
+				break;
+			}
+		}
+	}
+
+	return numMismatches;
+}
+
+
+size_t TransformHierarchy::UpdateNodes( const size_t firstNode, const size_t endNode )
+{
+	size_t numUpdated = 0;
+
+	for( size_t nodeIndex = firstNode; nodeIndex < endNode; ++nodeIndex )
+	{
+		// Push the flag down from the depth above, which has been updated
+		// but not cleared yet.
+		m_IsDirty[ nodeIndex ] |= m_IsDirty[ m_Parents[ nodeIndex ] ];
+
+		if( ! m_IsDirty[ nodeIndex ] )
+			continue;
+
+		MultiplyTransform( m_WorldTransforms[ m_Parents[ nodeIndex ] ].data(), m_LocalTransforms[ nodeIndex ].data(), m_WorldTransforms[ nodeIndex ].data() );
+		UpdateInstanceBounds( nodeIndex );
+		++numUpdated;
+	}
+
+	return numUpdated;
+}
+
+
+// The box is transformed by its centre, and the half extents by the absolute
+// values of the linear part of the transform, which gives the smallest box
+// around the transformed one (Arvo's method).
+void TransformHierarchy::UpdateInstanceBounds( const size_t nodeIndex )
+{
+	const Matrix4f & world = m_WorldTransforms[ nodeIndex ];
+	const Matrix3f absLinear = world.topLeftCorner< 3, 3 >().cwiseAbs();
+
+	for( size_t instanceIndex = m_NodeFirstInstances[ nodeIndex ]; instanceIndex < m_NodeFirstInstances[ nodeIndex + 1 ]; ++instanceIndex )
+	{
+		const AlignedBox3f & bounds = m_Instances[ instanceIndex ]->GetMesh().GetBounds();
+		const Vector3f centre = world.topLeftCorner< 3, 3 >() * bounds.center() + world.topRightCorner< 3, 1 >();
+		const Vector3f extent = absLinear * ( 0.5f * bounds.sizes() );
+
+		for( int axis = 0; axis < 3; ++axis )
+		{
+			m_InstanceBounds.m_Centres[ axis ][ instanceIndex ] = centre[ axis ];
+			m_InstanceBounds.m_Extents[ axis ][ instanceIndex ] = extent[ axis ];
+		}
+	}
+}
+
+
+size_t TransformHierarchy::GetMemoryUsage() const
+{
+	return m_Nodes.capacity() * sizeof( SceneNode * ) +
+		   m_Parents.capacity() * sizeof( int32_t ) +
+		   ( m_LocalTransforms.capacity() + m_WorldTransforms.capacity() ) * sizeof( Matrix4f ) +
+		   m_IsDirty.capacity() +
+		   m_LevelStarts.capacity() * sizeof( size_t ) +
+		   m_Instances.capacity() * sizeof( MeshInstance * ) +
+		   ( m_InstanceNodes.capacity() + m_NodeFirstInstances.capacity() ) * sizeof( uint32_t ) +
+		   6 * m_InstanceBounds.m_Centres[0].capacity() * sizeof( float );
+}
@@ -0,0 +1,139 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// The scene's node hierarchy flattened into arrays, so that world transforms
+// can be cached rather than recomputed by walking the tree every time the
+// scene is drawn. Nodes are stored breadth first: every node comes after its
+// parent, and the nodes at each depth are next to each other, so each depth
+// can be updated as one batch, split between the scene's workers, once the
+// depth above it is done. Changing a node's local transform marks it dirty,
+// and Update only recomputes the world transforms of dirty nodes and their
+// descendents.
+//
+// The mesh instances of the nodes are flattened too, in node order, along
+// with world space bounding boxes that are kept up to date with the world
+// transforms for culling.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+
+class SceneNode;
+class ThreadPool;
+class MeshInstance;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// TransformHierarchy class
+///////////////////////////////////////////////////////////////////////////////
+class TransformHierarchy
+{
+public:
+	typedef vector< Matrix4f, Eigen::aligned_allocator< Matrix4f > >	MatrixArray;
+	typedef vector< float, Eigen::aligned_allocator< float > >			FloatArray;
+
+	// World space bounding boxes of the instances, as centres and half
+	// extents with each axis in a separate array so that they can be tested
+	// four at a time. The arrays are padded to a multiple of four.
+	struct InstanceBounds
+	{
+		FloatArray				m_Centres[3];
+		FloatArray				m_Extents[3];
+	};
+
+								TransformHierarchy();
+
+	// Flattens the tree under root and marks every node dirty. Must be called
+	// whenever nodes are added to or removed from the tree, as the arrays hold
+	// pointers to the nodes. Each node's index is stored in the node (see
+	// SceneNode::GetHierarchyIndex).
+	void						Rebuild( SceneNode & root );
+
+	// Changes a node's local transform. Its world transform, and those of its
+	// descendents, are recomputed by the next Update.
+	void						SetLocalTransform( const size_t nodeIndex, const Affine3f & transform );
+
+	// Recomputes the world transforms of dirty nodes, and the bounds of their
+	// instances.
+	void						Update( ThreadPool & threadPool );
+
+	// Computes view * world for every node, in node order, with the same
+	// kernel that Update uses.
+	void						ComputeModelViews( const Affine3f & view, MatrixArray & modelViews, ThreadPool & threadPool ) const;
+
+	// Flattens the same tree into a second hierarchy, updates all of it, and
+	// returns how many world transforms and instance bounds differ from the
+	// ones that Update has kept up to date here, which should be none. The
+	// tree mustn't have changed since the last Rebuild.
+	size_t						CountMismatches( ThreadPool & threadPool ) const;
+
+	size_t						GetNumNodes() const							{ return m_Nodes.size(); }
+	SceneNode &					GetNode( const size_t nodeIndex ) const		{ return * m_Nodes[ nodeIndex ]; }
+	int32_t						GetParent( const size_t nodeIndex ) const	{ return m_Parents[ nodeIndex ]; }
+	const Matrix4f &			GetWorldTransform( const size_t nodeIndex ) const	{ return m_WorldTransforms[ nodeIndex ]; }
+
+	size_t						GetNumInstances() const						{ return m_Instances.size(); }
+	MeshInstance &				GetInstance( const size_t instanceIndex ) const		{ return * m_Instances[ instanceIndex ]; }
+	size_t						GetInstanceNode( const size_t instanceIndex ) const	{ return m_InstanceNodes[ instanceIndex ]; }
+	const InstanceBounds &		GetInstanceBounds() const					{ return m_InstanceBounds; }
+
+	// Number of world transforms recomputed by the last Update.
+	size_t						GetNumUpdated() const						{ return m_NumUpdated; }
+
+	// These change whenever the hierarchy is rebuilt, and whenever an Update
+	// moves any instance bounds, so that anything built from the bounds (see
+	// InstanceBvh) can tell when it is out of date.
+	size_t						GetLayoutRevision() const					{ return m_LayoutRevision; }
+	size_t						GetBoundsRevision() const					{ return m_BoundsRevision; }
+
+	size_t						GetMemoryUsage() const;
+
+	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+	// Revoked.
+								TransformHierarchy( const TransformHierarchy & copy );
+	TransformHierarchy &		operator = ( const TransformHierarchy & copy );
+
+	// Updates a range of nodes at the same depth, returning how many were
+	// dirty.
+	size_t						UpdateNodes( const size_t firstNode, const size_t endNode );
+
+	// Recomputes the bounds of the node's instances from its world
+	// transform.
+	void						UpdateInstanceBounds( const size_t nodeIndex );
+
+	vector< SceneNode * >		m_Nodes;
+	vector< int32_t >			m_Parents;			// -1 for the root.
+	MatrixArray					m_LocalTransforms;
+	MatrixArray					m_WorldTransforms;
+	vector< uint8_t >			m_IsDirty;
+
+	// Each node's instances are m_NodeFirstInstances[ node ] up to
+	// m_NodeFirstInstances[ node + 1 ].
+	vector< MeshInstance * >	m_Instances;
+	vector< uint32_t >			m_InstanceNodes;
+	vector< uint32_t >			m_NodeFirstInstances;
+	InstanceBounds				m_InstanceBounds;
+
+	// The index of the first node at each depth, with the number of nodes at
+	// the end.
+	vector< size_t >			m_LevelStarts;
+
+	size_t						m_NumUpdated;
+
+	size_t						m_LayoutRevision;
+	size_t						m_BoundsRevision;
+};
@@ -0,0 +1,432 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Precomp.hpp"
+#include "Common.hpp"
+
+#include "TriangleOrder.hpp"
+
+
+const float TriangleOrder::OverdrawThreshold = 1.05f;
+
+
+namespace
+{
+	struct ModeInfo
+	{
+		const char *	m_pName;
+		const char *	m_pLabel;
+	};
+
+	const ModeInfo Modes[ TriangleOrder::NumModes ] =
+	{
+		{ "original",	"&Original" },
+		{ "cache",		"&Vertex Cache" },
+		{ "overdraw",	"Vertex Cache and &Overdraw" }
+	};
+
+
+	// Simulates a FIFO post-transform vertex cache. Each vertex records when
+	// it was added to the cache, and it has dropped out once CacheSize other
+	// vertices have been added after it.
+	class VertexCache
+	{
+	public:
+		explicit VertexCache( const size_t numVertices )
+			: m_Time		( TriangleOrder::CacheSize + 1 )
+			, m_AddedTimes	( numVertices, 0 )
+		{}
+
+		// Returns the number of vertices of the triangle that had to be
+		// transformed.
+		int FetchTri( const uint32_t * pTri )
+		{
+			int numMisses = 0;
+
+			for( int cornerIndex = 0; cornerIndex < 3; ++cornerIndex )
+			{
+				if( m_Time - m_AddedTimes[ pTri[ cornerIndex ] ] > TriangleOrder::CacheSize )
+				{
+					m_AddedTimes[ pTri[ cornerIndex ] ] = m_Time++;
+					++numMisses;
+				}
+			}
+
+			return numMisses;
+		}
+
+		// Empties the cache.
+		void Flush()
+		{
+			m_Time += TriangleOrder::CacheSize + 1;
+		}
+
+	private:
+		size_t				m_Time;
+		vector< size_t >	m_AddedTimes;
+	};
+
+
+	Vector3f ToVector3f( const aiVector3D & vector )
+	{
+		return Vector3f( vector.x, vector.y, vector.z );
+	}
+}
+
+
+const char * TriangleOrder::GetModeName( const Mode mode )
+{
+	return Modes[ mode ].m_pName;
+}
+
+
+const char * TriangleOrder::GetModeLabel( const Mode mode )
+{
+	return Modes[ mode ].m_pLabel;
+}
+
+
+bool TriangleOrder::FindMode( const string & name, Mode & mode )
+{
+	for( int modeIndex = 0; modeIndex < NumModes; ++modeIndex )
+	{
+		if( name == Modes[ modeIndex ].m_pName )
+		{
+			mode = static_cast< Mode >( modeIndex );
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+void TriangleOrder::Optimise( const Mode mode, uint32_t * pTriIndices, const size_t numTris, const aiVector3D * pVertices, const size_t numVertices )
+{
+	if( mode == Mode_Original || numTris == 0 )
+		return;
+
+	vector< uint32_t > triOrder;
+	Tipsify( pTriIndices, numTris, numVertices, triOrder );
+
+	if( mode == Mode_Overdraw )
+		SortClusters( pTriIndices, pVertices, numVertices, triOrder );
+
+	vector< uint32_t > orderedIndices;
+	orderedIndices.reserve( numTris * 3 );
+
+	foreach( const uint32_t triIndex, triOrder )
+		orderedIndices.insert( orderedIndices.end(), pTriIndices + triIndex * 3, pTriIndices + triIndex * 3 + 3 );
+
+	copy( orderedIndices.begin(), orderedIndices.end(), pTriIndices );
+}
+
+
+TriangleOrder::CacheStats TriangleOrder::MeasureCache( const uint32_t * pTriIndices, const size_t numTris, const size_t numVertices )
+{
+	VertexCache cache( numVertices );
+	vector< bool > isUsed( numVertices, false );
+	size_t numMisses = 0;
+	size_t numUsedVertices = 0;
+
+	for( size_t triIndex = 0; triIndex < numTris; ++triIndex )
+	{
+		numMisses += cache.FetchTri( pTriIndices + triIndex * 3 );
+
+		for( int cornerIndex = 0; cornerIndex < 3; ++cornerIndex )
+		{
+			if( ! isUsed[ pTriIndices[ triIndex * 3 + cornerIndex ] ] )
+			{
+				isUsed[ pTriIndices[ triIndex * 3 + cornerIndex ] ] = true;
+				++numUsedVertices;
+			}
+		}
+	}
+
+	CacheStats stats;
+	stats.m_Acmr = ( numTris > 0 ) ? static_cast< float >( numMisses ) / numTris : 0.0f;
+	stats.m_Atvr = ( numUsedVertices > 0 ) ? static_cast< float >( numMisses ) / numUsedVertices : 0.0f;
+
+	return stats;
+}
+
+
+void TriangleOrder::Tipsify( const uint32_t * pTriIndices, const size_t numTris, const size_t numVertices, vector< uint32_t > & triOrder )
+{
+	// The triangles that use each vertex, stored back to back.
+	// vertexTris[ firstVertexTris[v] ] to vertexTris[ firstVertexTris[v + 1] ]
+	// are the triangles that use vertex v.
+	vector< uint32_t > firstVertexTris( numVertices + 1, 0 );
+
+	for( size_t cornerIndex = 0; cornerIndex < numTris * 3; ++cornerIndex )
+		++firstVertexTris[ pTriIndices[ cornerIndex ] + 1 ];
+
+	for( size_t vertexIndex = 0; vertexIndex < numVertices; ++vertexIndex )
+		firstVertexTris[ vertexIndex + 1 ] += firstVertexTris[ vertexIndex ];
+
+	vector< uint32_t > vertexTris( numTris * 3 );
+	vector< uint32_t > nextVertexTris( firstVertexTris.begin(), firstVertexTris.end() - 1 );
+
+	for( size_t cornerIndex = 0; cornerIndex < numTris * 3; ++cornerIndex )
+		vertexTris[ nextVertexTris[ pTriIndices[ cornerIndex ] ]++ ] = static_cast< uint32_t >( cornerIndex / 3 );
+
+	// The number of triangles using each vertex that haven't been output yet.
+	vector< uint32_t > numLiveTris( numVertices );
+
+	for( size_t vertexIndex = 0; vertexIndex < numVertices; ++vertexIndex )
+		numLiveTris[ vertexIndex ] = firstVertexTris[ vertexIndex + 1 ] - firstVertexTris[ vertexIndex ];
+
+	// Same scheme as VertexCache, but the fanning vertex is chosen by how
+	// long ago vertices were added so we need the times.
+	vector< size_t > addedTimes( numVertices, 0 );
+	size_t time = CacheSize + 1;
+
+	vector< bool > isEmitted( numTris, false );
+	vector< uint32_t > deadEnds;
+	vector< uint32_t > candidates;
+	size_t nextUnusedVertex = 0;
+
+	triOrder.clear();
+	triOrder.reserve( numTris );
+
+	// Output all of the remaining triangles around the fanning vertex, then
+	// move on to the vertex of one of those triangles that is most likely to
+	// still be in the cache. numVertices means there are no vertices left.
+	size_t fanVertex = 0;
+
+	while( fanVertex < numVertices )
+	{
+		candidates.clear();
+
+		for( uint32_t vertexTriIndex = firstVertexTris[ fanVertex ]; vertexTriIndex < firstVertexTris[ fanVertex + 1 ]; ++vertexTriIndex )
+		{
+			const uint32_t triIndex = vertexTris[ vertexTriIndex ];
+
+			if( isEmitted[ triIndex ] )
+				continue;
+
+			for( int cornerIndex = 0; cornerIndex < 3; ++cornerIndex )
+			{
+				const uint32_t vertexIndex = pTriIndices[ triIndex * 3 + cornerIndex ];
+
+				deadEnds.push_back( vertexIndex );
+				candidates.push_back( vertexIndex );
+				--numLiveTris[ vertexIndex ];
+
+				if( time - addedTimes[ vertexIndex ] > CacheSize )
+					addedTimes[ vertexIndex ] = time++;
+			}
+
+			isEmitted[ triIndex ] = true;
+			triOrder.push_back( triIndex );
+		}
+
+		// Prefer the candidate that has been in the cache longest, as long as
+		// it will still be in there once its triangles have been output (each
+		// of which adds up to two more vertices). Otherwise any candidate
+		// that still has triangles will do.
+		size_t nextFanVertex = numVertices;
+		size_t bestPriority = 0;
+
+		foreach( const uint32_t vertexIndex, candidates )
+		{
+			if( numLiveTris[ vertexIndex ] == 0 )
+				continue;
+
+			const size_t age = time - addedTimes[ vertexIndex ];
+			const size_t priority = ( age + 2 * numLiveTris[ vertexIndex ] <= CacheSize ) ? age : 0;
+
+			if( nextFanVertex == numVertices || priority > bestPriority )
+			{
+				nextFanVertex = vertexIndex;
+				bestPriority = priority;
+			}
+		}
+
+		// At a dead end, go back to the most recently used vertex that still
+		// has triangles. Failing that, start again at the next vertex in the
+		// mesh that has triangles.
+		while( nextFanVertex == numVertices && ! deadEnds.empty() )
+		{
+			if( numLiveTris[ deadEnds.back() ] > 0 )
+				nextFanVertex = deadEnds.back();
+
+			deadEnds.pop_back();
+		}
+
+		while( nextFanVertex == numVertices && nextUnusedVertex < numVertices )
+		{
+			if( numLiveTris[ nextUnusedVertex ] > 0 )
+				nextFanVertex = nextUnusedVertex;
+
+			++nextUnusedVertex;
+		}
+
+		fanVertex = nextFanVertex;
+	}
+
+	assert( triOrder.size() == numTris );
+}
+
+
+void TriangleOrder::SortClusters( const uint32_t * pTriIndices, const aiVector3D * pVertices, const size_t numVertices, vector< uint32_t > & triOrder )
+{
+	const size_t numTris = triOrder.size();
+
+	// Tipsify has moved on to an unrelated part of the mesh wherever none of
+	// a triangle's vertices are in the cache. Starting a new cluster there
+	// costs nothing. The first cluster always starts at the first triangle,
+	// which misses fewer than three times if it repeats a vertex.
+	vector< size_t > hardBoundaries( 1, 0 );
+	{
+		VertexCache cache( numVertices );
+
+		for( size_t orderIndex = 0; orderIndex < numTris; ++orderIndex )
+		{
+			if( cache.FetchTri( pTriIndices + triOrder[ orderIndex ] * 3 ) == 3 && orderIndex > 0 )
+				hardBoundaries.push_back( orderIndex );
+		}
+
+		hardBoundaries.push_back( numTris );
+	}
+
+	// Those clusters can be very large, so they are split further wherever
+	// the part of the cluster so far would, on its own, have a cache miss
+	// ratio no more than OverdrawThreshold times that of the whole cluster.
+	// Starting again with an empty cache from there on doesn't cost much.
+	vector< size_t > clusterStarts;
+	VertexCache cache( numVertices );
+
+	for( size_t hardIndex = 0; hardIndex + 1 < hardBoundaries.size(); ++hardIndex )
+	{
+		const size_t begin = hardBoundaries[ hardIndex ];
+		const size_t end = hardBoundaries[ hardIndex + 1 ];
+
+		cache.Flush();
+		size_t numClusterMisses = 0;
+
+		for( size_t orderIndex = begin; orderIndex < end; ++orderIndex )
+			numClusterMisses += cache.FetchTri( pTriIndices + triOrder[ orderIndex ] * 3 );
+
+		const float maxMissesPerTri = OverdrawThreshold * numClusterMisses / ( end - begin );
+
+		cache.Flush();
+		size_t clusterStart = begin;
+		size_t numMisses = 0;
+
+		for( size_t orderIndex = begin; orderIndex < end; ++orderIndex )
+		{
+			numMisses += cache.FetchTri( pTriIndices + triOrder[ orderIndex ] * 3 );
+
+			if( orderIndex + 1 < end && numMisses <= maxMissesPerTri * ( orderIndex + 1 - clusterStart ) )
+			{
+				clusterStarts.push_back( clusterStart );
+				clusterStart = orderIndex + 1;
+				numMisses = 0;
+				cache.Flush();
+			}
+		}
+
+		clusterStarts.push_back( clusterStart );
+	}
+
+	clusterStarts.push_back( numTris );
+
+	// Each cluster's occlusion potential is how far it is in front of the
+	// middle of the mesh along its average normal. Clusters on the outside
+	// of the mesh facing outwards are drawn first.
+	Vector3f meshCentroid( Vector3f::Zero() );
+	float meshArea = 0.0f;
+
+	for( size_t triIndex = 0; triIndex < numTris; ++triIndex )
+	{
+		const uint32_t * const pTri = pTriIndices + triIndex * 3;
+		const Vector3f a = ToVector3f( pVertices[ pTri[0] ] );
+		const Vector3f b = ToVector3f( pVertices[ pTri[1] ] );
+		const Vector3f c = ToVector3f( pVertices[ pTri[2] ] );
+		const float area = ( b - a ).cross( c - a ).norm();
+
+		meshCentroid += area * ( a + b + c );
+		meshArea += area * 3.0f;
+	}
+
+	meshCentroid = ( meshArea > 0.0f ) ? Vector3f( meshCentroid / meshArea ) : Vector3f::Zero();
+
+	struct Cluster
+	{
+		size_t				m_Begin;
+		size_t				m_End;
+		float				m_Potential;
+	};
+
+	vector< Cluster > clusters;
+	float outwardness = 0.0f;
+
+	for( size_t clusterIndex = 0; clusterIndex + 1 < clusterStarts.size(); ++clusterIndex )
+	{
+		Cluster cluster;
+		cluster.m_Begin = clusterStarts[ clusterIndex ];
+		cluster.m_End = clusterStarts[ clusterIndex + 1 ];
+
+		// The normals are area weighted, as are the centroids.
+		Vector3f centroid( Vector3f::Zero() );
+		Vector3f normal( Vector3f::Zero() );
+		float area = 0.0f;
+
+		for( size_t orderIndex = cluster.m_Begin; orderIndex < cluster.m_End; ++orderIndex )
+		{
+			const uint32_t * const pTri = pTriIndices + triOrder[ orderIndex ] * 3;
+			const Vector3f a = ToVector3f( pVertices[ pTri[0] ] );
+			const Vector3f b = ToVector3f( pVertices[ pTri[1] ] );
+			const Vector3f c = ToVector3f( pVertices[ pTri[2] ] );
+			const Vector3f triNormal = ( b - a ).cross( c - a );
+			const float triArea = triNormal.norm();
+
+			centroid += triArea * ( a + b + c );
+			normal += triNormal;
+			area += triArea * 3.0f;
+		}
+
+		if( area > 0.0f )
+			centroid /= area;
+
+		outwardness += ( centroid - meshCentroid ).dot( normal );
+
+		const float normalLength = normal.norm();
+		cluster.m_Potential = ( area > 0.0f && normalLength > 0.0f ) ? ( centroid - meshCentroid ).dot( normal ) / normalLength : 0.0f;
+
+		clusters.push_back( cluster );
+	}
+
+	// Whether the cross products point out of the mesh depends on the
+	// winding order, so work it out from the mesh as a whole rather than
+	// assuming.
+	const float outwardSign = ( outwardness < 0.0f ) ? -1.0f : 1.0f;
+
+	stable_sort( clusters.begin(), clusters.end(), [ outwardSign ]( const Cluster & a, const Cluster & b )
+	{
+		return a.m_Potential * outwardSign > b.m_Potential * outwardSign;
+	} );
+
+	vector< uint32_t > sortedOrder;
+	sortedOrder.reserve( numTris );
+
+	foreach( const Cluster & cluster, clusters )
+		sortedOrder.insert( sortedOrder.end(), triOrder.begin() + cluster.m_Begin, triOrder.begin() + cluster.m_End );
+
+	assert( sortedOrder.size() == numTris );
+	triOrder.swap( sortedOrder );
+}
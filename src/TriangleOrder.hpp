@@ -0,0 +1,89 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2012, Ben Lane
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+// Reorders the triangles of a mesh before it goes into the scene cache. The
+// shadow pass runs the geometry shader once per triangle and the shadow
+// volumes are expensive to fill, so both the post-transform vertex cache and
+// overdraw matter more here than usual.
+//
+// Ordering for the vertex cache uses Tipsify (Sander, Nehab & Barczak, "Fast
+// Triangle Reordering for Vertex Locality and Reduced Overdraw", 2007), which
+// is linear in the size of the mesh and does nearly as well as Forsyth's
+// algorithm. The overdraw mode follows the same paper: the Tipsify order is
+// cut into clusters wherever that costs little in cache efficiency, and the
+// clusters are sorted so that those facing away from the middle of the mesh,
+// which are likely to occlude the others, are drawn first.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+
+///////////////////////////////////////////////////////////////////////////////
+// TriangleOrder class
+///////////////////////////////////////////////////////////////////////////////
+class TriangleOrder
+{
+public:
+	enum Mode
+	{
+		Mode_Original,
+		Mode_VertexCache,
+		Mode_Overdraw,
+		NumModes
+	};
+
+	// Size of the FIFO vertex cache that triangles are ordered for and that
+	// the statistics are measured against.
+	static const size_t		CacheSize = 16;
+
+	// How much worse than the plain Tipsify order the overdraw mode allows the
+	// cache miss ratio of each cluster to get.
+	static const float		OverdrawThreshold;
+
+	// Post-transform vertex cache statistics. ACMR is the average number of
+	// cache misses per triangle (0.5 at best for large regular meshes, 3 at
+	// worst). ATVR is the average number of times each vertex is transformed
+	// (1 at best).
+	struct CacheStats
+	{
+		float				m_Acmr;
+		float				m_Atvr;
+	};
+
+	// Returns the short name of a mode, as used on the command line.
+	static const char *		GetModeName( const Mode mode );
+
+	// Returns a human readable name for a mode, for use in the UI.
+	static const char *		GetModeLabel( const Mode mode );
+
+	// Looks up a mode by its short name. Returns false if there isn't a mode
+	// with that name.
+	static bool				FindMode( const string & name, Mode & mode );
+
+	// Reorders the triangles in place. The winding of each triangle is kept.
+	// Positions are only used by the overdraw mode.
+	static void				Optimise( const Mode mode, uint32_t * pTriIndices, const size_t numTris, const aiVector3D * pVertices, const size_t numVertices );
+
+	// Simulates a FIFO vertex cache of CacheSize entries.
+	static CacheStats		MeasureCache( const uint32_t * pTriIndices, const size_t numTris, const size_t numVertices );
+
+private:
+	// Writes the Tipsify order of the triangles to triOrder (as triangle
+	// indices).
+	static void				Tipsify( const uint32_t * pTriIndices, const size_t numTris, const size_t numVertices, vector< uint32_t > & triOrder );
+
+	// Splits the ordered triangles into clusters and sorts them for overdraw.
+	static void				SortClusters( const uint32_t * pTriIndices, const aiVector3D * pVertices, const size_t numVertices, vector< uint32_t > & triOrder );
+};
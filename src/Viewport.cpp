@@ -20,14 +20,17 @@
 #include "Viewport.hpp"
 
 #include "Scene.hpp"
+#include "Options.hpp"
 #include "ShaderProgram.hpp"
 
 
 Viewport::Viewport( const GLint width, const GLint height )
+	: m_LightPosition		( 0.0f, 0.0f, -100.0f )
+	, m_TargetFramebufferId	( 0 )
 {
 	glGenFramebuffers( 1, & m_GeometryFramebufferId );
 	glGenFramebuffers( 1, & m_ShadowFramebufferId );
-	glGenRenderbuffers( 1, & m_DepthRenderBufferId );
+	glGenTextures( 1, & m_DepthTextureId );
 	glGenTextures( 1, & m_PositionTextureId );
 	glGenTextures( 1, & m_NormalTextureId );
 	glGenTextures( 1, & m_ColourTextureId );
@@ -37,7 +40,7 @@ Viewport::Viewport( const GLint width, const GLint height )
 
 	glBindFramebuffer( GL_DRAW_FRAMEBUFFER, m_GeometryFramebufferId );
 	{
-		glFramebufferRenderbuffer( GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_DepthRenderBufferId );
+		glFramebufferTexture2D( GL_DRAW_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_RECTANGLE, m_DepthTextureId, 0 );
 		glFramebufferTexture2D( GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_RECTANGLE, m_PositionTextureId, 0 );
 		glFramebufferTexture2D( GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_RECTANGLE, m_NormalTextureId, 0 );
 		glFramebufferTexture2D( GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_RECTANGLE, m_ColourTextureId, 0 );
@@ -48,7 +51,7 @@ Viewport::Viewport( const GLint width, const GLint height )
 
 	glBindFramebuffer( GL_DRAW_FRAMEBUFFER, m_ShadowFramebufferId );
 	{
-		glFramebufferRenderbuffer( GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_DepthRenderBufferId );
+		glFramebufferTexture2D( GL_DRAW_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_RECTANGLE, m_DepthTextureId, 0 );
 		glFramebufferTexture2D( GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_RECTANGLE, m_ShadowTextureId, 0 );
 
 		glDrawBuffer( GL_COLOR_ATTACHMENT0 );
@@ -62,9 +65,10 @@ void Viewport::OnSize( const GLint width, const GLint height )
 {
 	glViewport( 0, 0, width, height );
 
-	glBindRenderbuffer( GL_RENDERBUFFER, m_DepthRenderBufferId );
-	glRenderbufferStorage( GL_RENDERBUFFER, GL_DEPTH_COMPONENT32F, width, height );
-	glBindRenderbuffer( GL_RENDERBUFFER, 0 );
+	// The stencil buffer is used to count hard shadow volumes (see
+	// ShadowPass.hpp).
+	glBindTexture( GL_TEXTURE_RECTANGLE, m_DepthTextureId );
+	glTexImage2D( GL_TEXTURE_RECTANGLE, 0, GL_DEPTH32F_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_FLOAT_32_UNSIGNED_INT_24_8_REV, nullptr );
 
 	glBindTexture( GL_TEXTURE_RECTANGLE, m_ColourTextureId );
 	glTexImage2D( GL_TEXTURE_RECTANGLE, 0, GL_RGB8, width, height, 0, GL_RGB, GL_BYTE, nullptr );
@@ -85,6 +89,8 @@ void Viewport::OnSize( const GLint width, const GLint height )
 
 	glBindTexture( GL_TEXTURE_RECTANGLE, 0 );
 
+	m_OcclusionCulling.SetDepthTexture( m_DepthTextureId, width, height );
+
 	const float horizFov = pi< float >() / 2.0f;
 
 	m_Camera.SetInfinitePerspectiveProjection( horizFov, 2.0f * atan( tan( horizFov / 2.0f ) * height / width ), 0.1f );
@@ -104,7 +110,7 @@ void Viewport::Render()
 
 	glDisable( GL_CULL_FACE );
 
-	m_Camera.Render();
+	m_Camera.Render( & m_OcclusionCulling );
 
 	glEnable( GL_CULL_FACE );
 
@@ -124,7 +130,8 @@ void Viewport::Render()
 	//glDisable( GL_DEPTH_TEST );
 
 	glClearColor( 1.0f, 1.0f, 1.0f, 1.0f );
-	glClear( GL_COLOR_BUFFER_BIT );
+	glClearStencil( 0 );
+	glClear( GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT );
 
 	glEnable( GL_BLEND );
 	glBlendEquation( GL_MIN );
@@ -135,7 +142,7 @@ void Viewport::Render()
 	glMatrixMode( GL_MODELVIEW );
 	glLoadIdentity();
 
-	const Vector4f lightPos = m_Camera.ViewMatrix() * Vector4f( 0.0f, 0.0f, -100.0f, 1.0f );
+	const Vector4f lightPos = m_Camera.ViewMatrix() * Vector4f( m_LightPosition.x(), m_LightPosition.y(), m_LightPosition.z(), 1.0f );
 	glLightfv( GL_LIGHT0, GL_POSITION, lightPos.data() );
 
 	GLint dimensions[4];
@@ -143,13 +150,49 @@ void Viewport::Render()
 	glGetIntegerv( GL_VIEWPORT, dimensions );
 	glUniform2iv( glGetUniformLocation( GetScene().m_pShadowShaderProgram->GetID(), "viewport" ), 1, & dimensions[2] );
 
-	m_Camera.RenderShadowVolumes();
+	// Shadows only need drawing where the light reaches, so a light with a
+	// range limits the shadow volumes to the part of the screen its sphere
+	// covers, and to the pixels whose depth is within it. The shadow texture
+	// was cleared to fully lit everywhere, and the lighting pass fades the
+	// light out at its range, so nothing outside needs drawing at all.
+	GLint scissorBox[4];
+	float depthBounds[2];
+	const bool isLightInView = GetLightBounds( lightPos.head< 3 >(), & dimensions[2], scissorBox, depthBounds );
+
+	if( isLightInView && GetOptions().m_LightRange > 0.0f )
+	{
+		glEnable( GL_SCISSOR_TEST );
+		glScissor( scissorBox[0], scissorBox[1], scissorBox[2], scissorBox[3] );
+
+		if( GLEW_EXT_depth_bounds_test )
+		{
+			glEnable( GL_DEPTH_BOUNDS_TEST_EXT );
+			glDepthBoundsEXT( depthBounds[0], depthBounds[1] );
+		}
+	}
+
+	if( isLightInView )
+	{
+		m_Camera.RenderShadowVolumes( ShadowPass_Triangles, m_LightPosition, & m_OcclusionCulling );
+
+		if( GetOptions().m_SilhouetteShadows )
+			RenderSilhouetteShadows( & dimensions[2] );
+	}
+
+	glDisable( GL_SCISSOR_TEST );
+
+	if( GLEW_EXT_depth_bounds_test )
+		glDisable( GL_DEPTH_BOUNDS_TEST_EXT );
 
 	glDisable( GL_BLEND );
 
 	// Lighting pass.
-	glBindFramebuffer( GL_DRAW_FRAMEBUFFER, 0 );
+	m_LightClusters.Build( m_Camera, dimensions[2], dimensions[3] );
+
+	glBindFramebuffer( GL_DRAW_FRAMEBUFFER, m_TargetFramebufferId );
 	GetScene().m_pLightingShaderProgram->SetCurrent();
+	m_LightClusters.Bind( GetScene().m_pLightingShaderProgram->GetID() );
+	glUniform1f( glGetUniformLocation( GetScene().m_pLightingShaderProgram->GetID(), "lightRange" ), GetOptions().m_LightRange );
 
 	glCullFace( GL_BACK );
 	glDisable( GL_DEPTH_TEST );
@@ -191,3 +234,124 @@ void Viewport::Render()
 
 	glFinish();
 }
+
+
+void Viewport::RenderSilhouetteShadows( const GLint * pViewportSize )
+{
+	// Penumbral wedges are drawn like the per-triangle volumes, only
+	// processing pixels in front of their back faces.
+	GetScene().m_pShadowWedgeShaderProgram->SetCurrent();
+	glUniform2iv( glGetUniformLocation( GetScene().m_pShadowWedgeShaderProgram->GetID(), "viewport" ), 1, pViewportSize );
+
+	m_Camera.RenderShadowVolumes( ShadowPass_Wedges, m_LightPosition, & m_OcclusionCulling );
+
+	// Count the hard shadow volumes into the stencil buffer. Counting the
+	// faces behind the scene (aka Carmack's reverse) copes with the camera
+	// being inside a volume, and the back caps at infinity are never clipped
+	// thanks to the infinite projection.
+	GetScene().m_pShadowVolumeShaderProgram->SetCurrent();
+
+	glColorMask( GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE );
+	glDisable( GL_CULL_FACE );
+	glDepthFunc( GL_LESS );
+
+	glEnable( GL_STENCIL_TEST );
+	glStencilFunc( GL_ALWAYS, 0, ~0u );
+	glStencilOpSeparate( GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP );
+	glStencilOpSeparate( GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP );
+
+	m_Camera.RenderShadowVolumes( ShadowPass_Umbra, m_LightPosition, & m_OcclusionCulling );
+
+	// Pixels inside a hard shadow volume get no light at all. The wedges stop
+	// at the edge of the hard shadow, so there's nothing to blend with.
+	GetScene().m_pShadowFillShaderProgram->SetCurrent();
+
+	glColorMask( GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE );
+	glDisable( GL_DEPTH_TEST );
+
+	glStencilFunc( GL_NOTEQUAL, 0, ~0u );
+	glStencilOp( GL_KEEP, GL_KEEP, GL_KEEP );
+
+	glBegin( GL_TRIANGLE_STRIP );
+	{
+		glVertex3f( -1.0f,  1.0f, 0.0f );
+		glVertex3f(  1.0f,  1.0f, 0.0f );
+		glVertex3f( -1.0f, -1.0f, 0.0f );
+		glVertex3f(  1.0f, -1.0f, 0.0f );
+	}
+	glEnd();
+
+	glDisable( GL_STENCIL_TEST );
+	glEnable( GL_DEPTH_TEST );
+	glDepthFunc( GL_GREATER );
+	glEnable( GL_CULL_FACE );
+}
+
+
+bool Viewport::GetLightBounds( const Vector3f & lightPosition, const GLint * pViewportSize, GLint * pScissorBox, float * pDepthBounds ) const
+{
+	const GLint width = pViewportSize[0];
+	const GLint height = pViewportSize[1];
+
+	pScissorBox[0] = 0;
+	pScissorBox[1] = 0;
+	pScissorBox[2] = width;
+	pScissorBox[3] = height;
+
+	pDepthBounds[0] = 0.0f;
+	pDepthBounds[1] = 1.0f;
+
+	const float range = GetOptions().m_LightRange;
+
+	if( range <= 0.0f )
+		return true;
+
+	// View space depth is positive in front of the camera, and projects to a
+	// window space depth of 0 at the near plane.
+	const Matrix4f & projection = m_Camera.ProjectionMatrix().matrix();
+	const float zNear = -projection( 2, 3 ) / ( 1.0f + projection( 2, 2 ) );
+
+	if( lightPosition.z() + range <= zNear )
+		return false;
+
+	pDepthBounds[1] = 0.5f * ( projection( 2, 2 ) + projection( 2, 3 ) / ( lightPosition.z() + range ) ) + 0.5f;
+
+	// A sphere that reaches the near plane may cover any of the screen, but
+	// otherwise it's inside the projection of its bounding box.
+	if( lightPosition.z() - range <= zNear )
+		return true;
+
+	pDepthBounds[0] = 0.5f * ( projection( 2, 2 ) + projection( 2, 3 ) / ( lightPosition.z() - range ) ) + 0.5f;
+
+	Vector2f minPixel = Vector2f::Constant( numeric_limits< float >::max() );
+	Vector2f maxPixel = -minPixel;
+
+	for( int corner = 0; corner < 8; ++corner )
+	{
+		const Vector4f point( lightPosition.x() + ( corner & 1 ? range : -range ),
+							  lightPosition.y() + ( corner & 2 ? range : -range ),
+							  lightPosition.z() + ( corner & 4 ? range : -range ),
+							  1.0f );
+		const Vector4f clip = projection * point;
+		const Vector2f pixel( ( clip.x() / clip.w() * 0.5f + 0.5f ) * width,
+							  ( clip.y() / clip.w() * 0.5f + 0.5f ) * height );
+
+		minPixel = minPixel.cwiseMin( pixel );
+		maxPixel = maxPixel.cwiseMax( pixel );
+	}
+
+	const GLint minX = max( static_cast< GLint >( floor( minPixel.x() ) ), 0 );
+	const GLint minY = max( static_cast< GLint >( floor( minPixel.y() ) ), 0 );
+	const GLint maxX = min( static_cast< GLint >( ceil( maxPixel.x() ) ), width );
+	const GLint maxY = min( static_cast< GLint >( ceil( maxPixel.y() ) ), height );
+
+	if( minX >= maxX || minY >= maxY )
+		return false;
+
+	pScissorBox[0] = minX;
+	pScissorBox[1] = minY;
+	pScissorBox[2] = maxX - minX;
+	pScissorBox[3] = maxY - minY;
+
+	return true;
+}
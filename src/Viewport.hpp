@@ -32,6 +32,7 @@
 
 
 #include "Camera.hpp"
+#include "LightClusters.hpp"
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -52,11 +53,34 @@ public:
 	// The camera whose view is rendered into this viewport.
 	Camera			m_Camera;
 
+	// World space position of the key light, the only one that casts
+	// shadows. The scene's own lights are added in the lighting pass through
+	// the light clusters.
+	Vector3f		m_LightPosition;
+
+	// The scene's lights as they were culled for the last frame.
+	const LightClusters &	GetLightClusters() const		{ return m_LightClusters; }
+
+	// The framebuffer that the final, lit image is rendered into. Zero (the
+	// default) is the window's framebuffer.
+	GLuint			m_TargetFramebufferId;
+
 	// Eigen needs this so that vectors/matrices are aligned properly in
 	// classes that are new'd.
 	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
 private:
+	// Draws the shadows of closed meshes, which are extruded along their
+	// silhouettes (see ShadowPass.hpp), into the shadow framebuffer. Expects
+	// the state that the per-triangle shadow volumes are drawn with.
+	void			RenderSilhouetteShadows( const GLint * pViewportSize );
+
+	// Works out the box of the viewport, as glScissor takes it, and the range
+	// of window space depths that the light can reach, given its view space
+	// position (see Options::m_LightRange). Returns false if it can't reach
+	// anything in view.
+	bool			GetLightBounds( const Vector3f & lightPosition, const GLint * pViewportSize, GLint * pScissorBox, float * pDepthBounds ) const;
+
 	// The geometry framebuffer renders position, normal and colour into
 	// respective textures for later use in deferred shading.
 	GLuint			m_GeometryFramebufferId;
@@ -67,7 +91,8 @@ private:
 	GLuint			m_ShadowFramebufferId;
 
 	// Have to use a custom depth buffer when rendering to the geometry buffer.
-	GLuint			m_DepthRenderBufferId;
+	// It's a texture so that the occlusion culling can read it.
+	GLuint			m_DepthTextureId;
 
 	// The following textures are render targets that will store the position,
 	// normal, colour and shadow at each fragment location. They are all
@@ -76,4 +101,12 @@ private:
 	GLuint			m_NormalTextureId;
 	GLuint			m_ColourTextureId;
 	GLuint			m_ShadowTextureId;
+
+	// Builds a depth pyramid from the geometry buffer's depth each frame, to
+	// cull hidden instances and shadow casters against.
+	OcclusionCulling	m_OcclusionCulling;
+
+	// The scene's lights, culled into clusters each frame for the lighting
+	// pass.
+	LightClusters	m_LightClusters;
 };